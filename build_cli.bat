@@ -0,0 +1,60 @@
+@echo off
+setlocal enabledelayedexpansion
+
+echo ================================================
+echo Building suurstof-pack.exe (command line packer)
+echo ================================================
+
+set PATH=C:\Qt\Tools\mingw1310_64\bin;%PATH%
+
+cd /d "%~dp0"
+if not exist build mkdir build
+
+set INCLUDES=-I. -Isrc -Isrc/core -Isrc/cli -Isrc/utils
+set FLAGS=-O2 -std=c++17 -Wall -fexceptions -mthreads -municode -DUNICODE -D_UNICODE -DWIN32
+
+g++ %FLAGS% %INCLUDES% -o build\suurstof-pack.exe ^
+    src\cli\main.cpp ^
+    src\cli\JobFile.cpp ^
+    src\cli\BatchRunner.cpp ^
+    src\cli\InputWatcher.cpp ^
+    src\core\AllocStats.cpp ^
+    src\core\BufferPool.cpp ^
+    src\core\SparseScan.cpp ^
+    src\core\DeltaCodec.cpp ^
+    src\core\PackEngine.cpp ^
+    src\core\IoBackend.cpp ^
+    src\core\UringIoBackend.cpp ^
+    src\core\ArchiveReader.cpp ^
+    src\core\ArchiveSource.cpp ^
+    src\core\SizeEstimator.cpp ^
+    src\core\BuildPipeline.cpp ^
+    src\core\BundleReader.cpp ^
+    src\core\Codec.cpp ^
+    src\core\CodecSearch.cpp ^
+    src\core\FileIO.cpp ^
+    src\core\InputLoader.cpp ^
+    src\core\MemoryBudget.cpp ^
+    src\core\ManifestWriter.cpp ^
+    src\core\PEParser.cpp ^
+    src\core\ResourceEmbedder.cpp ^
+    src\core\StubGenerator.cpp ^
+    src\core\StubRegistry.cpp ^
+    src\core\ThreadPool.cpp
+if errorlevel 1 goto error
+
+echo.
+echo ================================================
+echo BUILD SUCCESS!
+echo ================================================
+dir build\suurstof-pack.exe
+echo.
+echo The packer looks for stub.exe next to itself unless --stub is given.
+exit /b 0
+
+:error
+echo.
+echo ================================================
+echo BUILD FAILED!
+echo ================================================
+exit /b 1
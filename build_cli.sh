@@ -0,0 +1,48 @@
+#!/bin/sh
+# Builds the headless packer (suurstof-pack) on Linux build hosts.
+# Usage: ./build_cli.sh [extra compiler flags, e.g. -DUSE_ZLIB -lz or -DPACKER_ALLOC_STATS]
+set -e
+
+cd "$(dirname "$0")"
+mkdir -p build
+
+echo "================================================"
+echo "Building suurstof-pack"
+echo "================================================"
+
+CXX=${CXX:-g++}
+FLAGS="-O2 -std=c++17 -Wall -pthread -Isrc -Isrc/core -Isrc/cli -Isrc/utils"
+
+SOURCES="
+    src/cli/main.cpp
+    src/cli/JobFile.cpp
+    src/cli/BatchRunner.cpp
+    src/cli/InputWatcher.cpp
+    src/core/AllocStats.cpp
+    src/core/BufferPool.cpp
+    src/core/SparseScan.cpp
+    src/core/DeltaCodec.cpp
+    src/core/PackEngine.cpp
+    src/core/IoBackend.cpp
+    src/core/UringIoBackend.cpp
+    src/core/ArchiveReader.cpp
+    src/core/ArchiveSource.cpp
+    src/core/SizeEstimator.cpp
+    src/core/BuildPipeline.cpp
+    src/core/BundleReader.cpp
+    src/core/Codec.cpp
+    src/core/CodecSearch.cpp
+    src/core/FileIO.cpp
+    src/core/InputLoader.cpp
+    src/core/MemoryBudget.cpp
+    src/core/ManifestWriter.cpp
+    src/core/PEParser.cpp
+    src/core/ResourceEmbedder.cpp
+    src/core/StubGenerator.cpp
+    src/core/StubRegistry.cpp
+    src/core/ThreadPool.cpp
+"
+
+$CXX $FLAGS -o build/suurstof-pack $SOURCES "$@"
+
+echo "BUILD SUCCESS: build/suurstof-pack"
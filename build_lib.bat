@@ -0,0 +1,57 @@
+@echo off
+setlocal enabledelayedexpansion
+
+echo ================================================
+echo Building suurstof-pack.dll (embeddable packer, C API)
+echo ================================================
+
+set PATH=C:\Qt\Tools\mingw1310_64\bin;%PATH%
+
+cd /d "%~dp0"
+if not exist build mkdir build
+
+set INCLUDES=-I. -Isrc -Isrc/core -Isrc/utils
+set FLAGS=-O2 -std=c++17 -Wall -fexceptions -mthreads -DUNICODE -D_UNICODE -DWIN32 -DSUURSTOF_PACK_BUILD
+
+g++ %FLAGS% %INCLUDES% -shared -o build\suurstof-pack.dll -Wl,--out-implib,build\libsuurstof-pack.dll.a ^
+    src\api\suurstof_pack.cpp ^
+    src\core\AllocStats.cpp ^
+    src\core\BufferPool.cpp ^
+    src\core\SparseScan.cpp ^
+    src\core\DeltaCodec.cpp ^
+    src\core\PackEngine.cpp ^
+    src\core\IoBackend.cpp ^
+    src\core\UringIoBackend.cpp ^
+    src\core\ArchiveReader.cpp ^
+    src\core\ArchiveSource.cpp ^
+    src\core\SizeEstimator.cpp ^
+    src\core\BuildPipeline.cpp ^
+    src\core\BundleReader.cpp ^
+    src\core\Codec.cpp ^
+    src\core\CodecSearch.cpp ^
+    src\core\FileIO.cpp ^
+    src\core\InputLoader.cpp ^
+    src\core\MemoryBudget.cpp ^
+    src\core\ManifestWriter.cpp ^
+    src\core\PEParser.cpp ^
+    src\core\ResourceEmbedder.cpp ^
+    src\core\StubGenerator.cpp ^
+    src\core\StubRegistry.cpp ^
+    src\core\ThreadPool.cpp
+if errorlevel 1 goto error
+
+echo.
+echo ================================================
+echo BUILD SUCCESS!
+echo ================================================
+dir build\suurstof-pack.dll
+echo.
+echo Include src\api\suurstof_pack.h and link build\libsuurstof-pack.dll.a.
+exit /b 0
+
+:error
+echo.
+echo ================================================
+echo BUILD FAILED!
+echo ================================================
+exit /b 1
@@ -0,0 +1,46 @@
+#!/bin/sh
+# Builds the embeddable packer library (libsuurstof-pack.so) and its C API,
+# see src/api/suurstof_pack.h.
+# Usage: ./build_lib.sh [extra compiler flags, e.g. -DUSE_ZLIB -lz]
+set -e
+
+cd "$(dirname "$0")"
+mkdir -p build
+
+echo "================================================"
+echo "Building libsuurstof-pack"
+echo "================================================"
+
+CXX=${CXX:-g++}
+FLAGS="-O2 -std=c++17 -Wall -pthread -fPIC -shared -fvisibility=hidden -DSUURSTOF_PACK_BUILD -Isrc -Isrc/core -Isrc/utils"
+
+SOURCES="
+    src/api/suurstof_pack.cpp
+    src/core/AllocStats.cpp
+    src/core/BufferPool.cpp
+    src/core/SparseScan.cpp
+    src/core/DeltaCodec.cpp
+    src/core/PackEngine.cpp
+    src/core/IoBackend.cpp
+    src/core/UringIoBackend.cpp
+    src/core/ArchiveReader.cpp
+    src/core/ArchiveSource.cpp
+    src/core/SizeEstimator.cpp
+    src/core/BuildPipeline.cpp
+    src/core/BundleReader.cpp
+    src/core/Codec.cpp
+    src/core/CodecSearch.cpp
+    src/core/FileIO.cpp
+    src/core/InputLoader.cpp
+    src/core/MemoryBudget.cpp
+    src/core/ManifestWriter.cpp
+    src/core/PEParser.cpp
+    src/core/ResourceEmbedder.cpp
+    src/core/StubGenerator.cpp
+    src/core/StubRegistry.cpp
+    src/core/ThreadPool.cpp
+"
+
+$CXX $FLAGS -o build/libsuurstof-pack.so $SOURCES "$@"
+
+echo "BUILD SUCCESS: build/libsuurstof-pack.so"
@@ -13,43 +13,101 @@ echo.
 echo [Step 1/3] Generating MOC...
 C:\Qt\6.10.0\mingw_64\bin\moc.exe src\gui\MainWindow.h -o build\moc\moc_MainWindow.cpp
 if errorlevel 1 goto error
+C:\Qt\6.10.0\mingw_64\bin\moc.exe src\gui\FileListModel.h -o build\moc\moc_FileListModel.cpp
+if errorlevel 1 goto error
 
 set INCLUDES=-I. -Isrc -Isrc/gui -Isrc/core -Isrc/utils -IC:/Qt/6.10.0/mingw_64/include -IC:/Qt/6.10.0/mingw_64/include/QtWidgets -IC:/Qt/6.10.0/mingw_64/include/QtGui -IC:/Qt/6.10.0/mingw_64/include/QtCore -Ibuild/moc -IC:/Qt/6.10.0/mingw_64/mkspecs/win32-g++
 set FLAGS=-c -O2 -std=c++17 -Wall -fexceptions -mthreads -DUNICODE -D_UNICODE -DWIN32 -DQT_NO_DEBUG -DQT_WIDGETS_LIB -DQT_GUI_LIB -DQT_CORE_LIB -DQT_NEEDS_QMAIN
 
 echo.
 echo [Step 2/3] Compiling...
-echo   [1/7] main.cpp
+echo   [1/21] main.cpp
 g++ %FLAGS% %INCLUDES% -o build\obj\main.o src\main.cpp
 if errorlevel 1 goto error
 
-echo   [2/7] MainWindow.cpp
+echo   [2/21] MainWindow.cpp
 g++ %FLAGS% %INCLUDES% -o build\obj\MainWindow.o src\gui\MainWindow.cpp
 if errorlevel 1 goto error
 
-echo   [3/7] PEParser.cpp
+echo   [3/21] PEParser.cpp
 g++ %FLAGS% %INCLUDES% -o build\obj\PEParser.o src\core\PEParser.cpp
 if errorlevel 1 goto error
 
-echo   [4/7] ResourceEmbedder.cpp
+echo   [4/21] ResourceEmbedder.cpp
 g++ %FLAGS% %INCLUDES% -o build\obj\ResourceEmbedder.o src\core\ResourceEmbedder.cpp
 if errorlevel 1 goto error
 
-echo   [5/7] Obfuscator.cpp
+echo   [5/21] Obfuscator.cpp
 g++ %FLAGS% %INCLUDES% -o build\obj\Obfuscator.o src\core\Obfuscator.cpp
 if errorlevel 1 goto error
 
-echo   [6/7] StubGenerator.cpp
+echo   [6/21] StubGenerator.cpp
 g++ %FLAGS% %INCLUDES% -o build\obj\StubGenerator.o src\core\StubGenerator.cpp
 if errorlevel 1 goto error
 
-echo   [7/7] moc_MainWindow.cpp
+echo   [7/21] ManifestWriter.cpp
+g++ %FLAGS% %INCLUDES% -o build\obj\ManifestWriter.o src\core\ManifestWriter.cpp
+if errorlevel 1 goto error
+
+echo   [8/21] FileIO.cpp
+g++ %FLAGS% %INCLUDES% -o build\obj\FileIO.o src\core\FileIO.cpp
+if errorlevel 1 goto error
+
+echo   [9/21] InputLoader.cpp
+g++ %FLAGS% %INCLUDES% -o build\obj\InputLoader.o src\core\InputLoader.cpp
+if errorlevel 1 goto error
+
+echo   [10/21] Codec.cpp
+g++ %FLAGS% %INCLUDES% -o build\obj\Codec.o src\core\Codec.cpp
+if errorlevel 1 goto error
+
+echo   [11/21] CodecSearch.cpp
+g++ %FLAGS% %INCLUDES% -o build\obj\CodecSearch.o src\core\CodecSearch.cpp
+if errorlevel 1 goto error
+
+echo   [12/21] ThreadPool.cpp
+g++ %FLAGS% %INCLUDES% -o build\obj\ThreadPool.o src\core\ThreadPool.cpp
+if errorlevel 1 goto error
+
+echo   [13/21] BufferPool.cpp
+g++ %FLAGS% %INCLUDES% -o build\obj\BufferPool.o src\core\BufferPool.cpp
+if errorlevel 1 goto error
+
+echo   [14/21] SparseScan.cpp
+g++ %FLAGS% %INCLUDES% -o build\obj\SparseScan.o src\core\SparseScan.cpp
+if errorlevel 1 goto error
+
+echo   [15/21] DeltaCodec.cpp
+g++ %FLAGS% %INCLUDES% -o build\obj\DeltaCodec.o src\core\DeltaCodec.cpp
+if errorlevel 1 goto error
+
+echo   [16/21] ArchiveReader.cpp
+g++ %FLAGS% %INCLUDES% -o build\obj\ArchiveReader.o src\core\ArchiveReader.cpp
+if errorlevel 1 goto error
+
+echo   [17/21] StubRegistry.cpp
+g++ %FLAGS% %INCLUDES% -o build\obj\StubRegistry.o src\core\StubRegistry.cpp
+if errorlevel 1 goto error
+
+echo   [18/21] SizeEstimator.cpp
+g++ %FLAGS% %INCLUDES% -o build\obj\SizeEstimator.o src\core\SizeEstimator.cpp
+if errorlevel 1 goto error
+
+echo   [19/21] FileListModel.cpp
+g++ %FLAGS% %INCLUDES% -o build\obj\FileListModel.o src\gui\FileListModel.cpp
+if errorlevel 1 goto error
+
+echo   [20/21] moc_FileListModel.cpp
+g++ %FLAGS% %INCLUDES% -o build\obj\moc_FileListModel.o build\moc\moc_FileListModel.cpp
+if errorlevel 1 goto error
+
+echo   [21/21] moc_MainWindow.cpp
 g++ %FLAGS% %INCLUDES% -o build\obj\moc_MainWindow.o build\moc\moc_MainWindow.cpp
 if errorlevel 1 goto error
 
 echo.
 echo [Step 3/3] Linking...
-g++ -Wl,-subsystem,windows -mthreads -o build\SuurStof-Packer.exe build\obj\main.o build\obj\MainWindow.o build\obj\PEParser.o build\obj\ResourceEmbedder.o build\obj\Obfuscator.o build\obj\StubGenerator.o build\obj\moc_MainWindow.o -LC:/Qt/6.10.0/mingw_64/lib -lQt6Widgets -lQt6Gui -lQt6Core -lmingw32 C:/Qt/6.10.0/mingw_64/lib/libQt6EntryPoint.a
+g++ -Wl,-subsystem,windows -mthreads -o build\SuurStof-Packer.exe build\obj\main.o build\obj\MainWindow.o build\obj\PEParser.o build\obj\ResourceEmbedder.o build\obj\Obfuscator.o build\obj\StubGenerator.o build\obj\ManifestWriter.o build\obj\FileIO.o build\obj\InputLoader.o build\obj\Codec.o build\obj\CodecSearch.o build\obj\ThreadPool.o build\obj\BufferPool.o build\obj\SparseScan.o build\obj\DeltaCodec.o build\obj\ArchiveReader.o build\obj\StubRegistry.o build\obj\SizeEstimator.o build\obj\FileListModel.o build\obj\moc_FileListModel.o build\obj\moc_MainWindow.o -LC:/Qt/6.10.0/mingw_64/lib -lQt6Widgets -lQt6Gui -lQt6Core -lmingw32 C:/Qt/6.10.0/mingw_64/lib/libQt6EntryPoint.a
 if errorlevel 1 goto error
 
 echo.
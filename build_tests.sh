@@ -0,0 +1,61 @@
+#!/bin/sh
+# Builds and runs the unit tests in tests/ on Linux build hosts.
+# Usage: ./build_tests.sh [extra compiler flags]
+set -e
+
+cd "$(dirname "$0")"
+mkdir -p build/tests
+
+CXX=${CXX:-g++}
+FLAGS="-O2 -std=c++17 -Wall -pthread -Isrc -Isrc/core -Isrc/utils -Itests"
+
+# Core sources the tests link against, as in build_lib.sh
+CORE="
+    src/core/AllocStats.cpp
+    src/core/BufferPool.cpp
+    src/core/SparseScan.cpp
+    src/core/DeltaCodec.cpp
+    src/core/PackEngine.cpp
+    src/core/IoBackend.cpp
+    src/core/UringIoBackend.cpp
+    src/core/ArchiveReader.cpp
+    src/core/ArchiveSource.cpp
+    src/core/SizeEstimator.cpp
+    src/core/BuildPipeline.cpp
+    src/core/BundleReader.cpp
+    src/core/Codec.cpp
+    src/core/CodecSearch.cpp
+    src/core/FileIO.cpp
+    src/core/InputLoader.cpp
+    src/core/MemoryBudget.cpp
+    src/core/ManifestWriter.cpp
+    src/core/PEParser.cpp
+    src/core/ResourceEmbedder.cpp
+    src/core/StubGenerator.cpp
+    src/core/StubRegistry.cpp
+    src/core/ThreadPool.cpp
+"
+
+mkdir -p build/tests/obj
+for source in $CORE; do
+    $CXX $FLAGS -c -o build/tests/obj/$(basename $source .cpp).o $source "$@"
+done
+
+TESTS="
+    StubGeneratorTest
+    ManifestFormatTest
+    StepSchedulerTest
+    SharedContentTest
+    FileTypeDetectorTest
+"
+
+for test in $TESTS; do
+    echo "Building $test"
+    $CXX $FLAGS -o build/tests/$test tests/$test.cpp build/tests/obj/*.o "$@"
+done
+
+for test in $TESTS; do
+    build/tests/$test
+done
+
+echo "TESTS PASSED"
@@ -0,0 +1,146 @@
+#include "suurstof_pack.h"
+#include "../core/PackEngine.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+struct suurstof_engine {
+    Packer::PackEngine engine;
+    
+    explicit suurstof_engine(size_t threads) : engine(threads) {}
+};
+
+static_assert(SUURSTOF_BUILD_SIZE_V1 < sizeof(suurstof_build), "fields are only added at the end");
+
+namespace {
+
+void setError(suurstof_result* result, const char* error) {
+    if (result) {
+        std::snprintf(result->error, sizeof(result->error), "%s", error);
+    }
+}
+
+suurstof_status invalid(suurstof_result* result, const char* error) {
+    setError(result, error);
+    return SUURSTOF_INVALID_ARGUMENT;
+}
+
+std::wstring path(const char* text) {
+    return text ? Packer::FileIO::fromUtf8(text) : std::wstring();
+}
+
+} // namespace
+
+extern "C" {
+
+uint32_t suurstof_abi_version(void) {
+    return SUURSTOF_PACK_ABI_VERSION;
+}
+
+void suurstof_build_init(suurstof_build* build) {
+    if (!build) {
+        return;
+    }
+    std::memset(build, 0, sizeof(*build));
+    build->struct_size = sizeof(*build);
+    build->layout = SUURSTOF_LAYOUT_OVERLAY;
+    build->compression = SUURSTOF_COMPRESSION_SOLID;
+    build->flags = SUURSTOF_WAIT_FOR_PREVIOUS | SUURSTOF_SPARSE;
+}
+
+suurstof_engine* suurstof_engine_create(uint32_t threads) {
+    try {
+        return new suurstof_engine(threads);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void suurstof_engine_destroy(suurstof_engine* engine) {
+    delete engine;
+}
+
+suurstof_status suurstof_pack(suurstof_engine* engine, const suurstof_build* build,
+                              suurstof_result* result) {
+    if (result) {
+        if (result->struct_size < SUURSTOF_RESULT_SIZE_V1) {
+            return SUURSTOF_INVALID_ARGUMENT;
+        }
+        uint32_t size = result->struct_size;
+        std::memset(result, 0, std::min<size_t>(size, sizeof(suurstof_result)));
+        result->struct_size = size;
+    }
+    if (!engine || !build || build->struct_size < SUURSTOF_BUILD_SIZE_V1) {
+        return invalid(result, "missing engine or build description");
+    }
+    
+    // Callers built against an older header pass a shorter struct: read the
+    // fields it has and keep the defaults for the rest
+    suurstof_build desc;
+    suurstof_build_init(&desc);
+    std::memcpy(&desc, build, std::min<size_t>(build->struct_size, sizeof(desc)));
+    build = &desc;
+    
+    if (!build->output_path || (build->input_count > 0 && !build->inputs)) {
+        return invalid(result, "missing output path or inputs");
+    }
+    if (build->layout > SUURSTOF_LAYOUT_SECTION || build->compression > SUURSTOF_COMPRESSION_SOLID) {
+        return invalid(result, "unknown layout or compression");
+    }
+    
+    // Exceptions must not cross the C boundary
+    try {
+        std::vector<std::wstring> inputs;
+        inputs.reserve(build->input_count);
+        for (size_t i = 0; i < build->input_count; i++) {
+            if (!build->inputs[i]) {
+                return invalid(result, "null input path");
+            }
+            inputs.push_back(path(build->inputs[i]));
+        }
+        
+        Packer::PackerOptions options;
+        options.outputPath = path(build->output_path);
+        options.stubPath = path(build->stub_path);
+        options.basePath = path(build->base_path);
+        options.payloadLayout = build->layout == SUURSTOF_LAYOUT_SECTION
+                                    ? Packer::PayloadLayout::SECTION : Packer::PayloadLayout::OVERLAY;
+        options.compression = build->compression == SUURSTOF_COMPRESSION_NONE ? Packer::CompressionMode::NONE
+                            : build->compression == SUURSTOF_COMPRESSION_ENTRY ? Packer::CompressionMode::ENTRY
+                            : Packer::CompressionMode::SOLID;
+        options.waitForPrevious = (build->flags & SUURSTOF_WAIT_FOR_PREVIOUS) != 0;
+        options.sparse = (build->flags & SUURSTOF_SPARSE) != 0;
+        options.expandArchives = (build->flags & SUURSTOF_EXPAND_ARCHIVES) != 0;
+        options.codecSearch.enabled = (build->flags & SUURSTOF_CODEC_SEARCH) != 0;
+        options.codecSearch.timeBudget = build->time_budget;
+        options.codecSearch.minDecodeSpeed = build->min_decode_speed;
+        options.startupEntries = build->startup_entries;
+        
+        Packer::PackResult packed;
+        bool ok = engine->engine.pack(inputs, options, packed, (build->flags & SUURSTOF_DRY_RUN) != 0);
+        if (result) {
+            result->output_size = packed.outputSize;
+            result->seconds = packed.seconds;
+            result->delta_unchanged = packed.delta.unchanged;
+            result->delta_diffed = packed.delta.diffed;
+            result->delta_added = packed.delta.added;
+        }
+        if (!ok) {
+            setError(result, packed.error.c_str());
+            return SUURSTOF_BUILD_FAILED;
+        }
+        return SUURSTOF_OK;
+    } catch (const std::bad_alloc&) {
+        setError(result, "out of memory");
+        return SUURSTOF_OUT_OF_MEMORY;
+    } catch (const std::exception& error) {
+        setError(result, error.what());
+        return SUURSTOF_BUILD_FAILED;
+    } catch (...) {
+        setError(result, "unknown error");
+        return SUURSTOF_BUILD_FAILED;
+    }
+}
+
+} // extern "C"
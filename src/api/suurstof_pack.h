@@ -0,0 +1,117 @@
+#ifndef SUURSTOF_PACK_H
+#define SUURSTOF_PACK_H
+
+/*
+ * C interface to the packer, for build systems that pack in-process.
+ *
+ * An engine owns worker threads and buffer caches. Any number of threads
+ * may call suurstof_pack on the same engine at once; every call builds one
+ * bundle from its own description and shares no other state.
+ *
+ * ABI rules: structs begin with struct_size and only ever grow at the end,
+ * enum values are never renumbered, and functions are never removed. Fill
+ * descriptions with suurstof_build_init so fields added later get their
+ * defaults. Strings are UTF-8.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#  if defined(SUURSTOF_PACK_BUILD)
+#    define SUURSTOF_API __declspec(dllexport)
+#  else
+#    define SUURSTOF_API __declspec(dllimport)
+#  endif
+#elif defined(SUURSTOF_PACK_BUILD)
+#  define SUURSTOF_API __attribute__((visibility("default")))
+#else
+#  define SUURSTOF_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 2: suurstof_build.startup_entries */
+#define SUURSTOF_PACK_ABI_VERSION 2
+
+typedef enum suurstof_status {
+    SUURSTOF_OK = 0,
+    SUURSTOF_INVALID_ARGUMENT = 1,   /* Null pointer, bad enum, struct_size too small */
+    SUURSTOF_BUILD_FAILED = 2,       /* See suurstof_result.error */
+    SUURSTOF_OUT_OF_MEMORY = 3
+} suurstof_status;
+
+typedef enum suurstof_layout {
+    SUURSTOF_LAYOUT_OVERLAY = 0,     /* Payload appended after the last section */
+    SUURSTOF_LAYOUT_SECTION = 1      /* Payload in a .pack section */
+} suurstof_layout;
+
+typedef enum suurstof_compression {
+    SUURSTOF_COMPRESSION_NONE = 0,
+    SUURSTOF_COMPRESSION_ENTRY = 1,
+    SUURSTOF_COMPRESSION_SOLID = 2
+} suurstof_compression;
+
+/* suurstof_build.flags */
+#define SUURSTOF_WAIT_FOR_PREVIOUS 0x1u   /* Stub runs entries one after another */
+#define SUURSTOF_SPARSE            0x2u   /* Store long zero runs as holes */
+#define SUURSTOF_CODEC_SEARCH      0x4u   /* Try every codec, keep the smallest */
+#define SUURSTOF_DRY_RUN           0x8u   /* Encode but write nothing */
+#define SUURSTOF_EXPAND_ARCHIVES   0x10u  /* Pack the files inside .zip/.tar inputs */
+
+typedef struct suurstof_engine suurstof_engine;
+
+typedef struct suurstof_build {
+    uint32_t struct_size;            /* sizeof(suurstof_build) */
+    const char* output_path;
+    const char* const* inputs;       /* In execution order; "a.zip!/dir/f" = file in an archive */
+    size_t input_count;
+    const char* stub_path;           /* NULL: stub.exe (or stub-dll.dll) next to the host */
+    const char* base_path;           /* Non-NULL: write a delta against this bundle */
+    uint32_t layout;                 /* suurstof_layout */
+    uint32_t compression;            /* suurstof_compression */
+    uint32_t flags;                  /* SUURSTOF_* flags above */
+    double time_budget;              /* Codec search seconds, 0 = unlimited */
+    double min_decode_speed;         /* Codec search floor in MB/s, 0 = none */
+    /* ABI version 2 */
+    uint32_t startup_entries;        /* First inputs stored uncompressed at the front */
+} suurstof_build;
+
+typedef struct suurstof_result {
+    uint32_t struct_size;            /* sizeof(suurstof_result), set by the caller */
+    uint64_t output_size;            /* Bundle size, payload size for a dry run */
+    double seconds;
+    uint64_t delta_unchanged;        /* Delta builds: entries referenced as they are */
+    uint64_t delta_diffed;           /* ... stored as a diff */
+    uint64_t delta_added;            /* ... stored in full */
+    char error[512];                 /* NUL-terminated, empty on success */
+} suurstof_result;
+
+/* Smallest struct_size accepted: the structs as ABI version 1 defined them.
+ * Fields past struct_size are neither read nor written. */
+#define SUURSTOF_BUILD_SIZE_V1 offsetof(suurstof_build, startup_entries)
+#define SUURSTOF_RESULT_SIZE_V1 sizeof(suurstof_result)
+
+/* SUURSTOF_PACK_ABI_VERSION of the loaded library */
+SUURSTOF_API uint32_t suurstof_abi_version(void);
+
+/* Defaults: overlay layout, solid compression, sequential, sparse */
+SUURSTOF_API void suurstof_build_init(suurstof_build* build);
+
+/* threads 0 = one per hardware thread. NULL when out of memory. */
+SUURSTOF_API suurstof_engine* suurstof_engine_create(uint32_t threads);
+
+/* No suurstof_pack call may be running on the engine */
+SUURSTOF_API void suurstof_engine_destroy(suurstof_engine* engine);
+
+/* Build one bundle on the calling thread. result may be NULL. */
+SUURSTOF_API suurstof_status suurstof_pack(suurstof_engine* engine, const suurstof_build* build,
+                                           suurstof_result* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SUURSTOF_PACK_H */
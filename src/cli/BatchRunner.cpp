@@ -0,0 +1,113 @@
+#include "BatchRunner.h"
+#include "../core/ArchiveReader.h"
+#include "../core/FileIO.h"
+#include "../core/Trace.h"
+#include <algorithm>
+#include <mutex>
+
+namespace Packer {
+
+namespace {
+
+// The pipeline streams, so a job holds at most a few inputs at a time:
+// those read ahead, queued between stages and in the encode window, each
+// once as read and once encoded. The stub template and slack are a fixed
+// overhead on top.
+const uint64_t JOB_FIXED_OVERHEAD = 16ull * 1024 * 1024;
+const uint64_t JOB_INPUTS_IN_FLIGHT = 24;
+const uint64_t JOB_INPUT_COPIES = 2;
+const uint64_t DELTA_INPUT_COPIES = 4;     // Plus the base entry and the diff script
+
+// Idle buffers kept for reuse: a quarter of the memory budget, at most the
+// pool's default
+uint64_t bufferRetainLimit(uint64_t memoryBudget) {
+    if (memoryBudget == 0) {
+        return BufferPool::DEFAULT_RETAIN_LIMIT;
+    }
+    return std::min<uint64_t>(memoryBudget / 4, BufferPool::DEFAULT_RETAIN_LIMIT);
+}
+
+} // namespace
+
+BatchRunner::BatchRunner(size_t threads, uint64_t memoryBudget, IoBackendKind io)
+    : m_pool(threads), m_budget(memoryBudget),
+      m_engine(threads, bufferRetainLimit(memoryBudget), io) {
+}
+
+BatchRunner::~BatchRunner() {
+}
+
+uint64_t BatchRunner::estimateMemory(const JobSpec& job) {
+    uint64_t inputBytes = 0;
+    uint64_t largest = 0;
+    auto add = [&](uint64_t size) {
+        inputBytes += size;
+        largest = std::max(largest, size);
+    };
+    
+    for (const auto& input : job.inputs) {
+        // Files in archives count at their extracted size
+        std::wstring archivePath;
+        std::string name;
+        bool member = ArchiveReader::splitMemberPath(input, archivePath, name);
+        if (member || (job.options.expandArchives && ArchiveReader::isArchive(input))) {
+            ArchiveReader archive;
+            if (archive.open(member ? archivePath : input)) {
+                for (const ArchiveMember& file : archive.members()) {
+                    if (!member || file.name == name) {
+                        add(file.size);
+                    }
+                }
+            }
+            continue;
+        }
+        
+        uint64_t size = 0;
+        if (FileIO::fileSize(input, size)) {
+            add(size);
+        }
+    }
+    
+    uint64_t inFlight = std::min(inputBytes, largest * JOB_INPUTS_IN_FLIGHT);
+    uint64_t copies = job.options.basePath.empty() ? JOB_INPUT_COPIES : DELTA_INPUT_COPIES;
+    return inFlight * copies + JOB_FIXED_OVERHEAD;
+}
+
+bool BatchRunner::runJob(const JobSpec& job, JobResult& result) {
+    TRACE_THREAD("job worker");
+    TRACE_SPAN("job", job.dryRun ? job.origin : job.options.outputPath);
+    if (!job.variants.empty() && !job.dryRun) {
+        return m_engine.packMatrix(job.inputs, job.options, job.variants, result);
+    }
+    return m_engine.pack(job.inputs, job.options, result, job.dryRun);
+}
+
+bool BatchRunner::run(const std::vector<JobSpec>& jobs, std::vector<JobResult>& results,
+                      const ReportFn& report) {
+    results.assign(jobs.size(), JobResult());
+    std::mutex reportMutex;
+    
+    for (size_t i = 0; i < jobs.size(); i++) {
+        m_pool.submit([this, i, &jobs, &results, &report, &reportMutex] {
+            uint64_t granted = m_budget.acquire(estimateMemory(jobs[i]));
+            runJob(jobs[i], results[i]);
+            m_budget.release(granted);
+            
+            if (report) {
+                std::lock_guard<std::mutex> lock(reportMutex);
+                report(i, jobs[i], results[i]);
+            }
+        });
+    }
+    
+    m_pool.wait();
+    
+    for (const auto& result : results) {
+        if (!result.success) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace Packer
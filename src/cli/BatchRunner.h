@@ -0,0 +1,50 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include "JobFile.h"
+#include "../core/ThreadPool.h"
+#include "../core/MemoryBudget.h"
+#include "../core/PackEngine.h"
+#include <functional>
+
+namespace Packer {
+
+typedef PackResult JobResult;
+
+// Runs jobs on a shared worker pool under a global memory budget. Their
+// builds go through one PackEngine, so they share its encode pool (a job
+// task waiting on its writer never holds up encode work), its buffer pool
+// and its arenas, and later jobs reuse earlier jobs' memory.
+class BatchRunner {
+public:
+    // threads 0 = one per hardware thread, memoryBudget 0 = unlimited
+    BatchRunner(size_t threads, uint64_t memoryBudget, IoBackendKind io = IoBackendKind::AUTO);
+    ~BatchRunner();
+    
+    // Called once per finished job, never concurrently
+    typedef std::function<void(size_t index, const JobSpec& job, const JobResult& result)> ReportFn;
+    
+    // Run all jobs; true when every job succeeded
+    bool run(const std::vector<JobSpec>& jobs, std::vector<JobResult>& results,
+             const ReportFn& report);
+    
+    // Build one job on the calling thread, see PackEngine::pack
+    bool runJob(const JobSpec& job, JobResult& result);
+    
+    // Bytes a job is expected to hold while it runs
+    static uint64_t estimateMemory(const JobSpec& job);
+    
+    size_t threadCount() const { return m_pool.threadCount(); }
+    uint64_t peakMemory() const { return m_budget.peak(); }
+    BufferPoolStats bufferStats() const { return m_engine.bufferStats(); }
+    const char* ioBackendName() const { return m_engine.ioBackendName(); }
+
+private:
+    ThreadPool m_pool;          // One task per job
+    MemoryBudget m_budget;
+    PackEngine m_engine;
+};
+
+} // namespace Packer
+
+#endif // BATCHRUNNER_H
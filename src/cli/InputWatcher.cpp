@@ -0,0 +1,175 @@
+#include "InputWatcher.h"
+#include "../core/FileIO.h"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+
+#ifdef __linux__
+#include <cerrno>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace Packer {
+
+namespace {
+
+// How long one inotify wait blocks before looking at the stop flag again
+const int EVENT_WAIT_MS = 100;
+
+// How often polling stats every file
+const int POLL_INTERVAL_MS = 250;
+
+typedef std::chrono::steady_clock Clock;
+
+// Size and modification time; a missing file reads as size ~0
+void statFile(const std::wstring& path, uint64_t& size, int64_t& time) {
+    std::error_code error;
+    std::filesystem::path file = FileIO::nativePath(path);
+    size = std::filesystem::file_size(file, error);
+    if (error) {
+        size = ~0ull;
+    }
+    auto written = std::filesystem::last_write_time(file, error);
+    time = error ? 0 : static_cast<int64_t>(written.time_since_epoch().count());
+}
+
+} // namespace
+
+InputWatcher::InputWatcher() : m_fd(-1) {
+}
+
+InputWatcher::~InputWatcher() {
+#ifdef __linux__
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+#endif
+}
+
+bool InputWatcher::watch(const std::vector<std::wstring>& paths, std::string& error) {
+    m_files.assign(paths.size(), Watched());
+    for (size_t i = 0; i < paths.size(); i++) {
+        m_files[i].path = paths[i];
+        statFile(paths[i], m_files[i].size, m_files[i].time);
+    }
+
+#ifdef __linux__
+    // Without inotify (e.g. out of instances) polling still works
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0) {
+        return true;
+    }
+    
+    const uint32_t mask = IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_MOVED_TO |
+                          IN_DELETE | IN_MOVED_FROM;
+    for (size_t i = 0; i < paths.size(); i++) {
+        std::error_code failure;
+        std::filesystem::path file = std::filesystem::absolute(FileIO::nativePath(paths[i]), failure);
+        std::string directory = file.parent_path().string();
+        
+        // The same directory always gets the same watch
+        int wd = inotify_add_watch(m_fd, directory.c_str(), mask);
+        if (wd < 0) {
+            error = "cannot watch " + directory + ": " + std::strerror(errno);
+            return false;
+        }
+        m_names.insert(std::make_pair(std::make_pair(wd, file.filename().string()), i));
+    }
+#else
+    (void)error;
+#endif
+    return true;
+}
+
+bool InputWatcher::wait(int quietMs, std::vector<size_t>& changed, const std::atomic<bool>& stop) {
+    std::vector<bool> marked(m_files.size(), false);
+    bool pending = false;
+    Clock::time_point lastChange = Clock::now();
+    
+    while (!stop) {
+        bool seen;
+        if (m_fd >= 0) {
+#ifdef __linux__
+            pollfd descriptor = { m_fd, POLLIN, 0 };
+            ::poll(&descriptor, 1, EVENT_WAIT_MS);
+#endif
+            seen = readEvents(marked);
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+            seen = poll(marked);
+        }
+        
+        if (seen) {
+            pending = true;
+            lastChange = Clock::now();
+        } else if (pending && Clock::now() - lastChange >= std::chrono::milliseconds(quietMs)) {
+            changed.clear();
+            for (size_t i = 0; i < marked.size(); i++) {
+                if (marked[i]) {
+                    changed.push_back(i);
+                }
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+bool InputWatcher::poll(std::vector<bool>& changed) {
+    bool seen = false;
+    for (size_t i = 0; i < m_files.size(); i++) {
+        Watched& file = m_files[i];
+        uint64_t size;
+        int64_t time;
+        statFile(file.path, size, time);
+        if (size != file.size || time != file.time) {
+            file.size = size;
+            file.time = time;
+            changed[i] = true;
+            seen = true;
+        }
+    }
+    return seen;
+}
+
+bool InputWatcher::readEvents(std::vector<bool>& changed) {
+    bool seen = false;
+#ifdef __linux__
+    alignas(inotify_event) char buffer[16384];
+    for (;;) {
+        ssize_t length = read(m_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+        
+        for (char* p = buffer; p < buffer + length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+            
+            // Events were dropped: anything may have changed
+            if (event->mask & IN_Q_OVERFLOW) {
+                changed.assign(changed.size(), true);
+                seen = true;
+                continue;
+            }
+            if (event->len == 0) {
+                continue;
+            }
+            
+            auto range = m_names.equal_range(std::make_pair(event->wd, std::string(event->name)));
+            for (auto it = range.first; it != range.second; ++it) {
+                changed[it->second] = true;
+                seen = true;
+            }
+        }
+    }
+#else
+    (void)changed;
+#endif
+    return seen;
+}
+
+} // namespace Packer
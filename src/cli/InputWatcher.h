@@ -0,0 +1,56 @@
+#ifndef INPUTWATCHER_H
+#define INPUTWATCHER_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Packer {
+
+// Reports changes to a fixed set of files. On Linux it watches their
+// directories with inotify, so files that are replaced by a rename (the way
+// many compilers and editors save) are seen as well as files written in
+// place. Elsewhere it polls each file's size and modification time.
+class InputWatcher {
+public:
+    InputWatcher();
+    ~InputWatcher();
+    
+    InputWatcher(const InputWatcher&) = delete;
+    InputWatcher& operator=(const InputWatcher&) = delete;
+    
+    // Start watching; false (see error) if a directory cannot be watched
+    bool watch(const std::vector<std::wstring>& paths, std::string& error);
+    
+    // Block until some file changed and then nothing changed for quietMs,
+    // so a build writing several inputs is seen as one change. changed gets
+    // the indices of every file that changed, sorted. False once stop is set.
+    bool wait(int quietMs, std::vector<size_t>& changed, const std::atomic<bool>& stop);
+    
+    const char* method() const { return m_fd >= 0 ? "inotify" : "polling"; }
+
+private:
+    // Stat every file and mark the ones whose size or time moved; false
+    // when none did
+    bool poll(std::vector<bool>& changed);
+    
+    // Read pending inotify events and mark the files they name; false when
+    // there were none
+    bool readEvents(std::vector<bool>& changed);
+    
+    struct Watched {
+        std::wstring path;
+        uint64_t size;          // Polling only
+        int64_t time;
+    };
+    
+    std::vector<Watched> m_files;
+    std::multimap<std::pair<int, std::string>, size_t> m_names;  // (watch, name) -> file
+    int m_fd;                   // inotify descriptor, -1 when polling
+};
+
+} // namespace Packer
+
+#endif // INPUTWATCHER_H
@@ -0,0 +1,320 @@
+#include "JobFile.h"
+#include "../core/FileIO.h"
+#include <cwchar>
+#include <filesystem>
+#include <fstream>
+
+namespace Packer {
+
+namespace {
+
+std::string trim(const std::string& text) {
+    size_t first = text.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) {
+        return std::string();
+    }
+    size_t last = text.find_last_not_of(" \t\r\n");
+    return text.substr(first, last - first + 1);
+}
+
+bool parseBool(const std::wstring& value, bool& result) {
+    if (value == L"true" || value == L"yes" || value == L"1") {
+        result = true;
+        return true;
+    }
+    if (value == L"false" || value == L"no" || value == L"0") {
+        result = false;
+        return true;
+    }
+    return false;
+}
+
+// Non-negative decimal number
+bool parseNumber(const std::wstring& value, double& result) {
+    wchar_t* end = nullptr;
+    double number = std::wcstod(value.c_str(), &end);
+    if (value.empty() || *end != L'\0' || !(number >= 0)) {
+        return false;
+    }
+    result = number;
+    return true;
+}
+
+// Non-negative whole number
+bool parseCount(const std::wstring& value, uint32_t& result) {
+    wchar_t* end = nullptr;
+    unsigned long long number = std::wcstoull(value.c_str(), &end, 10);
+    if (value.empty() || value[0] == L'-' || *end != L'\0' || number > UINT32_MAX) {
+        return false;
+    }
+    result = static_cast<uint32_t>(number);
+    return true;
+}
+
+std::wstring trim(const std::wstring& text) {
+    size_t first = text.find_first_not_of(L" \t");
+    if (first == std::wstring::npos) {
+        return std::wstring();
+    }
+    size_t last = text.find_last_not_of(L" \t");
+    return text.substr(first, last - first + 1);
+}
+
+// "step: first, second" - step runs after both
+bool parseDependencies(const std::wstring& value, std::vector<StepDependency>& dependencies) {
+    size_t colon = value.find(L':');
+    if (colon == std::wstring::npos) {
+        return false;
+    }
+    StepDependency dependency;
+    dependency.step = trim(value.substr(0, colon));
+    if (dependency.step.empty()) {
+        return false;
+    }
+    
+    std::vector<StepDependency> parsed;
+    for (size_t start = colon + 1; start <= value.size();) {
+        size_t comma = value.find(L',', start);
+        size_t end = comma == std::wstring::npos ? value.size() : comma;
+        dependency.after = trim(value.substr(start, end - start));
+        if (dependency.after.empty()) {
+            return false;
+        }
+        parsed.push_back(dependency);
+        start = end + 1;
+    }
+    dependencies.insert(dependencies.end(), parsed.begin(), parsed.end());
+    return true;
+}
+
+} // namespace
+
+bool JobFile::applyOption(const std::string& key, const std::wstring& value,
+                          JobSpec& job, std::string& error) {
+    if (key == "input") {
+        job.inputs.push_back(value);
+    } else if (key == "output") {
+        job.options.outputPath = value;
+    } else if (key == "stub") {
+        job.options.stubPath = value;
+    } else if (key == "base") {
+        job.options.basePath = value;
+    } else if (key == "type") {
+        if (value == L"exe") {
+            job.options.outputType = OutputType::EXE;
+        } else if (value == L"dll") {
+            job.options.outputType = OutputType::DLL;
+        } else {
+            error = "type must be exe or dll";
+            return false;
+        }
+    } else if (key == "layout") {
+        if (value == L"overlay") {
+            job.options.payloadLayout = PayloadLayout::OVERLAY;
+        } else if (value == L"section") {
+            job.options.payloadLayout = PayloadLayout::SECTION;
+        } else {
+            error = "layout must be overlay or section";
+            return false;
+        }
+    } else if (key == "compression") {
+        if (value == L"none") {
+            job.options.compression = CompressionMode::NONE;
+        } else if (value == L"entry") {
+            job.options.compression = CompressionMode::ENTRY;
+        } else if (value == L"solid") {
+            job.options.compression = CompressionMode::SOLID;
+        } else {
+            error = "compression must be none, entry or solid";
+            return false;
+        }
+    } else if (key == "codec_search") {
+        if (!parseBool(value, job.options.codecSearch.enabled)) {
+            error = "codec_search must be true or false";
+            return false;
+        }
+    } else if (key == "time_budget") {
+        if (!parseNumber(value, job.options.codecSearch.timeBudget)) {
+            error = "time_budget must be a number of seconds";
+            return false;
+        }
+    } else if (key == "min_decode_speed") {
+        if (!parseNumber(value, job.options.codecSearch.minDecodeSpeed)) {
+            error = "min_decode_speed must be a number of MB/s";
+            return false;
+        }
+    } else if (key == "sparse") {
+        if (!parseBool(value, job.options.sparse)) {
+            error = "sparse must be true or false";
+            return false;
+        }
+    } else if (key == "expand_archives") {
+        if (!parseBool(value, job.options.expandArchives)) {
+            error = "expand_archives must be true or false";
+            return false;
+        }
+    } else if (key == "startup_entries") {
+        if (!parseCount(value, job.options.startupEntries)) {
+            error = "startup_entries must be a number of entries";
+            return false;
+        }
+    } else if (key == "depends") {
+        if (!parseDependencies(value, job.options.dependencies)) {
+            error = "depends must be 'step: step it waits for, ...'";
+            return false;
+        }
+    } else if (key == "max_parallel") {
+        if (!parseCount(value, job.options.maxParallel)) {
+            error = "max_parallel must be a number of steps";
+            return false;
+        }
+    } else if (key == "wait") {
+        if (!parseBool(value, job.options.waitForPrevious)) {
+            error = "wait must be true or false";
+            return false;
+        }
+    } else {
+        error = "unknown key '" + key + "'";
+        return false;
+    }
+    
+    return true;
+}
+
+bool JobFile::validate(const JobSpec& job, std::string& error) {
+    if (job.options.outputPath.empty() && !job.dryRun) {
+        error = "job has no output";
+        return false;
+    }
+    if (job.inputs.empty()) {
+        error = "job has no inputs";
+        return false;
+    }
+    if (!job.variants.empty() && !job.options.basePath.empty()) {
+        error = "a delta job cannot have variants";
+        return false;
+    }
+    return true;
+}
+
+bool JobFile::parse(const std::wstring& filePath, const JobSpec& defaults,
+                    std::vector<JobSpec>& jobs, std::string& error) {
+    std::ifstream file(FileIO::nativePath(filePath), std::ios::in);
+    if (!file.is_open()) {
+        error = "cannot open job file " + FileIO::toUtf8(filePath);
+        return false;
+    }
+    
+    std::filesystem::path baseDir = FileIO::nativePath(filePath).parent_path();
+    std::string fileName = FileIO::toUtf8(filePath);
+    
+    JobSpec fileDefaults = defaults;
+    JobSpec* current = nullptr;
+    size_t firstJob = jobs.size();
+
+    // The open [variant] section, as a copy of its job's settings
+    JobSpec variant;
+    std::string variantWhere;
+    bool inVariant = false;
+    auto closeVariant = [&]() {
+        if (!inVariant) {
+            return true;
+        }
+        inVariant = false;
+        if (variant.options.outputPath.empty()) {
+            error = variantWhere + ": variant has no output";
+            return false;
+        }
+        current->variants.push_back(OutputVariant(variant.options));
+        return true;
+    };
+    
+    std::string line;
+    int lineNumber = 0;
+    
+    while (std::getline(file, line)) {
+        lineNumber++;
+        
+        size_t comment = line.find_first_of("#;");
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        line = trim(line);
+        if (line.empty()) {
+            continue;
+        }
+        
+        std::string where = fileName + ":" + std::to_string(lineNumber);
+        
+        if (line == "[job]" || line == "[variant]") {
+            if (!closeVariant()) {
+                return false;
+            }
+        }
+
+        if (line == "[variant]") {
+            if (!current) {
+                error = where + ": [variant] must follow a [job]";
+                return false;
+            }
+            variant = *current;
+            variant.options.outputPath.clear();
+            variantWhere = where;
+            inVariant = true;
+            continue;
+        }
+
+        if (line == "[job]") {
+            jobs.push_back(fileDefaults);
+            current = &jobs.back();
+            current->origin = FileIO::fromUtf8(where);
+            continue;
+        }
+        
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            error = where + ": expected key = value";
+            return false;
+        }
+        
+        std::string key = trim(line.substr(0, equals));
+        std::wstring value = FileIO::fromUtf8(trim(line.substr(equals + 1)));
+        
+        // Paths are relative to the job file
+        if (key == "input" || key == "output" || key == "stub" || key == "base") {
+            std::filesystem::path path = FileIO::nativePath(value);
+            if (path.is_relative()) {
+                value = FileIO::fromNative((baseDir / path).lexically_normal());
+            }
+        }
+        
+        if (inVariant && key != "output" && key != "stub" && key != "type" && key != "layout" &&
+            key != "wait") {
+            error = where + ": only output, stub, type, layout and wait can differ in a variant";
+            return false;
+        }
+
+        std::string optionError;
+        JobSpec& target = inVariant ? variant : current ? *current : fileDefaults;
+        if (!applyOption(key, value, target, optionError)) {
+            error = where + ": " + optionError;
+            return false;
+        }
+    }
+    
+    if (!closeVariant()) {
+        return false;
+    }
+
+    for (size_t i = firstJob; i < jobs.size(); i++) {
+        std::string jobError;
+        if (!validate(jobs[i], jobError)) {
+            error = FileIO::toUtf8(jobs[i].origin) + ": " + jobError;
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+} // namespace Packer
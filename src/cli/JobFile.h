@@ -0,0 +1,68 @@
+#ifndef JOBFILE_H
+#define JOBFILE_H
+
+#include "../core/common.h"
+
+namespace Packer {
+
+// One bundle to build: inputs in execution order plus packer options
+struct JobSpec {
+    std::vector<std::wstring> inputs;
+    PackerOptions options;        // options.outputPath is the bundle to write
+    std::vector<OutputVariant> variants;  // More outputs from the same encoded payload
+    std::wstring origin;          // "file:line" the job came from, for messages
+    bool dryRun;                  // Encode and report sizes, write nothing
+    
+    JobSpec() : dryRun(false) {}
+};
+
+// Job description files.
+//
+//   # Keys before the first [job] are defaults for every job in the file
+//   stub = stubs/stub.exe
+//
+//   [job]
+//   output = out/setup.exe
+//   type   = exe          # exe | dll
+//   layout = overlay      # overlay | section
+//   compression = solid   # none | entry | solid
+//   codec_search = false  # try every codec and level per block
+//   time_budget = 0       # seconds of codec search per job, 0 = unlimited
+//   min_decode_speed = 0  # MB/s a searched codec must decode at
+//   sparse = true         # store zero runs of 64 KB and more as holes
+//   expand_archives = false  # pack the files inside .zip/.tar inputs
+//   startup_entries = 0   # first inputs to store uncompressed at the front
+//   wait   = true         # run inputs one after another
+//   depends = b.bat: a.exe  # repeatable: b.bat starts once a.exe has
+//                         # finished; any depends or max_parallel runs the
+//                         # inputs as a graph instead of by wait
+//   max_parallel = 0      # graph steps running at once, 0 = no cap
+//   base   = old.exe      # optional: build a delta against this bundle
+//   input  = tools/a.exe  # repeat, in execution order
+//   input  = scripts/b.bat
+//   input  = extras.zip!/docs/readme.txt  # one file inside an archive
+//
+//   [variant]             # optional, repeatable: another output of the job
+//   output = out/setup.dll  # above, encoded only once. Starts from the
+//   type   = dll            # job's settings; only output, stub, type,
+//   stub   = stubs/dll.dll  # layout and wait may be set.
+//   wait   = false
+//
+// Relative paths are resolved against the job file's directory.
+class JobFile {
+public:
+    // Parse a job file into jobs, starting each from 'defaults'
+    static bool parse(const std::wstring& filePath, const JobSpec& defaults,
+                      std::vector<JobSpec>& jobs, std::string& error);
+    
+    // Apply one key/value to a job. Shared with the command line flags.
+    static bool applyOption(const std::string& key, const std::wstring& value,
+                            JobSpec& job, std::string& error);
+    
+    // Check a finished job has an output (unless a dry run) and at least one input
+    static bool validate(const JobSpec& job, std::string& error);
+};
+
+} // namespace Packer
+
+#endif // JOBFILE_H
@@ -0,0 +1,1097 @@
+#include "JobFile.h"
+#include "BatchRunner.h"
+#include "InputWatcher.h"
+#include "../core/ArchiveReader.h"
+#include "../core/ArchiveSource.h"
+#include "../core/BundleReader.h"
+#include "../core/Codec.h"
+#include "../core/AllocStats.h"
+#include "../core/FileIO.h"
+#include "../core/MemoryBudget.h"
+#include "../core/SizeEstimator.h"
+#include "../core/ThreadPool.h"
+#include "../core/Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cwchar>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Packer;
+
+namespace {
+
+void printUsage() {
+    std::printf(
+        "Usage:\n"
+        "  suurstof-pack [pack] [options] -o <output> <input>...\n"
+        "  suurstof-pack [pack] [options] --jobs <file>...\n"
+        "  suurstof-pack inspect <bundle>...\n"
+        "  suurstof-pack verify [-j <n>] [--memory-budget <size>] [--base <bundle>] [-q] <bundle>...\n"
+        "  suurstof-pack apply --base <bundle> [options] -o <output> <delta>\n"
+        "  suurstof-pack watch [options] [--debounce <ms>] -o <output> <input>...\n"
+        "\n"
+        "inspect lists the entries of a bundle from its manifest alone; verify\n"
+        "reads every entry and checks its size and content hash (delta bundles\n"
+        "need --base). apply rebuilds the full bundle from a delta and the bundle\n"
+        "it was built against; give it the pack options of the full build.\n"
+        "watch builds the bundle, then updates it in place each time inputs change:\n"
+        "only the changed inputs are encoded and appended, once no input has\n"
+        "changed for --debounce milliseconds (default 300). It stops on Ctrl+C.\n"
+        "\n"
+        "An input may also name one file inside a ZIP or TAR archive as\n"
+        "archive.zip!/dir/file; it is read from the archive without extracting it.\n"
+        "\n"
+        "Pack options:\n"
+        "  -o, --output <path>       Bundle to write (single job)\n"
+        "  --jobs <file>             Job description file, may be repeated\n"
+        "  --type exe|dll            Output type (default exe)\n"
+        "  --layout overlay|section  Payload layout (default overlay)\n"
+        "  --compression none|entry|solid\n"
+        "                            Compress each entry, or also pack small entries\n"
+        "                            into shared solid groups (default solid)\n"
+        "  --codec-search            Try every codec and level per block, keep the smallest\n"
+        "  --time-budget <seconds>   Stop searching after this long per job (default 0,\n"
+        "                            unlimited); later blocks get the default codec\n"
+        "  --min-decode-speed <MB/s> Skip codecs that decode slower than this\n"
+        "  --dry-run                 Encode and print each block's predicted size and\n"
+        "                            encode/decode time; write nothing\n"
+        "  --estimate                Sample the inputs instead of encoding them and print\n"
+        "                            the predicted bundle size and encode and extract\n"
+        "                            times; write nothing\n"
+        "  --no-sparse               Store zero runs of 64 KB and more like other data\n"
+        "                            instead of as holes the stub recreates\n"
+        "  --expand-archives         Pack the files inside .zip and .tar inputs, read\n"
+        "                            straight from the archives, instead of the archives\n"
+        "  --startup-entries <n>     Store the first n inputs uncompressed at the front\n"
+        "                            of the payload, so launching reads less (default 0)\n"
+        "  --no-wait                 Start all inputs at once instead of in order\n"
+        "  --depends <step>:<step>,...\n"
+        "                            Start the first step only once the listed ones have\n"
+        "                            finished (steps named by file name); repeatable.\n"
+        "                            Inputs then run as a dependency graph, not in order\n"
+        "  --max-parallel <n>        Graph steps running at once (default 0, no cap)\n"
+        "  --stub <path>             Stub template (default stub.exe next to the packer,\n"
+        "                            stub-dll.dll for --type dll); must match the type\n"
+        "  --base <bundle>           Write a delta against this earlier bundle: unchanged\n"
+        "                            entries are referenced, changed ones diffed\n"
+        "  -j, --threads <n>         Worker threads (default: all cores)\n"
+        "  --memory-budget <size>    Cap on memory held by running jobs, e.g. 512M, 4G\n"
+        "                            (default 4G, 0 = unlimited)\n"
+        "  --io <backend>            auto, threads or uring: how inputs are read and\n"
+        "                            bundles written (default auto: io_uring on Linux\n"
+        "                            when the kernel allows it)\n"
+        "  --stats                   Print per-stage pipeline throughput for each job\n"
+        "  --trace <file.json>       Write a Chrome/Perfetto trace of every build stage\n"
+        "  --alloc-stats             Count heap allocations per stage (needs a build with\n"
+        "                            -DPACKER_ALLOC_STATS)\n"
+        "  -q, --quiet               Only report failures\n"
+        "  -h, --help                Show this help\n");
+}
+
+// "4G", "512M", "64K" or plain bytes
+bool parseSize(const std::wstring& text, uint64_t& size) {
+    if (text.empty()) {
+        return false;
+    }
+
+    wchar_t* end = nullptr;
+    unsigned long long value = std::wcstoull(text.c_str(), &end, 10);
+    if (end == text.c_str()) {
+        return false;
+    }
+
+    std::wstring suffix(end);
+    uint64_t scale = 1;
+    if (suffix == L"K" || suffix == L"k") scale = 1ull << 10;
+    else if (suffix == L"M" || suffix == L"m") scale = 1ull << 20;
+    else if (suffix == L"G" || suffix == L"g") scale = 1ull << 30;
+    else if (!suffix.empty()) return false;
+
+    size = value * scale;
+    return true;
+}
+
+// Set by Ctrl+C while watching
+std::atomic<bool> g_stopWatching(false);
+
+void stopWatching(int) {
+    g_stopWatching = true;
+}
+
+int fail(const std::string& message) {
+    std::fprintf(stderr, "suurstof-pack: %s\n", message.c_str());
+    return 2;
+}
+
+// Throughput of each pipeline stage of one job. Busy MB/s is what the stage
+// manages while working; starved and blocked show where the pipeline waits.
+void printStages(const JobResult& result) {
+    std::printf("  %-8s %8s %10s %9s %9s %9s %10s\n", "stage", "items", "MB", "busy s",
+                "starved s", "blocked s", "busy MB/s");
+    for (const auto& stage : result.stages) {
+        double megabytes = stage.bytes / (1024.0 * 1024.0);
+        double speed = stage.busySeconds > 0 ? megabytes / stage.busySeconds : 0.0;
+        std::printf("  %-8s %8" PRIu64 " %10.1f %9.3f %9.3f %9.3f %10.1f\n", stage.name,
+                    stage.items, megabytes, stage.busySeconds, stage.starvedSeconds,
+                    stage.blockedSeconds, speed);
+    }
+}
+
+// What a delta build stored and how fast it diffed. The full bundle's size
+// for comparison comes from a build without --base.
+void printDelta(const JobResult& result) {
+    const DeltaStats& delta = result.delta;
+    double diffedMB = delta.diffedBytes / (1024.0 * 1024.0);
+    double speed = delta.diffSeconds > 0 ? diffedMB / delta.diffSeconds : 0.0;
+    double ratio = delta.entryBytes ? 100.0 * result.outputSize / delta.entryBytes : 100.0;
+    std::printf("  delta: %" PRIu64 " unchanged, %" PRIu64 " diffed, %" PRIu64 " stored in full\n",
+                delta.unchanged, delta.diffed, delta.added);
+    std::printf("  diff: %.1f MB into %.1f MB of scripts in %.3f s (%.1f MB/s)\n",
+                diffedMB, delta.scriptBytes / (1024.0 * 1024.0), delta.diffSeconds, speed);
+    std::printf("  delta payload %" PRIu64 " bytes for %.1f MB of entries (%.2f%%)\n",
+                result.outputSize, delta.entryBytes / (1024.0 * 1024.0), ratio);
+}
+
+// Heap use of the whole run by stage. Realloc copies are buffers replaced
+// by a larger one, mostly vector growth; peak MB is the most a stage's
+// allocations held at one time.
+void printAllocStats() {
+    AllocCounters counters[ALLOC_STAGE_COUNT];
+    AllocStats::snapshot(counters);
+
+    std::printf("Allocations by stage:\n");
+    std::printf("  %-8s %10s %10s %14s %10s %9s\n", "stage", "allocs", "MB", "realloc copies",
+                "copied MB", "peak MB");
+    for (const auto& stage : counters) {
+        std::printf("  %-8s %10" PRIu64 " %10.1f %14" PRIu64 " %10.1f %9.1f\n", stage.name,
+                    stage.allocations, stage.bytes / (1024.0 * 1024.0), stage.reallocCopies,
+                    stage.reallocBytes / (1024.0 * 1024.0), stage.peakLive / (1024.0 * 1024.0));
+    }
+}
+
+// Predicted layout of one dry-run job, one row per stored block
+void printDryRun(const std::string& output, const JobResult& result) {
+    std::printf("%s: dry run, payload %" PRIu64 " bytes\n", output.c_str(), result.outputSize);
+    std::printf("  %-32s %7s %12s %12s %7s %10s %10s\n", "block", "codec", "original",
+                "stored", "ratio", "encode ms", "decode ms");
+
+    uint64_t original = 0;
+    uint64_t stored = 0;
+    for (const auto& block : result.blocks) {
+        std::string name = block.name.empty()
+            ? "group " + std::to_string(block.group) + " (" +
+              std::to_string(block.entryCount) + " entries)"
+            : FileIO::toUtf8(block.name);
+        std::string codec = codecName(block.codec);
+        if (block.codec != CODEC_STORE) {
+            codec += ":" + std::to_string(block.level);
+        }
+        double ratio = block.originalSize ? 100.0 * block.storedSize / block.originalSize : 100.0;
+
+        std::printf("  %-32s %7s %12" PRIu64 " %12" PRIu64 " %6.1f%% %10.2f %10.2f\n",
+                    name.c_str(), codec.c_str(), block.originalSize, block.storedSize, ratio,
+                    block.encodeSeconds * 1000.0, block.decodeSeconds * 1000.0);
+        original += block.originalSize;
+        stored += block.storedSize;
+    }
+
+    std::printf("  %-32s %7s %12" PRIu64 " %12" PRIu64 "\n", "total", "", original, stored);
+}
+
+void printEstimate(const char* prefix, const SizeEstimate& estimate, size_t threads) {
+    std::printf("%s~%.1f KB (file data %.1f KB), encode ~%.2f s on %zu thread(s), "
+                "extract ~%.2f s\n", prefix, estimate.outputSize / 1024.0,
+                estimate.dataSize / 1024.0, estimate.encodeSeconds, threads,
+                estimate.extractSeconds);
+}
+
+// Sample each job's inputs and print the predicted bundle instead of
+// building it. While samples come in, the running estimate is printed
+// every ESTIMATE_REFRESH.
+const std::chrono::milliseconds ESTIMATE_REFRESH(250);
+
+int estimateJobs(const std::vector<JobSpec>& jobs, size_t threads, bool quiet) {
+    size_t buildThreads = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    int status = 0;
+
+    for (size_t j = 0; j < jobs.size(); j++) {
+        const JobSpec& job = jobs[j];
+        std::string output = FileIO::toUtf8(job.options.outputPath.empty() ? job.origin
+                                                                            : job.options.outputPath);
+        std::vector<std::wstring> inputs = job.inputs;
+        if (job.options.expandArchives) {
+            ArchiveSource source;
+            std::string error;
+            if (!source.open(job.inputs, true, error)) {
+                std::fprintf(stderr, "[%zu/%zu] FAILED %s: %s\n", j + 1, jobs.size(),
+                             output.c_str(), error.c_str());
+                status = 1;
+                continue;
+            }
+            inputs = source.inputs();
+        }
+
+        SizeEstimator estimator(job.options.codecSearch, threads);
+        std::mutex mutex;
+        std::condition_variable sampled;
+        estimator.setListener([&] {
+            std::lock_guard<std::mutex> lock(mutex);
+            sampled.notify_one();
+        });
+        estimator.add(inputs);
+
+        auto lastPrint = std::chrono::steady_clock::now();
+        while (estimator.busy()) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                sampled.wait_for(lock, ESTIMATE_REFRESH);
+            }
+            if (quiet || std::chrono::steady_clock::now() - lastPrint < ESTIMATE_REFRESH) {
+                continue;
+            }
+            lastPrint = std::chrono::steady_clock::now();
+            SizeEstimate estimate = estimator.estimate(inputs, job.options, buildThreads);
+            std::printf("  %zu/%zu sampled: ", estimate.sampled, inputs.size());
+            printEstimate("", estimate, buildThreads);
+        }
+        estimator.wait();
+
+        SizeEstimate estimate = estimator.estimate(inputs, job.options, buildThreads);
+        if (estimate.pending > 0) {
+            std::fprintf(stderr, "[%zu/%zu] %s: %zu input(s) could not be read\n", j + 1,
+                         jobs.size(), output.c_str(), estimate.pending);
+            status = 1;
+        }
+        std::string prefix = "[" + std::to_string(j + 1) + "/" + std::to_string(jobs.size()) +
+                             "] " + output + ": ";
+        printEstimate(prefix.c_str(), estimate, buildThreads);
+
+        // Variants share the payload but differ in stub, layout and manifest flags
+        for (const OutputVariant& variant : job.variants) {
+            PackerOptions options = job.options;
+            options.outputPath = variant.outputPath;
+            options.stubPath = variant.stubPath;
+            options.outputType = variant.outputType;
+            options.payloadLayout = variant.payloadLayout;
+            options.waitForPrevious = variant.waitForPrevious;
+            estimate = estimator.estimate(inputs, options, buildThreads);
+            prefix = "[" + std::to_string(j + 1) + "/" + std::to_string(jobs.size()) + "] " +
+                     FileIO::toUtf8(variant.outputPath) + ": ";
+            printEstimate(prefix.c_str(), estimate, buildThreads);
+        }
+    }
+    return status;
+}
+
+int commandPack(const std::vector<std::wstring>& args) {
+    JobSpec cliJob;
+    std::vector<std::wstring> jobFiles;
+    size_t threads = 0;
+    uint64_t memoryBudget = 4ull << 30;
+    bool quiet = false;
+    bool stats = false;
+    bool allocStats = false;
+    bool estimate = false;
+    std::wstring tracePath;
+    IoBackendKind io = IoBackendKind::AUTO;
+
+    for (size_t i = 0; i < args.size(); i++) {
+        const std::wstring& arg = args[i];
+        bool hasValue = i + 1 < args.size();
+        std::string error;
+
+        if (arg == L"-h" || arg == L"--help") {
+            printUsage();
+            return 0;
+        } else if (arg == L"-q" || arg == L"--quiet") {
+            quiet = true;
+        } else if (arg == L"--stats") {
+            stats = true;
+        } else if (arg == L"--alloc-stats") {
+            allocStats = true;
+        } else if (arg == L"--trace" && hasValue) {
+            tracePath = args[++i];
+        } else if (arg == L"--no-wait") {
+            cliJob.options.waitForPrevious = false;
+        } else if (arg == L"--no-sparse") {
+            cliJob.options.sparse = false;
+        } else if (arg == L"--expand-archives") {
+            cliJob.options.expandArchives = true;
+        } else if (arg == L"--startup-entries" && hasValue) {
+            JobFile::applyOption("startup_entries", args[++i], cliJob, error);
+        } else if (arg == L"--depends" && hasValue) {
+            JobFile::applyOption("depends", args[++i], cliJob, error);
+        } else if (arg == L"--max-parallel" && hasValue) {
+            JobFile::applyOption("max_parallel", args[++i], cliJob, error);
+        } else if ((arg == L"-o" || arg == L"--output") && hasValue) {
+            JobFile::applyOption("output", args[++i], cliJob, error);
+        } else if (arg == L"--type" && hasValue) {
+            JobFile::applyOption("type", args[++i], cliJob, error);
+        } else if (arg == L"--layout" && hasValue) {
+            JobFile::applyOption("layout", args[++i], cliJob, error);
+        } else if (arg == L"--compression" && hasValue) {
+            JobFile::applyOption("compression", args[++i], cliJob, error);
+        } else if (arg == L"--codec-search") {
+            cliJob.options.codecSearch.enabled = true;
+        } else if (arg == L"--time-budget" && hasValue) {
+            JobFile::applyOption("time_budget", args[++i], cliJob, error);
+        } else if (arg == L"--min-decode-speed" && hasValue) {
+            JobFile::applyOption("min_decode_speed", args[++i], cliJob, error);
+        } else if (arg == L"--dry-run") {
+            cliJob.dryRun = true;
+        } else if (arg == L"--estimate") {
+            // Writes nothing either, so jobs need no output
+            estimate = true;
+            cliJob.dryRun = true;
+        } else if (arg == L"--stub" && hasValue) {
+            JobFile::applyOption("stub", args[++i], cliJob, error);
+        } else if (arg == L"--base" && hasValue) {
+            JobFile::applyOption("base", args[++i], cliJob, error);
+        } else if (arg == L"--jobs" && hasValue) {
+            jobFiles.push_back(args[++i]);
+        } else if ((arg == L"-j" || arg == L"--threads") && hasValue) {
+            threads = static_cast<size_t>(std::wcstoul(args[++i].c_str(), nullptr, 10));
+        } else if (arg == L"--memory-budget" && hasValue) {
+            if (!parseSize(args[++i], memoryBudget)) {
+                error = "invalid size for --memory-budget";
+            }
+        } else if (arg == L"--io" && hasValue) {
+            const std::wstring& backend = args[++i];
+            if (backend == L"auto") {
+                io = IoBackendKind::AUTO;
+            } else if (backend == L"threads") {
+                io = IoBackendKind::THREADS;
+            } else if (backend == L"uring") {
+                io = IoBackendKind::URING;
+            } else {
+                error = "--io must be auto, threads or uring";
+            }
+        } else if (!arg.empty() && arg[0] == L'-') {
+            error = "unknown or incomplete option " + FileIO::toUtf8(arg);
+        } else {
+            cliJob.inputs.push_back(arg);
+        }
+
+        if (!error.empty()) {
+            return fail(error);
+        }
+    }
+
+    std::vector<JobSpec> jobs;
+
+    // Inputs on the command line form one job; options also act as
+    // defaults for every job file
+    if (!cliJob.inputs.empty() || jobFiles.empty()) {
+        std::string error;
+        if (!JobFile::validate(cliJob, error)) {
+            printUsage();
+            return fail(error);
+        }
+        cliJob.origin = L"command line";
+        jobs.push_back(cliJob);
+    }
+
+    JobSpec defaults = cliJob;
+    defaults.inputs.clear();
+    defaults.options.outputPath.clear();
+
+    for (const auto& jobFile : jobFiles) {
+        std::string error;
+        if (!JobFile::parse(jobFile, defaults, jobs, error)) {
+            return fail(error);
+        }
+    }
+
+    if (estimate) {
+        return estimateJobs(jobs, threads, quiet);
+    }
+
+    if (!tracePath.empty()) {
+        Tracer::instance().enable(1, "suurstof-pack");
+    }
+    if (allocStats) {
+        if (!AllocStats::available()) {
+            return fail("--alloc-stats needs a build with -DPACKER_ALLOC_STATS");
+        }
+        AllocStats::enable();
+    }
+
+    if (io == IoBackendKind::URING && !IoBackend::uringAvailable()) {
+        return fail("io_uring is not available on this system");
+    }
+    BatchRunner runner(threads, memoryBudget, io);
+    std::vector<JobResult> results;
+    size_t finished = 0;
+
+    bool allOk = runner.run(jobs, results,
+        [&](size_t, const JobSpec& job, const JobResult& result) {
+            finished++;
+            std::string output = FileIO::toUtf8(job.options.outputPath);
+            if (output.empty()) {
+                output = FileIO::toUtf8(job.origin);
+            }
+            if (!result.success) {
+                std::fprintf(stderr, "[%zu/%zu] FAILED %s (%s): %s\n", finished, jobs.size(),
+                             output.c_str(), FileIO::toUtf8(job.origin).c_str(),
+                             result.error.c_str());
+            } else if (job.dryRun) {
+                printDryRun(output, result);
+            } else if (!quiet) {
+                std::printf("[%zu/%zu] %s (%.1f KB, %.2f s)\n", finished, jobs.size(),
+                            output.c_str(), result.outputSize / 1024.0, result.seconds);
+                for (size_t v = 0; v < result.variantSizes.size(); v++) {
+                    std::printf("        + %s (%.1f KB)\n",
+                                FileIO::toUtf8(job.variants[v].outputPath).c_str(),
+                                result.variantSizes[v] / 1024.0);
+                }
+            }
+            if (stats && result.success) {
+                printStages(result);
+                if (!job.options.basePath.empty()) {
+                    printDelta(result);
+                }
+            }
+        });
+
+    if (!quiet) {
+        size_t failed = 0;
+        for (const auto& result : results) {
+            failed += result.success ? 0 : 1;
+        }
+        std::printf("%zu %s, %zu failed, %zu thread(s), peak budget %.1f MB\n",
+                    jobs.size() - failed, cliJob.dryRun ? "job(s) encoded" : "bundle(s) built",
+                    failed, runner.threadCount(), runner.peakMemory() / (1024.0 * 1024.0));
+    }
+    if (stats) {
+        BufferPoolStats buffers = runner.bufferStats();
+        std::printf("buffer pool: %" PRIu64 " reused, %" PRIu64 " allocated, %.1f MB retained\n",
+                    buffers.reused, buffers.allocated, buffers.retainedBytes / (1024.0 * 1024.0));
+        std::printf("io backend: %s\n", runner.ioBackendName());
+    }
+
+    if (allocStats) {
+        printAllocStats();
+    }
+
+    // Every job has finished, so no thread is still recording
+    if (!tracePath.empty()) {
+        std::string json;
+        Tracer::instance().exportJson(json);
+        if (!FileIO::writeFile(tracePath, std::vector<uint8_t>(json.begin(), json.end()))) {
+            return fail("failed to write trace " + FileIO::toUtf8(tracePath));
+        }
+    }
+
+    return allOk ? 0 : 1;
+}
+
+const char* layoutName(PayloadLayout layout) {
+    return layout == PayloadLayout::SECTION ? "section" : "overlay";
+}
+
+int commandInspect(const std::vector<std::wstring>& args) {
+    if (args.empty()) {
+        printUsage();
+        return fail("inspect needs at least one bundle");
+    }
+
+    bool allOk = true;
+    for (const auto& path : args) {
+        std::string name = FileIO::toUtf8(path);
+        BundleReader reader;
+        if (!reader.open(path)) {
+            std::fprintf(stderr, "%s: %s\n", name.c_str(), reader.error().c_str());
+            allOk = false;
+            continue;
+        }
+
+        const ManifestView& manifest = reader.manifest();
+        const BundleTrailer& trailer = reader.trailer();
+        ManifestSchedule schedule;
+        bool scheduled = manifest.schedule(schedule);
+        std::printf("%s\n", name.c_str());
+        std::printf("  layout %s, payload %" PRIu64 " bytes at 0x%" PRIx64 ", manifest %u bytes, "
+                    "%u entries, %s\n",
+                    layoutName(reader.layout()), trailer.payloadSize, reader.payloadOffset(),
+                    trailer.manifestSize, manifest.entryCount(),
+                    scheduled ? "scheduled" : manifest.waitForPrevious() ? "sequential" : "parallel");
+        ManifestBase base;
+        if (manifest.base(base)) {
+            std::printf("  delta against a %u-entry bundle with manifest hash %016" PRIx64 "\n",
+                        base.entryCount, base.manifestHash);
+        }
+
+        // Entries each entry waits for, shown after its path
+        std::vector<std::string> after(manifest.entryCount());
+        if (scheduled) {
+            std::string cap = schedule.maxParallel ? "up to " + std::to_string(schedule.maxParallel) +
+                                                     " steps at once" : "no cap on steps at once";
+            std::printf("  %u dependencies, %s\n", manifest.dependencyCount(), cap.c_str());
+            for (uint32_t d = 0; d < manifest.dependencyCount(); d++) {
+                ManifestDependency edge;
+                if (manifest.dependency(d, edge) && edge.entry < after.size()) {
+                    after[edge.entry] += (after[edge.entry].empty() ? " (after " : ", ") +
+                                         std::to_string(edge.dependsOn);
+                }
+            }
+        }
+        std::printf("  %5s %5s %-7s %12s %12s %6s  %-16s  %s\n",
+                    "#", "order", "codec", "stored", "original", "ratio", "xxh64", "path");
+
+        uint64_t totalStored = 0;
+        uint64_t totalOriginal = 0;
+        for (uint32_t i = 0; i < manifest.entryCount(); i++) {
+            ManifestRecord record;
+            if (!manifest.entry(i, record)) {
+                std::printf("  %5u <corrupt record>\n", i);
+                allOk = false;
+                continue;
+            }
+
+            char hash[17] = "-";
+            if (record.flags & MANIFEST_RECORD_HASH) {
+                std::snprintf(hash, sizeof(hash), "%016" PRIx64, record.contentHash);
+            }
+
+            // Solid entries are sized by their group below
+            std::string path = FileIO::toUtf8(manifest.string(record.path));
+            if (record.flags & MANIFEST_RECORD_SPARSE) {
+                path += " (sparse, " + std::to_string(record.holeCount) + " hole(s))";
+            }
+            if (record.flags & (MANIFEST_RECORD_BASE | MANIFEST_RECORD_DELTA)) {
+                path += " (base entry " + std::to_string(record.baseEntry) + ")";
+            }
+            if (!after[i].empty()) {
+                path += after[i] + ")";
+            }
+            if (record.flags & MANIFEST_RECORD_BASE) {
+                std::printf("  %5u %5u %-7s %12s %12" PRIu64 " %6s  %-16s  %s\n",
+                            i, record.executionOrder, "base", "-",
+                            record.originalSize, "", hash, path.c_str());
+            } else if (record.flags & MANIFEST_RECORD_SOLID) {
+                std::string codec = "g" + std::to_string(record.group);
+                std::printf("  %5u %5u %-7s %12s %12" PRIu64 " %6s  %-16s  %s\n",
+                            i, record.executionOrder, codec.c_str(), "-",
+                            record.originalSize, "", hash, path.c_str());
+            } else {
+                double ratio = record.originalSize ? 100.0 * record.storedSize / record.originalSize : 100.0;
+                std::string codec = codecName(record.codec);
+                if (record.flags & MANIFEST_RECORD_DELTA) {
+                    codec = "d:" + codec;
+                }
+                std::printf("  %5u %5u %-7s %12" PRIu64 " %12" PRIu64 " %5.1f%%  %-16s  %s\n",
+                            i, record.executionOrder, codec.c_str(),
+                            record.storedSize, record.originalSize, ratio, hash, path.c_str());
+                totalStored += record.storedSize;
+            }
+            totalOriginal += record.originalSize;
+        }
+
+        for (uint32_t g = 0; g < manifest.groupCount(); g++) {
+            ManifestGroup group = {};
+            manifest.group(g, group);
+            double ratio = group.originalSize ? 100.0 * group.storedSize / group.originalSize : 100.0;
+            std::string label = "g" + std::to_string(g);
+            std::printf("  %5s %5s %-7s %12" PRIu64 " %12" PRIu64 " %5.1f%%  solid %s, %u entries\n",
+                        label.c_str(), "", codecName(group.codec), group.storedSize,
+                        group.originalSize, ratio, label.c_str(), group.entryCount);
+            totalStored += group.storedSize;
+        }
+
+        double ratio = totalOriginal ? 100.0 * totalStored / totalOriginal : 100.0;
+        std::printf("  %5s %5s %-7s %12" PRIu64 " %12" PRIu64 " %5.1f%%\n",
+                    "", "", "total", totalStored, totalOriginal, ratio);
+    }
+
+    return allOk ? 0 : 1;
+}
+
+int commandVerify(const std::vector<std::wstring>& args) {
+    std::vector<std::wstring> paths;
+    size_t threads = 0;
+    uint64_t memoryBudget = 1ull << 30;
+    bool quiet = false;
+    std::wstring basePath;
+
+    for (size_t i = 0; i < args.size(); i++) {
+        const std::wstring& arg = args[i];
+        bool hasValue = i + 1 < args.size();
+
+        if (arg == L"-h" || arg == L"--help") {
+            printUsage();
+            return 0;
+        } else if (arg == L"-q" || arg == L"--quiet") {
+            quiet = true;
+        } else if (arg == L"--base" && hasValue) {
+            basePath = args[++i];
+        } else if ((arg == L"-j" || arg == L"--threads") && hasValue) {
+            threads = static_cast<size_t>(std::wcstoul(args[++i].c_str(), nullptr, 10));
+        } else if (arg == L"--memory-budget" && hasValue) {
+            if (!parseSize(args[++i], memoryBudget)) {
+                return fail("invalid size for --memory-budget");
+            }
+        } else if (!arg.empty() && arg[0] == L'-') {
+            return fail("unknown or incomplete option " + FileIO::toUtf8(arg));
+        } else {
+            paths.push_back(arg);
+        }
+    }
+
+    if (paths.empty()) {
+        printUsage();
+        return fail("verify needs at least one bundle");
+    }
+
+    // Manifests are opened up front; every standalone entry and every solid
+    // group is then one task, so a single large bundle still spreads across
+    // all cores
+    std::vector<BundleReader> readers(paths.size());
+    std::vector<std::string> failures(paths.size());
+    std::vector<std::atomic<size_t>> badEntries(paths.size());
+    std::mutex failureMutex;
+
+    // Delta bundles read unchanged and diffed entries through their base
+    BundleReader base;
+    if (!basePath.empty() && !base.open(basePath)) {
+        return fail("cannot open base bundle " + FileIO::toUtf8(basePath) + ": " + base.error());
+    }
+
+    ThreadPool pool(threads);
+    MemoryBudget budget(memoryBudget);
+
+    for (size_t b = 0; b < paths.size(); b++) {
+        BundleReader& reader = readers[b];
+        if (!reader.open(paths[b]) || (!basePath.empty() && reader.isDelta() && !reader.setBase(base))) {
+            failures[b] = reader.error();
+            badEntries[b] = 1;
+            continue;
+        }
+
+        const ManifestView& manifest = reader.manifest();
+        std::vector<std::vector<ManifestRecord>> groupMembers(manifest.groupCount());
+        auto report = [&, b](const std::string& what, const std::string& error) {
+            badEntries[b]++;
+            std::lock_guard<std::mutex> lock(failureMutex);
+            failures[b] += (failures[b].empty() ? "" : "; ") + what + ": " + error;
+        };
+
+        for (uint32_t i = 0; i < manifest.entryCount(); i++) {
+            ManifestRecord record;
+            if (!manifest.entry(i, record)) {
+                report("entry " + std::to_string(i), "corrupt record");
+                continue;
+            }
+
+            // Members of a solid group are checked together so each group
+            // is decoded once
+            if (record.flags & MANIFEST_RECORD_SOLID) {
+                groupMembers[record.group].push_back(record);
+                continue;
+            }
+
+            pool.submit([&, b, i, record, report] {
+                std::string error;
+                uint64_t granted = budget.acquire(record.storedSize + record.originalSize);
+                bool ok = readers[b].verifyEntry(record, error);
+                budget.release(granted);
+                if (!ok) {
+                    report("entry " + std::to_string(i) + " " +
+                           FileIO::toUtf8(readers[b].manifest().string(record.path)), error);
+                }
+            });
+        }
+
+        for (uint32_t g = 0; g < groupMembers.size(); g++) {
+            if (groupMembers[g].empty()) {
+                continue;  // Data no entry refers to
+            }
+            pool.submit([&, b, g, members = std::move(groupMembers[g]), report] {
+                const BundleReader& bundle = readers[b];
+                ManifestGroup group = {};
+                bundle.manifest().group(g, group);
+
+                std::vector<uint8_t> data;
+                std::string error;
+                uint64_t granted = budget.acquire(group.storedSize + group.originalSize);
+                if (!bundle.readGroup(g, data, error)) {
+                    report("group " + std::to_string(g), error);
+                }
+                for (size_t m = 0; error.empty() && m < members.size(); m++) {
+                    const ManifestRecord& record = members[m];
+                    bool inside = record.dataOffset <= data.size() &&
+                                  record.originalSize <= data.size() - record.dataOffset;
+                    std::string entryError = inside ? "" : "entry outside its solid group";
+                    if (!inside || !BundleReader::checkEntry(record, data.data() + record.dataOffset,
+                                                             static_cast<size_t>(record.originalSize),
+                                                             entryError)) {
+                        report(FileIO::toUtf8(bundle.manifest().string(record.path)), entryError);
+                    }
+                }
+                budget.release(granted);
+            });
+        }
+    }
+    pool.wait();
+
+    size_t failed = 0;
+    for (size_t b = 0; b < paths.size(); b++) {
+        std::string name = FileIO::toUtf8(paths[b]);
+        if (badEntries[b] != 0) {
+            failed++;
+            std::fprintf(stderr, "FAILED %s: %s\n", name.c_str(), failures[b].c_str());
+        } else if (!quiet) {
+            std::printf("OK %s (%u entries)\n", name.c_str(), readers[b].manifest().entryCount());
+        }
+    }
+
+    if (!quiet) {
+        std::printf("%zu bundle(s) verified, %zu failed, %zu thread(s)\n",
+                    paths.size() - failed, failed, pool.threadCount());
+    }
+
+    return failed == 0 ? 0 : 1;
+}
+
+// Feeds the entries of a delta bundle, rebuilt against its base and
+// hash-checked, to a pipeline in place of input files
+class DeltaSource : public InputSource {
+public:
+    DeltaSource(const BundleReader& delta, const std::vector<ManifestRecord>& records)
+        : m_delta(delta), m_records(records) {}
+
+    bool read(size_t index, std::vector<uint8_t>& data, std::string& error) override {
+        const ManifestRecord& record = m_records[index];
+        return m_delta.readEntry(record, data, error) &&
+               BundleReader::checkEntry(record, data.data(), data.size(), error);
+    }
+
+private:
+    const BundleReader& m_delta;
+    const std::vector<ManifestRecord>& m_records;
+};
+
+int commandApply(const std::vector<std::wstring>& args) {
+    JobSpec job;
+    std::wstring basePath;
+    std::vector<std::wstring> deltas;
+    size_t threads = 0;
+    bool quiet = false;
+
+    for (size_t i = 0; i < args.size(); i++) {
+        const std::wstring& arg = args[i];
+        bool hasValue = i + 1 < args.size();
+        std::string error;
+
+        if (arg == L"-h" || arg == L"--help") {
+            printUsage();
+            return 0;
+        } else if (arg == L"-q" || arg == L"--quiet") {
+            quiet = true;
+        } else if (arg == L"--base" && hasValue) {
+            basePath = args[++i];
+        } else if ((arg == L"-o" || arg == L"--output") && hasValue) {
+            JobFile::applyOption("output", args[++i], job, error);
+        } else if (arg == L"--stub" && hasValue) {
+            JobFile::applyOption("stub", args[++i], job, error);
+        } else if (arg == L"--type" && hasValue) {
+            JobFile::applyOption("type", args[++i], job, error);
+        } else if (arg == L"--layout" && hasValue) {
+            JobFile::applyOption("layout", args[++i], job, error);
+        } else if (arg == L"--compression" && hasValue) {
+            JobFile::applyOption("compression", args[++i], job, error);
+        } else if (arg == L"--codec-search") {
+            job.options.codecSearch.enabled = true;
+        } else if (arg == L"--time-budget" && hasValue) {
+            JobFile::applyOption("time_budget", args[++i], job, error);
+        } else if (arg == L"--min-decode-speed" && hasValue) {
+            JobFile::applyOption("min_decode_speed", args[++i], job, error);
+        } else if (arg == L"--no-sparse") {
+            job.options.sparse = false;
+        } else if (arg == L"--startup-entries" && hasValue) {
+            JobFile::applyOption("startup_entries", args[++i], job, error);
+        } else if (arg == L"--depends" && hasValue) {
+            JobFile::applyOption("depends", args[++i], job, error);
+        } else if (arg == L"--max-parallel" && hasValue) {
+            JobFile::applyOption("max_parallel", args[++i], job, error);
+        } else if ((arg == L"-j" || arg == L"--threads") && hasValue) {
+            threads = static_cast<size_t>(std::wcstoul(args[++i].c_str(), nullptr, 10));
+        } else if (!arg.empty() && arg[0] == L'-') {
+            error = "unknown or incomplete option " + FileIO::toUtf8(arg);
+        } else {
+            deltas.push_back(arg);
+        }
+
+        if (!error.empty()) {
+            return fail(error);
+        }
+    }
+
+    if (basePath.empty() || deltas.size() != 1 || job.options.outputPath.empty()) {
+        printUsage();
+        return fail("apply needs --base, -o and one delta bundle");
+    }
+
+    BundleReader base;
+    BundleReader delta;
+    if (!base.open(basePath)) {
+        return fail(FileIO::toUtf8(basePath) + ": " + base.error());
+    }
+    if (!delta.open(deltas[0]) || !delta.setBase(base)) {
+        return fail(FileIO::toUtf8(deltas[0]) + ": " + delta.error());
+    }
+
+    // Same names, order and contents as the full build, so with the same
+    // options the pipeline writes the same bundle
+    const ManifestView& manifest = delta.manifest();
+    std::vector<ManifestRecord> records(manifest.entryCount());
+    for (uint32_t i = 0; i < manifest.entryCount(); i++) {
+        if (!manifest.entry(i, records[i])) {
+            return fail(FileIO::toUtf8(deltas[0]) + ": corrupt record " + std::to_string(i));
+        }
+        job.inputs.push_back(manifest.string(records[i].path));
+    }
+    job.options.waitForPrevious = manifest.waitForPrevious();
+
+    PackEngine engine(threads);
+    PackResult result;
+    DeltaSource source(delta, records);
+    if (!engine.pack(job.inputs, job.options, result, false, &source)) {
+        std::fprintf(stderr, "FAILED %s: %s\n", FileIO::toUtf8(job.options.outputPath).c_str(),
+                     result.error.c_str());
+        return 1;
+    }
+
+    if (!quiet) {
+        std::printf("%s (%.1f KB, %.2f s, %u entries from %s + %s)\n",
+                    FileIO::toUtf8(job.options.outputPath).c_str(), result.outputSize / 1024.0,
+                    result.seconds, manifest.entryCount(), FileIO::toUtf8(basePath).c_str(),
+                    FileIO::toUtf8(deltas[0]).c_str());
+    }
+    return 0;
+}
+
+int commandWatch(const std::vector<std::wstring>& args) {
+    JobSpec job;
+    size_t threads = 0;
+    int debounceMs = 300;
+    bool quiet = false;
+    bool stats = false;
+    IoBackendKind io = IoBackendKind::AUTO;
+
+    for (size_t i = 0; i < args.size(); i++) {
+        const std::wstring& arg = args[i];
+        bool hasValue = i + 1 < args.size();
+        std::string error;
+
+        if (arg == L"-h" || arg == L"--help") {
+            printUsage();
+            return 0;
+        } else if (arg == L"-q" || arg == L"--quiet") {
+            quiet = true;
+        } else if (arg == L"--stats") {
+            stats = true;
+        } else if (arg == L"--debounce" && hasValue) {
+            debounceMs = static_cast<int>(std::wcstol(args[++i].c_str(), nullptr, 10));
+            if (debounceMs < 0) {
+                error = "--debounce must not be negative";
+            }
+        } else if ((arg == L"-o" || arg == L"--output") && hasValue) {
+            JobFile::applyOption("output", args[++i], job, error);
+        } else if (arg == L"--stub" && hasValue) {
+            JobFile::applyOption("stub", args[++i], job, error);
+        } else if (arg == L"--type" && hasValue) {
+            JobFile::applyOption("type", args[++i], job, error);
+        } else if (arg == L"--layout" && hasValue) {
+            JobFile::applyOption("layout", args[++i], job, error);
+        } else if (arg == L"--compression" && hasValue) {
+            JobFile::applyOption("compression", args[++i], job, error);
+        } else if (arg == L"--codec-search") {
+            job.options.codecSearch.enabled = true;
+        } else if (arg == L"--time-budget" && hasValue) {
+            JobFile::applyOption("time_budget", args[++i], job, error);
+        } else if (arg == L"--min-decode-speed" && hasValue) {
+            JobFile::applyOption("min_decode_speed", args[++i], job, error);
+        } else if (arg == L"--no-sparse") {
+            job.options.sparse = false;
+        } else if (arg == L"--expand-archives") {
+            job.options.expandArchives = true;
+        } else if (arg == L"--startup-entries" && hasValue) {
+            JobFile::applyOption("startup_entries", args[++i], job, error);
+        } else if (arg == L"--depends" && hasValue) {
+            JobFile::applyOption("depends", args[++i], job, error);
+        } else if (arg == L"--max-parallel" && hasValue) {
+            JobFile::applyOption("max_parallel", args[++i], job, error);
+        } else if (arg == L"--no-wait") {
+            job.options.waitForPrevious = false;
+        } else if ((arg == L"-j" || arg == L"--threads") && hasValue) {
+            threads = static_cast<size_t>(std::wcstoul(args[++i].c_str(), nullptr, 10));
+        } else if (arg == L"--io" && hasValue) {
+            const std::wstring& backend = args[++i];
+            if (backend == L"auto") {
+                io = IoBackendKind::AUTO;
+            } else if (backend == L"threads") {
+                io = IoBackendKind::THREADS;
+            } else if (backend == L"uring") {
+                io = IoBackendKind::URING;
+            } else {
+                error = "--io must be auto, threads or uring";
+            }
+        } else if (!arg.empty() && arg[0] == L'-') {
+            error = "unknown or incomplete option " + FileIO::toUtf8(arg);
+        } else {
+            job.inputs.push_back(arg);
+        }
+
+        if (!error.empty()) {
+            return fail(error);
+        }
+    }
+
+    std::string error;
+    if (!JobFile::validate(job, error)) {
+        printUsage();
+        return fail(error);
+    }
+
+    // A file inside an archive changes with the archive. A new stub changes
+    // every byte before the payload, so it means a full build.
+    std::vector<std::wstring> watched = job.inputs;
+    for (std::wstring& path : watched) {
+        std::wstring archivePath;
+        std::string name;
+        if (ArchiveReader::splitMemberPath(path, archivePath, name)) {
+            path = archivePath;
+        }
+    }
+    if (!job.options.stubPath.empty()) {
+        watched.push_back(job.options.stubPath);
+    }
+    InputWatcher watcher;
+    if (!watcher.watch(watched, error)) {
+        return fail(error);
+    }
+
+    if (io == IoBackendKind::URING && !IoBackend::uringAvailable()) {
+        return fail("io_uring is not available on this system");
+    }
+    PackEngine engine(threads, BufferPool::DEFAULT_RETAIN_LIMIT, io);
+    std::string output = FileIO::toUtf8(job.options.outputPath);
+    PackResult result;
+
+    // Start from a bundle built with exactly these options
+    if (!engine.pack(job.inputs, job.options, result)) {
+        std::fprintf(stderr, "FAILED %s: %s\n", output.c_str(), result.error.c_str());
+    } else if (!quiet) {
+        std::printf("%s (%.1f KB, %.2f s)\n", output.c_str(), result.outputSize / 1024.0,
+                    result.seconds);
+    }
+
+    std::signal(SIGINT, stopWatching);
+    std::signal(SIGTERM, stopWatching);
+    if (!quiet) {
+        std::printf("watching %zu file(s) with %s, Ctrl+C to stop\n", watched.size(),
+                    watcher.method());
+    }
+
+    // Inputs changed since the last good build; a failed update keeps them
+    std::vector<bool> pending(job.inputs.size(), false);
+    bool stubChanged = false;
+    std::vector<size_t> changed;
+
+    while (watcher.wait(debounceMs, changed, g_stopWatching)) {
+        std::vector<size_t> inputs;
+        for (size_t index : changed) {
+            if (index < job.inputs.size()) {
+                pending[index] = true;
+            } else {
+                stubChanged = true;
+            }
+        }
+        for (size_t i = 0; i < pending.size(); i++) {
+            if (pending[i]) {
+                inputs.push_back(i);
+            }
+        }
+
+        bool ok = stubChanged ? engine.pack(job.inputs, job.options, result)
+                              : engine.update(job.inputs, job.options, inputs, result);
+        if (!ok) {
+            std::fprintf(stderr, "FAILED %s: %s\n", output.c_str(), result.error.c_str());
+            continue;
+        }
+        pending.assign(pending.size(), false);
+
+        if (!quiet && stubChanged) {
+            std::printf("%s rebuilt for the new stub (%.1f KB, %.2f s)\n", output.c_str(),
+                        result.outputSize / 1024.0, result.seconds);
+        } else if (!quiet && !result.update.rebuildReason.empty()) {
+            std::printf("%s rebuilt, %s (%.1f KB, %.2f s)\n", output.c_str(),
+                        result.update.rebuildReason.c_str(), result.outputSize / 1024.0,
+                        result.seconds);
+        } else if (!quiet) {
+            const UpdateStats& update = result.update;
+            std::printf("%s updated: %zu changed, %" PRIu64 " re-encoded, %.1f KB appended "
+                        "(%.1f KB, %.2f s)\n", output.c_str(), inputs.size(), update.encoded,
+                        update.appendedBytes / 1024.0, result.outputSize / 1024.0,
+                        result.seconds);
+        }
+        if (stats) {
+            printStages(result);
+            if (result.update.rebuildReason.empty() && !stubChanged) {
+                std::printf("  %.1f KB of replaced data left in the bundle\n",
+                            result.update.deadBytes / 1024.0);
+            }
+        }
+        stubChanged = false;
+    }
+
+    if (!quiet) {
+        std::printf("stopped watching\n");
+    }
+    return 0;
+}
+
+int runCli(const std::vector<std::wstring>& args) {
+    std::vector<std::wstring> rest(args.begin() + (args.empty() ? 0 : 1), args.end());
+    if (!args.empty() && args[0] == L"pack") {
+        return commandPack(rest);
+    }
+    if (!args.empty() && args[0] == L"inspect") {
+        return commandInspect(rest);
+    }
+    if (!args.empty() && args[0] == L"verify") {
+        return commandVerify(rest);
+    }
+    if (!args.empty() && args[0] == L"apply") {
+        return commandApply(rest);
+    }
+    if (!args.empty() && args[0] == L"watch") {
+        return commandWatch(rest);
+    }
+    return commandPack(args);
+}
+
+} // namespace
+
+#ifdef _WIN32
+int wmain(int argc, wchar_t* argv[]) {
+    return runCli(std::vector<std::wstring>(argv + 1, argv + argc));
+}
+#else
+int main(int argc, char* argv[]) {
+    std::vector<std::wstring> args;
+    for (int i = 1; i < argc; i++) {
+        args.push_back(FileIO::fromUtf8(argv[i]));
+    }
+    return runCli(args);
+}
+#endif
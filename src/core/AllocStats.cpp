@@ -0,0 +1,180 @@
+#include "AllocStats.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace Packer {
+
+namespace {
+
+const char* const STAGE_NAMES[ALLOC_STAGE_COUNT] = {
+    "other", "read", "sniff", "hash", "encode", "manifest", "write"
+};
+
+#ifdef PACKER_ALLOC_STATS
+
+// Every block carries its size and stage in front of it, so frees are
+// charged to the stage that allocated, whichever thread releases them.
+// 16 bytes keeps malloc's alignment for the caller.
+struct BlockHeader {
+    uint64_t size;
+    uint32_t stage;
+    uint32_t counted;           // Allocated while accounting was enabled
+};
+
+static_assert(sizeof(BlockHeader) == 16, "header must preserve malloc alignment");
+
+struct StageCounters {
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> reallocCopies;
+    std::atomic<uint64_t> reallocBytes;
+    std::atomic<int64_t> live;
+    std::atomic<int64_t> peakLive;
+};
+
+std::atomic<bool> g_enabled(false);
+StageCounters g_counters[ALLOC_STAGE_COUNT];
+
+// Vector growth allocates the larger buffer, copies, then frees the old one
+// on the same thread. A free of a smaller block right after an allocation
+// is counted as such a copy.
+thread_local uint64_t t_lastAllocation = 0;
+
+void* allocate(size_t size) {
+    void* raw = std::malloc(sizeof(BlockHeader) + (size ? size : 1));
+    BlockHeader* header = static_cast<BlockHeader*>(raw);
+    if (!header) {
+        return nullptr;
+    }
+    
+    header->size = size;
+    header->stage = AllocStats::currentStage();
+    header->counted = g_enabled.load(std::memory_order_relaxed) ? 1 : 0;
+    
+    if (header->counted) {
+        StageCounters& counters = g_counters[header->stage];
+        counters.allocations.fetch_add(1, std::memory_order_relaxed);
+        counters.bytes.fetch_add(size, std::memory_order_relaxed);
+        
+        int64_t delta = static_cast<int64_t>(size);
+        int64_t live = counters.live.fetch_add(delta, std::memory_order_relaxed) + delta;
+        int64_t peak = counters.peakLive.load(std::memory_order_relaxed);
+        while (live > peak &&
+               !counters.peakLive.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+        }
+        t_lastAllocation = size;
+    }
+    
+    return header + 1;
+}
+
+void release(void* block) {
+    if (!block) {
+        return;
+    }
+    
+    BlockHeader* header = static_cast<BlockHeader*>(block) - 1;
+    if (header->counted) {
+        StageCounters& counters = g_counters[header->stage];
+        counters.live.fetch_sub(static_cast<int64_t>(header->size), std::memory_order_relaxed);
+        
+        if (header->size > 0 && header->size < t_lastAllocation) {
+            counters.reallocCopies.fetch_add(1, std::memory_order_relaxed);
+            counters.reallocBytes.fetch_add(header->size, std::memory_order_relaxed);
+        }
+        t_lastAllocation = 0;
+    }
+    
+    std::free(header);
+}
+
+#endif // PACKER_ALLOC_STATS
+
+} // namespace
+
+bool AllocStats::available() {
+#ifdef PACKER_ALLOC_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AllocStats::enable() {
+#ifdef PACKER_ALLOC_STATS
+    g_enabled.store(true, std::memory_order_relaxed);
+#endif
+}
+
+void AllocStats::snapshot(AllocCounters (&counters)[ALLOC_STAGE_COUNT]) {
+    for (int stage = 0; stage < ALLOC_STAGE_COUNT; stage++) {
+        AllocCounters& out = counters[stage];
+        out = AllocCounters();
+        out.name = STAGE_NAMES[stage];
+#ifdef PACKER_ALLOC_STATS
+        const StageCounters& in = g_counters[stage];
+        out.allocations = in.allocations.load(std::memory_order_relaxed);
+        out.bytes = in.bytes.load(std::memory_order_relaxed);
+        out.reallocCopies = in.reallocCopies.load(std::memory_order_relaxed);
+        out.reallocBytes = in.reallocBytes.load(std::memory_order_relaxed);
+        out.peakLive = static_cast<uint64_t>(in.peakLive.load(std::memory_order_relaxed));
+#endif
+    }
+}
+
+const char* AllocStats::stageName(AllocStage stage) {
+    return stage < ALLOC_STAGE_COUNT ? STAGE_NAMES[stage] : "?";
+}
+
+} // namespace Packer
+
+#ifdef PACKER_ALLOC_STATS
+
+// Replacements for the global allocation functions. The aligned forms are
+// left alone; they allocate separately and are only used for over-aligned types.
+void* operator new(size_t size) {
+    void* block = Packer::allocate(size);
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    return block;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return Packer::allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return Packer::allocate(size);
+}
+
+void operator delete(void* block) noexcept {
+    Packer::release(block);
+}
+
+void operator delete[](void* block) noexcept {
+    Packer::release(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    Packer::release(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+    Packer::release(block);
+}
+
+void operator delete(void* block, const std::nothrow_t&) noexcept {
+    Packer::release(block);
+}
+
+void operator delete[](void* block, const std::nothrow_t&) noexcept {
+    Packer::release(block);
+}
+
+#endif // PACKER_ALLOC_STATS
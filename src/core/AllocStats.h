@@ -0,0 +1,74 @@
+#ifndef ALLOCSTATS_H
+#define ALLOCSTATS_H
+
+#include <cstdint>
+
+namespace Packer {
+
+// Heap accounting per build stage. Builds compiled with PACKER_ALLOC_STATS
+// replace the global operator new/delete and, once enabled, charge every
+// allocation to the stage the allocating thread is in (ALLOC_SCOPE below).
+// Other builds keep the scopes but never count anything.
+enum AllocStage {
+    ALLOC_STAGE_OTHER,
+    ALLOC_STAGE_READ,
+    ALLOC_STAGE_SNIFF,
+    ALLOC_STAGE_HASH,
+    ALLOC_STAGE_ENCODE,
+    ALLOC_STAGE_MANIFEST,
+    ALLOC_STAGE_WRITE,
+    ALLOC_STAGE_COUNT
+};
+
+struct AllocCounters {
+    const char* name;
+    uint64_t allocations;
+    uint64_t bytes;             // Requested, summed over allocations
+    uint64_t reallocCopies;     // Buffers replaced by a larger one (vector growth)
+    uint64_t reallocBytes;      // Size of the replaced buffers, i.e. bytes copied
+    uint64_t peakLive;          // Most bytes held at once by this stage's allocations
+};
+
+class AllocStats {
+public:
+    // False unless built with PACKER_ALLOC_STATS
+    static bool available();
+    
+    // Start counting; blocks allocated earlier are ignored when freed
+    static void enable();
+    
+    // One entry per AllocStage
+    static void snapshot(AllocCounters (&counters)[ALLOC_STAGE_COUNT]);
+    
+    static const char* stageName(AllocStage stage);
+    
+    // Stage of the calling thread
+    static AllocStage& currentStage() {
+        thread_local AllocStage stage = ALLOC_STAGE_OTHER;
+        return stage;
+    }
+};
+
+// Charges the calling thread's allocations to a stage for its scope
+class AllocScope {
+public:
+    explicit AllocScope(AllocStage stage) : m_previous(AllocStats::currentStage()) {
+        AllocStats::currentStage() = stage;
+    }
+    
+    ~AllocScope() { AllocStats::currentStage() = m_previous; }
+    
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+
+private:
+    AllocStage m_previous;
+};
+
+} // namespace Packer
+
+#define PACKER_ALLOC_CONCAT2(a, b) a##b
+#define PACKER_ALLOC_CONCAT(a, b) PACKER_ALLOC_CONCAT2(a, b)
+#define ALLOC_SCOPE(stage) ::Packer::AllocScope PACKER_ALLOC_CONCAT(allocScope_, __LINE__)(stage)
+
+#endif // ALLOCSTATS_H
@@ -0,0 +1,575 @@
+#include "ArchiveReader.h"
+#include "Codec.h"
+#include "FileIO.h"
+#include "../utils/FileTypeDetector.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <cwctype>
+#include <fstream>
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace Packer {
+
+namespace {
+
+const wchar_t MEMBER_SEPARATOR[] = L"!/";
+
+const uint32_t ZIP_LOCAL_HEADER = 0x04034b50;
+const uint32_t ZIP_CENTRAL_HEADER = 0x02014b50;
+const uint32_t ZIP_END = 0x06054b50;
+const uint32_t ZIP64_END = 0x06064b50;
+const uint32_t ZIP64_LOCATOR = 0x07064b50;
+const size_t ZIP_LOCAL_SIZE = 30;
+const size_t ZIP_CENTRAL_SIZE = 46;
+const size_t ZIP_END_SIZE = 22;
+const size_t ZIP64_END_SIZE = 56;
+const size_t ZIP64_LOCATOR_SIZE = 20;
+const size_t ZIP_MAX_COMMENT = 0xFFFF;
+const uint16_t ZIP_FLAG_ENCRYPTED = 0x0001;
+
+const size_t TAR_BLOCK = 512;
+
+uint16_t read16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t read32(const uint8_t* p) {
+    return static_cast<uint32_t>(read16(p)) | (static_cast<uint32_t>(read16(p + 2)) << 16);
+}
+
+uint64_t read64(const uint8_t* p) {
+    return static_cast<uint64_t>(read32(p)) | (static_cast<uint64_t>(read32(p + 4)) << 32);
+}
+
+uint32_t crc32Of(const uint8_t* data, size_t size) {
+#ifdef USE_ZLIB
+    uLong crc = crc32(0L, Z_NULL, 0);
+    while (size > 0) {
+        uInt chunk = static_cast<uInt>(size < 0x40000000 ? size : 0x40000000);
+        crc = crc32(crc, data, chunk);
+        data += chunk;
+        size -= chunk;
+    }
+    return static_cast<uint32_t>(crc);
+#else
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> entries;
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++) {
+                value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            }
+            entries[i] = value;
+        }
+        return entries;
+    }();
+    
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+#endif
+}
+
+// Raw deflate into exactly outSize bytes; zlib's inflater when compiled in,
+// as it is several times faster than the stub's
+bool inflateMember(const uint8_t* in, size_t inSize, uint8_t* out, size_t outSize) {
+#ifdef USE_ZLIB
+    z_stream stream = {};
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        return false;
+    }
+    // zlib refuses a null output even for an empty member
+    uint8_t none = 0;
+    stream.next_in = const_cast<Bytef*>(in);
+    stream.next_out = outSize != 0 ? out : &none;
+    int status = Z_OK;
+    size_t inLeft = inSize;
+    size_t outLeft = outSize;
+    while (status == Z_OK) {
+        // avail_* are 32-bit; feed members over 4 GB in slices
+        if (stream.avail_in == 0 && inLeft > 0) {
+            stream.avail_in = static_cast<uInt>(inLeft < 0x40000000 ? inLeft : 0x40000000);
+            inLeft -= stream.avail_in;
+        }
+        if (stream.avail_out == 0 && outLeft > 0) {
+            stream.avail_out = static_cast<uInt>(outLeft < 0x40000000 ? outLeft : 0x40000000);
+            outLeft -= stream.avail_out;
+        }
+        status = inflate(&stream, Z_NO_FLUSH);
+    }
+    bool complete = status == Z_STREAM_END && stream.avail_out == 0 && outLeft == 0;
+    inflateEnd(&stream);
+    return complete;
+#else
+    return decodeDeflate(in, inSize, out, outSize);
+#endif
+}
+
+// NUL-terminated string in a fixed-width header field
+std::string tarString(const uint8_t* field, size_t width) {
+    size_t length = 0;
+    while (length < width && field[length] != 0) {
+        length++;
+    }
+    return std::string(reinterpret_cast<const char*>(field), length);
+}
+
+// Octal, or GNU base-256 when the top bit of the first byte is set
+bool tarNumber(const uint8_t* field, size_t width, uint64_t& value) {
+    value = 0;
+    if (field[0] & 0x80) {
+        value = field[0] & 0x7F;
+        for (size_t i = 1; i < width; i++) {
+            if (value >> 56) {
+                return false;
+            }
+            value = (value << 8) | field[i];
+        }
+        return true;
+    }
+    
+    size_t i = 0;
+    while (i < width && field[i] == ' ') {
+        i++;
+    }
+    for (; i < width && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = (value << 3) | static_cast<uint64_t>(field[i] - '0');
+    }
+    return i == width || field[i] == 0 || field[i] == ' ';
+}
+
+// Header checksum: every byte summed, the checksum field counted as spaces
+bool tarHeaderValid(const uint8_t* header) {
+    uint64_t expected;
+    if (!tarNumber(header + 148, 8, expected)) {
+        return false;
+    }
+    uint64_t sum = 0;
+    for (size_t i = 0; i < TAR_BLOCK; i++) {
+        sum += (i >= 148 && i < 156) ? ' ' : header[i];
+    }
+    return sum == expected;
+}
+
+bool allZero(const uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Archive names become entry names: no leading "./" or "/"
+std::string cleanName(std::string name) {
+    while (name.compare(0, 2, "./") == 0) {
+        name.erase(0, 2);
+    }
+    size_t first = name.find_first_not_of('/');
+    return first == std::string::npos ? std::string() : name.substr(first);
+}
+
+uint64_t roundToBlock(uint64_t size) {
+    return (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+}
+
+} // namespace
+
+ArchiveReader::ArchiveReader() : m_zip(false) {
+}
+
+bool ArchiveReader::isArchive(const std::wstring& path) {
+    std::wstring extension = FileTypeDetector::getExtension(path);
+    for (wchar_t& c : extension) {
+        c = static_cast<wchar_t>(std::towlower(c));
+    }
+    return extension == L"zip" || extension == L"tar";
+}
+
+bool ArchiveReader::open(const std::wstring& archivePath) {
+    m_path = archivePath;
+    m_error.clear();
+    m_members.clear();
+    m_byName.clear();
+    m_zip = false;
+    
+    uint64_t fileSize = 0;
+    std::vector<uint8_t> header;
+    if (!FileIO::fileSize(archivePath, fileSize)) {
+        m_error = "cannot open archive";
+        return false;
+    }
+    
+    // A TAR starts with a header whose checksum adds up; a ZIP is found
+    // from its end record
+    bool tar = fileSize >= TAR_BLOCK && FileIO::readRange(archivePath, 0, TAR_BLOCK, header) &&
+               tarHeaderValid(header.data());
+    m_zip = !tar;
+    if (!(tar ? openTar(fileSize) : openZip(fileSize))) {
+        m_members.clear();
+        return false;
+    }
+    
+    // A name stored twice (a TAR appended to) means its last copy
+    for (size_t i = 0; i < m_members.size(); i++) {
+        m_byName[m_members[i].name] = i;
+    }
+    return true;
+}
+
+bool ArchiveReader::openZip(uint64_t fileSize) {
+    // The end record is the last 22 bytes but for a comment of up to 64 KB
+    size_t tailSize = static_cast<size_t>(std::min<uint64_t>(fileSize, ZIP_END_SIZE + ZIP_MAX_COMMENT));
+    std::vector<uint8_t> tail;
+    if (tailSize < ZIP_END_SIZE || !FileIO::readRange(m_path, fileSize - tailSize, tailSize, tail)) {
+        m_error = "not a ZIP or TAR archive";
+        return false;
+    }
+    
+    // Nearest the end first; the record's comment length must reach exactly
+    // to the end of the file, so a signature inside a comment is not taken
+    size_t end = tailSize - ZIP_END_SIZE;
+    while (read32(tail.data() + end) != ZIP_END ||
+           read16(tail.data() + end + 20) != tailSize - end - ZIP_END_SIZE) {
+        if (end == 0) {
+            m_error = "not a ZIP or TAR archive";
+            return false;
+        }
+        end--;
+    }
+    
+    const uint8_t* record = tail.data() + end;
+    uint64_t count = read16(record + 10);
+    uint64_t directorySize = read32(record + 12);
+    uint64_t directoryOffset = read32(record + 16);
+    
+    // ZIP64: the real values are in a second end record, found through the
+    // locator right before the first
+    uint64_t endOffset = fileSize - tailSize + end;
+    if ((count == 0xFFFF || directorySize == 0xFFFFFFFF || directoryOffset == 0xFFFFFFFF) &&
+        end >= ZIP64_LOCATOR_SIZE && read32(record - ZIP64_LOCATOR_SIZE) == ZIP64_LOCATOR) {
+        uint64_t end64Offset = read64(record - ZIP64_LOCATOR_SIZE + 8);
+        std::vector<uint8_t> end64;
+        if (end64Offset > endOffset || !FileIO::readRange(m_path, end64Offset, ZIP64_END_SIZE, end64) ||
+            read32(end64.data()) != ZIP64_END) {
+            m_error = "corrupt ZIP64 end record";
+            return false;
+        }
+        count = read64(end64.data() + 32);
+        directorySize = read64(end64.data() + 40);
+        directoryOffset = read64(end64.data() + 48);
+        endOffset = end64Offset;
+    }
+    
+    std::vector<uint8_t> directory;
+    if (directoryOffset > endOffset || directorySize > endOffset - directoryOffset ||
+        directorySize > SIZE_MAX || count > directorySize / ZIP_CENTRAL_SIZE ||
+        !FileIO::readRange(m_path, directoryOffset, static_cast<size_t>(directorySize), directory)) {
+        m_error = "corrupt ZIP central directory";
+        return false;
+    }
+    
+    size_t pos = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        const uint8_t* entry = directory.data() + pos;
+        if (directory.size() - pos < ZIP_CENTRAL_SIZE || read32(entry) != ZIP_CENTRAL_HEADER) {
+            m_error = "corrupt ZIP central directory";
+            return false;
+        }
+        uint16_t flags = read16(entry + 8);
+        uint16_t method = read16(entry + 10);
+        size_t nameLength = read16(entry + 28);
+        size_t extraLength = read16(entry + 30);
+        size_t commentLength = read16(entry + 32);
+        if (directory.size() - pos - ZIP_CENTRAL_SIZE < nameLength + extraLength + commentLength) {
+            m_error = "corrupt ZIP central directory";
+            return false;
+        }
+        
+        // Names are kept as stored: UTF-8 when flag bit 11 says so, and in
+        // practice ASCII otherwise
+        ArchiveMember member;
+        member.name = std::string(reinterpret_cast<const char*>(entry + ZIP_CENTRAL_SIZE), nameLength);
+        member.method = method;
+        member.crc = read32(entry + 16);
+        member.storedSize = read32(entry + 20);
+        member.size = read32(entry + 24);
+        member.offset = read32(entry + 42);
+        
+        // Sizes and offset that did not fit come from the ZIP64 extra field,
+        // in this order, only those that overflowed
+        const uint8_t* extra = entry + ZIP_CENTRAL_SIZE + nameLength;
+        for (size_t e = 0; e + 4 <= extraLength;) {
+            uint16_t id = read16(extra + e);
+            size_t size = read16(extra + e + 2);
+            if (size > extraLength - e - 4) {
+                break;
+            }
+            if (id == 0x0001) {
+                const uint8_t* field = extra + e + 4;
+                const uint8_t* fieldEnd = field + size;
+                uint64_t* values[3] = { &member.size, &member.storedSize, &member.offset };
+                for (uint64_t* value : values) {
+                    if (*value == 0xFFFFFFFF && fieldEnd - field >= 8) {
+                        *value = read64(field);
+                        field += 8;
+                    }
+                }
+            }
+            e += 4 + size;
+        }
+        pos += ZIP_CENTRAL_SIZE + nameLength + extraLength + commentLength;
+        
+        member.name = cleanName(member.name);
+        if (member.name.empty() || member.name.back() == '/') {
+            continue;   // Directory
+        }
+        if (flags & ZIP_FLAG_ENCRYPTED) {
+            m_error = member.name + " is encrypted";
+            return false;
+        }
+        if (method != ARCHIVE_STORED && method != ARCHIVE_DEFLATED) {
+            m_error = member.name + " uses compression method " + std::to_string(method) +
+                      "; only stored and deflated members can be read";
+            return false;
+        }
+        if (member.offset >= directoryOffset || member.storedSize > directoryOffset - member.offset ||
+            (method == ARCHIVE_STORED && member.storedSize != member.size)) {
+            m_error = "corrupt ZIP entry " + member.name;
+            return false;
+        }
+        m_members.push_back(member);
+    }
+    return true;
+}
+
+bool ArchiveReader::openTar(uint64_t fileSize) {
+    std::ifstream file(FileIO::nativePath(m_path), std::ios::binary);
+    if (!file.is_open()) {
+        m_error = "cannot open archive";
+        return false;
+    }
+    
+    // GNU long names and pax records apply to the header that follows them
+    std::string longName;
+    std::string paxPath;
+    bool hasPaxSize = false;
+    uint64_t paxSize = 0;
+    
+    uint8_t header[TAR_BLOCK];
+    uint64_t offset = 0;
+    while (offset + TAR_BLOCK <= fileSize) {
+        file.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+        if (!file.read(reinterpret_cast<char*>(header), TAR_BLOCK)) {
+            m_error = "cannot read TAR header";
+            return false;
+        }
+        if (allZero(header, TAR_BLOCK)) {
+            break;      // End of archive
+        }
+        if (!tarHeaderValid(header)) {
+            m_error = "corrupt TAR header at offset " + std::to_string(offset);
+            return false;
+        }
+        
+        uint64_t size = 0;
+        if (!tarNumber(header + 124, 12, size)) {
+            m_error = "corrupt TAR header at offset " + std::to_string(offset);
+            return false;
+        }
+        char type = static_cast<char>(header[156]);
+        if (hasPaxSize && type != 'x' && type != 'g' && type != 'L') {
+            size = paxSize;
+        }
+        
+        uint64_t dataOffset = offset + TAR_BLOCK;
+        if (size > fileSize - dataOffset) {
+            m_error = "truncated TAR member at offset " + std::to_string(offset);
+            return false;
+        }
+        offset = dataOffset + roundToBlock(size);
+        
+        if (type == 'L' || type == 'x') {
+            std::vector<uint8_t> text;
+            if (size > (1u << 20) || !FileIO::readRange(m_path, dataOffset, static_cast<size_t>(size), text)) {
+                m_error = "corrupt TAR extended header";
+                return false;
+            }
+            if (type == 'L') {
+                longName = tarString(text.data(), text.size());
+                continue;
+            }
+            
+            // pax records: "<length> <key>=<value>\n"
+            for (size_t pos = 0; pos < text.size();) {
+                size_t space = pos;
+                size_t length = 0;
+                while (space < text.size() && text[space] >= '0' && text[space] <= '9') {
+                    length = length * 10 + (text[space++] - '0');
+                }
+                if (space == text.size() || text[space] != ' ' || length <= space - pos ||
+                    length > text.size() - pos) {
+                    break;
+                }
+                std::string record(reinterpret_cast<const char*>(text.data()) + space + 1,
+                                   length - (space + 1 - pos) - 1);
+                size_t equals = record.find('=');
+                if (equals != std::string::npos) {
+                    std::string key = record.substr(0, equals);
+                    if (key == "path") {
+                        paxPath = record.substr(equals + 1);
+                    } else if (key == "size") {
+                        paxSize = std::strtoull(record.c_str() + equals + 1, nullptr, 10);
+                        hasPaxSize = true;
+                    }
+                }
+                pos += length;
+            }
+            continue;
+        }
+        
+        std::string name;
+        if (!paxPath.empty()) {
+            name = paxPath;
+        } else if (!longName.empty()) {
+            name = longName;
+        } else {
+            name = tarString(header, 100);
+            std::string prefix = tarString(header + 345, 155);
+            if (std::memcmp(header + 257, "ustar", 5) == 0 && !prefix.empty()) {
+                name = prefix + "/" + name;
+            }
+        }
+        longName.clear();
+        paxPath.clear();
+        hasPaxSize = false;
+        
+        if (type == 'S') {
+            m_error = "sparse TAR members are not supported (" + name + ")";
+            return false;
+        }
+        
+        // Regular files only; links, directories and devices carry no data
+        // of their own
+        name = cleanName(name);
+        if ((type != '0' && type != '\0' && type != '7') || name.empty() || name.back() == '/') {
+            continue;
+        }
+        
+        ArchiveMember member;
+        member.name = name;
+        member.offset = dataOffset;
+        member.storedSize = size;
+        member.size = size;
+        m_members.push_back(member);
+    }
+    return true;
+}
+
+bool ArchiveReader::find(const std::string& name, size_t& index) const {
+    auto it = m_byName.find(name);
+    if (it == m_byName.end()) {
+        return false;
+    }
+    index = it->second;
+    return true;
+}
+
+bool ArchiveReader::zipDataOffset(const ArchiveMember& member, uint64_t& offset,
+                                  std::string& error) const {
+    // The local header repeats the name but may have its own extra field
+    std::vector<uint8_t> local;
+    if (!FileIO::readRange(m_path, member.offset, ZIP_LOCAL_SIZE, local) ||
+        read32(local.data()) != ZIP_LOCAL_HEADER) {
+        error = "corrupt local header for " + member.name;
+        return false;
+    }
+    offset = member.offset + ZIP_LOCAL_SIZE + read16(local.data() + 26) + read16(local.data() + 28);
+    return true;
+}
+
+bool ArchiveReader::readMember(size_t index, std::vector<uint8_t>& data, std::string& error) const {
+    const ArchiveMember& member = m_members[index];
+    if (member.size > SIZE_MAX || member.storedSize > SIZE_MAX) {
+        error = member.name + " is too large for this platform";
+        return false;
+    }
+    
+    uint64_t offset = member.offset;
+    if (m_zip && !zipDataOffset(member, offset, error)) {
+        return false;
+    }
+    
+    // Stored members are read straight into the caller's buffer
+    size_t size = static_cast<size_t>(member.size);
+    if (member.method == ARCHIVE_STORED) {
+        if (!FileIO::readRange(m_path, offset, size, data)) {
+            error = "cannot read " + member.name;
+            return false;
+        }
+    } else {
+        std::vector<uint8_t> stored;
+        if (!FileIO::readRange(m_path, offset, static_cast<size_t>(member.storedSize), stored)) {
+            error = "cannot read " + member.name;
+            return false;
+        }
+        data.resize(size);
+        if (!inflateMember(stored.data(), stored.size(), data.data(), size)) {
+            error = "corrupt deflate data in " + member.name;
+            return false;
+        }
+    }
+    
+    if (m_zip && crc32Of(data.data(), data.size()) != member.crc) {
+        error = "CRC mismatch in " + member.name;
+        return false;
+    }
+    return true;
+}
+
+bool ArchiveReader::readPrefix(size_t index, size_t size, std::vector<uint8_t>& data,
+                               std::string& error) const {
+    const ArchiveMember& member = m_members[index];
+    if (member.method != ARCHIVE_STORED) {
+        if (!readMember(index, data, error)) {
+            return false;
+        }
+        data.resize(std::min(data.size(), size));
+        return true;
+    }
+    
+    uint64_t offset = member.offset;
+    if (m_zip && !zipDataOffset(member, offset, error)) {
+        return false;
+    }
+    size = static_cast<size_t>(std::min<uint64_t>(member.size, size));
+    if (!FileIO::readRange(m_path, offset, size, data)) {
+        error = "cannot read " + member.name;
+        return false;
+    }
+    return true;
+}
+
+std::wstring ArchiveReader::memberPath(const std::wstring& archivePath, const std::string& name) {
+    return archivePath + MEMBER_SEPARATOR + FileIO::fromUtf8(name);
+}
+
+bool ArchiveReader::splitMemberPath(const std::wstring& path, std::wstring& archivePath,
+                                    std::string& name) {
+    size_t separator = path.find(MEMBER_SEPARATOR);
+    if (separator == std::wstring::npos || separator == 0 || separator + 2 == path.size()) {
+        return false;
+    }
+    archivePath = path.substr(0, separator);
+    name = FileIO::toUtf8(path.substr(separator + 2));
+    return true;
+}
+
+} // namespace Packer
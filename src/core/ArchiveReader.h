@@ -0,0 +1,83 @@
+#ifndef ARCHIVEREADER_H
+#define ARCHIVEREADER_H
+
+#include "common.h"
+#include <unordered_map>
+
+namespace Packer {
+
+const uint32_t ARCHIVE_STORED   = 0;  // Member bytes as they are (all TAR members)
+const uint32_t ARCHIVE_DEFLATED = 8;  // Raw deflate stream, ZIP method 8
+
+// One regular file inside an archive
+struct ArchiveMember {
+    std::string name;        // Path inside the archive, '/'-separated
+    uint64_t offset;         // ZIP: its local header; TAR: its data
+    uint64_t storedSize;     // Bytes in the archive
+    uint64_t size;           // Bytes once extracted
+    uint32_t method;         // ARCHIVE_STORED or ARCHIVE_DEFLATED
+    uint32_t crc;            // ZIP only: CRC-32 of the extracted bytes
+    
+    ArchiveMember() : offset(0), storedSize(0), size(0), method(ARCHIVE_STORED), crc(0) {}
+};
+
+// Reads the files inside a ZIP or TAR archive without extracting it.
+// open() loads only the member index (ZIP central directory, TAR headers);
+// members are read on demand, stored ones straight from their byte range
+// and deflated ones inflated into the caller's buffer, so nothing is ever
+// written to disk. Directories, links and other special members are left
+// out; encrypted or otherwise unreadable ZIP members fail open().
+//
+// A member is named on its own by a member path, "archive.zip!/dir/a.exe",
+// which the builders accept wherever an input file path goes.
+class ArchiveReader {
+public:
+    ArchiveReader();
+    
+    // Whether a path names a ZIP or TAR archive (by extension) that
+    // --expand-archives should replace by its members
+    static bool isArchive(const std::wstring& path);
+    
+    // Load the member index; false (see error()) if this is not a ZIP or
+    // TAR archive, or one this reader cannot read
+    bool open(const std::wstring& archivePath);
+    
+    const std::string& error() const { return m_error; }
+    const std::wstring& path() const { return m_path; }
+    const std::vector<ArchiveMember>& members() const { return m_members; }
+    
+    // Member by name
+    bool find(const std::string& name, size_t& index) const;
+    
+    // The read calls below are safe to use from several threads.
+    
+    // Extracted bytes of a member, CRC-checked for ZIP
+    bool readMember(size_t index, std::vector<uint8_t>& data, std::string& error) const;
+    
+    // Its first size bytes (fewer for a shorter member). Deflated members
+    // are inflated whole first.
+    bool readPrefix(size_t index, size_t size, std::vector<uint8_t>& data,
+                    std::string& error) const;
+    
+    // "archive!/name" and back; split is false for an ordinary path
+    static std::wstring memberPath(const std::wstring& archivePath, const std::string& name);
+    static bool splitMemberPath(const std::wstring& path, std::wstring& archivePath,
+                                std::string& name);
+
+private:
+    bool openZip(uint64_t fileSize);
+    bool openTar(uint64_t fileSize);
+    
+    // Where a ZIP member's data starts, past its local header
+    bool zipDataOffset(const ArchiveMember& member, uint64_t& offset, std::string& error) const;
+    
+    std::wstring m_path;
+    std::string m_error;
+    std::vector<ArchiveMember> m_members;
+    std::unordered_map<std::string, size_t> m_byName;
+    bool m_zip;             // Else TAR
+};
+
+} // namespace Packer
+
+#endif // ARCHIVEREADER_H
@@ -0,0 +1,75 @@
+#include "ArchiveSource.h"
+#include "FileIO.h"
+
+namespace Packer {
+
+bool ArchiveSource::open(const std::vector<std::wstring>& inputs, bool expand, std::string& error) {
+    m_inputs.clear();
+    m_origins.clear();
+    m_members.clear();
+    m_archives.clear();
+    
+    for (size_t i = 0; i < inputs.size(); i++) {
+        Member member = { nullptr, 0 };
+        std::wstring archivePath;
+        std::string name;
+        
+        if (expand && ArchiveReader::isArchive(inputs[i])) {
+            member.archive = archive(inputs[i], error);
+            if (!member.archive) {
+                return false;
+            }
+            if (member.archive->members().empty()) {
+                error = FileIO::toUtf8(inputs[i]) + ": no files to pack";
+                return false;
+            }
+            for (size_t m = 0; m < member.archive->members().size(); m++) {
+                member.index = m;
+                m_inputs.push_back(ArchiveReader::memberPath(inputs[i],
+                                                             member.archive->members()[m].name));
+                m_origins.push_back(i);
+                m_members.push_back(member);
+            }
+            continue;
+        }
+        
+        if (ArchiveReader::splitMemberPath(inputs[i], archivePath, name)) {
+            member.archive = archive(archivePath, error);
+            if (!member.archive) {
+                return false;
+            }
+            if (!member.archive->find(name, member.index)) {
+                error = FileIO::toUtf8(archivePath) + ": no file " + name;
+                return false;
+            }
+        }
+        m_inputs.push_back(inputs[i]);
+        m_origins.push_back(i);
+        m_members.push_back(member);
+    }
+    return true;
+}
+
+const ArchiveReader* ArchiveSource::archive(const std::wstring& path, std::string& error) {
+    std::unique_ptr<ArchiveReader>& reader = m_archives[path];
+    if (!reader) {
+        reader.reset(new ArchiveReader());
+        if (!reader->open(path)) {
+            error = FileIO::toUtf8(path) + ": " + reader->error();
+            m_archives.erase(path);
+            return nullptr;
+        }
+    }
+    return reader.get();
+}
+
+bool ArchiveSource::provides(size_t index) const {
+    return m_members[index].archive != nullptr;
+}
+
+bool ArchiveSource::read(size_t index, std::vector<uint8_t>& data, std::string& error) {
+    const Member& member = m_members[index];
+    return member.archive->readMember(member.index, data, error);
+}
+
+} // namespace Packer
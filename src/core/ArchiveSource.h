@@ -0,0 +1,51 @@
+#ifndef ARCHIVESOURCE_H
+#define ARCHIVESOURCE_H
+
+#include "ArchiveReader.h"
+#include "BuildPipeline.h"
+#include <map>
+#include <memory>
+
+namespace Packer {
+
+// Reads the archive members among a build's inputs (member paths, see
+// ArchiveReader) straight from their archives, so nothing is extracted
+// to disk first. Every other input is left to the pipeline's own reads.
+class ArchiveSource : public InputSource {
+public:
+    // Take the inputs of a build. With expand, every input
+    // ArchiveReader::isArchive takes for an archive is replaced by the
+    // member paths of its files, in archive order. Each archive is opened
+    // once; false (see error) if one cannot be read or lacks a named member.
+    bool open(const std::vector<std::wstring>& inputs, bool expand, std::string& error);
+    
+    // The inputs to build from, archives expanded
+    const std::vector<std::wstring>& inputs() const { return m_inputs; }
+    
+    // Index of the input an expanded input came from
+    size_t origin(size_t index) const { return m_origins[index]; }
+    
+    // Whether no input is an archive member
+    bool empty() const { return m_archives.empty(); }
+    
+    bool provides(size_t index) const override;
+    bool read(size_t index, std::vector<uint8_t>& data, std::string& error) override;
+
+private:
+    // The reader for an archive, opened on first use
+    const ArchiveReader* archive(const std::wstring& path, std::string& error);
+    
+    struct Member {
+        const ArchiveReader* archive;   // nullptr: a file on disk
+        size_t index;
+    };
+    
+    std::vector<std::wstring> m_inputs;
+    std::vector<size_t> m_origins;
+    std::vector<Member> m_members;      // Per input
+    std::map<std::wstring, std::unique_ptr<ArchiveReader>> m_archives;
+};
+
+} // namespace Packer
+
+#endif // ARCHIVESOURCE_H
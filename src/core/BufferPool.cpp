@@ -0,0 +1,125 @@
+#include "BufferPool.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace Packer {
+
+namespace {
+
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+int floorLog2(uint64_t value) {
+    int shift = 0;
+    while (value >>= 1) {
+        shift++;
+    }
+    return shift;
+}
+
+// Ask for transparent huge pages on the 2 MB-aligned part of a large
+// buffer: fewer TLB misses while encoders sweep it. Windows only grants
+// large pages to VirtualAlloc callers holding SeLockMemoryPrivilege, which
+// std::vector storage cannot use, so there it is a no-op.
+void adviseHugePages(std::vector<uint8_t>& buffer) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    uintptr_t start = reinterpret_cast<uintptr_t>(buffer.data());
+    uintptr_t begin = (start + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    uintptr_t end = (start + buffer.capacity()) & ~(HUGE_PAGE_SIZE - 1);
+    if (end > begin) {
+        madvise(reinterpret_cast<void*>(begin), end - begin, MADV_HUGEPAGE);
+    }
+#else
+    (void)buffer;
+#endif
+}
+
+} // namespace
+
+BufferPool::BufferPool(uint64_t retainLimit) : m_retainLimit(retainLimit) {
+}
+
+BufferPool::~BufferPool() {
+}
+
+int BufferPool::classFor(size_t size) {
+    if (size <= (size_t(1) << MIN_SHIFT)) {
+        return 0;
+    }
+    
+    // 2^shift < size <= 2^(shift + 1), in quarter steps
+    int shift = floorLog2(size - 1);
+    if (shift >= MAX_SHIFT) {
+        return -1;
+    }
+    size_t step = size_t(1) << (shift - 2);
+    size_t quarters = (size - (size_t(1) << shift) + step - 1) / step;
+    return (shift - MIN_SHIFT) * 4 + static_cast<int>(quarters);
+}
+
+int BufferPool::classOf(size_t capacity) {
+    if (capacity < (size_t(1) << MIN_SHIFT)) {
+        return -1;
+    }
+    
+    int shift = floorLog2(capacity);
+    if (shift >= MAX_SHIFT) {
+        return -1;
+    }
+    size_t step = size_t(1) << (shift - 2);
+    size_t quarters = (capacity - (size_t(1) << shift)) / step;
+    return (shift - MIN_SHIFT) * 4 + static_cast<int>(quarters);
+}
+
+size_t BufferPool::classSize(int sizeClass) {
+    int shift = MIN_SHIFT + sizeClass / 4;
+    return (size_t(1) << shift) + static_cast<size_t>(sizeClass % 4) * (size_t(1) << (shift - 2));
+}
+
+std::vector<uint8_t> BufferPool::acquire(size_t size) {
+    std::vector<uint8_t> buffer;
+    int sizeClass = classFor(size);
+    
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (sizeClass >= 0 && !m_free[sizeClass].empty()) {
+            buffer = std::move(m_free[sizeClass].back());
+            m_free[sizeClass].pop_back();
+            m_stats.retainedBytes -= buffer.capacity();
+            m_stats.reused++;
+            return buffer;
+        }
+        m_stats.allocated++;
+    }
+    
+    buffer.reserve(sizeClass >= 0 ? classSize(sizeClass) : size);
+    if (buffer.capacity() >= HUGE_PAGE_SIZE) {
+        adviseHugePages(buffer);
+    }
+    return buffer;
+}
+
+void BufferPool::release(std::vector<uint8_t>&& buffer) {
+    // Owned here so a buffer the pool does not keep is freed outside the lock
+    std::vector<uint8_t> owned(std::move(buffer));
+    int sizeClass = classOf(owned.capacity());
+    if (sizeClass < 0) {
+        return;
+    }
+    owned.clear();
+    
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stats.retainedBytes + owned.capacity() > m_retainLimit) {
+        return;
+    }
+    m_stats.retainedBytes += owned.capacity();
+    m_free[sizeClass].push_back(std::move(owned));
+}
+
+BufferPoolStats BufferPool::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+} // namespace Packer
@@ -0,0 +1,60 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace Packer {
+
+struct BufferPoolStats {
+    uint64_t reused;            // acquire() served from the pool
+    uint64_t allocated;         // acquire() that had to allocate
+    uint64_t retainedBytes;     // Capacity currently parked in the pool
+    
+    BufferPoolStats() : reused(0), allocated(0), retainedBytes(0) {}
+};
+
+// Byte buffers recycled between blocks and jobs. Capacities are rounded up
+// to size classes a quarter power of two apart (4 KB, 5 KB, 6 KB, 7 KB,
+// 8 KB, 10 KB, ...), so a released buffer serves any later request of its
+// class and at most a quarter of a buffer goes unused. Buffers of 2 MB and
+// more are marked for transparent huge pages where the OS supports it.
+class BufferPool {
+public:
+    // retainLimit caps the capacity kept for reuse; larger releases are freed
+    explicit BufferPool(uint64_t retainLimit = DEFAULT_RETAIN_LIMIT);
+    ~BufferPool();
+    
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+    
+    // An empty buffer with capacity for at least size bytes
+    std::vector<uint8_t> acquire(size_t size);
+    
+    // Hand a buffer back; its contents are discarded
+    void release(std::vector<uint8_t>&& buffer);
+    
+    BufferPoolStats stats() const;
+    
+    static constexpr uint64_t DEFAULT_RETAIN_LIMIT = 256ull << 20;
+
+private:
+    static const int MIN_SHIFT = 12;         // Smallest class: 4 KB
+    static const int MAX_SHIFT = 36;         // Larger requests are not pooled
+    static const int CLASS_COUNT = (MAX_SHIFT - MIN_SHIFT) * 4 + 1;
+    
+    // Smallest class holding size bytes, and largest class a capacity fills
+    static int classFor(size_t size);
+    static int classOf(size_t capacity);
+    static size_t classSize(int sizeClass);
+    
+    uint64_t m_retainLimit;
+    std::vector<std::vector<uint8_t>> m_free[CLASS_COUNT];
+    BufferPoolStats m_stats;
+    mutable std::mutex m_mutex;
+};
+
+} // namespace Packer
+
+#endif // BUFFERPOOL_H
@@ -0,0 +1,1036 @@
+#include "BuildPipeline.h"
+#include "AllocStats.h"
+#include "Codec.h"
+#include "ContentHash.h"
+#include "DeltaCodec.h"
+#include "InputLoader.h"
+#include "ManifestWriter.h"
+#include "SparseScan.h"
+#include "StubRegistry.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <thread>
+
+namespace Packer {
+
+namespace {
+
+// Inputs buffered between read, sniff and hash. Kept small: each item
+// holds a whole file.
+const size_t STAGE_QUEUE_DEPTH = 4;
+
+// Input files the I/O backend reads ahead of the read stage
+const size_t READ_AHEAD = 8;
+
+// Blocks handed to the encode pool per pool thread before the hash stage
+// waits for the writer
+const size_t ENCODE_WINDOW_PER_THREAD = 2;
+
+// Variants copy the shared file data from the first output in pieces this size
+const size_t VARIANT_COPY_CHUNK = 4 * 1024 * 1024;
+
+// Updates leave replaced data behind in the bundle. Once more than half of
+// its file data is dead, and at least this much, it is rebuilt instead.
+const uint64_t UPDATE_MIN_DEAD = 64ull << 20;
+
+// Trace detail for blocks that are solid groups rather than one entry
+const std::wstring GROUP_SPAN_DETAIL = L"solid group";
+
+typedef std::chrono::steady_clock Clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+} // namespace
+
+BuildPipeline::BuildPipeline(ThreadPool& encodePool, BufferPool& buffers, JobArena& arena,
+                             IoBackend& io)
+    : m_encodePool(encodePool),
+      m_buffers(buffers),
+      m_arena(arena),
+      m_io(io),
+      m_source(nullptr),
+      m_appendOffset(0),
+      m_readQueue(STAGE_QUEUE_DEPTH),
+      m_sniffQueue(STAGE_QUEUE_DEPTH),
+      m_writeQueue(encodePool.threadCount() * ENCODE_WINDOW_PER_THREAD + 1),
+      m_window(encodePool.threadCount() * ENCODE_WINDOW_PER_THREAD),
+      m_inFlight(0),
+      m_encoding(0),
+      m_dryRun(false),
+      m_blockCount(0),
+      m_stats(STAGE_COUNT),
+      m_failed(false),
+      m_outputSize(0),
+      m_dataOffset(0),
+      m_dataSize(0) {
+    const char* names[STAGE_COUNT] = { "read", "sniff", "hash", "encode", "write" };
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        m_stats[i].name = names[i];
+    }
+}
+
+BuildPipeline::~BuildPipeline() {
+}
+
+void BuildPipeline::fail(const std::string& message) {
+    {
+        std::lock_guard<std::mutex> lock(m_errorMutex);
+        if (m_error.empty()) {
+            m_error = message;
+        }
+    }
+    m_failed = true;
+    
+    m_readQueue.close();
+    m_sniffQueue.close();
+    m_writeQueue.close();
+    
+    std::lock_guard<std::mutex> lock(m_windowMutex);
+    m_windowChanged.notify_all();
+}
+
+bool BuildPipeline::run(const std::vector<std::wstring>& inputs, const PackerOptions& options,
+                        bool dryRun, InputSource* source) {
+    m_arena.reset(inputs.size());
+    m_dryRun = dryRun;
+    m_source = source;
+    
+    // A delta build looks entries up in the base's manifest as they arrive
+    if (!options.basePath.empty()) {
+        m_base.reset(new BundleReader());
+        if (!m_base->open(options.basePath)) {
+            fail("cannot open base bundle " + FileIO::toUtf8(options.basePath) + ": " + m_base->error());
+            return false;
+        }
+        if (m_base->isDelta()) {
+            fail("base bundle " + FileIO::toUtf8(options.basePath) + " is itself a delta");
+            return false;
+        }
+        ManifestBase base = {};
+        base.manifestHash = m_base->manifestHash();
+        base.entryCount = m_base->manifest().entryCount();
+        m_arena.manifest.setBase(base);
+    }
+    
+    return runStages(inputs, options);
+}
+
+bool BuildPipeline::update(const std::vector<std::wstring>& inputs, const PackerOptions& options,
+                           const std::vector<size_t>& changed, InputSource* source) {
+    m_arena.reset(inputs.size());
+    m_dryRun = false;
+    m_source = source;
+    m_changed = changed;
+    
+    if (!loadPrevious(inputs, options)) {
+        m_previous.reset();
+        fail("cannot update " + FileIO::toUtf8(options.outputPath) + " in place: " +
+             m_update.rebuildReason);
+        return false;
+    }
+    return runStages(inputs, options);
+}
+
+bool BuildPipeline::runStages(const std::vector<std::wstring>& inputs, const PackerOptions& options) {
+    if (!scheduleSteps(inputs, options)) {
+        return false;
+    }
+    m_search.reset(new CodecSearch(options.codecSearch, false));
+    
+    std::thread reader(&BuildPipeline::readStage, this, std::cref(inputs));
+    std::thread sniffer(&BuildPipeline::sniffStage, this);
+    std::thread hasher(&BuildPipeline::hashStage, this, std::cref(options));
+    
+    bool written = writeStage(options, m_dryRun);
+    if (!written) {
+        fail("failed to write " + FileIO::toUtf8(options.outputPath));
+    }
+    
+    reader.join();
+    sniffer.join();
+    hasher.join();
+    
+    // Encode tasks still reference this pipeline
+    {
+        std::unique_lock<std::mutex> lock(m_windowMutex);
+        m_windowChanged.wait(lock, [this] { return m_encoding == 0; });
+    }
+    
+    if (m_writer) {
+        if (!m_writer->close() && !m_failed) {
+            fail("failed to write " + FileIO::toUtf8(options.outputPath));
+        }
+        m_writer.reset();
+        if (m_failed && m_previous) {
+            FileIO::truncateFile(options.outputPath, m_previous->fileSize());  // Back to the old bundle
+        } else if (m_failed) {
+            FileIO::removeFile(options.outputPath);  // No half-written bundles
+        }
+    }
+    m_search.reset();
+    m_base.reset();
+    m_previous.reset();
+    return !m_failed;
+}
+
+bool BuildPipeline::scheduleSteps(const std::vector<std::wstring>& inputs,
+                                  const PackerOptions& options) {
+    // Entry names as the sniff stage gives them
+    std::vector<std::wstring> names;
+    names.reserve(inputs.size());
+    for (const std::wstring& input : inputs) {
+        size_t lastSlash = input.find_last_of(L"\\/");
+        names.push_back(lastSlash == std::wstring::npos ? input : input.substr(lastSlash + 1));
+    }
+    
+    std::string error;
+    if (!m_arena.manifest.setSteps(names, options.dependencies, options.maxParallel, error)) {
+        fail(error);
+        return false;
+    }
+    return true;
+}
+
+bool BuildPipeline::loadPrevious(const std::vector<std::wstring>& inputs,
+                                 const PackerOptions& options) {
+    std::string& reason = m_update.rebuildReason;
+    if (!options.basePath.empty() || options.payloadLayout != PayloadLayout::OVERLAY) {
+        reason = "only full bundles with an overlay payload are updated in place";
+        return false;
+    }
+    
+    m_previous.reset(new BundleReader());
+    if (!m_previous->open(options.outputPath)) {
+        reason = m_previous->error();
+        return false;
+    }
+    if (m_previous->isDelta() || m_previous->layout() != PayloadLayout::OVERLAY) {
+        reason = "only full bundles with an overlay payload are updated in place";
+        return false;
+    }
+    
+    // New file data goes behind the whole old payload, which the new file
+    // data region then spans
+    const BundleTrailer& trailer = m_previous->trailer();
+    if (m_previous->payloadOffset() + trailer.payloadSize != m_previous->fileSize()) {
+        reason = "its payload is not at the end of the file";
+        return false;
+    }
+    m_appendOffset = trailer.payloadSize - trailer.dataOffset;
+    
+    const ManifestView& manifest = m_previous->manifest();
+    if (manifest.entryCount() != inputs.size()) {
+        reason = "the inputs no longer match its entries";
+        return false;
+    }
+    std::vector<bool> changed(inputs.size(), false);
+    for (size_t index : m_changed) {
+        if (index >= inputs.size()) {
+            reason = "changed input out of range";
+            return false;
+        }
+        changed[index] = true;
+        if (index < options.startupEntries) {
+            reason = "a startup entry changed and would no longer be at the front";
+            return false;
+        }
+    }
+    
+    // Kept solid entries still point at the old group indices; see below
+    for (uint32_t i = 0; i < manifest.groupCount(); i++) {
+        ManifestGroup group;
+        if (!manifest.group(i, group)) {
+            reason = "its manifest is corrupt";
+            return false;
+        }
+        m_arena.groups.push_back(group);
+    }
+    
+    for (size_t i = 0; i < inputs.size(); i++) {
+        ManifestRecord previous;
+        if (!manifest.entry(static_cast<uint32_t>(i), previous) ||
+            ((previous.flags & MANIFEST_RECORD_SOLID) && previous.group >= manifest.groupCount())) {
+            reason = "its manifest is corrupt";
+            return false;
+        }
+        
+        size_t lastSlash = inputs[i].find_last_of(L"\\/");
+        std::wstring name = lastSlash == std::wstring::npos ? inputs[i] : inputs[i].substr(lastSlash + 1);
+        if (manifest.string(previous.name) != name) {
+            reason = "the inputs no longer match its entries";
+            return false;
+        }
+        if (changed[i]) {
+            continue;
+        }
+        if (!adoptPrevious(i, previous)) {
+            reason = "its manifest is corrupt";
+            return false;
+        }
+        m_update.kept++;
+    }
+    
+    // A group is listed only with the members it kept. One whose members
+    // were all re-encoded is dropped, its data left as dead space like any
+    // replaced entry's, and the groups after it move up.
+    std::vector<uint32_t> members(m_arena.groups.size(), 0);
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (!changed[i] && (m_arena.records[i].flags & MANIFEST_RECORD_SOLID)) {
+            members[m_arena.records[i].group]++;
+        }
+    }
+    std::vector<uint32_t> renumbered(members.size(), 0);
+    uint32_t groupCount = 0;
+    for (size_t g = 0; g < members.size(); g++) {
+        if (members[g] != 0) {
+            renumbered[g] = groupCount;
+            m_arena.groups[groupCount] = m_arena.groups[g];
+            m_arena.groups[groupCount].entryCount = members[g];
+            groupCount++;
+        }
+    }
+    m_arena.groups.resize(groupCount);
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (!changed[i] && (m_arena.records[i].flags & MANIFEST_RECORD_SOLID)) {
+            m_arena.records[i].group = renumbered[m_arena.records[i].group];
+        }
+    }
+    
+    uint64_t live = keptBytes();
+    m_update.deadBytes = m_appendOffset - std::min(live, m_appendOffset);
+    if (m_update.deadBytes > live && m_update.deadBytes >= UPDATE_MIN_DEAD) {
+        reason = "more than half of its file data has been replaced";
+        return false;
+    }
+    return true;
+}
+
+bool BuildPipeline::adoptPrevious(size_t index, const ManifestRecord& previous) {
+    const ManifestView& manifest = m_previous->manifest();
+    ManifestRecord& entry = m_arena.records[index];
+    entry = previous;
+    m_arena.names[index] = manifest.string(previous.name);
+    
+    if (previous.flags & MANIFEST_RECORD_SPARSE) {
+        size_t firstHole = m_arena.holes.size();
+        entry.firstHole = static_cast<uint32_t>(firstHole);
+        for (uint32_t i = 0; i < previous.holeCount; i++) {
+            ManifestHole hole;
+            if (!manifest.hole(previous, i, hole)) {
+                m_arena.holes.resize(firstHole);
+                return false;
+            }
+            m_arena.holes.push_back(hole);
+        }
+    }
+    return true;
+}
+
+uint64_t BuildPipeline::keptBytes() const {
+    std::vector<bool> groups(m_arena.groups.size(), false);
+    uint64_t kept = 0;
+    for (const ManifestRecord& record : m_arena.records) {
+        if (record.flags & MANIFEST_RECORD_SOLID) {
+            groups[record.group] = true;
+        } else if (record.dataOffset < m_appendOffset) {
+            kept += record.storedSize;
+        }
+    }
+    for (size_t i = 0; i < groups.size(); i++) {
+        if (groups[i] && m_arena.groups[i].dataOffset < m_appendOffset) {
+            kept += m_arena.groups[i].storedSize;
+        }
+    }
+    return kept;
+}
+
+void BuildPipeline::readStage(const std::vector<std::wstring>& inputs) {
+    StageStats& stats = m_stats[STAGE_READ];
+    TRACE_THREAD("read stage");
+    ALLOC_SCOPE(ALLOC_STAGE_READ);
+    
+    // Updates read only the inputs that changed
+    size_t count = m_previous ? m_changed.size() : inputs.size();
+    auto inputAt = [&](size_t n) { return m_previous ? m_changed[n] : n; };
+    auto fromSource = [&](size_t i) { return m_source && m_source->provides(i); };
+    
+    // Inputs the source does not supply go through the backend's read-ahead
+    std::unique_ptr<FileReadQueue> reads;
+    for (size_t n = 0; n < count && !reads; n++) {
+        if (!fromSource(inputAt(n))) {
+            reads = m_io.openReader(READ_AHEAD);
+            if (!reads) {
+                fail(std::string("cannot start ") + m_io.name() + " reads");
+                m_readQueue.close();
+                return;
+            }
+        }
+    }
+    size_t submitted = 0;
+    
+    for (size_t n = 0; n < count && !m_failed; n++) {
+        size_t i = inputAt(n);
+        auto start = Clock::now();
+        while (reads && submitted < count && submitted < n + READ_AHEAD) {
+            size_t next = inputAt(submitted++);
+            if (!fromSource(next)) {
+                reads->submit(inputs[next]);
+            }
+        }
+        
+        std::unique_ptr<Item> item(new Item());
+        item->index = i;
+        bool read;
+        std::string error;
+        {
+            TRACE_SPAN("read", inputs[i]);
+            read = fromSource(i) ? m_source->read(i, item->file.fileData, error)
+                                 : reads->next(item->file.fileData);
+        }
+        if (!read) {
+            fail("failed to read input " + FileIO::toUtf8(inputs[i]) + (error.empty() ? "" : ": " + error));
+            break;
+        }
+        item->file.filePath = inputs[i];
+        stats.busySeconds += secondsSince(start);
+        stats.items++;
+        stats.bytes += item->file.fileData.size();
+        
+        start = Clock::now();
+        if (!m_readQueue.push(std::move(item))) {
+            break;
+        }
+        stats.blockedSeconds += secondsSince(start);
+    }
+    
+    m_readQueue.close();
+}
+
+void BuildPipeline::sniffStage() {
+    StageStats& stats = m_stats[STAGE_SNIFF];
+    TRACE_THREAD("sniff stage");
+    ALLOC_SCOPE(ALLOC_STAGE_SNIFF);
+    
+    for (;;) {
+        std::unique_ptr<Item> item;
+        auto start = Clock::now();
+        if (!m_readQueue.pop(item)) {
+            break;
+        }
+        stats.starvedSeconds += secondsSince(start);
+        
+        start = Clock::now();
+        {
+            TRACE_SPAN("sniff", item->file.filePath);
+            InputLoader::describe(item->file.filePath, static_cast<int>(item->index), item->file);
+        }
+        stats.busySeconds += secondsSince(start);
+        stats.items++;
+        stats.bytes += item->file.fileData.size();
+        
+        start = Clock::now();
+        if (!m_sniffQueue.push(std::move(item))) {
+            break;
+        }
+        stats.blockedSeconds += secondsSince(start);
+    }
+    
+    m_sniffQueue.close();
+}
+
+void BuildPipeline::hashStage(const PackerOptions& options) {
+    StageStats& stats = m_stats[STAGE_HASH];
+    CompressionMode compression = options.compression;
+    TRACE_THREAD("hash stage");
+    ALLOC_SCOPE(ALLOC_STAGE_HASH);
+    uint64_t sequence = 0;
+    uint32_t groupCount = static_cast<uint32_t>(m_arena.groups.size());  // Updates keep the groups in use
+    std::unique_ptr<Block> pending;  // Solid group being filled
+    
+    // Queue a block; blocked time is the encode window being full
+    auto emit = [&](std::unique_ptr<Block> block) {
+        block->sequence = sequence++;
+        auto start = Clock::now();
+        bool ok = emitBlock(std::move(block));
+        stats.blockedSeconds += secondsSince(start);
+        return ok;
+    };
+    
+    for (;;) {
+        std::unique_ptr<Item> item;
+        auto start = Clock::now();
+        if (!m_sniffQueue.pop(item)) {
+            break;
+        }
+        stats.starvedSeconds += secondsSince(start);
+        
+        start = Clock::now();
+        FileInfo& file = item->file;
+        ManifestRecord& entry = m_arena.records[item->index];
+        entry.id = 100 + static_cast<uint32_t>(item->index);  // Resource IDs start at 100
+        entry.originalSize = file.fileData.size();
+        entry.executionOrder = static_cast<uint32_t>(file.executionOrder);
+        entry.flags = MANIFEST_RECORD_HASH;
+        {
+            TRACE_SPAN("hash", file.originalName);
+            entry.contentHash = xxh64(file.fileData.data(), file.fileData.size());
+        }
+        m_arena.names[item->index].assign(file.originalName);
+        stats.busySeconds += secondsSince(start);
+        stats.items++;
+        stats.bytes += file.fileData.size();
+        
+        if (m_previous) {
+            if (matchPrevious(item->index, entry)) {
+                m_buffers.release(std::move(file.fileData));
+                continue;
+            }
+            m_update.encoded++;
+        }
+        
+        if (m_base) {
+            std::unique_ptr<Block> block;
+            if (matchBase(item->index, file, entry, block)) {
+                if (block) {
+                    block->compress = compression != CompressionMode::NONE;
+                    if (!emit(std::move(block))) {
+                        break;
+                    }
+                }
+                continue;
+            }
+        }
+        
+        // Startup entries come first in input order, so they are written
+        // ahead of every group and need no decoding to run
+        bool startup = entry.executionOrder < options.startupEntries;
+        
+        // Already compressed content is stored on its own
+        if (compression == CompressionMode::SOLID && file.compressible && !startup &&
+            entry.originalSize <= SOLID_ENTRY_LIMIT) {
+            // Small entry: a slice of the pending group's decoded stream
+            if (!pending) {
+                pending.reset(new Block());
+                pending->compress = true;
+                pending->report.group = groupCount++;
+                pending->data = m_buffers.acquire(SOLID_GROUP_TARGET + SOLID_ENTRY_LIMIT);
+            }
+            entry.flags |= MANIFEST_RECORD_SOLID;
+            entry.group = pending->report.group;
+            entry.dataOffset = pending->data.size();
+            entry.codec = CODEC_STORE;
+            entry.storedSize = entry.originalSize;
+            pending->data.insert(pending->data.end(), file.fileData.begin(), file.fileData.end());
+            pending->report.entryCount++;
+            m_buffers.release(std::move(file.fileData));
+            
+            if (pending->data.size() >= SOLID_GROUP_TARGET && !emit(std::move(pending))) {
+                break;
+            }
+            continue;
+        }
+        
+        // Long zero runs become holes; only the bytes between them are encoded
+        if (options.sparse && entry.originalSize >= SPARSE_MIN_HOLE) {
+            start = Clock::now();
+            TRACE_SPAN("sparse scan", file.originalName);
+            size_t firstHole = m_arena.holes.size();
+            if (SparseScan::pack(file.fileData, SPARSE_MIN_HOLE, m_arena.holes)) {
+                entry.flags |= MANIFEST_RECORD_SPARSE;
+                entry.firstHole = static_cast<uint32_t>(firstHole);
+                entry.holeCount = static_cast<uint32_t>(m_arena.holes.size() - firstHole);
+            }
+            stats.busySeconds += secondsSince(start);
+        }
+        
+        std::unique_ptr<Block> block(new Block());
+        block->entry = static_cast<int64_t>(item->index);
+        block->compress = compression != CompressionMode::NONE && file.compressible && !startup;
+        block->report.name = file.originalName;
+        block->report.entryCount = 1;
+        block->data = std::move(file.fileData);
+        if (!emit(std::move(block))) {
+            break;
+        }
+    }
+    
+    if (!m_failed && pending) {
+        emit(std::move(pending));
+    }
+    
+    // End marker: the writer stops once it has written this many blocks
+    m_blockCount = sequence;
+    m_writeQueue.push(nullptr);
+}
+
+bool BuildPipeline::matchBase(size_t index, FileInfo& file, ManifestRecord& entry,
+                              std::unique_ptr<Block>& block) {
+    const ManifestView& base = m_base->manifest();
+    m_delta.entryBytes += entry.originalSize;
+    
+    uint32_t baseIndex;
+    ManifestRecord previous;
+    if (!base.find(file.originalName, baseIndex) || !base.entry(baseIndex, previous)) {
+        m_delta.added++;
+        return false;
+    }
+    
+    if ((previous.flags & MANIFEST_RECORD_HASH) && previous.contentHash == entry.contentHash &&
+        previous.originalSize == entry.originalSize) {
+        entry.flags |= MANIFEST_RECORD_BASE;
+        entry.baseEntry = baseIndex;
+        entry.codec = CODEC_STORE;
+        m_buffers.release(std::move(file.fileData));
+        m_delta.unchanged++;
+        return true;
+    }
+    
+    // Small entries cost little in full and pack into solid groups as usual
+    if (entry.originalSize <= SOLID_ENTRY_LIMIT || previous.originalSize <= SOLID_ENTRY_LIMIT) {
+        m_delta.added++;
+        return false;
+    }
+    
+    entry.flags |= MANIFEST_RECORD_DELTA;
+    entry.baseEntry = baseIndex;
+    block.reset(new Block());
+    block->entry = static_cast<int64_t>(index);
+    block->delta = true;
+    block->baseRecord = previous;
+    block->report.name = file.originalName;
+    block->report.entryCount = 1;
+    block->data = std::move(file.fileData);
+    return true;
+}
+
+bool BuildPipeline::matchPrevious(size_t index, ManifestRecord& entry) {
+    ManifestRecord previous;
+    if (!m_previous->manifest().entry(static_cast<uint32_t>(index), previous) ||
+        !(previous.flags & MANIFEST_RECORD_HASH) || previous.contentHash != entry.contentHash ||
+        previous.originalSize != entry.originalSize) {
+        return false;
+    }
+    if (!adoptPrevious(index, previous)) {
+        return false;
+    }
+    m_update.unchanged++;
+    return true;
+}
+
+bool BuildPipeline::diffBlock(Block& block) {
+    TRACE_SPAN("diff", block.report.name);
+    auto start = Clock::now();
+    std::vector<uint8_t> base;
+    std::string error;
+    if (!m_base->readEntry(block.baseRecord, base, error)) {
+        fail("cannot read " + FileIO::toUtf8(block.report.name) + " from the base bundle: " + error);
+        return false;
+    }
+    
+    std::vector<uint8_t> script = m_buffers.acquire(block.data.size() / 8);
+    DeltaCodec::diff(base, block.data, script);
+    double seconds = secondsSince(start);
+    
+    {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        m_delta.diffed++;
+        m_delta.diffedBytes += block.data.size();
+        m_delta.scriptBytes += script.size();
+        m_delta.diffSeconds += seconds;
+    }
+    m_buffers.release(std::move(block.data));
+    block.data = std::move(script);
+    return true;
+}
+
+bool BuildPipeline::emitBlock(std::unique_ptr<Block> block) {
+    {
+        std::unique_lock<std::mutex> lock(m_windowMutex);
+        m_windowChanged.wait(lock, [this] { return m_failed || m_inFlight < m_window; });
+        if (m_failed) {
+            return false;
+        }
+        m_inFlight++;
+        m_encoding++;
+    }
+    
+    // std::function needs a copyable callable, so the task owns a raw pointer
+    Block* raw = block.release();
+    m_encodePool.submit([this, raw] { encodeBlock(raw); });
+    return true;
+}
+
+void BuildPipeline::encodeBlock(Block* raw) {
+    std::unique_ptr<Block> block(raw);
+    TRACE_THREAD("encode worker");
+    ALLOC_SCOPE(ALLOC_STAGE_ENCODE);
+    
+    if (!m_failed && (!block->delta || diffBlock(*block))) {
+        TRACE_SPAN("encode", block->report.name.empty() ? GROUP_SPAN_DETAIL : block->report.name);
+        auto start = Clock::now();
+        if (block->compress) {
+            block->choice.output = m_buffers.acquire(encodeBound(block->data.size()));
+            m_search->choose(block->data.data(), block->data.size(), block->choice);
+        } else {
+            block->choice.codec = CODEC_STORE;
+        }
+        double seconds = secondsSince(start);
+        
+        {
+            std::lock_guard<std::mutex> lock(m_statsMutex);
+            StageStats& stats = m_stats[STAGE_ENCODE];
+            stats.busySeconds += seconds;
+            stats.items++;
+            stats.bytes += block->data.size();
+        }
+        
+        m_writeQueue.push(std::move(block));
+    }
+    
+    std::lock_guard<std::mutex> lock(m_windowMutex);
+    m_encoding--;
+    m_windowChanged.notify_all();
+}
+
+bool BuildPipeline::output(const uint8_t* data, size_t size) {
+    m_outputSize += size;
+    return !m_writer || m_writer->write(data, size);
+}
+
+bool BuildPipeline::output(std::vector<uint8_t>& buffer) {
+    m_outputSize += buffer.size();
+    return !m_writer || m_writer->append(std::move(buffer));
+}
+
+bool BuildPipeline::writeBlock(Block& block, uint64_t& dataSize) {
+    const CodecChoice& choice = block.choice;
+    BlockReport& report = block.report;
+    report.originalSize = block.entry >= 0 ? m_arena.records[static_cast<size_t>(block.entry)].originalSize
+                                           : block.data.size();
+    report.codec = choice.codec;
+    report.level = choice.level;
+    report.encodeSeconds = choice.encodeSeconds;
+    report.decodeSeconds = choice.decodeSeconds;
+    
+    std::vector<uint8_t>& stored = choice.codec == CODEC_STORE ? block.data : block.choice.output;
+    report.storedSize = stored.size();
+    
+    if (block.entry >= 0) {
+        ManifestRecord& entry = m_arena.records[static_cast<size_t>(block.entry)];
+        entry.dataOffset = dataSize;
+        entry.codec = report.codec;
+        entry.storedSize = report.storedSize;
+        if (entry.flags & MANIFEST_RECORD_DELTA) {
+            entry.deltaSize = block.data.size();
+        }
+    } else {
+        ManifestGroup group = {};
+        group.dataOffset = dataSize;
+        group.storedSize = report.storedSize;
+        group.originalSize = report.originalSize;
+        group.codec = report.codec;
+        group.entryCount = report.entryCount;
+        m_arena.groups.push_back(group);
+    }
+    
+    dataSize += stored.size();
+    if (m_dryRun) {
+        m_arena.reports.push_back(report);
+    }
+    
+    TRACE_SPAN("write", report.name.empty() ? GROUP_SPAN_DETAIL : report.name);
+    bool written = output(stored);
+    m_buffers.release(std::move(block.data));
+    m_buffers.release(std::move(block.choice.output));
+    return written;
+}
+
+bool BuildPipeline::writeStage(const PackerOptions& options, bool dryRun) {
+    StageStats& stats = m_stats[STAGE_WRITE];
+    ALLOC_SCOPE(ALLOC_STAGE_WRITE);
+    
+    // Delta bundles are a bare payload; they are applied, never run. Updates
+    // append to the payload already behind the stub.
+    bool updating = m_previous != nullptr;
+    bool withStub = !m_base && !updating;
+    bool section = withStub && options.payloadLayout == PayloadLayout::SECTION;
+    
+    // Stub first, so file data can stream out behind it as it is encoded
+    std::shared_ptr<const StubTemplate> stub;
+    size_t stubSize = 0;
+    size_t payloadOffset = 0;
+    size_t fileAlignment = 1;
+    if (!dryRun) {
+        TRACE_SPAN("write stub");
+        if (withStub) {
+            std::string error;
+            stub = StubRegistry::instance().get(options.stubPath, options.outputType, error);
+            if (!stub) {
+                fail("failed to load stub template: " + error);
+                return true;
+            }
+            stubSize = stub->data.size();
+        }
+        if (section) {
+            if (!stub->sectionReady) {
+                fail("stub template has no room for a payload section");
+                return true;
+            }
+            payloadOffset = stub->payloadOffset;
+            fileAlignment = stub->fileAlignment;
+        }
+        
+        m_writer = m_io.openWriter();
+        if (!m_writer) {
+            return false;
+        }
+        if (updating) {
+            if (!m_writer->openAppend(options.outputPath)) {
+                return false;
+            }
+            m_outputSize = m_writer->size();
+        } else if (!m_writer->open(options.outputPath) ||
+                   (stub && !output(stub->data.data(), stubSize))) {
+            return false;
+        }
+        if (section) {
+            std::vector<uint8_t> padding(payloadOffset - stubSize, 0);
+            if (!output(padding.data(), padding.size())) {
+                return false;
+            }
+        }
+    }
+    uint64_t payloadStart = updating ? m_previous->payloadOffset() : m_outputSize;
+    uint64_t dataStart = updating ? m_previous->trailer().dataOffset : 0;  // In the payload
+    
+    // Encode tasks finish out of order; hold early blocks until their turn
+    std::map<uint64_t, std::unique_ptr<Block>> waiting;
+    uint64_t nextSequence = 0;
+    uint64_t dataSize = m_appendOffset;
+    bool ended = false;
+    
+    while (!(ended && nextSequence == m_blockCount)) {
+        std::unique_ptr<Block> block;
+        auto start = Clock::now();
+        if (!m_writeQueue.pop(block)) {
+            return !m_failed;  // Closed by a failing stage
+        }
+        stats.starvedSeconds += secondsSince(start);
+        
+        if (!block) {
+            ended = true;
+            continue;
+        }
+        uint64_t sequence = block->sequence;
+        waiting[sequence] = std::move(block);
+        
+        start = Clock::now();
+        for (auto it = waiting.find(nextSequence); it != waiting.end();
+             it = waiting.find(nextSequence)) {
+            if (!writeBlock(*it->second, dataSize)) {
+                return false;
+            }
+            stats.items++;
+            stats.bytes += it->second->report.storedSize;
+            waiting.erase(it);
+            nextSequence++;
+            
+            std::lock_guard<std::mutex> lock(m_windowMutex);
+            m_inFlight--;
+            m_windowChanged.notify_all();
+        }
+        stats.busySeconds += secondsSince(start);
+    }
+    
+    if (m_failed) {
+        return true;
+    }
+    
+    // Manifest and trailer once every stored size is known
+    auto start = Clock::now();
+    TRACE_SPAN("manifest");
+    ALLOC_SCOPE(ALLOC_STAGE_MANIFEST);
+    ManifestWriter& writer = m_arena.manifest;
+    for (size_t i = 0; i < m_arena.records.size(); i++) {
+        writer.addEntry(m_arena.records[i], m_arena.names[i], m_arena.names[i]);
+    }
+    for (const auto& group : m_arena.groups) {
+        writer.addGroup(group);
+    }
+    for (const auto& hole : m_arena.holes) {
+        writer.addHole(hole);
+    }
+    
+    std::vector<uint8_t>& tail = m_arena.tail;
+    if (!writer.write(options.waitForPrevious, tail)) {
+        fail("failed to build manifest");
+        return true;
+    }
+    uint32_t manifestSize = static_cast<uint32_t>(tail.size());
+    BundleTrailer trailer = makeBundleTrailer(dataStart + dataSize + manifestSize,
+                                              dataStart + dataSize, manifestSize,
+                                              dataStart, dataSize);
+    m_dataOffset = payloadStart + dataStart;
+    m_dataSize = dataSize;
+    if (updating) {
+        m_update.appendedBytes = dataSize - m_appendOffset;
+        m_update.deadBytes = m_appendOffset - std::min(keptBytes(), m_appendOffset);
+    }
+    WireCodec<BundleTrailer>::encode(&trailer, 1, tail);
+    if (!output(tail.data(), tail.size())) {
+        return false;
+    }
+    
+    if (dryRun) {
+        stats.busySeconds += secondsSince(start);
+        return true;
+    }
+    
+    if (section) {
+        // Now the payload size is known: add the section header and pad the
+        // raw data to the file alignment
+        uint64_t payloadSize = m_outputSize - payloadStart;
+        StubGenerator stubGen;
+        std::vector<uint8_t> headers;
+        if (!stubGen.sectionHeaders(*stub, payloadSize, headers)) {
+            fail("failed to add payload section");
+            return true;
+        }
+        
+        size_t paddedSize = static_cast<size_t>((payloadSize + fileAlignment - 1) / fileAlignment *
+                                                fileAlignment);
+        std::vector<uint8_t> padding(paddedSize - static_cast<size_t>(payloadSize), 0);
+        if (!output(padding.data(), padding.size()) ||
+            !m_writer->writeAt(0, headers.data(), headers.size())) {
+            return false;
+        }
+    }
+    
+    stats.busySeconds += secondsSince(start);
+    return true;
+}
+
+bool BuildPipeline::writeVariants(const std::vector<OutputVariant>& variants,
+                                  const PackerOptions& options, std::vector<uint64_t>& sizes) {
+    sizes.assign(variants.size(), 0);
+    if (variants.empty()) {
+        return true;
+    }
+    if (m_failed || m_dryRun || !options.basePath.empty()) {
+        m_error = "variants need a finished full build";
+        return false;
+    }
+    
+    // Manifests differ only in the run order flag; the writer still holds
+    // every entry of the run
+    std::vector<std::vector<uint8_t>> tails(variants.size());
+    for (size_t i = 0; i < variants.size(); i++) {
+        std::vector<uint8_t>& tail = tails[i];
+        if (!m_arena.manifest.write(variants[i].waitForPrevious, tail)) {
+            m_error = "failed to build manifest";
+            return false;
+        }
+        uint32_t manifestSize = static_cast<uint32_t>(tail.size());
+        BundleTrailer trailer = makeBundleTrailer(m_dataSize + manifestSize, m_dataSize,
+                                                  manifestSize, 0, m_dataSize);
+        WireCodec<BundleTrailer>::encode(&trailer, 1, tail);
+    }
+    
+    std::vector<std::string> errors(variants.size());
+    std::mutex doneMutex;
+    std::condition_variable allDone;
+    size_t pending = variants.size();
+    
+    for (size_t i = 0; i < variants.size(); i++) {
+        m_encodePool.submit([&, i] {
+            if (!writeVariant(variants[i], options.outputPath, tails[i], sizes[i], errors[i])) {
+                FileIO::removeFile(variants[i].outputPath);
+            }
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (--pending == 0) {
+                allDone.notify_all();
+            }
+        });
+    }
+    
+    std::unique_lock<std::mutex> lock(doneMutex);
+    allDone.wait(lock, [&] { return pending == 0; });
+    
+    for (size_t i = 0; i < variants.size(); i++) {
+        if (!errors[i].empty()) {
+            m_error = FileIO::toUtf8(variants[i].outputPath) + ": " + errors[i];
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BuildPipeline::writeVariant(const OutputVariant& variant, const std::wstring& source,
+                                 const std::vector<uint8_t>& tail, uint64_t& size,
+                                 std::string& error) {
+    TRACE_SPAN("write variant", variant.outputPath);
+    ALLOC_SCOPE(ALLOC_STAGE_WRITE);
+    uint64_t payloadSize = m_dataSize + tail.size();
+    
+    std::shared_ptr<const StubTemplate> stub =
+        StubRegistry::instance().get(variant.stubPath, variant.outputType, error);
+    if (!stub) {
+        error = "failed to load stub template: " + error;
+        return false;
+    }
+    
+    // Payload size is known up front, so section headers go in before
+    // writing: the patched headers, then the rest of the shared template
+    const std::vector<uint8_t>& stubData = stub->data;
+    std::vector<uint8_t> headers;
+    size_t payloadOffset = stubData.size();
+    size_t fileAlignment = 1;
+    if (variant.payloadLayout == PayloadLayout::SECTION) {
+        StubGenerator stubGen;
+        if (!stub->sectionReady || !stubGen.sectionHeaders(*stub, payloadSize, headers)) {
+            error = "failed to add payload section";
+            return false;
+        }
+        payloadOffset = stub->payloadOffset;
+        fileAlignment = stub->fileAlignment;
+    }
+    uint64_t paddedSize = (payloadSize + fileAlignment - 1) / fileAlignment * fileAlignment;
+    
+    std::unique_ptr<FileWriteQueue> writer = m_io.openWriter();
+    std::vector<uint8_t> padding(payloadOffset - stubData.size(), 0);
+    if (!writer || !writer->open(variant.outputPath) ||
+        !writer->write(headers.data(), headers.size()) ||
+        !writer->write(stubData.data() + headers.size(), stubData.size() - headers.size()) ||
+        !writer->write(padding.data(), padding.size())) {
+        error = "cannot write output";
+        return false;
+    }
+    
+    // Each piece goes to the writer, so reading the next overlaps its write
+    bool copied = true;
+    for (uint64_t offset = 0; copied && offset < m_dataSize; offset += VARIANT_COPY_CHUNK) {
+        size_t length = static_cast<size_t>(std::min<uint64_t>(VARIANT_COPY_CHUNK, m_dataSize - offset));
+        std::vector<uint8_t> chunk = m_buffers.acquire(length);
+        copied = FileIO::readRange(source, m_dataOffset + offset, length, chunk) &&
+                 writer->append(std::move(chunk));
+    }
+    if (!copied) {
+        error = "cannot copy file data from " + FileIO::toUtf8(source);
+        return false;
+    }
+    
+    padding.assign(static_cast<size_t>(paddedSize - payloadSize), 0);
+    if (!writer->write(tail.data(), tail.size()) || !writer->write(padding.data(), padding.size()) ||
+        !writer->close()) {
+        error = "cannot write output";
+        return false;
+    }
+    size = writer->size();
+    return true;
+}
+
+} // namespace Packer
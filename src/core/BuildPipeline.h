@@ -0,0 +1,273 @@
+#ifndef BUILDPIPELINE_H
+#define BUILDPIPELINE_H
+
+#include "common.h"
+#include "BoundedQueue.h"
+#include "BufferPool.h"
+#include "BundleReader.h"
+#include "CodecSearch.h"
+#include "FileIO.h"
+#include "IoBackend.h"
+#include "JobArena.h"
+#include "ResourceEmbedder.h"
+#include "ThreadPool.h"
+#include <atomic>
+
+namespace Packer {
+
+// Throughput of one pipeline stage
+struct StageStats {
+    const char* name;
+    uint64_t items;
+    uint64_t bytes;          // Bytes the stage consumed
+    double busySeconds;      // Working, summed over the stage's threads
+    double starvedSeconds;   // Waiting for input from the stage before
+    double blockedSeconds;   // Waiting for room in the stage after (backpressure)
+    
+    StageStats() : name(""), items(0), bytes(0), busySeconds(0), starvedSeconds(0),
+                   blockedSeconds(0) {}
+};
+
+// What a delta build did with its entries (see PackerOptions::basePath)
+struct DeltaStats {
+    uint64_t unchanged;      // Referenced in the base as they are
+    uint64_t diffed;         // Stored as a diff against their base entry
+    uint64_t added;          // Stored in full: new, or too small to be worth a diff
+    uint64_t diffedBytes;    // Original size of the diffed entries
+    uint64_t scriptBytes;    // Their diff scripts, before compression
+    uint64_t entryBytes;     // Original size of every entry
+    double diffSeconds;      // Building the scripts, summed over encode threads
+    
+    DeltaStats() : unchanged(0), diffed(0), added(0), diffedBytes(0), scriptBytes(0),
+                   entryBytes(0), diffSeconds(0) {}
+};
+
+// What an in-place update did (see BuildPipeline::update)
+struct UpdateStats {
+    uint64_t kept;           // Entries whose stored data was reused untouched
+    uint64_t encoded;        // Changed entries encoded and appended
+    uint64_t unchanged;      // Reported changed but with the same content
+    uint64_t appendedBytes;  // File data added behind the old payload
+    uint64_t deadBytes;      // Data in the bundle no entry refers to any more
+    std::string rebuildReason;  // Why the bundle could not be updated in place
+    
+    UpdateStats() : kept(0), encoded(0), unchanged(0), appendedBytes(0), deadBytes(0) {}
+};
+
+// Input bytes from somewhere other than the file system, such as entries
+// rebuilt from a delta bundle or files inside an archive
+class InputSource {
+public:
+    virtual ~InputSource() {}
+    
+    // Whether this source supplies input index; the others are read from
+    // the file system as without a source
+    virtual bool provides(size_t) const { return true; }
+    
+    // Contents of input index; the inputs passed to run still name them.
+    // Called on the read stage's thread, in input order.
+    virtual bool read(size_t index, std::vector<uint8_t>& data, std::string& error) = 0;
+};
+
+// Streaming bundle build. Inputs flow through concurrent stages
+//
+//   read -> sniff -> hash -> encode -> write
+//
+// connected by bounded queues, so disk reads, encoding and output writes
+// overlap and a slow stage throttles the ones feeding it instead of
+// letting data pile up in memory. Read, sniff and hash each run on their
+// own thread and keep input order; encode tasks run on a shared pool, at
+// most a fixed window of blocks at a time, and the writer (the calling
+// thread) puts their results back in order.
+//
+// The payload is written as file data | manifest | trailer, since the
+// manifest needs every stored size; readers only go by the trailer's offsets.
+// File data follows input (execution) order, and the first
+// options.startupEntries inputs are stored uncompressed ahead of any solid
+// group, so the stub can start the first step from the front of the file.
+//
+// With options.basePath set, the output is a delta bundle: just the payload,
+// with no stub, whose entries reference the base bundle's entries when
+// their content is unchanged and store a DeltaCodec diff against the entry
+// of the same name when it changed. `suurstof-pack apply` turns base and
+// delta back into a full bundle.
+//
+// update() instead rebuilds an existing overlay bundle after some of its
+// inputs changed. Only those are read and encoded; their data goes after
+// the old payload, followed by a new manifest in which every other entry
+// keeps its stored data where it is. The old bundle stays intact until the
+// new trailer lands, and a failed update cuts the file back to it.
+//
+// File data, solid groups and encoder output live in buffers taken from
+// and returned to a BufferPool, and manifest bookkeeping in a JobArena, so
+// a batch of jobs sharing them settles into reusing the same memory. Input
+// reads and output writes go through an IoBackend, which keeps several
+// inputs in flight ahead of the read stage and writes behind the writer.
+class BuildPipeline {
+public:
+    // encodePool, buffers and io may be shared by several pipelines; the
+    // arena belongs to this pipeline until run returns
+    BuildPipeline(ThreadPool& encodePool, BufferPool& buffers, JobArena& arena, IoBackend& io);
+    ~BuildPipeline();
+    
+    BuildPipeline(const BuildPipeline&) = delete;
+    BuildPipeline& operator=(const BuildPipeline&) = delete;
+    
+    // Build a bundle from inputs (in execution order) at options.outputPath.
+    // A dry run encodes everything but writes nothing. With a source, input
+    // contents come from it instead of the files.
+    bool run(const std::vector<std::wstring>& inputs, const PackerOptions& options,
+             bool dryRun = false, InputSource* source = nullptr);
+    
+    // Update the bundle at options.outputPath, built from the same inputs
+    // with the same options, after the inputs at indices changed (sorted)
+    // did. When the bundle cannot be updated in place the file is left
+    // alone, and updateStats().rebuildReason says why.
+    bool update(const std::vector<std::wstring>& inputs, const PackerOptions& options,
+                const std::vector<size_t>& changed, InputSource* source = nullptr);
+    
+    const std::string& error() const { return m_error; }
+    
+    // Bundle size, or payload size for a dry run
+    uint64_t outputSize() const { return m_outputSize; }
+    
+    // One report per stored block, in payload order; dry runs only
+    const std::vector<BlockReport>& blockReports() const { return m_arena.reports; }
+    
+    // read, sniff, hash, encode, write
+    const std::vector<StageStats>& stageStats() const { return m_stats; }
+    
+    // Delta builds only
+    const DeltaStats& deltaStats() const { return m_delta; }
+    
+    // Updates only
+    const UpdateStats& updateStats() const { return m_update; }
+    
+    // After a successful run, write more outputs of the same bundle: each
+    // variant gets its own stub, layout and manifest around the file data
+    // just written, which is copied over instead of encoded again. Variants
+    // are written in parallel on the encode pool; sizes gets each one's size.
+    bool writeVariants(const std::vector<OutputVariant>& variants, const PackerOptions& options,
+                       std::vector<uint64_t>& sizes);
+
+private:
+    enum Stage { STAGE_READ, STAGE_SNIFF, STAGE_HASH, STAGE_ENCODE, STAGE_WRITE, STAGE_COUNT };
+    
+    // One input between read and hash
+    struct Item {
+        size_t index;
+        FileInfo file;
+    };
+    
+    // One stored block between hash and write
+    struct Block {
+        uint64_t sequence;
+        int64_t entry;          // Record index, or -1 for a solid group
+        bool compress;
+        bool delta;             // Encode a diff against baseRecord instead
+        ManifestRecord baseRecord;
+        std::vector<uint8_t> data;
+        BlockReport report;
+        CodecChoice choice;     // Set by the encode task
+        
+        Block() : sequence(0), entry(-1), compress(false), delta(false), baseRecord() {}
+    };
+    
+    // Stages, joins and cleanup shared by run and update
+    bool runStages(const std::vector<std::wstring>& inputs, const PackerOptions& options);
+    
+    // Check options.dependencies against the inputs and put the graph in
+    // the manifest; false (after fail) for an unknown name or a cycle
+    bool scheduleSteps(const std::vector<std::wstring>& inputs, const PackerOptions& options);
+    
+    // Load the bundle being updated and carry over every entry that did not
+    // change. False, with the reason in m_update, if it cannot be updated.
+    bool loadPrevious(const std::vector<std::wstring>& inputs, const PackerOptions& options);
+    
+    // Copy a record of the bundle being updated, with its holes; false if
+    // they are missing
+    bool adoptPrevious(size_t index, const ManifestRecord& previous);
+    
+    // Stored bytes before m_appendOffset that the arena's records still use
+    uint64_t keptBytes() const;
+    
+    void readStage(const std::vector<std::wstring>& inputs);
+    void sniffStage();
+    void hashStage(const PackerOptions& options);
+    void encodeBlock(Block* block);
+    bool writeStage(const PackerOptions& options, bool dryRun);
+    
+    // Delta builds: refer unchanged entries to the base and turn changed
+    // ones into diff blocks. True when the entry was handled here.
+    bool matchBase(size_t index, FileInfo& file, ManifestRecord& entry,
+                   std::unique_ptr<Block>& block);
+    
+    // Updates: keep the stored data of a changed input whose content is
+    // the same after all. True when the entry was handled here.
+    bool matchPrevious(size_t index, ManifestRecord& entry);
+    
+    // Replace a delta block's data by its diff script
+    bool diffBlock(Block& block);
+    
+    // Hand a block to the encode pool once the window has room
+    bool emitBlock(std::unique_ptr<Block> block);
+    
+    // Append one encoded block and fill in its record or group
+    bool writeBlock(Block& block, uint64_t& dataSize);
+    
+    // Write bytes to the output, or only count them in a dry run
+    bool output(const uint8_t* data, size_t size);
+    
+    // Same for a pool buffer, which the writer takes over
+    bool output(std::vector<uint8_t>& buffer);
+    
+    // One variant: its stub, the file data read back from source, then its
+    // manifest and trailer (tail)
+    bool writeVariant(const OutputVariant& variant, const std::wstring& source,
+                      const std::vector<uint8_t>& tail, uint64_t& size, std::string& error);
+    
+    // Record the first error and stop every stage
+    void fail(const std::string& message);
+    
+    ThreadPool& m_encodePool;
+    BufferPool& m_buffers;
+    JobArena& m_arena;
+    IoBackend& m_io;
+    std::unique_ptr<CodecSearch> m_search;
+    std::unique_ptr<FileWriteQueue> m_writer;
+    std::unique_ptr<BundleReader> m_base;   // Delta builds only
+    InputSource* m_source;
+    std::unique_ptr<BundleReader> m_previous;  // Updates only: the bundle being updated
+    std::vector<size_t> m_changed;          // Updates only: the inputs to read
+    uint64_t m_appendOffset;                // Updates only: new data starts here
+    UpdateStats m_update;
+    DeltaStats m_delta;
+    
+    BoundedQueue<std::unique_ptr<Item>> m_readQueue;
+    BoundedQueue<std::unique_ptr<Item>> m_sniffQueue;
+    BoundedQueue<std::unique_ptr<Block>> m_writeQueue;  // nullptr marks the end
+    
+    // Encode window: blocks handed out but not yet written
+    std::mutex m_windowMutex;
+    std::condition_variable m_windowChanged;
+    size_t m_window;
+    size_t m_inFlight;
+    size_t m_encoding;          // Encode tasks still running
+    
+    bool m_dryRun;
+    std::atomic<uint64_t> m_blockCount;  // Final once the end marker is queued
+    
+    std::vector<StageStats> m_stats;
+    std::mutex m_statsMutex;     // Encode stats only; other stages own theirs
+    
+    std::atomic<bool> m_failed;
+    std::mutex m_errorMutex;
+    std::string m_error;
+    uint64_t m_outputSize;
+    uint64_t m_dataOffset;       // File data in the output, for variants
+    uint64_t m_dataSize;
+};
+
+} // namespace Packer
+
+#endif // BUILDPIPELINE_H
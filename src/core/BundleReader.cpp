@@ -0,0 +1,318 @@
+#include "BundleReader.h"
+#include "Codec.h"
+#include "ContentHash.h"
+#include "DeltaCodec.h"
+#include "FileIO.h"
+#include <algorithm>
+#include <cstring>
+
+namespace Packer {
+
+BundleReader::BundleReader() : m_fileSize(0), m_payloadOffset(0),
+                               m_layout(PayloadLayout::OVERLAY), m_trailer(), m_base(nullptr) {
+}
+
+BundleReader::~BundleReader() {
+}
+
+bool BundleReader::open(const std::wstring& bundlePath) {
+    m_path = bundlePath;
+    m_error.clear();
+    m_manifest.clear();
+    
+    if (!FileIO::fileSize(m_path, m_fileSize)) {
+        m_error = "cannot open file";
+        return false;
+    }
+    
+    // Section bundles keep the trailer at the end of the .pack section's
+    // data, overlay bundles at the end of the file. A section payload can
+    // end at the end of the file too, so as in the stub the section is
+    // looked for first and the overlay only when there is none.
+    bool hasSection = false;
+    if (findSectionPayload(hasSection)) {
+        m_layout = PayloadLayout::SECTION;
+    } else if (!hasSection && findOverlayPayload()) {
+        m_layout = PayloadLayout::OVERLAY;
+    } else {
+        if (m_error.empty()) {
+            m_error = "no bundle payload found";
+        }
+        return false;
+    }
+    
+    if (!FileIO::readRange(m_path, m_payloadOffset + m_trailer.manifestOffset,
+                           m_trailer.manifestSize, m_manifest)) {
+        m_error = "cannot read manifest";
+        return false;
+    }
+    
+    if (!m_view.open(m_manifest.data(), m_manifest.size())) {
+        m_error = "corrupt manifest";
+        return false;
+    }
+    
+    return true;
+}
+
+bool BundleReader::setBase(const BundleReader& base) {
+    ManifestBase descriptor;
+    if (!m_view.base(descriptor)) {
+        m_error = "not a delta bundle";
+        return false;
+    }
+    if (descriptor.manifestHash != base.manifestHash() ||
+        descriptor.entryCount != base.manifest().entryCount()) {
+        m_error = "built against a different base bundle";
+        return false;
+    }
+    m_base = &base;
+    return true;
+}
+
+bool BundleReader::isDelta() const {
+    ManifestBase descriptor;
+    return m_view.base(descriptor);
+}
+
+uint64_t BundleReader::manifestHash() const {
+    return xxh64(m_manifest.data(), m_manifest.size());
+}
+
+bool BundleReader::findOverlayPayload() {
+    return loadTrailer(m_fileSize, m_fileSize);
+}
+
+bool BundleReader::findSectionPayload(bool& hasSection) {
+    // Only the headers are read: DOS header, NT headers and section table
+    std::vector<uint8_t> headers;
+    size_t headerSize = static_cast<size_t>(std::min<uint64_t>(m_fileSize, 0x10000));
+    if (!FileIO::readRange(m_path, 0, headerSize, headers) ||
+        headers.size() < sizeof(IMAGE_DOS_HEADER)) {
+        return false;
+    }
+    
+    IMAGE_DOS_HEADER dosHeader;
+    memcpy(&dosHeader, headers.data(), sizeof(dosHeader));
+    if (dosHeader.e_magic != IMAGE_DOS_SIGNATURE || dosHeader.e_lfanew < 0) {
+        return false;
+    }
+    
+    size_t ntOffset = static_cast<size_t>(dosHeader.e_lfanew);
+    size_t fileHeaderOffset = ntOffset + sizeof(DWORD);
+    if (fileHeaderOffset + sizeof(IMAGE_FILE_HEADER) > headers.size() ||
+        readU32(headers.data() + ntOffset) != IMAGE_NT_SIGNATURE) {
+        return false;
+    }
+    
+    // The section table follows the optional header in PE32 and PE32+ alike
+    IMAGE_FILE_HEADER fileHeader;
+    memcpy(&fileHeader, headers.data() + fileHeaderOffset, sizeof(fileHeader));
+    size_t tableOffset = fileHeaderOffset + sizeof(IMAGE_FILE_HEADER) +
+                         fileHeader.SizeOfOptionalHeader;
+    
+    for (WORD i = 0; i < fileHeader.NumberOfSections; i++) {
+        size_t offset = tableOffset + i * sizeof(IMAGE_SECTION_HEADER);
+        if (offset + sizeof(IMAGE_SECTION_HEADER) > headers.size()) {
+            return false;
+        }
+        
+        IMAGE_SECTION_HEADER section;
+        memcpy(&section, headers.data() + offset, sizeof(section));
+        if (memcmp(section.Name, ".pack\0\0", IMAGE_SIZEOF_SHORT_NAME) != 0) {
+            continue;
+        }
+        hasSection = true;
+        
+        uint64_t payloadEnd = static_cast<uint64_t>(section.PointerToRawData) +
+                              section.Misc.VirtualSize;
+        if (section.Misc.VirtualSize > section.SizeOfRawData || payloadEnd > m_fileSize) {
+            m_error = "truncated .pack section";
+            return false;
+        }
+        if (!loadTrailer(payloadEnd, section.Misc.VirtualSize)) {
+            m_error = "no bundle payload in the .pack section";
+            return false;
+        }
+        return true;
+    }
+    
+    return false;
+}
+
+bool BundleReader::loadTrailer(uint64_t payloadEnd, uint64_t available) {
+    if (available < sizeof(BundleTrailer)) {
+        return false;
+    }
+    
+    std::vector<uint8_t> tail;
+    if (!FileIO::readRange(m_path, payloadEnd - sizeof(BundleTrailer),
+                           sizeof(BundleTrailer), tail)) {
+        return false;
+    }
+    
+    WireCodec<BundleTrailer>::decode(tail.data(), tail.size(), 1, &m_trailer);
+    if (!checkBundleTrailer(m_trailer, available)) {
+        return false;
+    }
+    
+    m_payloadOffset = payloadEnd - m_trailer.payloadSize;
+    return true;
+}
+
+bool BundleReader::readStored(const ManifestRecord& record, std::vector<uint8_t>& stored) const {
+    if (record.dataOffset > m_trailer.dataSize ||
+        record.storedSize > m_trailer.dataSize - record.dataOffset) {
+        return false;
+    }
+    
+    uint64_t offset = m_payloadOffset + m_trailer.dataOffset + record.dataOffset;
+    return FileIO::readRange(m_path, offset, static_cast<size_t>(record.storedSize), stored);
+}
+
+bool BundleReader::readGroup(uint32_t group, std::vector<uint8_t>& data, std::string& error) const {
+    ManifestGroup descriptor;
+    if (!m_view.group(group, descriptor)) {
+        error = "missing solid group";
+        return false;
+    }
+    
+    if (descriptor.dataOffset > m_trailer.dataSize ||
+        descriptor.storedSize > m_trailer.dataSize - descriptor.dataOffset) {
+        error = "solid group out of range";
+        return false;
+    }
+    
+    std::vector<uint8_t> stored;
+    uint64_t offset = m_payloadOffset + m_trailer.dataOffset + descriptor.dataOffset;
+    if (!FileIO::readRange(m_path, offset, static_cast<size_t>(descriptor.storedSize), stored)) {
+        error = "solid group unreadable";
+        return false;
+    }
+    
+    data.resize(static_cast<size_t>(descriptor.originalSize));
+    if (!decodeBlock(descriptor.codec, stored.data(), stored.size(), data.data(), data.size())) {
+        error = std::string("solid group does not decode (") + codecName(descriptor.codec) + ")";
+        return false;
+    }
+    return true;
+}
+
+bool BundleReader::readPacked(const ManifestRecord& record, std::vector<uint8_t>& packed,
+                              std::string& error) const {
+    // Sparse entries store less than their original size, deltas a script
+    uint64_t packedSize;
+    if (!m_view.packedSize(record, packedSize)) {
+        error = "bad sparse holes";
+        return false;
+    }
+    
+    std::vector<uint8_t> stored;
+    if (!readStored(record, stored)) {
+        error = "data out of range or unreadable";
+        return false;
+    }
+    
+    if (record.codec == CODEC_STORE) {
+        packed.swap(stored);
+        return true;
+    }
+    
+    packed.resize(static_cast<size_t>(packedSize));
+    if (!decodeBlock(record.codec, stored.data(), stored.size(), packed.data(), packed.size())) {
+        error = std::string("does not decode (") + codecName(record.codec) + ")";
+        return false;
+    }
+    return true;
+}
+
+bool BundleReader::readFromBase(const ManifestRecord& record, std::vector<uint8_t>& data,
+                                std::string& error) const {
+    ManifestRecord baseRecord;
+    if (!m_base) {
+        error = "delta entry needs its base bundle";
+        return false;
+    }
+    if (!m_base->manifest().entry(record.baseEntry, baseRecord)) {
+        error = "missing base entry";
+        return false;
+    }
+    
+    if (record.flags & MANIFEST_RECORD_BASE) {
+        return m_base->readEntry(baseRecord, data, error);
+    }
+    
+    std::vector<uint8_t> base;
+    std::vector<uint8_t> script;
+    if (!m_base->readEntry(baseRecord, base, error) || !readPacked(record, script, error)) {
+        return false;
+    }
+    
+    data.resize(static_cast<size_t>(record.originalSize));
+    if (!DeltaCodec::apply(base.data(), base.size(), script.data(), script.size(),
+                           data.data(), data.size())) {
+        error = "diff does not apply to the base entry";
+        return false;
+    }
+    return true;
+}
+
+bool BundleReader::readEntry(const ManifestRecord& record, std::vector<uint8_t>& data,
+                             std::string& error) const {
+    if (record.flags & (MANIFEST_RECORD_BASE | MANIFEST_RECORD_DELTA)) {
+        return readFromBase(record, data, error);
+    }
+    
+    if (record.flags & MANIFEST_RECORD_SOLID) {
+        std::vector<uint8_t> group;
+        if (!readGroup(record.group, group, error)) {
+            return false;
+        }
+        if (record.dataOffset > group.size() || record.originalSize > group.size() - record.dataOffset) {
+            error = "entry outside its solid group";
+            return false;
+        }
+        auto first = group.begin() + static_cast<ptrdiff_t>(record.dataOffset);
+        data.assign(first, first + static_cast<ptrdiff_t>(record.originalSize));
+        return true;
+    }
+    
+    std::vector<uint8_t> packed;
+    if (!readPacked(record, packed, error)) {
+        return false;
+    }
+    
+    if (!(record.flags & MANIFEST_RECORD_SPARSE)) {
+        data.swap(packed);
+        return true;
+    }
+    
+    data.resize(static_cast<size_t>(record.originalSize));
+    if (!m_view.expand(record, packed.data(), packed.size(), data.data())) {
+        error = "size mismatch";
+        return false;
+    }
+    return true;
+}
+
+bool BundleReader::verifyEntry(const ManifestRecord& record, std::string& error) const {
+    std::vector<uint8_t> data;
+    return readEntry(record, data, error) && checkEntry(record, data.data(), data.size(), error);
+}
+
+bool BundleReader::checkEntry(const ManifestRecord& record, const uint8_t* data, size_t size,
+                              std::string& error) {
+    if (size != record.originalSize) {
+        error = "size mismatch";
+        return false;
+    }
+    
+    if ((record.flags & MANIFEST_RECORD_HASH) && xxh64(data, size) != record.contentHash) {
+        error = "content hash mismatch";
+        return false;
+    }
+    
+    return true;
+}
+
+} // namespace Packer
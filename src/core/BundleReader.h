@@ -0,0 +1,92 @@
+#ifndef BUNDLEREADER_H
+#define BUNDLEREADER_H
+
+#include "common.h"
+#include "ManifestFormat.h"
+
+namespace Packer {
+
+// Reads a packed bundle from disk without running it. open() loads only the
+// trailer and the manifest, so it costs the same whatever the payload size;
+// entry data is read on demand. Works on any host, for bundles of either
+// payload layout.
+class BundleReader {
+public:
+    BundleReader();
+    ~BundleReader();
+    
+    BundleReader(const BundleReader&) = delete;
+    BundleReader& operator=(const BundleReader&) = delete;
+    
+    // Locate the payload and load its manifest
+    bool open(const std::wstring& bundlePath);
+    
+    // For a delta bundle, the full bundle it was built against; base
+    // references and diffs then read through it. False (see error()) when
+    // this is not a delta of that bundle. base must outlive this reader.
+    bool setBase(const BundleReader& base);
+    
+    // Whether the manifest names a base bundle
+    bool isDelta() const;
+    
+    // XXH64 of the manifest; delta bundles record their base's
+    uint64_t manifestHash() const;
+    
+    // Why open(), setBase() or verifyEntry() failed
+    const std::string& error() const { return m_error; }
+    
+    const ManifestView& manifest() const { return m_view; }
+    const BundleTrailer& trailer() const { return m_trailer; }
+    PayloadLayout layout() const { return m_layout; }
+    uint64_t fileSize() const { return m_fileSize; }
+    uint64_t payloadOffset() const { return m_payloadOffset; }
+    
+    // The read/verify calls below are safe to use from several threads.
+    
+    // Stored bytes of one non-solid entry
+    bool readStored(const ManifestRecord& record, std::vector<uint8_t>& stored) const;
+    
+    // Decoded stream of one solid group
+    bool readGroup(uint32_t group, std::vector<uint8_t>& data, std::string& error) const;
+    
+    // Decoded bytes of one entry; solid entries decode their whole group,
+    // delta entries read their base entry and apply the diff
+    bool readEntry(const ManifestRecord& record, std::vector<uint8_t>& data,
+                   std::string& error) const;
+    
+    // Read, decode and hash-check one entry
+    bool verifyEntry(const ManifestRecord& record, std::string& error) const;
+    
+    // Check decoded bytes against the record's size and content hash
+    static bool checkEntry(const ManifestRecord& record, const uint8_t* data, size_t size,
+                           std::string& error);
+
+private:
+    bool findOverlayPayload();
+    // hasSection is set when there is a .pack section, even one without a
+    // payload in it
+    bool findSectionPayload(bool& hasSection);
+    bool loadTrailer(uint64_t payloadEnd, uint64_t available);
+    
+    // Stored bytes of a non-solid entry, decoded but with holes still left out
+    bool readPacked(const ManifestRecord& record, std::vector<uint8_t>& packed,
+                    std::string& error) const;
+    
+    // Entry of a delta bundle that refers to the base
+    bool readFromBase(const ManifestRecord& record, std::vector<uint8_t>& data,
+                      std::string& error) const;
+    
+    std::wstring m_path;
+    std::string m_error;
+    uint64_t m_fileSize;
+    uint64_t m_payloadOffset;
+    PayloadLayout m_layout;
+    BundleTrailer m_trailer;
+    std::vector<uint8_t> m_manifest;
+    ManifestView m_view;
+    const BundleReader* m_base;
+};
+
+} // namespace Packer
+
+#endif // BUNDLEREADER_H
@@ -0,0 +1,276 @@
+#include "Codec.h"
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace Packer {
+
+namespace {
+
+// LZ4 block limits: the last match must start 12 bytes before the end
+// and the last 5 bytes are always literals
+const size_t LZ_MIN_MATCH = 4;
+const size_t LZ_MATCH_LIMIT = 12;
+const size_t LZ_LAST_LITERALS = 5;
+const size_t LZ_MAX_OFFSET = 65535;
+const int LZ_HASH_BITS = 16;
+
+// Match candidates examined per position by the chained levels
+const int LZ_CHAIN_DEPTH[] = {0, 0, 16, 256};
+
+uint32_t read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint32_t hashLz(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Hash chain heads, cleared for each block but kept per thread so encoding
+// a block does not allocate them again
+std::vector<int64_t>& hashHeads() {
+    thread_local std::vector<int64_t> heads;
+    heads.assign(size_t(1) << LZ_HASH_BITS, -1);
+    return heads;
+}
+
+void appendLength(std::vector<uint8_t>& out, size_t length) {
+    while (length >= 255) {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back(static_cast<uint8_t>(length));
+}
+
+void appendSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalCount,
+                    size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength ? matchLength - LZ_MIN_MATCH : 0;
+    uint8_t token = static_cast<uint8_t>(((literalCount < 15 ? literalCount : 15) << 4) |
+                                         (matchCode < 15 ? matchCode : 15));
+    out.push_back(token);
+    if (literalCount >= 15) {
+        appendLength(out, literalCount - 15);
+    }
+    out.insert(out.end(), literals, literals + literalCount);
+    
+    if (matchLength == 0) {
+        return;  // Last sequence
+    }
+    out.push_back(static_cast<uint8_t>(offset));
+    out.push_back(static_cast<uint8_t>(offset >> 8));
+    if (matchCode >= 15) {
+        appendLength(out, matchCode - 15);
+    }
+}
+
+// Level 1: one candidate per position, skipping ahead faster through data
+// that does not match
+void encodeLzGreedy(const uint8_t* in, size_t size, std::vector<uint8_t>& out) {
+    size_t anchor = 0;
+    
+    if (size > LZ_MATCH_LIMIT) {
+        std::vector<int64_t>& table = hashHeads();
+        size_t matchEnd = size - LZ_MATCH_LIMIT;
+        size_t i = 0;
+        
+        while (i < matchEnd) {
+            uint32_t sequence = read32(in + i);
+            uint32_t hash = hashLz(sequence);
+            int64_t candidate = table[hash];
+            table[hash] = static_cast<int64_t>(i);
+            
+            if (candidate < 0 || i - candidate > LZ_MAX_OFFSET ||
+                read32(in + candidate) != sequence) {
+                // Skip faster through data that does not match
+                i += 1 + ((i - anchor) >> 6);
+                continue;
+            }
+            
+            size_t match = static_cast<size_t>(candidate);
+            size_t length = LZ_MIN_MATCH;
+            size_t maxLength = size - LZ_LAST_LITERALS - i;
+            while (length < maxLength && in[match + length] == in[i + length]) {
+                length++;
+            }
+            
+            // Extend backwards into the pending literals
+            while (i > anchor && match > 0 && in[i - 1] == in[match - 1]) {
+                i--;
+                match--;
+                length++;
+            }
+            
+            appendSequence(out, in + anchor, i - anchor, i - match, length);
+            i += length;
+            anchor = i;
+            
+            if (i - 2 < matchEnd) {
+                table[hashLz(read32(in + i - 2))] = static_cast<int64_t>(i - 2);
+            }
+        }
+    }
+    
+    appendSequence(out, in + anchor, size - anchor, 0, 0);
+}
+
+// Levels 2-3: every position goes into hash chains; each match is the
+// longest of up to LZ_CHAIN_DEPTH candidates, and is deferred by one byte
+// when the next position has a longer one
+void encodeLzChained(const uint8_t* in, size_t size, std::vector<uint8_t>& out, int level) {
+    size_t anchor = 0;
+    
+    if (size > LZ_MATCH_LIMIT) {
+        std::vector<int64_t>& head = hashHeads();
+        std::vector<int64_t> chain(size, -1);
+        size_t matchEnd = size - LZ_MATCH_LIMIT;
+        int depth = LZ_CHAIN_DEPTH[level];
+        size_t inserted = 0;
+        
+        auto insertUpTo = [&](size_t position) {
+            for (; inserted < position && inserted < matchEnd; inserted++) {
+                uint32_t hash = hashLz(read32(in + inserted));
+                chain[inserted] = head[hash];
+                head[hash] = static_cast<int64_t>(inserted);
+            }
+        };
+        
+        // Longest match for position i among earlier positions
+        auto findMatch = [&](size_t i, size_t& match) {
+            insertUpTo(i);
+            size_t best = 0;
+            size_t maxLength = size - LZ_LAST_LITERALS - i;
+            int64_t candidate = head[hashLz(read32(in + i))];
+            for (int attempts = depth; candidate >= 0 && attempts > 0; attempts--) {
+                size_t c = static_cast<size_t>(candidate);
+                if (i - c > LZ_MAX_OFFSET) {
+                    break;
+                }
+                if (in[c + best] == in[i + best] && read32(in + c) == read32(in + i)) {
+                    size_t length = LZ_MIN_MATCH;
+                    while (length < maxLength && in[c + length] == in[i + length]) {
+                        length++;
+                    }
+                    if (length > best) {
+                        best = length;
+                        match = c;
+                        if (length == maxLength) {
+                            break;
+                        }
+                    }
+                }
+                candidate = chain[c];
+            }
+            return best;
+        };
+        
+        size_t i = 0;
+        while (i < matchEnd) {
+            size_t match = 0;
+            size_t length = findMatch(i, match);
+            if (length < LZ_MIN_MATCH) {
+                i++;
+                continue;
+            }
+            
+            // Lazy step: prefer a longer match one byte later
+            size_t nextMatch = 0;
+            if (i + 1 < matchEnd && findMatch(i + 1, nextMatch) > length) {
+                i++;
+                continue;
+            }
+            
+            while (i > anchor && match > 0 && in[i - 1] == in[match - 1]) {
+                i--;
+                match--;
+                length++;
+            }
+            
+            appendSequence(out, in + anchor, i - anchor, i - match, length);
+            i += length;
+            anchor = i;
+        }
+    }
+    
+    appendSequence(out, in + anchor, size - anchor, 0, 0);
+}
+
+} // namespace
+
+void encodeRle(const uint8_t* in, size_t size, std::vector<uint8_t>& out) {
+    size_t i = 0;
+    while (i < size) {
+        uint8_t value = in[i];
+        size_t count = 1;
+        while (i + count < size && in[i + count] == value && count < 255) {
+            count++;
+        }
+        
+        if (count > 3 || value == 0xFF) {
+            out.push_back(0xFF);
+            out.push_back(static_cast<uint8_t>(count));
+            out.push_back(value);
+        } else {
+            out.insert(out.end(), count, value);
+        }
+        i += count;
+    }
+}
+
+void encodeLz(const uint8_t* in, size_t size, std::vector<uint8_t>& out, int level) {
+    if (level <= 1) {
+        encodeLzGreedy(in, size, out);
+    } else {
+        encodeLzChained(in, size, out, level > 3 ? 3 : level);
+    }
+}
+
+bool encodeBlock(uint32_t codec, const uint8_t* in, size_t size, std::vector<uint8_t>& out,
+                 int level) {
+    switch (codec) {
+        case CODEC_STORE:
+            out.insert(out.end(), in, in + size);
+            return true;
+        case CODEC_RLE:
+            encodeRle(in, size, out);
+            return true;
+        case CODEC_LZ:
+            encodeLz(in, size, out, level);
+            return true;
+#ifdef USE_ZLIB
+        case CODEC_ZLIB: {
+            size_t start = out.size();
+            uLongf compressedSize = compressBound(static_cast<uLong>(size));
+            out.resize(start + compressedSize);
+            if (compress2(out.data() + start, &compressedSize, in, static_cast<uLong>(size),
+                          level) != Z_OK) {
+                out.resize(start);
+                return false;
+            }
+            out.resize(start + compressedSize);
+            return true;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+bool codecAvailable(uint32_t codec) {
+    switch (codec) {
+        case CODEC_STORE:
+        case CODEC_RLE:
+        case CODEC_LZ:
+            return true;
+#ifdef USE_ZLIB
+        case CODEC_ZLIB:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+} // namespace Packer
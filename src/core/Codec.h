@@ -0,0 +1,509 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+// Entry codecs referenced by ManifestRecord::codec and ManifestGroup::codec.
+// Decoders are header-only and dependency-free because the stub compiles
+// them in directly; the encoders live in Codec.cpp and are builder-only.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+namespace Packer {
+
+const uint32_t CODEC_STORE = 0;  // Raw bytes
+const uint32_t CODEC_RLE   = 1;  // 0xFF count value runs, see encodeRle
+const uint32_t CODEC_LZ    = 2;  // LZ4 block format, 64 KB window
+const uint32_t CODEC_ZLIB  = 3;  // zlib stream (RFC 1950); encoder needs USE_ZLIB
+
+inline const char* codecName(uint32_t codec) {
+    switch (codec) {
+        case CODEC_STORE: return "store";
+        case CODEC_RLE:   return "rle";
+        case CODEC_LZ:    return "lz";
+        case CODEC_ZLIB:  return "zlib";
+        default:          return "unknown";
+    }
+}
+
+// RLE: a 0xFF byte starts a run (0xFF, count 1-255, value); anything else is
+// a literal. Runs of 0xFF are always encoded as runs so literals never
+// contain the escape byte.
+inline bool decodeRle(const uint8_t* in, size_t inSize, uint8_t* out, size_t outSize) {
+    size_t ip = 0;
+    size_t op = 0;
+    while (ip < inSize) {
+        if (in[ip] != 0xFF) {
+            if (op == outSize) {
+                return false;
+            }
+            out[op++] = in[ip++];
+            continue;
+        }
+        if (inSize - ip < 3) {
+            return false;
+        }
+        size_t count = in[ip + 1];
+        if (count == 0 || count > outSize - op) {
+            return false;
+        }
+        memset(out + op, in[ip + 2], count);
+        op += count;
+        ip += 3;
+    }
+    return op == outSize;
+}
+
+// LZ4 block: sequences of (token, literal length ext, literals, offset,
+// match length ext). The last sequence carries literals only.
+inline bool decodeLz(const uint8_t* in, size_t inSize, uint8_t* out, size_t outSize) {
+    const uint8_t* ip = in;
+    const uint8_t* iend = in + inSize;
+    uint8_t* op = out;
+    uint8_t* oend = out + outSize;
+    
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            uint8_t extra;
+            do {
+                if (ip == iend) {
+                    return false;
+                }
+                extra = *ip++;
+                literals += extra;
+            } while (extra == 255);
+        }
+        
+        if (literals > static_cast<size_t>(iend - ip) || literals > static_cast<size_t>(oend - op)) {
+            return false;
+        }
+        if (literals != 0) {
+            memcpy(op, ip, literals);
+        }
+        ip += literals;
+        op += literals;
+        
+        if (ip == iend) {
+            break;
+        }
+        
+        if (iend - ip < 2) {
+            return false;
+        }
+        size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - out)) {
+            return false;
+        }
+        
+        size_t length = token & 15;
+        if (length == 15) {
+            uint8_t extra;
+            do {
+                if (ip == iend) {
+                    return false;
+                }
+                extra = *ip++;
+                length += extra;
+            } while (extra == 255);
+        }
+        length += 4;
+        
+        if (length > static_cast<size_t>(oend - op)) {
+            return false;
+        }
+        
+        const uint8_t* match = op - offset;
+        if (offset >= length) {
+            memcpy(op, match, length);
+            op += length;
+        } else {
+            // Overlapping copy repeats the last 'offset' bytes
+            for (size_t i = 0; i < length; i++) {
+                *op++ = *match++;
+            }
+        }
+    }
+    
+    return op == oend;
+}
+
+// Inflate, after zlib's contrib/puff: canonical Huffman codes decoded a
+// bit at a time. Small rather than fast; the codec search only picks zlib
+// when it still meets the decode-speed floor.
+namespace inflatedetail {
+
+const int MAX_BITS = 15;
+
+struct Huffman {
+    short count[MAX_BITS + 1];  // Codes of each length
+    short symbol[288];          // Symbols in canonical order
+};
+
+struct State {
+    const uint8_t* in;
+    size_t inSize;
+    size_t inPos;
+    uint8_t* out;
+    size_t outSize;
+    size_t outPos;
+    uint32_t bitBuffer;
+    int bitCount;
+    bool error;
+};
+
+inline int bits(State& s, int need) {
+    uint32_t value = s.bitBuffer;
+    while (s.bitCount < need) {
+        if (s.inPos == s.inSize) {
+            s.error = true;
+            return 0;
+        }
+        value |= static_cast<uint32_t>(s.in[s.inPos++]) << s.bitCount;
+        s.bitCount += 8;
+    }
+    s.bitBuffer = value >> need;
+    s.bitCount -= need;
+    return static_cast<int>(value & ((1u << need) - 1));
+}
+
+inline int decodeSymbol(State& s, const Huffman& h) {
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int len = 1; len <= MAX_BITS; len++) {
+        code |= bits(s, 1);
+        int count = h.count[len];
+        if (code - count < first) {
+            return h.symbol[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+// 0 = complete code, > 0 = incomplete, < 0 = over-subscribed
+inline int buildHuffman(Huffman& h, const short* lengths, int n) {
+    for (int len = 0; len <= MAX_BITS; len++) {
+        h.count[len] = 0;
+    }
+    for (int symbol = 0; symbol < n; symbol++) {
+        h.count[lengths[symbol]]++;
+    }
+    if (h.count[0] == n) {
+        return 0;
+    }
+    
+    int left = 1;
+    for (int len = 1; len <= MAX_BITS; len++) {
+        left <<= 1;
+        left -= h.count[len];
+        if (left < 0) {
+            return left;
+        }
+    }
+    
+    short offsets[MAX_BITS + 1];
+    offsets[1] = 0;
+    for (int len = 1; len < MAX_BITS; len++) {
+        offsets[len + 1] = static_cast<short>(offsets[len] + h.count[len]);
+    }
+    for (int symbol = 0; symbol < n; symbol++) {
+        if (lengths[symbol] != 0) {
+            h.symbol[offsets[lengths[symbol]]++] = static_cast<short>(symbol);
+        }
+    }
+    return left;
+}
+
+inline bool storedBlock(State& s) {
+    s.bitBuffer = 0;
+    s.bitCount = 0;
+    if (s.inSize - s.inPos < 4) {
+        return false;
+    }
+    size_t length = s.in[s.inPos] | (static_cast<size_t>(s.in[s.inPos + 1]) << 8);
+    size_t check = s.in[s.inPos + 2] | (static_cast<size_t>(s.in[s.inPos + 3]) << 8);
+    s.inPos += 4;
+    if (length != (~check & 0xFFFF) || length > s.inSize - s.inPos ||
+        length > s.outSize - s.outPos) {
+        return false;
+    }
+    if (length != 0) {
+        memcpy(s.out + s.outPos, s.in + s.inPos, length);
+    }
+    s.inPos += length;
+    s.outPos += length;
+    return true;
+}
+
+inline bool codes(State& s, const Huffman& lengthCode, const Huffman& distanceCode) {
+    static const short lengthBase[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const short lengthExtra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const int distanceBase[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+        8193, 12289, 16385, 24577};
+    static const short distanceExtra[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    
+    for (;;) {
+        int symbol = decodeSymbol(s, lengthCode);
+        if (s.error || symbol < 0) {
+            return false;
+        }
+        if (symbol < 256) {
+            if (s.outPos == s.outSize) {
+                return false;
+            }
+            s.out[s.outPos++] = static_cast<uint8_t>(symbol);
+            continue;
+        }
+        if (symbol == 256) {
+            return true;
+        }
+        
+        symbol -= 257;
+        if (symbol >= 29) {
+            return false;
+        }
+        size_t length = lengthBase[symbol] + bits(s, lengthExtra[symbol]);
+        
+        symbol = decodeSymbol(s, distanceCode);
+        if (s.error || symbol < 0 || symbol >= 30) {
+            return false;
+        }
+        size_t distance = distanceBase[symbol] + bits(s, distanceExtra[symbol]);
+        if (s.error || distance > s.outPos || length > s.outSize - s.outPos) {
+            return false;
+        }
+        
+        const uint8_t* from = s.out + s.outPos - distance;
+        for (size_t i = 0; i < length; i++) {
+            s.out[s.outPos++] = from[i];
+        }
+    }
+}
+
+inline bool fixedBlock(State& s) {
+    Huffman lengthCode;
+    Huffman distanceCode;
+    short lengths[288];
+    int symbol = 0;
+    for (; symbol < 144; symbol++) lengths[symbol] = 8;
+    for (; symbol < 256; symbol++) lengths[symbol] = 9;
+    for (; symbol < 280; symbol++) lengths[symbol] = 7;
+    for (; symbol < 288; symbol++) lengths[symbol] = 8;
+    buildHuffman(lengthCode, lengths, 288);
+    for (symbol = 0; symbol < 30; symbol++) lengths[symbol] = 5;
+    buildHuffman(distanceCode, lengths, 30);
+    return codes(s, lengthCode, distanceCode);
+}
+
+inline bool dynamicBlock(State& s) {
+    static const short order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    
+    int lengthCount = bits(s, 5) + 257;
+    int distanceCount = bits(s, 5) + 1;
+    int codeCount = bits(s, 4) + 4;
+    if (s.error || lengthCount > 286 || distanceCount > 30) {
+        return false;
+    }
+    
+    short lengths[286 + 30];
+    int index = 0;
+    for (; index < codeCount; index++) {
+        lengths[order[index]] = static_cast<short>(bits(s, 3));
+    }
+    for (; index < 19; index++) {
+        lengths[order[index]] = 0;
+    }
+    
+    Huffman lengthCode;
+    Huffman distanceCode;
+    if (s.error || buildHuffman(lengthCode, lengths, 19) != 0) {
+        return false;
+    }
+    
+    index = 0;
+    while (index < lengthCount + distanceCount) {
+        int symbol = decodeSymbol(s, lengthCode);
+        if (s.error || symbol < 0) {
+            return false;
+        }
+        if (symbol < 16) {
+            lengths[index++] = static_cast<short>(symbol);
+            continue;
+        }
+        
+        short repeat = 0;
+        if (symbol == 16) {
+            if (index == 0) {
+                return false;
+            }
+            repeat = lengths[index - 1];
+            symbol = 3 + bits(s, 2);
+        } else if (symbol == 17) {
+            symbol = 3 + bits(s, 3);
+        } else {
+            symbol = 11 + bits(s, 7);
+        }
+        if (s.error || index + symbol > lengthCount + distanceCount) {
+            return false;
+        }
+        while (symbol-- > 0) {
+            lengths[index++] = repeat;
+        }
+    }
+    
+    if (lengths[256] == 0) {
+        return false;
+    }
+    
+    // Incomplete codes are only allowed for a single length
+    int err = buildHuffman(lengthCode, lengths, lengthCount);
+    if (err < 0 || (err > 0 && lengthCount - lengthCode.count[0] != 1)) {
+        return false;
+    }
+    err = buildHuffman(distanceCode, lengths + lengthCount, distanceCount);
+    if (err < 0 || (err > 0 && distanceCount - distanceCode.count[0] != 1)) {
+        return false;
+    }
+    
+    return codes(s, lengthCode, distanceCode);
+}
+
+// Every block up to and including the one marked last
+inline bool blocks(State& s) {
+    int last;
+    do {
+        last = bits(s, 1);
+        int type = bits(s, 2);
+        bool ok = false;
+        if (s.error) {
+            return false;
+        } else if (type == 0) {
+            ok = storedBlock(s);
+        } else if (type == 1) {
+            ok = fixedBlock(s);
+        } else if (type == 2) {
+            ok = dynamicBlock(s);
+        }
+        if (!ok) {
+            return false;
+        }
+    } while (!last);
+    return true;
+}
+
+inline uint32_t adler32(const uint8_t* data, size_t size) {
+    uint32_t a = 1;
+    uint32_t b = 0;
+    while (size > 0) {
+        size_t block = size < 5552 ? size : 5552;
+        size -= block;
+        while (block-- > 0) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+} // namespace inflatedetail
+
+// zlib stream: 2-byte header, deflate blocks, big-endian Adler-32
+inline bool decodeZlib(const uint8_t* in, size_t inSize, uint8_t* out, size_t outSize) {
+    using namespace inflatedetail;
+    
+    if (inSize < 6 || (in[0] & 0x0F) != 8 || (in[0] >> 4) > 7 ||
+        ((in[0] << 8) | in[1]) % 31 != 0 || (in[1] & 0x20) != 0) {
+        return false;
+    }
+    
+    State s = {};
+    s.in = in;
+    s.inSize = inSize - 4;
+    s.inPos = 2;
+    s.out = out;
+    s.outSize = outSize;
+    if (!blocks(s)) {
+        return false;
+    }
+    
+    const uint8_t* check = in + inSize - 4;
+    uint32_t expected = (static_cast<uint32_t>(check[0]) << 24) | (check[1] << 16) |
+                        (check[2] << 8) | check[3];
+    return s.outPos == outSize && adler32(out, outSize) == expected;
+}
+
+// Raw deflate stream (RFC 1951), as stored in ZIP archives; not a codec
+// of its own, but shares the inflater with decodeZlib
+inline bool decodeDeflate(const uint8_t* in, size_t inSize, uint8_t* out, size_t outSize) {
+    using namespace inflatedetail;
+    
+    State s = {};
+    s.in = in;
+    s.inSize = inSize;
+    s.out = out;
+    s.outSize = outSize;
+    return blocks(s) && s.outPos == outSize;
+}
+
+// Decode exactly outSize bytes
+inline bool decodeBlock(uint32_t codec, const uint8_t* in, size_t inSize,
+                        uint8_t* out, size_t outSize) {
+    switch (codec) {
+        case CODEC_STORE:
+            if (inSize != outSize) {
+                return false;
+            }
+            if (outSize != 0) {
+                memcpy(out, in, outSize);
+            }
+            return true;
+        case CODEC_RLE:
+            return decodeRle(in, inSize, out, outSize);
+        case CODEC_LZ:
+            return decodeLz(in, inSize, out, outSize);
+        case CODEC_ZLIB:
+            return decodeZlib(in, inSize, out, outSize);
+        default:
+            return false;
+    }
+}
+
+// Builder side (Codec.cpp). Output is appended to 'out'. Levels: LZ 1
+// (greedy, fast) to 3 (deep match search), zlib 1 to 9.
+void encodeRle(const uint8_t* in, size_t size, std::vector<uint8_t>& out);
+void encodeLz(const uint8_t* in, size_t size, std::vector<uint8_t>& out, int level = 1);
+bool encodeBlock(uint32_t codec, const uint8_t* in, size_t size, std::vector<uint8_t>& out,
+                 int level = 1);
+
+// False when the codec's encoder is not compiled in (zlib without USE_ZLIB)
+bool codecAvailable(uint32_t codec);
+
+// Output capacity that covers any encoding worth keeping: LZ's worst case,
+// and more than zlib's. Outputs at least as large as the input are stored
+// instead, so reserving this up front means encoding never regrows 'out'.
+inline size_t encodeBound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+} // namespace Packer
+
+#endif // CODEC_H
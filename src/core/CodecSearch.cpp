@@ -0,0 +1,138 @@
+#include "CodecSearch.h"
+#include "Codec.h"
+
+namespace Packer {
+
+namespace {
+
+const double BYTES_PER_MB = 1024.0 * 1024.0;
+
+// Largest round-trip buffer a thread keeps between blocks
+const size_t DECODE_SCRATCH_LIMIT = 16 * 1024 * 1024;
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+CodecSearch::CodecSearch(const CodecSearchOptions& options, bool parallel)
+    : m_options(options),
+      m_deadline(std::chrono::steady_clock::now() +
+                 std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                     std::chrono::duration<double>(options.timeBudget))) {
+    if (!m_options.enabled) {
+        return;
+    }
+    
+    // Fast to slow; zlib only when the encoder is compiled in
+    const Candidate all[] = {
+        { CODEC_RLE, 1 },
+        { CODEC_LZ, 1 }, { CODEC_LZ, 2 }, { CODEC_LZ, 3 },
+        { CODEC_ZLIB, 1 }, { CODEC_ZLIB, 6 }, { CODEC_ZLIB, 9 },
+    };
+    for (const auto& candidate : all) {
+        if (codecAvailable(candidate.codec)) {
+            m_candidates.push_back(candidate);
+        }
+    }
+    
+    if (parallel) {
+        m_pool.reset(new ThreadPool(m_candidates.size()));
+    }
+}
+
+CodecSearch::~CodecSearch() {
+}
+
+bool CodecSearch::expired() const {
+    return m_options.timeBudget > 0 && std::chrono::steady_clock::now() >= m_deadline;
+}
+
+bool CodecSearch::tryCandidate(const Candidate& candidate, const uint8_t* data, size_t size,
+                               CodecChoice& result) {
+    result.codec = candidate.codec;
+    result.level = candidate.level;
+    result.output.clear();
+    
+    auto start = std::chrono::steady_clock::now();
+    if (!encodeBlock(candidate.codec, data, size, result.output, candidate.level)) {
+        return false;
+    }
+    result.encodeSeconds = secondsSince(start);
+    
+    if (result.output.size() >= size) {
+        return false;  // Storing is smaller
+    }
+    
+    // Decode back: measures the stub's decode cost and guards against
+    // encoder bugs ever reaching a bundle. Blocks up to the scratch limit
+    // decode into a buffer each thread keeps.
+    thread_local std::vector<uint8_t> scratch;
+    std::vector<uint8_t> large;
+    std::vector<uint8_t>& decoded = size <= DECODE_SCRATCH_LIMIT ? scratch : large;
+    decoded.resize(size);
+    start = std::chrono::steady_clock::now();
+    bool ok = decodeBlock(candidate.codec, result.output.data(), result.output.size(),
+                          decoded.data(), decoded.size());
+    result.decodeSeconds = secondsSince(start);
+    
+    return ok && memcmp(decoded.data(), data, size) == 0;
+}
+
+void CodecSearch::choose(const uint8_t* data, size_t size, CodecChoice& choice) {
+    std::vector<uint8_t> output = std::move(choice.output);
+    output.clear();
+    choice = CodecChoice();
+    choice.codec = CODEC_STORE;
+    choice.output = std::move(output);
+    if (size == 0) {
+        return;
+    }
+    
+    // Default path: one fast candidate, encoded into the caller's buffer
+    if (!m_options.enabled || expired()) {
+        CodecChoice result;
+        result.output = std::move(choice.output);
+        if (tryCandidate({ CODEC_LZ, 1 }, data, size, result)) {
+            choice = std::move(result);
+        } else {
+            result.output.clear();
+            choice.output = std::move(result.output);
+        }
+        return;
+    }
+    
+    std::vector<CodecChoice> results(m_candidates.size());
+    std::vector<char> succeeded(m_candidates.size(), 0);
+    for (size_t i = 0; i < m_candidates.size(); i++) {
+        if (!m_pool) {
+            succeeded[i] = tryCandidate(m_candidates[i], data, size, results[i]) ? 1 : 0;
+            continue;
+        }
+        m_pool->submit([this, i, data, size, &results, &succeeded] {
+            succeeded[i] = tryCandidate(m_candidates[i], data, size, results[i]) ? 1 : 0;
+        });
+    }
+    if (m_pool) {
+        m_pool->wait();
+    }
+    
+    for (size_t i = 0; i < results.size(); i++) {
+        if (!succeeded[i]) {
+            continue;
+        }
+        
+        CodecChoice& result = results[i];
+        double decodeSpeed = result.decodeSeconds > 0 ? size / BYTES_PER_MB / result.decodeSeconds : 0;
+        bool fastEnough = m_options.minDecodeSpeed <= 0 || result.decodeSeconds <= 0 ||
+                          decodeSpeed >= m_options.minDecodeSpeed;
+        bool smaller = choice.codec == CODEC_STORE || result.output.size() < choice.output.size();
+        
+        if (fastEnough && smaller) {
+            choice = std::move(result);
+        }
+    }
+}
+
+} // namespace Packer
@@ -0,0 +1,60 @@
+#ifndef CODECSEARCH_H
+#define CODECSEARCH_H
+
+#include "common.h"
+#include "ThreadPool.h"
+#include <chrono>
+
+namespace Packer {
+
+// Outcome of encoding one block
+struct CodecChoice {
+    uint32_t codec;
+    int level;
+    std::vector<uint8_t> output;  // Encoded bytes; empty for CODEC_STORE (use the input)
+    double encodeSeconds;         // Chosen candidate only
+    double decodeSeconds;         // Measured by decoding the output back
+    
+    CodecChoice() : codec(0), level(0), encodeSeconds(0), decodeSeconds(0) {}
+};
+
+// Picks the codec for each block. Without search every block gets the
+// default (LZ level 1). With search, all candidates are tried and
+// the smallest output that decodes at least minDecodeSpeed wins; once the
+// time budget is spent the remaining blocks fall back to the default.
+// Every chosen output is decoded back and compared before it is used.
+class CodecSearch {
+public:
+    // parallel: run the candidates for a block on an internal pool. Without
+    // it they run one after another on the calling thread, and choose may
+    // be called from several threads at once.
+    explicit CodecSearch(const CodecSearchOptions& options, bool parallel = true);
+    ~CodecSearch();
+    
+    // Encode one block. Not reentrant when parallel. Without search the
+    // output goes into choice.output's existing buffer, so callers can hand
+    // in a pooled one with encodeBound(size) capacity.
+    void choose(const uint8_t* data, size_t size, CodecChoice& choice);
+    
+    // True once the time budget is spent
+    bool expired() const;
+
+private:
+    struct Candidate {
+        uint32_t codec;
+        int level;
+    };
+    
+    // Encode and time one candidate; false if it fails to round-trip
+    static bool tryCandidate(const Candidate& candidate, const uint8_t* data, size_t size,
+                             CodecChoice& result);
+    
+    CodecSearchOptions m_options;
+    std::vector<Candidate> m_candidates;
+    std::unique_ptr<ThreadPool> m_pool;
+    std::chrono::steady_clock::time_point m_deadline;
+};
+
+} // namespace Packer
+
+#endif // CODECSEARCH_H
@@ -0,0 +1,198 @@
+#ifndef CONTENTHASH_H
+#define CONTENTHASH_H
+
+// XXH64 content hash stored per entry in the manifest.
+// Header-only and dependency-free so the stub and the Linux tools compute
+// exactly the same value as the builder.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+namespace Packer {
+
+namespace xxh64detail {
+
+const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+const uint64_t PRIME3 = 0x165667B19E3779F9ull;
+const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+const uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t rotl(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t read64(const uint8_t* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint32_t read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input) {
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+inline uint64_t mergeRound(uint64_t acc, uint64_t value) {
+    acc ^= round(0, value);
+    return acc * PRIME1 + PRIME4;
+}
+
+// Length, remaining tail bytes and final avalanche
+inline uint64_t finish(uint64_t hash, uint64_t totalSize, const uint8_t* p, const uint8_t* end) {
+    hash += totalSize;
+    
+    while (end - p >= 8) {
+        hash ^= round(0, read64(p));
+        hash = rotl(hash, 27) * PRIME1 + PRIME4;
+        p += 8;
+    }
+    
+    if (end - p >= 4) {
+        hash ^= static_cast<uint64_t>(read32(p)) * PRIME1;
+        hash = rotl(hash, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    
+    while (p < end) {
+        hash ^= (*p) * PRIME5;
+        hash = rotl(hash, 11) * PRIME1;
+        p++;
+    }
+    
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+inline uint64_t mergeLanes(uint64_t v1, uint64_t v2, uint64_t v3, uint64_t v4) {
+    uint64_t hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    hash = mergeRound(hash, v1);
+    hash = mergeRound(hash, v2);
+    hash = mergeRound(hash, v3);
+    hash = mergeRound(hash, v4);
+    return hash;
+}
+
+} // namespace xxh64detail
+
+// XXH64 of a buffer (little-endian hosts, same as the manifest)
+inline uint64_t xxh64(const void* data, size_t size, uint64_t seed = 0) {
+    using namespace xxh64detail;
+    
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* end = p + size;
+    uint64_t hash;
+    
+    if (size >= 32) {
+        uint64_t v1 = seed + PRIME1 + PRIME2;
+        uint64_t v2 = seed + PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME1;
+        
+        const uint8_t* limit = end - 32;
+        do {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        
+        hash = mergeLanes(v1, v2, v3, v4);
+    } else {
+        hash = seed + PRIME5;
+    }
+    
+    return finish(hash, static_cast<uint64_t>(size), p, end);
+}
+
+// XXH64 fed piece by piece; digest() equals xxh64() of everything passed
+// to update() and zeros() in order. Lets the stub check sparse entries
+// without materializing their holes.
+class Xxh64Stream {
+public:
+    explicit Xxh64Stream(uint64_t seed = 0)
+        : m_v1(seed + xxh64detail::PRIME1 + xxh64detail::PRIME2), m_v2(seed + xxh64detail::PRIME2),
+          m_v3(seed), m_v4(seed - xxh64detail::PRIME1), m_seed(seed), m_total(0), m_buffered(0) {}
+    
+    void update(const void* data, size_t size) {
+        using namespace xxh64detail;
+        
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        m_total += size;
+        
+        if (m_buffered + size < 32) {
+            memcpy(m_buffer + m_buffered, p, size);
+            m_buffered += size;
+            return;
+        }
+        
+        if (m_buffered != 0) {
+            size_t fill = 32 - m_buffered;
+            memcpy(m_buffer + m_buffered, p, fill);
+            consume(m_buffer);
+            p += fill;
+            size -= fill;
+            m_buffered = 0;
+        }
+        
+        for (; size >= 32; p += 32, size -= 32) {
+            consume(p);
+        }
+        
+        memcpy(m_buffer, p, size);
+        m_buffered = size;
+    }
+    
+    // Feed count zero bytes
+    void zeros(uint64_t count) {
+        static const uint8_t ZERO_BLOCK[4096] = {};
+        while (count > 0) {
+            size_t chunk = count < sizeof(ZERO_BLOCK) ? static_cast<size_t>(count) : sizeof(ZERO_BLOCK);
+            update(ZERO_BLOCK, chunk);
+            count -= chunk;
+        }
+    }
+    
+    uint64_t digest() const {
+        using namespace xxh64detail;
+        
+        uint64_t hash = m_total >= 32 ? mergeLanes(m_v1, m_v2, m_v3, m_v4) : m_seed + PRIME5;
+        return finish(hash, m_total, m_buffer, m_buffer + m_buffered);
+    }
+
+private:
+    void consume(const uint8_t* p) {
+        using namespace xxh64detail;
+        
+        m_v1 = round(m_v1, read64(p));
+        m_v2 = round(m_v2, read64(p + 8));
+        m_v3 = round(m_v3, read64(p + 16));
+        m_v4 = round(m_v4, read64(p + 24));
+    }
+    
+    uint64_t m_v1;
+    uint64_t m_v2;
+    uint64_t m_v3;
+    uint64_t m_v4;
+    uint64_t m_seed;
+    uint64_t m_total;
+    uint8_t m_buffer[32];
+    size_t m_buffered;
+};
+
+} // namespace Packer
+
+#endif // CONTENTHASH_H
@@ -0,0 +1,384 @@
+#include "DeltaCodec.h"
+#include "ManifestFormat.h"
+#include "PEParser.h"
+#include <algorithm>
+
+namespace Packer {
+
+namespace {
+
+const uint64_t OP_COPY  = 0;
+const uint64_t OP_ADD   = 1;
+const uint64_t OP_PATCH = 2;
+
+const size_t WINDOW = 16;           // Bytes hashed per base index entry
+const size_t MIN_MATCH = 32;        // Shorter matches are left to PATCH or ADD
+const size_t PATCH_CHUNK = 64;      // PATCH is chosen per chunk of this many bytes
+const int MAX_INDEX_BITS = 26;      // 64M slots, 256 MB of index
+
+// After this many positions without a match the scan starts skipping,
+// by odd steps so it still meets every alignment of the base index
+const size_t SKIP_AFTER = 64;
+const size_t MAX_SKIP = 15;
+
+inline uint32_t windowHash(const uint8_t* p, int bits) {
+    uint64_t low;
+    uint64_t high;
+    memcpy(&low, p, 8);
+    memcpy(&high, p + 8, 8);
+    uint64_t hash = (low ^ (high * 0x9E3779B97F4A7C15ull)) * 0xC2B2AE3D27D4EB4Full;
+    return static_cast<uint32_t>(hash >> (64 - bits));
+}
+
+inline uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// A section present in both images: target range and where it starts in the base
+struct SectionPair {
+    uint64_t targetStart;
+    uint64_t targetEnd;
+    uint64_t baseStart;
+};
+
+void pairSections(const std::vector<uint8_t>& base, const std::vector<uint8_t>& target,
+                  std::vector<SectionPair>& pairs) {
+    PEParser parser;
+    std::vector<IMAGE_SECTION_HEADER> baseSections;
+    std::vector<IMAGE_SECTION_HEADER> targetSections;
+    if (!parser.getSections(base, baseSections) || !parser.getSections(target, targetSections)) {
+        return;
+    }
+    
+    for (const auto& section : targetSections) {
+        for (const auto& candidate : baseSections) {
+            if (memcmp(section.Name, candidate.Name, IMAGE_SIZEOF_SHORT_NAME) != 0) {
+                continue;
+            }
+            uint64_t start = section.PointerToRawData;
+            uint64_t end = std::min<uint64_t>(start + section.SizeOfRawData, target.size());
+            if (start < end && candidate.PointerToRawData < base.size()) {
+                pairs.push_back({ start, end, candidate.PointerToRawData });
+            }
+            break;
+        }
+    }
+}
+
+// Target position where a match too short to copy was found
+struct Anchor {
+    size_t position;
+    int64_t displacement;   // Base minus target offset
+};
+
+class Differ {
+public:
+    Differ(const std::vector<uint8_t>& base, const std::vector<uint8_t>& target,
+           std::vector<uint8_t>& script)
+        : m_base(base.data()), m_baseSize(base.size()),
+          m_target(target.data()), m_targetSize(target.size()),
+          m_script(script), m_baseCursor(0), m_displacement(0), m_indexBits(10) {
+        pairSections(base, target, m_sections);
+    }
+    
+    void run() {
+        buildIndex();
+        
+        size_t literal = 0;     // Start of target bytes not yet covered
+        size_t misses = 0;
+        size_t p = 0;
+        while (m_targetSize - p >= WINDOW) {
+            // Candidates: continuing the last copy, the same place in the
+            // matching section, and whatever the index remembers
+            size_t bestLength = 0;
+            size_t bestBase = 0;
+            size_t candidates[3];
+            size_t count = 0;
+            int64_t continued = static_cast<int64_t>(p) + m_displacement;
+            if (continued >= 0) {
+                candidates[count++] = static_cast<size_t>(continued);
+            }
+            size_t aligned;
+            if (sectionOffset(p, aligned)) {
+                candidates[count++] = aligned;
+            }
+            uint32_t slot = m_index[windowHash(m_target + p, m_indexBits)];
+            if (slot != 0) {
+                candidates[count++] = static_cast<size_t>(slot - 1) * WINDOW;
+            }
+            
+            for (size_t c = 0; c < count; c++) {
+                size_t length = matchLength(p, candidates[c]);
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestBase = candidates[c];
+                }
+            }
+            
+            // Widen backwards into bytes not yet covered
+            size_t back = 0;
+            while (bestLength != 0 && p - back > literal && bestBase > back &&
+                   m_target[p - back - 1] == m_base[bestBase - back - 1]) {
+                back++;
+            }
+            
+            if (bestLength + back < MIN_MATCH) {
+                // Too short to copy, but a hint for lining up the literal
+                // bytes; skip it, PATCH will cover it
+                size_t step = 1 + 2 * std::min(misses++ / SKIP_AFTER, MAX_SKIP / 2);
+                if (bestLength >= WINDOW) {
+                    addAnchor(p, static_cast<int64_t>(bestBase) - static_cast<int64_t>(p));
+                    step = bestLength;
+                    misses = 0;
+                }
+                p += std::min(step, m_targetSize - WINDOW - p + 1);
+                continue;
+            }
+            
+            flushLiteral(literal, p - back);
+            emit(OP_COPY, bestBase - back, bestLength + back);
+            m_displacement = static_cast<int64_t>(bestBase) - static_cast<int64_t>(p);
+            p += bestLength;
+            literal = p;
+            misses = 0;
+        }
+        
+        flushLiteral(literal, m_targetSize);
+    }
+
+private:
+    void buildIndex() {
+        size_t blocks = m_baseSize / WINDOW;
+        while (m_indexBits < MAX_INDEX_BITS && (size_t(1) << m_indexBits) < blocks) {
+            m_indexBits++;
+        }
+        m_index.assign(size_t(1) << m_indexBits, 0);
+        
+        // Slots hold block + 1; blocks past the 32-bit range are not indexed
+        blocks = std::min<size_t>(blocks, UINT32_MAX - 1);
+        for (size_t b = 0; b < blocks; b++) {
+            m_index[windowHash(m_base + b * WINDOW, m_indexBits)] = static_cast<uint32_t>(b + 1);
+        }
+    }
+    
+    // Base offset at the same place within the matching PE section
+    bool sectionOffset(size_t p, size_t& offset) const {
+        for (const auto& pair : m_sections) {
+            if (p >= pair.targetStart && p < pair.targetEnd) {
+                offset = static_cast<size_t>(pair.baseStart + (p - pair.targetStart));
+                return offset < m_baseSize;
+            }
+        }
+        return false;
+    }
+    
+    size_t matchLength(size_t p, size_t q) const {
+        if (q >= m_baseSize) {
+            return 0;
+        }
+        size_t limit = std::min(m_targetSize - p, m_baseSize - q);
+        size_t length = 0;
+        while (limit - length >= 8) {
+            uint64_t a;
+            uint64_t b;
+            memcpy(&a, m_target + p + length, 8);
+            memcpy(&b, m_base + q + length, 8);
+            if (a != b) {
+                break;
+            }
+            length += 8;
+        }
+        while (length < limit && m_target[p + length] == m_base[q + length]) {
+            length++;
+        }
+        return length;
+    }
+    
+    void emit(uint64_t op, size_t baseOffset, size_t length) {
+        appendVarint(m_script, static_cast<uint64_t>(length) << 2 | op);
+        appendVarint(m_script, zigzag(static_cast<int64_t>(baseOffset) - static_cast<int64_t>(m_baseCursor)));
+        m_baseCursor = baseOffset + length;
+    }
+    
+    void addAnchor(size_t p, int64_t displacement) {
+        if (m_anchors.empty() || m_anchors.back().displacement != displacement) {
+            m_anchors.push_back({ p, displacement });
+        }
+    }
+    
+    // Whether target bytes [p, p + length) mostly equal the base at p + displacement
+    bool similar(size_t p, size_t length, int64_t displacement) const {
+        int64_t q = static_cast<int64_t>(p) + displacement;
+        if (q < 0 || static_cast<uint64_t>(q) > m_baseSize || length > m_baseSize - static_cast<size_t>(q)) {
+            return false;
+        }
+        const uint8_t* base = m_base + q;
+        size_t equal = 0;
+        for (size_t i = 0; i < length; i++) {
+            equal += m_target[p + i] == base[i];
+        }
+        return equal * 2 >= length;
+    }
+    
+    // Cover target bytes [start, end) that no copy matched, chunk by chunk:
+    // as differences against the base where they mostly line up with it
+    // (last copy, same section, or a short match seen while scanning),
+    // else as literals
+    void flushLiteral(size_t start, size_t end) {
+        size_t addStart = start;
+        size_t patchStart = start;
+        bool patching = false;
+        int64_t current = m_displacement;
+        size_t anchor = 0;
+        
+        size_t i = start;
+        while (i < end) {
+            size_t chunk = std::min(PATCH_CHUNK, end - i);
+            while (anchor < m_anchors.size() && m_anchors[anchor].position < i + chunk) {
+                anchor++;
+            }
+            
+            bool matched = similar(i, chunk, current);
+            if (!matched) {
+                int64_t alternatives[2];
+                size_t count = 0;
+                size_t aligned;
+                if (sectionOffset(i, aligned)) {
+                    alternatives[count++] = static_cast<int64_t>(aligned) - static_cast<int64_t>(i);
+                }
+                if (anchor != 0) {
+                    alternatives[count++] = m_anchors[anchor - 1].displacement;
+                }
+                for (size_t c = 0; c < count && !matched; c++) {
+                    if (alternatives[c] != current && similar(i, chunk, alternatives[c])) {
+                        if (patching) {
+                            emitPatch(patchStart, i, current);
+                            patching = false;
+                        }
+                        current = alternatives[c];
+                        matched = true;
+                    }
+                }
+            }
+            
+            if (matched && !patching) {
+                emitAdd(addStart, i);
+                patchStart = i;
+                patching = true;
+            } else if (!matched && patching) {
+                emitPatch(patchStart, i, current);
+                patching = false;
+                addStart = i;
+            }
+            i += chunk;
+        }
+        
+        if (patching) {
+            emitPatch(patchStart, end, current);
+            m_displacement = current;
+        } else {
+            emitAdd(addStart, end);
+        }
+        m_anchors.clear();
+    }
+    
+    void emitPatch(size_t start, size_t end, int64_t displacement) {
+        size_t length = end - start;
+        size_t baseOffset = static_cast<size_t>(static_cast<int64_t>(start) + displacement);
+        emit(OP_PATCH, baseOffset, length);
+        size_t at = m_script.size();
+        m_script.resize(at + length);
+        for (size_t i = 0; i < length; i++) {
+            m_script[at + i] = static_cast<uint8_t>(m_target[start + i] - m_base[baseOffset + i]);
+        }
+    }
+    
+    void emitAdd(size_t start, size_t end) {
+        if (start == end) {
+            return;
+        }
+        appendVarint(m_script, static_cast<uint64_t>(end - start) << 2 | OP_ADD);
+        m_script.insert(m_script.end(), m_target + start, m_target + end);
+    }
+    
+    const uint8_t* m_base;
+    size_t m_baseSize;
+    const uint8_t* m_target;
+    size_t m_targetSize;
+    std::vector<uint8_t>& m_script;
+    std::vector<SectionPair> m_sections;
+    std::vector<uint32_t> m_index;
+    std::vector<Anchor> m_anchors;  // Short matches since the last copy
+    size_t m_baseCursor;        // Base offset after the last COPY or PATCH
+    int64_t m_displacement;     // Base minus target offset of the last COPY
+    int m_indexBits;
+};
+
+} // namespace
+
+void DeltaCodec::diff(const std::vector<uint8_t>& base, const std::vector<uint8_t>& target,
+                      std::vector<uint8_t>& script) {
+    script.clear();
+    Differ differ(base, target, script);
+    differ.run();
+}
+
+bool DeltaCodec::apply(const uint8_t* base, size_t baseSize, const uint8_t* script,
+                       size_t scriptSize, uint8_t* target, size_t targetSize) {
+    const uint8_t* p = script;
+    const uint8_t* end = script + scriptSize;
+    uint64_t position = 0;
+    uint64_t cursor = 0;
+    
+    while (p < end) {
+        uint64_t header;
+        if (!readVarint(p, end, header)) {
+            return false;
+        }
+        uint64_t op = header & 3;
+        uint64_t length = header >> 2;
+        if (length > targetSize - position) {
+            return false;
+        }
+        
+        if (op == OP_ADD) {
+            if (length > static_cast<uint64_t>(end - p)) {
+                return false;
+            }
+            memcpy(target + position, p, static_cast<size_t>(length));
+            p += length;
+        } else if (op == OP_COPY || op == OP_PATCH) {
+            uint64_t offset;
+            if (!readVarint(p, end, offset)) {
+                return false;
+            }
+            uint64_t from = cursor + static_cast<uint64_t>(unzigzag(offset));
+            if (from > baseSize || length > baseSize - from) {
+                return false;
+            }
+            if (op == OP_COPY) {
+                memcpy(target + position, base + from, static_cast<size_t>(length));
+            } else {
+                if (length > static_cast<uint64_t>(end - p)) {
+                    return false;
+                }
+                for (uint64_t i = 0; i < length; i++) {
+                    target[position + i] = static_cast<uint8_t>(base[from + i] + p[i]);
+                }
+                p += length;
+            }
+            cursor = from + length;
+        } else {
+            return false;
+        }
+        position += length;
+    }
+    
+    return position == targetSize;
+}
+
+} // namespace Packer
@@ -0,0 +1,42 @@
+#ifndef DELTACODEC_H
+#define DELTACODEC_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace Packer {
+
+// Binary diffs between two versions of an entry, for delta bundles.
+//
+// A script is a sequence of operations, each a varint (length << 2 | op):
+//
+//   0 COPY   varint base offset   length bytes of the base
+//   1 ADD    length bytes         literal bytes
+//   2 PATCH  varint base offset,  length bytes of the base, each plus the
+//            length bytes         matching byte here (mod 256)
+//
+// Base offsets are zigzag varints relative to where the previous COPY or
+// PATCH ended, so in-order copies cost a byte or two. PATCH covers code
+// whose bytes mostly line up with the base but differ here and there
+// (shifted addresses, relocations); its difference bytes are mostly zero
+// and compress well in the entry codec that runs on the script afterwards.
+//
+// When both versions are PE images, regions are lined up section by
+// section (matched by name) even where no exact match anchors them.
+class DeltaCodec {
+public:
+    // Script that turns base into target
+    static void diff(const std::vector<uint8_t>& base, const std::vector<uint8_t>& target,
+                     std::vector<uint8_t>& script);
+    
+    // Rebuild target from base and script; false when the script is
+    // malformed, reaches outside base, or does not produce exactly
+    // targetSize bytes
+    static bool apply(const uint8_t* base, size_t baseSize, const uint8_t* script,
+                      size_t scriptSize, uint8_t* target, size_t targetSize);
+};
+
+} // namespace Packer
+
+#endif // DELTACODEC_H
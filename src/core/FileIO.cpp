@@ -0,0 +1,216 @@
+#include "FileIO.h"
+
+namespace Packer {
+
+bool FileIO::readFile(const std::wstring& filePath, std::vector<uint8_t>& data) {
+    return readFile(filePath, data, nullptr);
+}
+
+bool FileIO::readFile(const std::wstring& filePath, std::vector<uint8_t>& data, BufferPool* pool) {
+    std::ifstream file(nativePath(filePath), std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    std::streamsize size = file.tellg();
+    if (size < 0) {
+        return false;
+    }
+    file.seekg(0, std::ios::beg);
+    
+    if (pool && data.capacity() < static_cast<size_t>(size)) {
+        pool->release(std::move(data));
+        data = pool->acquire(static_cast<size_t>(size));
+    }
+    data.resize(static_cast<size_t>(size));
+    return size == 0 || static_cast<bool>(file.read(reinterpret_cast<char*>(data.data()), size));
+}
+
+bool FileIO::readRange(const std::wstring& filePath, uint64_t offset, size_t size,
+                       std::vector<uint8_t>& data) {
+    std::ifstream file(nativePath(filePath), std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    file.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+    data.resize(size);
+    return size == 0 || static_cast<bool>(file.read(reinterpret_cast<char*>(data.data()), size));
+}
+
+bool FileIO::writeFile(const std::wstring& filePath, const std::vector<uint8_t>& data) {
+    std::ofstream file(nativePath(filePath), std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    file.close();
+    
+    return file.good();
+}
+
+bool FileIO::removeFile(const std::wstring& filePath) {
+    std::error_code error;
+    return std::filesystem::remove(nativePath(filePath), error);
+}
+
+bool FileIO::truncateFile(const std::wstring& filePath, uint64_t size) {
+    std::error_code error;
+    std::filesystem::resize_file(nativePath(filePath), size, error);
+    return !error;
+}
+
+bool FileIO::fileSize(const std::wstring& filePath, uint64_t& size) {
+    std::error_code error;
+    auto result = std::filesystem::file_size(nativePath(filePath), error);
+    if (error) {
+        return false;
+    }
+    
+    size = result;
+    return true;
+}
+
+FileWriter::FileWriter() : m_size(0) {
+}
+
+FileWriter::~FileWriter() {
+}
+
+bool FileWriter::open(const std::wstring& filePath) {
+    m_file.open(FileIO::nativePath(filePath), std::ios::binary | std::ios::trunc);
+    m_size = 0;
+    return m_file.is_open();
+}
+
+bool FileWriter::openAppend(const std::wstring& filePath) {
+    m_file.open(FileIO::nativePath(filePath), std::ios::binary | std::ios::in | std::ios::out);
+    if (!m_file.is_open()) {
+        return false;
+    }
+    m_file.seekp(0, std::ios::end);
+    std::streamoff end = m_file.tellp();
+    m_size = end < 0 ? 0 : static_cast<uint64_t>(end);
+    return end >= 0;
+}
+
+bool FileWriter::write(const uint8_t* data, size_t size) {
+    m_file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+    m_size += size;
+    return m_file.good();
+}
+
+bool FileWriter::writeAt(uint64_t offset, const uint8_t* data, size_t size) {
+    if (offset > m_size || size > m_size - offset) {
+        return false;
+    }
+    m_file.seekp(static_cast<std::streamoff>(offset), std::ios::beg);
+    m_file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+    m_file.seekp(static_cast<std::streamoff>(m_size), std::ios::beg);  // Back to the end
+    return m_file.good();
+}
+
+bool FileWriter::close() {
+    if (!m_file.is_open()) {
+        return false;
+    }
+    m_file.close();
+    return !m_file.fail();
+}
+
+// Converted by hand: std::filesystem's narrow encoding on Linux follows the
+// locale, and in the C locale it throws on any non-ASCII name. wchar_t holds
+// UTF-32 there and UTF-16 on Windows.
+std::wstring FileIO::fromUtf8(const std::string& text) {
+    const uint32_t replacement = 0xFFFD;
+    std::wstring out;
+    out.reserve(text.size());
+    size_t i = 0;
+    while (i < text.size()) {
+        uint32_t c = static_cast<uint8_t>(text[i]);
+        size_t length = c < 0x80 ? 1 : c >= 0xF0 && c < 0xF5 ? 4 : c >= 0xE0 ? 3 : c >= 0xC2 ? 2 : 0;
+        if (length == 0 || (length == 3 && c >= 0xF0)) {
+            out.push_back(static_cast<wchar_t>(replacement));
+            i++;
+            continue;
+        }
+        
+        uint32_t code = length == 1 ? c : c & (0x7F >> length);
+        size_t used = 1;
+        while (used < length && i + used < text.size() &&
+               (static_cast<uint8_t>(text[i + used]) & 0xC0) == 0x80) {
+            code = (code << 6) | (static_cast<uint8_t>(text[i + used]) & 0x3F);
+            used++;
+        }
+        // Truncated, overlong, a surrogate or past U+10FFFF
+        const uint32_t smallest[] = { 0, 0, 0x80, 0x800, 0x10000 };
+        if (used < length || code < smallest[length] || (code >= 0xD800 && code < 0xE000) ||
+            code > 0x10FFFF) {
+            code = replacement;
+        }
+        i += used;
+        
+        if (sizeof(wchar_t) == 2 && code > 0xFFFF) {
+            code -= 0x10000;
+            out.push_back(static_cast<wchar_t>(0xD800 + (code >> 10)));
+            out.push_back(static_cast<wchar_t>(0xDC00 + (code & 0x3FF)));
+        } else {
+            out.push_back(static_cast<wchar_t>(code));
+        }
+    }
+    return out;
+}
+
+std::string FileIO::toUtf8(const std::wstring& text) {
+    std::string out;
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size(); i++) {
+        uint32_t c = static_cast<uint32_t>(text[i]);
+        if (c >= 0xD800 && c < 0xDC00 && i + 1 < text.size()) {
+            uint32_t low = static_cast<uint32_t>(text[i + 1]);
+            if (low >= 0xDC00 && low < 0xE000) {
+                c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                i++;
+            }
+        }
+        if ((c >= 0xD800 && c < 0xE000) || c > 0x10FFFF) {
+            c = 0xFFFD;     // Unpaired surrogate, or not a code point
+        }
+        
+        if (c < 0x80) {
+            out += static_cast<char>(c);
+        } else if (c < 0x800) {
+            out += static_cast<char>(0xC0 | (c >> 6));
+            out += static_cast<char>(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            out += static_cast<char>(0xE0 | (c >> 12));
+            out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (c & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (c >> 18));
+            out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (c & 0x3F));
+        }
+    }
+    return out;
+}
+
+std::filesystem::path FileIO::nativePath(const std::wstring& path) {
+#ifdef _WIN32
+    return std::filesystem::path(path);
+#else
+    return std::filesystem::path(toUtf8(path));
+#endif
+}
+
+std::wstring FileIO::fromNative(const std::filesystem::path& path) {
+#ifdef _WIN32
+    return path.wstring();
+#else
+    return fromUtf8(path.string());
+#endif
+}
+
+} // namespace Packer
@@ -0,0 +1,83 @@
+#ifndef FILEIO_H
+#define FILEIO_H
+
+#include "common.h"
+#include "BufferPool.h"
+#include <filesystem>
+#include <fstream>
+
+namespace Packer {
+
+// Whole-file helpers. Paths are wide strings everywhere in the core; these
+// go through std::filesystem so they work the same on Windows and Linux.
+// Wide paths become std::filesystem paths only through nativePath, which
+// does not depend on the locale.
+class FileIO {
+public:
+    // Read an entire file
+    static bool readFile(const std::wstring& filePath, std::vector<uint8_t>& data);
+    
+    // Same, taking the buffer from pool when data is too small for the file
+    static bool readFile(const std::wstring& filePath, std::vector<uint8_t>& data, BufferPool* pool);
+    
+    // Read size bytes starting at offset; fails on a short read
+    static bool readRange(const std::wstring& filePath, uint64_t offset, size_t size,
+                          std::vector<uint8_t>& data);
+    
+    // Create or truncate a file and write data to it
+    static bool writeFile(const std::wstring& filePath, const std::vector<uint8_t>& data);
+    
+    // Delete a file; false if it could not be removed
+    static bool removeFile(const std::wstring& filePath);
+    
+    // Cut a file back to its first size bytes
+    static bool truncateFile(const std::wstring& filePath, uint64_t size);
+    
+    // Size of a file on disk, false if it does not exist
+    static bool fileSize(const std::wstring& filePath, uint64_t& size);
+    
+    // UTF-8 <-> wide conversions for command lines, job files and logs;
+    // independent of the locale, malformed input becomes U+FFFD
+    static std::wstring fromUtf8(const std::string& text);
+    static std::string toUtf8(const std::wstring& text);
+    
+    // Wide path <-> std::filesystem path; UTF-8 on Linux, UTF-16 on Windows
+    static std::filesystem::path nativePath(const std::wstring& path);
+    static std::wstring fromNative(const std::filesystem::path& path);
+};
+
+// Output file written piece by piece, for builds that stream their payload
+// instead of assembling it in memory first
+class FileWriter {
+public:
+    FileWriter();
+    ~FileWriter();
+    
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+    
+    // Create or truncate the file
+    bool open(const std::wstring& filePath);
+    
+    // Open an existing file to append to; size() starts at its length
+    bool openAppend(const std::wstring& filePath);
+    
+    // Append at the end of what has been written so far
+    bool write(const uint8_t* data, size_t size);
+    
+    // Overwrite bytes already written, e.g. headers patched at the end
+    bool writeAt(uint64_t offset, const uint8_t* data, size_t size);
+    
+    // Flush and close; false if any write failed
+    bool close();
+    
+    uint64_t size() const { return m_size; }
+
+private:
+    std::ofstream m_file;
+    uint64_t m_size;
+};
+
+} // namespace Packer
+
+#endif // FILEIO_H
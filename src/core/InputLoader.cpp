@@ -0,0 +1,89 @@
+#include "InputLoader.h"
+#include "FileIO.h"
+#include "PEParser.h"
+#include "../utils/FileTypeDetector.h"
+
+namespace Packer {
+
+bool InputLoader::loadFile(const std::wstring& filePath, int executionOrder,
+                           FileInfo& fileInfo) {
+    // Load file data
+    if (!FileIO::readFile(filePath, fileInfo.fileData)) {
+        return false;
+    }
+    
+    describe(filePath, executionOrder, fileInfo);
+    return true;
+}
+
+bool InputLoader::probeFile(const std::wstring& filePath, int executionOrder,
+                            FileInfo& fileInfo) {
+    uint64_t size = 0;
+    if (!FileIO::fileSize(filePath, size)) {
+        return false;
+    }
+    
+    // Enough for the content signatures and the PE headers of any usual image
+    size_t prefix = static_cast<size_t>(size < PROBE_SIZE ? size : PROBE_SIZE);
+    if (!FileIO::readRange(filePath, 0, prefix, fileInfo.fileData)) {
+        return false;
+    }
+    
+    describe(filePath, executionOrder, fileInfo);
+    fileInfo.fileSize = static_cast<size_t>(size);
+    fileInfo.fileData.clear();
+    fileInfo.fileData.shrink_to_fit();
+    return true;
+}
+
+bool InputLoader::loadMember(const ArchiveReader& archive, size_t index, int executionOrder,
+                             FileInfo& fileInfo, std::string& error) {
+    if (!archive.readMember(index, fileInfo.fileData, error)) {
+        return false;
+    }
+    
+    describe(ArchiveReader::memberPath(archive.path(), archive.members()[index].name),
+             executionOrder, fileInfo);
+    return true;
+}
+
+bool InputLoader::probeMember(const ArchiveReader& archive, size_t index, int executionOrder,
+                              FileInfo& fileInfo, std::string& error) {
+    if (!archive.readPrefix(index, PROBE_SIZE, fileInfo.fileData, error)) {
+        return false;
+    }
+    
+    describe(ArchiveReader::memberPath(archive.path(), archive.members()[index].name),
+             executionOrder, fileInfo);
+    fileInfo.fileSize = static_cast<size_t>(archive.members()[index].size);
+    fileInfo.fileData.clear();
+    fileInfo.fileData.shrink_to_fit();
+    return true;
+}
+
+void InputLoader::describe(const std::wstring& filePath, int executionOrder,
+                           FileInfo& fileInfo) {
+    fileInfo.filePath = filePath;
+    fileInfo.fileSize = fileInfo.fileData.size();
+    fileInfo.executionOrder = executionOrder;
+    
+    // Extract filename
+    size_t lastSlash = filePath.find_last_of(L"\\/");
+    fileInfo.originalName = (lastSlash != std::wstring::npos) ? 
+        filePath.substr(lastSlash + 1) : filePath;
+    
+    // Detect file type from the content, falling back to the extension
+    const uint8_t* data = fileInfo.fileData.data();
+    fileInfo.fileType = FileTypeDetector::detectFileType(filePath, data, fileInfo.fileData.size());
+    fileInfo.compressible = FileTypeDetector::isCompressible(data, fileInfo.fileData.size());
+    fileInfo.extension = FileTypeDetector::getExtension(filePath);
+    
+    // If it's an executable, try to parse PE info from the data we already have
+    if (fileInfo.fileType == FileType::EXECUTABLE) {
+        PEParser parser;
+        parser.parseHeaders(fileInfo);
+        fileInfo.obfuscate = false;  // Obfuscation disabled
+    }
+}
+
+} // namespace Packer
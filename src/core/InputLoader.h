@@ -0,0 +1,38 @@
+#ifndef INPUTLOADER_H
+#define INPUTLOADER_H
+
+#include "common.h"
+#include "ArchiveReader.h"
+
+namespace Packer {
+
+// Turns a path into a FileInfo ready to pack. Shared by the GUI and the
+// command line packer.
+class InputLoader {
+public:
+    // Read the file, detect its type and parse PE details for executables
+    static bool loadFile(const std::wstring& filePath, int executionOrder,
+                         FileInfo& fileInfo);
+    
+    // Fill in name, type and PE details for data already in fileInfo.fileData
+    static void describe(const std::wstring& filePath, int executionOrder,
+                         FileInfo& fileInfo);
+    
+    // Describe a file from its first PROBE_SIZE bytes only, leaving
+    // fileInfo.fileData empty; for lists that load the data later
+    static bool probeFile(const std::wstring& filePath, int executionOrder,
+                          FileInfo& fileInfo);
+    
+    // The same two for a file inside an open archive, named by its member
+    // path (see ArchiveReader)
+    static bool loadMember(const ArchiveReader& archive, size_t index, int executionOrder,
+                           FileInfo& fileInfo, std::string& error);
+    static bool probeMember(const ArchiveReader& archive, size_t index, int executionOrder,
+                            FileInfo& fileInfo, std::string& error);
+    
+    static const size_t PROBE_SIZE = 4096;
+};
+
+} // namespace Packer
+
+#endif // INPUTLOADER_H
@@ -0,0 +1,125 @@
+#include "IoBackend.h"
+#include "FileIO.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace Packer {
+
+namespace {
+
+// One read handed to the pool; shared with the task so a reader dropped
+// early never leaves it writing into freed memory
+struct ThreadRead {
+    std::vector<uint8_t> data;
+    bool ok;
+    bool done;
+    std::mutex mutex;
+    std::condition_variable finished;
+    
+    ThreadRead() : ok(false), done(false) {}
+};
+
+class ThreadReadQueue : public FileReadQueue {
+public:
+    ThreadReadQueue(ThreadPool& pool, BufferPool& buffers) : m_pool(pool), m_buffers(buffers) {}
+    
+    ~ThreadReadQueue() override {
+        std::vector<uint8_t> data;
+        while (!m_reads.empty()) {
+            next(data);
+        }
+        m_buffers.release(std::move(data));
+    }
+    
+    void submit(const std::wstring& path) override {
+        std::shared_ptr<ThreadRead> read = std::make_shared<ThreadRead>();
+        BufferPool* buffers = &m_buffers;
+        m_pool.submit([read, path, buffers] {
+            bool ok = FileIO::readFile(path, read->data, buffers);
+            std::lock_guard<std::mutex> lock(read->mutex);
+            read->ok = ok;
+            read->done = true;
+            read->finished.notify_all();
+        });
+        m_reads.push_back(read);
+    }
+    
+    bool next(std::vector<uint8_t>& data) override {
+        std::shared_ptr<ThreadRead> read = m_reads.front();
+        m_reads.pop_front();
+        
+        std::unique_lock<std::mutex> lock(read->mutex);
+        read->finished.wait(lock, [&] { return read->done; });
+        m_buffers.release(std::move(data));
+        data = std::move(read->data);
+        return read->ok;
+    }
+
+private:
+    ThreadPool& m_pool;
+    BufferPool& m_buffers;
+    std::deque<std::shared_ptr<ThreadRead>> m_reads;
+};
+
+// Writes straight through on the caller's thread
+class ThreadWriteQueue : public FileWriteQueue {
+public:
+    explicit ThreadWriteQueue(BufferPool& buffers) : m_buffers(buffers) {}
+    
+    bool open(const std::wstring& path) override { return m_writer.open(path); }
+    bool openAppend(const std::wstring& path) override { return m_writer.openAppend(path); }
+    
+    bool append(std::vector<uint8_t>&& buffer) override {
+        bool written = m_writer.write(buffer.data(), buffer.size());
+        m_buffers.release(std::move(buffer));
+        return written;
+    }
+    
+    bool write(const uint8_t* data, size_t size) override { return m_writer.write(data, size); }
+    
+    bool writeAt(uint64_t offset, const uint8_t* data, size_t size) override {
+        return m_writer.writeAt(offset, data, size);
+    }
+    
+    bool close() override { return m_writer.close(); }
+    uint64_t size() const override { return m_writer.size(); }
+
+private:
+    BufferPool& m_buffers;
+    FileWriter m_writer;
+};
+
+} // namespace
+
+std::unique_ptr<IoBackend> IoBackend::create(IoBackendKind kind, BufferPool& buffers) {
+    if (kind == IoBackendKind::URING || (kind == IoBackendKind::AUTO && uringAvailable())) {
+        if (!uringAvailable()) {
+            return nullptr;
+        }
+        return std::unique_ptr<IoBackend>(new UringIoBackend(buffers, kind == IoBackendKind::AUTO));
+    }
+    return std::unique_ptr<IoBackend>(new ThreadIoBackend(buffers));
+}
+
+ThreadIoBackend::ThreadIoBackend(BufferPool& buffers)
+    : m_buffers(buffers), m_readPool(READ_THREADS) {
+}
+
+std::unique_ptr<FileReadQueue> ThreadIoBackend::openReader(size_t) {
+    return std::unique_ptr<FileReadQueue>(new ThreadReadQueue(m_readPool, m_buffers));
+}
+
+std::unique_ptr<FileWriteQueue> ThreadIoBackend::openWriter() {
+    return std::unique_ptr<FileWriteQueue>(new ThreadWriteQueue(m_buffers));
+}
+
+ThreadIoBackend& UringIoBackend::threads() {
+    std::lock_guard<std::mutex> lock(m_threadsMutex);
+    if (!m_threads) {
+        m_threads.reset(new ThreadIoBackend(m_buffers));
+    }
+    return *m_threads;
+}
+
+} // namespace Packer
@@ -0,0 +1,127 @@
+#ifndef IOBACKEND_H
+#define IOBACKEND_H
+
+#include "BufferPool.h"
+#include "ThreadPool.h"
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace Packer {
+
+enum class IoBackendKind {
+    AUTO,       // io_uring where the kernel allows it, threads otherwise
+    THREADS,    // Blocking reads on a small thread pool, blocking writes
+    URING       // Linux io_uring
+};
+
+// Whole-file reads kept in flight ahead of the caller. Reads may complete
+// in any order but are handed back in the order they were submitted.
+class FileReadQueue {
+public:
+    virtual ~FileReadQueue() {}
+    
+    // Start reading a file. The caller keeps at most the depth the queue
+    // was opened with outstanding (submitted and not yet taken by next).
+    virtual void submit(const std::wstring& path) = 0;
+    
+    // Contents of the oldest outstanding read, in a buffer from the pool;
+    // false when that file could not be read
+    virtual bool next(std::vector<uint8_t>& data) = 0;
+};
+
+// One output file written at increasing offsets, with writes in flight
+// behind the caller
+class FileWriteQueue {
+public:
+    virtual ~FileWriteQueue() {}
+    
+    // Create or truncate the file
+    virtual bool open(const std::wstring& path) = 0;
+    
+    // Open an existing file and append after its end instead
+    virtual bool openAppend(const std::wstring& path) = 0;
+    
+    // Append a pool buffer; it goes back to the pool once written. False
+    // once any earlier write has failed.
+    virtual bool append(std::vector<uint8_t>&& buffer) = 0;
+    
+    // Append bytes the caller keeps
+    virtual bool write(const uint8_t* data, size_t size) = 0;
+    
+    // Overwrite bytes already appended, e.g. headers patched at the end
+    virtual bool writeAt(uint64_t offset, const uint8_t* data, size_t size) = 0;
+    
+    // Wait for every write and close; false if any write failed
+    virtual bool close() = 0;
+    
+    // Bytes appended so far
+    virtual uint64_t size() const = 0;
+};
+
+// Source of the read and write queues builds do their file I/O through.
+// A backend is shared by concurrent builds; each queue belongs to one.
+class IoBackend {
+public:
+    virtual ~IoBackend() {}
+    
+    // Null when io_uring is asked for but unavailable; AUTO never fails
+    static std::unique_ptr<IoBackend> create(IoBackendKind kind, BufferPool& buffers);
+    
+    // True when this kernel and process may use io_uring
+    static bool uringAvailable();
+    
+    virtual const char* name() const = 0;
+    
+    virtual std::unique_ptr<FileReadQueue> openReader(size_t depth) = 0;
+    virtual std::unique_ptr<FileWriteQueue> openWriter() = 0;
+};
+
+// Portable backend: reads on a few pool threads, writes on the caller's
+class ThreadIoBackend : public IoBackend {
+public:
+    explicit ThreadIoBackend(BufferPool& buffers);
+    
+    const char* name() const override { return "threads"; }
+    std::unique_ptr<FileReadQueue> openReader(size_t depth) override;
+    std::unique_ptr<FileWriteQueue> openWriter() override;
+
+private:
+    static const size_t READ_THREADS = 4;
+    
+    BufferPool& m_buffers;
+    ThreadPool m_readPool;
+};
+
+// io_uring backend, Linux only. Every queue owns a ring; large reads and
+// writes are split so one file keeps several requests in flight. Requests
+// go straight into pool buffers. They are not registered with the ring:
+// the pipeline frees or recycles them whenever it likes, and a stale
+// registration would leave the kernel filling pages the buffer gave up.
+//
+// Setting up a ring can still fail after startup, e.g. on the locked memory
+// limit once several builds run at once. With fallback (how AUTO creates
+// it) such a queue comes from a thread backend instead; without, opening
+// it fails.
+class UringIoBackend : public IoBackend {
+public:
+    explicit UringIoBackend(BufferPool& buffers, bool fallback = false);
+    
+    const char* name() const override { return "io_uring"; }
+    std::unique_ptr<FileReadQueue> openReader(size_t depth) override;
+    std::unique_ptr<FileWriteQueue> openWriter() override;
+
+private:
+    // Thread backend for queues whose ring could not be set up; created
+    // the first time one is needed
+    ThreadIoBackend& threads();
+    
+    BufferPool& m_buffers;
+    bool m_fallback;
+    std::mutex m_threadsMutex;
+    std::unique_ptr<ThreadIoBackend> m_threads;
+};
+
+} // namespace Packer
+
+#endif // IOBACKEND_H
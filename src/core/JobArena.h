@@ -0,0 +1,36 @@
+#ifndef JOBARENA_H
+#define JOBARENA_H
+
+#include "ManifestWriter.h"
+#include "ResourceEmbedder.h"
+
+namespace Packer {
+
+// Manifest and bookkeeping storage for one job at a time. A BuildPipeline
+// clears these containers when it starts instead of building new ones, so
+// a batch worker that keeps one arena reuses the previous job's capacity:
+// after the first few jobs, metadata costs no allocations at all.
+struct JobArena {
+    std::vector<ManifestRecord> records;
+    std::vector<std::wstring> names;     // Entry names, by record index
+    std::vector<ManifestGroup> groups;
+    std::vector<ManifestHole> holes;     // Of sparse entries, in record order
+    std::vector<BlockReport> reports;    // Dry runs only
+    ManifestWriter manifest;
+    std::vector<uint8_t> tail;           // Serialized manifest and trailer
+    
+    // Ready for a job with entryCount inputs
+    void reset(size_t entryCount) {
+        records.assign(entryCount, ManifestRecord());
+        names.resize(entryCount);        // Kept strings are overwritten, not freed
+        groups.clear();
+        holes.clear();
+        reports.clear();
+        manifest.reset();
+        tail.clear();
+    }
+};
+
+} // namespace Packer
+
+#endif // JOBARENA_H
@@ -0,0 +1,869 @@
+#ifndef MANIFESTFORMAT_H
+#define MANIFESTFORMAT_H
+
+// Wire format of the bundle payload and its manifest.
+// This is the single definition shared by the builder (ManifestWriter) and
+// the stub (stub-project/stub.cpp includes it directly), so it must not
+// depend on Windows.h or anything else from the core.
+//
+// Payload (overlay at the end of the file, or the .pack section):
+//   manifest | file data | BundleTrailer     (ResourceEmbedder)
+//   file data | manifest | BundleTrailer     (BuildPipeline, which streams)
+// The trailer is fixed-size and always last and gives both offsets, so
+// readers find everything from the end of the payload without scanning.
+//
+// Manifest layout (all integers little-endian, offsets relative to the manifest):
+//   ManifestHeader
+//   ManifestTable[tableCount]    directory of the tables below
+//   RIDX  uint32[entryCount]     offset of each record inside RECS
+//   NIDX  uint32[slotCount]      open-addressed path hash index, entry + 1 (0 = empty)
+//   RECS  varint records         one per entry, see ManifestRecord
+//   STRS  UTF-16 code units      deduplicated names and paths
+//   GRPS  ManifestGroup[]        solid groups: small entries compressed together
+//   HOLS  ManifestHole[]         zero runs left out of sparse entries
+//   BASE  ManifestBase           delta bundles only: the bundle they patch
+//   SCHD  ManifestSchedule       scheduled bundles only: run by dependencies
+//   DEPS  ManifestDependency[]   their edges, sorted by entry
+//
+// Everything is read in place: looking up or decoding one entry touches
+// only its own record and strings.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+namespace Packer {
+
+const char MANIFEST_MAGIC[4] = {'P', 'A', 'C', 'K'};
+const uint32_t MANIFEST_VERSION = 3;
+
+constexpr uint32_t manifestTag(char a, char b, char c, char d) {
+    return static_cast<uint32_t>(static_cast<uint8_t>(a)) |
+           (static_cast<uint32_t>(static_cast<uint8_t>(b)) << 8) |
+           (static_cast<uint32_t>(static_cast<uint8_t>(c)) << 16) |
+           (static_cast<uint32_t>(static_cast<uint8_t>(d)) << 24);
+}
+
+const uint32_t MANIFEST_TABLE_RECORD_INDEX = manifestTag('R', 'I', 'D', 'X');
+const uint32_t MANIFEST_TABLE_NAME_INDEX   = manifestTag('N', 'I', 'D', 'X');
+const uint32_t MANIFEST_TABLE_RECORDS      = manifestTag('R', 'E', 'C', 'S');
+const uint32_t MANIFEST_TABLE_STRINGS      = manifestTag('S', 'T', 'R', 'S');
+const uint32_t MANIFEST_TABLE_GROUPS       = manifestTag('G', 'R', 'P', 'S');
+const uint32_t MANIFEST_TABLE_HOLES        = manifestTag('H', 'O', 'L', 'S');
+const uint32_t MANIFEST_TABLE_BASE         = manifestTag('B', 'A', 'S', 'E');
+const uint32_t MANIFEST_TABLE_SCHEDULE     = manifestTag('S', 'C', 'H', 'D');
+const uint32_t MANIFEST_TABLE_DEPENDENCIES = manifestTag('D', 'E', 'P', 'S');
+
+// ManifestRecord::flags
+const uint32_t MANIFEST_RECORD_HASH  = 0x1;  // contentHash is present
+const uint32_t MANIFEST_RECORD_SOLID = 0x2;  // Stored inside solid group 'group'
+const uint32_t MANIFEST_RECORD_SPARSE = 0x4; // Holes firstHole.. are left out of the data
+const uint32_t MANIFEST_RECORD_BASE  = 0x8;  // Same bytes as base entry 'baseEntry'; nothing stored
+const uint32_t MANIFEST_RECORD_DELTA = 0x10; // Data is a DeltaCodec script against base entry 'baseEntry'
+
+const char BUNDLE_TRAILER_MAGIC[8] = {'S', 'S', 'P', 'A', 'Y', 'L', 'D', '1'};
+const uint32_t BUNDLE_TRAILER_VERSION = 1;
+
+#pragma pack(push, 1)
+struct ManifestHeader {
+    char magic[4];            // "PACK"
+    uint32_t version;
+    uint32_t entryCount;
+    uint8_t waitForPrevious;  // 1 = wait for each to finish, 0 = run all at once;
+                              // always 1 with a SCHD table, for stubs without one
+    uint8_t reserved[3];
+    uint32_t manifestSize;    // Whole manifest in bytes, file data follows it
+    uint32_t tableCount;
+};
+
+struct ManifestTable {
+    uint32_t tag;             // MANIFEST_TABLE_*
+    uint32_t offset;          // From the start of the manifest
+    uint32_t size;            // In bytes
+};
+
+// A solid group is one compressed stream holding several small entries
+// back to back. Member records point into the decoded stream, so reading
+// one entry decodes only its own group.
+struct ManifestGroup {
+    uint64_t dataOffset;      // Relative to the start of file data
+    uint64_t storedSize;
+    uint64_t originalSize;    // Decoded stream size
+    uint32_t codec;           // CODEC_* (Codec.h)
+    uint32_t entryCount;
+};
+
+// A run of zero bytes in a sparse entry. The entry's data holds only the
+// bytes between its holes, back to back; holes are sorted and disjoint.
+struct ManifestHole {
+    uint64_t offset;          // In the original file
+    uint64_t length;
+};
+
+// Identifies the full bundle a delta bundle's BASE and DELTA entries refer to
+struct ManifestBase {
+    uint64_t manifestHash;    // XXH64 of the base bundle's whole manifest
+    uint32_t entryCount;
+    uint32_t reserved;
+};
+
+// Present when entries run as a dependency graph (StepScheduler.h) rather
+// than by waitForPrevious: each starts once the entries it depends on have
+// finished, at most maxParallel at a time
+struct ManifestSchedule {
+    uint32_t maxParallel;     // 0 = no cap
+    uint32_t reserved;
+};
+
+// Entry 'entry' starts only after entry 'dependsOn' has finished
+struct ManifestDependency {
+    uint32_t entry;
+    uint32_t dependsOn;
+};
+
+struct BundleTrailer {
+    uint64_t payloadSize;     // Whole payload including this trailer
+    uint64_t manifestOffset;  // From the start of the payload
+    uint64_t dataOffset;      // From the start of the payload
+    uint64_t dataSize;
+    uint32_t manifestSize;
+    uint32_t version;         // BUNDLE_TRAILER_VERSION
+    char magic[8];            // BUNDLE_TRAILER_MAGIC
+};
+#pragma pack(pop)
+
+// Wire layout. Builder and stub are compiled by different toolchains and
+// on different hosts, so every offset is pinned here rather than trusted
+// to the compiler. Each schema names a record's members with their wire
+// offsets and generates its WireCodec: one memcpy per table when the
+// compiler laid the struct out exactly as the wire (WIRE_FIELD records
+// both offsets), a copy per field otherwise. Little-endian hosts only.
+template <typename Member>
+struct WireMember;
+
+template <typename Record, typename T>
+struct WireMember<T Record::*> {
+    typedef Record RecordType;
+    typedef T Type;
+};
+
+template <auto Member, size_t Offset, size_t StructOffset>
+struct WireField {
+    typedef typename WireMember<decltype(Member)>::RecordType Record;
+    typedef typename WireMember<decltype(Member)>::Type Type;
+    static constexpr size_t offset = Offset;
+    static constexpr size_t end = Offset + sizeof(Type);
+    static constexpr bool inPlace = Offset == StructOffset;
+    
+    static void encode(const Record& record, uint8_t* out) {
+        memcpy(out + Offset, &(record.*Member), sizeof(Type));
+    }
+    
+    static void decode(const uint8_t* in, Record& record) {
+        memcpy(&(record.*Member), in + Offset, sizeof(Type));
+    }
+};
+
+// A member at a wire offset; where the compiler put it comes along
+#define WIRE_FIELD(Record, member, wireOffset) \
+    WireField<&Record::member, wireOffset, offsetof(Record, member)>
+
+template <typename Record, typename... Fields>
+struct WireSchema {
+    static_assert(std::is_trivially_copyable<Record>::value, "wire records must be trivially copyable");
+    
+    static constexpr size_t size = (sizeof(typename Fields::Type) + ... + 0);
+    
+    // True when every field starts exactly where the previous one ended
+    static constexpr bool isPacked() {
+        size_t expected = 0;
+        bool packed = true;
+        ((packed = packed && Fields::offset == expected, expected = Fields::end), ...);
+        return packed;
+    }
+    
+    // True when the struct is byte for byte the wire record
+    static constexpr bool inPlace() {
+        return sizeof(Record) == size && (Fields::inPlace && ...);
+    }
+    
+    static void encode(const Record* records, size_t count, std::vector<uint8_t>& out) {
+        size_t start = out.size();
+        out.resize(start + count * size);
+        if (count == 0) {
+            return;
+        }
+        if constexpr (inPlace()) {
+            memcpy(out.data() + start, records, count * size);
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                (Fields::encode(records[i], out.data() + start + i * size), ...);
+            }
+        }
+    }
+    
+    static bool decode(const uint8_t* data, size_t dataSize, size_t count, Record* records) {
+        if (count > dataSize / size) {
+            return false;
+        }
+        if (count == 0) {
+            return true;
+        }
+        if constexpr (inPlace()) {
+            memcpy(records, data, count * size);
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                (Fields::decode(data + i * size, records[i]), ...);
+            }
+        }
+        return true;
+    }
+};
+
+typedef WireSchema<ManifestHeader,
+    WIRE_FIELD(ManifestHeader, magic,            0),
+    WIRE_FIELD(ManifestHeader, version,          4),
+    WIRE_FIELD(ManifestHeader, entryCount,       8),
+    WIRE_FIELD(ManifestHeader, waitForPrevious, 12),
+    WIRE_FIELD(ManifestHeader, reserved,        13),
+    WIRE_FIELD(ManifestHeader, manifestSize,    16),
+    WIRE_FIELD(ManifestHeader, tableCount,      20)
+> ManifestHeaderSchema;
+
+typedef WireSchema<ManifestTable,
+    WIRE_FIELD(ManifestTable, tag,    0),
+    WIRE_FIELD(ManifestTable, offset, 4),
+    WIRE_FIELD(ManifestTable, size,   8)
+> ManifestTableSchema;
+
+typedef WireSchema<ManifestGroup,
+    WIRE_FIELD(ManifestGroup, dataOffset,    0),
+    WIRE_FIELD(ManifestGroup, storedSize,    8),
+    WIRE_FIELD(ManifestGroup, originalSize, 16),
+    WIRE_FIELD(ManifestGroup, codec,        24),
+    WIRE_FIELD(ManifestGroup, entryCount,   28)
+> ManifestGroupSchema;
+
+typedef WireSchema<ManifestHole,
+    WIRE_FIELD(ManifestHole, offset, 0),
+    WIRE_FIELD(ManifestHole, length, 8)
+> ManifestHoleSchema;
+
+typedef WireSchema<ManifestBase,
+    WIRE_FIELD(ManifestBase, manifestHash, 0),
+    WIRE_FIELD(ManifestBase, entryCount,   8),
+    WIRE_FIELD(ManifestBase, reserved,    12)
+> ManifestBaseSchema;
+
+typedef WireSchema<ManifestSchedule,
+    WIRE_FIELD(ManifestSchedule, maxParallel, 0),
+    WIRE_FIELD(ManifestSchedule, reserved,    4)
+> ManifestScheduleSchema;
+
+typedef WireSchema<ManifestDependency,
+    WIRE_FIELD(ManifestDependency, entry,     0),
+    WIRE_FIELD(ManifestDependency, dependsOn, 4)
+> ManifestDependencySchema;
+
+typedef WireSchema<BundleTrailer,
+    WIRE_FIELD(BundleTrailer, payloadSize,     0),
+    WIRE_FIELD(BundleTrailer, manifestOffset,  8),
+    WIRE_FIELD(BundleTrailer, dataOffset,     16),
+    WIRE_FIELD(BundleTrailer, dataSize,       24),
+    WIRE_FIELD(BundleTrailer, manifestSize,   32),
+    WIRE_FIELD(BundleTrailer, version,        36),
+    WIRE_FIELD(BundleTrailer, magic,          40)
+> BundleTrailerSchema;
+
+// A schema must cover the whole record: a member left out would never
+// reach the wire
+static_assert(ManifestHeaderSchema::isPacked() && ManifestHeaderSchema::size == sizeof(ManifestHeader),
+              "ManifestHeader schema");
+static_assert(ManifestTableSchema::isPacked() && ManifestTableSchema::size == sizeof(ManifestTable),
+              "ManifestTable schema");
+static_assert(ManifestGroupSchema::isPacked() && ManifestGroupSchema::size == sizeof(ManifestGroup),
+              "ManifestGroup schema");
+static_assert(ManifestHoleSchema::isPacked() && ManifestHoleSchema::size == sizeof(ManifestHole),
+              "ManifestHole schema");
+static_assert(ManifestBaseSchema::isPacked() && ManifestBaseSchema::size == sizeof(ManifestBase),
+              "ManifestBase schema");
+static_assert(ManifestScheduleSchema::isPacked() &&
+              ManifestScheduleSchema::size == sizeof(ManifestSchedule), "ManifestSchedule schema");
+static_assert(ManifestDependencySchema::isPacked() &&
+              ManifestDependencySchema::size == sizeof(ManifestDependency), "ManifestDependency schema");
+static_assert(BundleTrailerSchema::isPacked() && BundleTrailerSchema::size == sizeof(BundleTrailer),
+              "BundleTrailer schema");
+
+// Bulk encode/decode of wire records: the record's schema, or a plain copy
+// for the integer tables (indices, strings, record bytes)
+template <typename Record>
+struct WireCodec {
+    static_assert(std::is_arithmetic<Record>::value, "wire records need a schema");
+    
+    static void encode(const Record* records, size_t count, std::vector<uint8_t>& out) {
+        size_t start = out.size();
+        out.resize(start + count * sizeof(Record));
+        if (count != 0) {
+            memcpy(out.data() + start, records, count * sizeof(Record));
+        }
+    }
+    
+    static bool decode(const uint8_t* data, size_t dataSize, size_t count, Record* records) {
+        if (count > dataSize / sizeof(Record)) {
+            return false;
+        }
+        if (count != 0) {
+            memcpy(records, data, count * sizeof(Record));
+        }
+        return true;
+    }
+};
+
+template <> struct WireCodec<ManifestHeader> : ManifestHeaderSchema {};
+template <> struct WireCodec<ManifestTable> : ManifestTableSchema {};
+template <> struct WireCodec<ManifestGroup> : ManifestGroupSchema {};
+template <> struct WireCodec<ManifestHole> : ManifestHoleSchema {};
+template <> struct WireCodec<ManifestBase> : ManifestBaseSchema {};
+template <> struct WireCodec<ManifestSchedule> : ManifestScheduleSchema {};
+template <> struct WireCodec<ManifestDependency> : ManifestDependencySchema {};
+template <> struct WireCodec<BundleTrailer> : BundleTrailerSchema {};
+
+// LEB128 varints used by the entry records
+inline void appendVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+inline bool readVarint(const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline uint32_t readU32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline void appendU64(std::vector<uint8_t>& out, uint64_t value) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+// Build the trailer for a payload whose body (everything before the
+// trailer) is bodySize bytes
+inline BundleTrailer makeBundleTrailer(uint64_t bodySize,
+                                       uint64_t manifestOffset, uint32_t manifestSize,
+                                       uint64_t dataOffset, uint64_t dataSize) {
+    BundleTrailer trailer = {};
+    trailer.payloadSize = bodySize + sizeof(BundleTrailer);
+    trailer.manifestOffset = manifestOffset;
+    trailer.dataOffset = dataOffset;
+    trailer.dataSize = dataSize;
+    trailer.manifestSize = manifestSize;
+    trailer.version = BUNDLE_TRAILER_VERSION;
+    memcpy(trailer.magic, BUNDLE_TRAILER_MAGIC, sizeof(trailer.magic));
+    return trailer;
+}
+
+// Validate a trailer whose payload can be at most available bytes long
+inline bool checkBundleTrailer(const BundleTrailer& trailer, uint64_t available) {
+    if (memcmp(trailer.magic, BUNDLE_TRAILER_MAGIC, sizeof(trailer.magic)) != 0 ||
+        trailer.version != BUNDLE_TRAILER_VERSION ||
+        trailer.payloadSize < sizeof(BundleTrailer) ||
+        trailer.payloadSize > available) {
+        return false;
+    }
+    
+    uint64_t body = trailer.payloadSize - sizeof(BundleTrailer);
+    return trailer.manifestOffset <= body &&
+           trailer.manifestSize <= body - trailer.manifestOffset &&
+           trailer.dataOffset <= body &&
+           trailer.dataSize <= body - trailer.dataOffset;
+}
+
+// Read and validate the trailer of a payload that ends at data + dataSize.
+// The payload itself starts at data + dataSize - trailer.payloadSize.
+inline bool readBundleTrailer(const uint8_t* data, size_t dataSize, BundleTrailer& trailer) {
+    if (dataSize < sizeof(BundleTrailer)) {
+        return false;
+    }
+    WireCodec<BundleTrailer>::decode(data + dataSize - sizeof(BundleTrailer), sizeof(BundleTrailer),
+                                     1, &trailer);
+    return checkBundleTrailer(trailer, dataSize);
+}
+
+// Reference to a run of UTF-16 code units in the string table
+struct ManifestString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+// One decoded entry record. On the wire every field up to path is a
+// varint, in this order; optional fields selected by flags follow.
+struct ManifestRecord {
+    uint32_t flags;           // MANIFEST_RECORD_*
+    uint32_t id;
+    uint64_t dataOffset;      // Relative to the start of file data, or of the
+                              // decoded group stream for solid entries
+    uint64_t storedSize;
+    uint64_t originalSize;
+    uint32_t codec;           // CODEC_* (Codec.h); CODEC_STORE for solid entries
+    uint32_t executionOrder;
+    ManifestString name;      // File name, e.g. "setup.exe"
+    ManifestString path;      // Relative path inside the bundle (key of NIDX)
+    uint64_t contentHash;     // XXH64 of the original bytes (MANIFEST_RECORD_HASH)
+    uint32_t group;           // Index into GRPS (MANIFEST_RECORD_SOLID)
+    uint32_t firstHole;       // Index into HOLS (MANIFEST_RECORD_SPARSE)
+    uint32_t holeCount;
+    uint32_t baseEntry;       // Entry of the base bundle (MANIFEST_RECORD_BASE or _DELTA)
+    uint64_t deltaSize;       // Decoded script size (MANIFEST_RECORD_DELTA)
+};
+
+// Bundle paths compare ASCII case-insensitively, like Windows file names
+inline uint16_t foldManifestChar(uint16_t c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<uint16_t>(c + ('a' - 'A')) : c;
+}
+
+// Record encoding: varints in declaration order, then the optional fields
+inline void appendManifestRecord(std::vector<uint8_t>& out, const ManifestRecord& record) {
+    appendVarint(out, record.flags);
+    appendVarint(out, record.id);
+    appendVarint(out, record.dataOffset);
+    appendVarint(out, record.storedSize);
+    appendVarint(out, record.originalSize);
+    appendVarint(out, record.codec);
+    appendVarint(out, record.executionOrder);
+    appendVarint(out, record.name.offset);
+    appendVarint(out, record.name.length);
+    appendVarint(out, record.path.offset);
+    appendVarint(out, record.path.length);
+    if (record.flags & MANIFEST_RECORD_HASH) {
+        appendU64(out, record.contentHash);
+    }
+    if (record.flags & MANIFEST_RECORD_SOLID) {
+        appendVarint(out, record.group);
+    }
+    if (record.flags & MANIFEST_RECORD_SPARSE) {
+        appendVarint(out, record.firstHole);
+        appendVarint(out, record.holeCount);
+    }
+    if (record.flags & (MANIFEST_RECORD_BASE | MANIFEST_RECORD_DELTA)) {
+        appendVarint(out, record.baseEntry);
+    }
+    if (record.flags & MANIFEST_RECORD_DELTA) {
+        appendVarint(out, record.deltaSize);
+    }
+}
+
+inline bool readManifestRecord(const uint8_t* p, const uint8_t* end, ManifestRecord& record) {
+    uint64_t fields[11];
+    for (uint64_t& field : fields) {
+        if (!readVarint(p, end, field)) {
+            return false;
+        }
+    }
+    
+    record.flags = static_cast<uint32_t>(fields[0]);
+    record.id = static_cast<uint32_t>(fields[1]);
+    record.dataOffset = fields[2];
+    record.storedSize = fields[3];
+    record.originalSize = fields[4];
+    record.codec = static_cast<uint32_t>(fields[5]);
+    record.executionOrder = static_cast<uint32_t>(fields[6]);
+    record.name.offset = static_cast<uint32_t>(fields[7]);
+    record.name.length = static_cast<uint32_t>(fields[8]);
+    record.path.offset = static_cast<uint32_t>(fields[9]);
+    record.path.length = static_cast<uint32_t>(fields[10]);
+    
+    record.contentHash = 0;
+    if (record.flags & MANIFEST_RECORD_HASH) {
+        if (end - p < 8) {
+            return false;
+        }
+        memcpy(&record.contentHash, p, sizeof(record.contentHash));
+        p += sizeof(record.contentHash);
+    }
+    
+    record.group = 0;
+    if (record.flags & MANIFEST_RECORD_SOLID) {
+        uint64_t group;
+        if (!readVarint(p, end, group)) {
+            return false;
+        }
+        record.group = static_cast<uint32_t>(group);
+    }
+    
+    record.firstHole = 0;
+    record.holeCount = 0;
+    if (record.flags & MANIFEST_RECORD_SPARSE) {
+        uint64_t firstHole;
+        uint64_t holeCount;
+        if (!readVarint(p, end, firstHole) || !readVarint(p, end, holeCount)) {
+            return false;
+        }
+        record.firstHole = static_cast<uint32_t>(firstHole);
+        record.holeCount = static_cast<uint32_t>(holeCount);
+    }
+    
+    record.baseEntry = 0;
+    record.deltaSize = 0;
+    if (record.flags & (MANIFEST_RECORD_BASE | MANIFEST_RECORD_DELTA)) {
+        uint64_t baseEntry;
+        if (!readVarint(p, end, baseEntry)) {
+            return false;
+        }
+        record.baseEntry = static_cast<uint32_t>(baseEntry);
+    }
+    if ((record.flags & MANIFEST_RECORD_DELTA) && !readVarint(p, end, record.deltaSize)) {
+        return false;
+    }
+    return true;
+}
+
+// FNV-1a over case-folded UTF-16 code units
+inline uint32_t hashManifestName(const char16_t* units, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        uint16_t c = foldManifestChar(units[i]);
+        hash = (hash ^ (c & 0xFF)) * 16777619u;
+        hash = (hash ^ (c >> 8)) * 16777619u;
+    }
+    return hash;
+}
+
+// UTF-16 conversion for hosts where wchar_t is 32 bits
+inline void appendManifestString(std::u16string& units, const std::wstring& text) {
+    for (wchar_t ch : text) {
+        uint32_t c = static_cast<uint32_t>(ch);
+        if (c > 0xFFFF) {
+            c -= 0x10000;
+            units.push_back(static_cast<char16_t>(0xD800 + (c >> 10)));
+            units.push_back(static_cast<char16_t>(0xDC00 + (c & 0x3FF)));
+        } else {
+            units.push_back(static_cast<char16_t>(c));
+        }
+    }
+}
+
+inline std::u16string toManifestString(const std::wstring& text) {
+    std::u16string units;
+    units.reserve(text.size());
+    appendManifestString(units, text);
+    return units;
+}
+
+// Read-only view over a manifest in a mapped or loaded buffer.
+// open() only validates the header and table directory; nothing is copied.
+class ManifestView {
+public:
+    ManifestView() : m_data(nullptr), m_size(0), m_header(),
+                     m_recordIndex(nullptr), m_nameIndex(nullptr), m_slotCount(0),
+                     m_records(nullptr), m_recordsSize(0),
+                     m_strings(nullptr), m_stringCount(0),
+                     m_groups(nullptr), m_groupCount(0),
+                     m_holes(nullptr), m_holeCount(0), m_base(nullptr),
+                     m_schedule(nullptr), m_dependencies(nullptr), m_dependencyCount(0) {}
+    
+    bool open(const uint8_t* data, size_t dataSize) {
+        if (!WireCodec<ManifestHeader>::decode(data, dataSize, 1, &m_header)) {
+            return false;
+        }
+        if (memcmp(m_header.magic, MANIFEST_MAGIC, 4) != 0 ||
+            m_header.version != MANIFEST_VERSION ||
+            m_header.manifestSize < sizeof(ManifestHeader) ||
+            m_header.manifestSize > dataSize) {
+            return false;
+        }
+        
+        m_data = data;
+        m_size = m_header.manifestSize;
+        
+        size_t directorySize = static_cast<size_t>(m_header.tableCount) * sizeof(ManifestTable);
+        if (directorySize > m_size - sizeof(ManifestHeader)) {
+            return false;
+        }
+        
+        for (uint32_t i = 0; i < m_header.tableCount; i++) {
+            ManifestTable table;
+            WireCodec<ManifestTable>::decode(m_data + sizeof(ManifestHeader) + i * sizeof(ManifestTable),
+                                             sizeof(ManifestTable), 1, &table);
+            if (table.offset > m_size || table.size > m_size - table.offset) {
+                return false;
+            }
+            
+            const uint8_t* tableData = m_data + table.offset;
+            if (table.tag == MANIFEST_TABLE_RECORD_INDEX) {
+                m_recordIndex = tableData;
+                if (table.size != static_cast<uint64_t>(m_header.entryCount) * 4) {
+                    return false;
+                }
+            } else if (table.tag == MANIFEST_TABLE_NAME_INDEX) {
+                m_nameIndex = tableData;
+                m_slotCount = table.size / 4;
+                if (m_slotCount & (m_slotCount - 1)) {
+                    return false;  // Must be a power of two
+                }
+            } else if (table.tag == MANIFEST_TABLE_RECORDS) {
+                m_records = tableData;
+                m_recordsSize = table.size;
+            } else if (table.tag == MANIFEST_TABLE_STRINGS) {
+                m_strings = tableData;
+                m_stringCount = table.size / 2;
+            } else if (table.tag == MANIFEST_TABLE_GROUPS) {
+                m_groups = tableData;
+                m_groupCount = static_cast<uint32_t>(table.size / sizeof(ManifestGroup));
+            } else if (table.tag == MANIFEST_TABLE_HOLES) {
+                m_holes = tableData;
+                m_holeCount = static_cast<uint32_t>(table.size / sizeof(ManifestHole));
+            } else if (table.tag == MANIFEST_TABLE_BASE && table.size >= sizeof(ManifestBase)) {
+                m_base = tableData;
+            } else if (table.tag == MANIFEST_TABLE_SCHEDULE && table.size >= sizeof(ManifestSchedule)) {
+                m_schedule = tableData;
+            } else if (table.tag == MANIFEST_TABLE_DEPENDENCIES) {
+                m_dependencies = tableData;
+                m_dependencyCount = static_cast<uint32_t>(table.size / sizeof(ManifestDependency));
+            }
+            // Unknown tables are skipped so newer builders stay readable
+        }
+        
+        return m_header.entryCount == 0 || (m_recordIndex && m_records);
+    }
+    
+    uint32_t entryCount() const { return m_header.entryCount; }
+    bool waitForPrevious() const { return m_header.waitForPrevious != 0; }
+    uint32_t manifestSize() const { return m_header.manifestSize; }
+    uint32_t groupCount() const { return m_groupCount; }
+    
+    // The bundle this one patches; false for full bundles
+    bool base(ManifestBase& descriptor) const {
+        return m_base && WireCodec<ManifestBase>::decode(m_base, sizeof(ManifestBase), 1, &descriptor);
+    }
+    
+    // How entries run when they form a dependency graph; false when they
+    // run by waitForPrevious
+    bool schedule(ManifestSchedule& descriptor) const {
+        return m_schedule &&
+               WireCodec<ManifestSchedule>::decode(m_schedule, sizeof(ManifestSchedule), 1, &descriptor);
+    }
+    
+    uint32_t dependencyCount() const { return m_dependencyCount; }
+    
+    // Copy out one dependency edge
+    bool dependency(uint32_t index, ManifestDependency& edge) const {
+        if (index >= m_dependencyCount) {
+            return false;
+        }
+        return WireCodec<ManifestDependency>::decode(m_dependencies + index * sizeof(ManifestDependency),
+                                                     sizeof(ManifestDependency), 1, &edge);
+    }
+    
+    // Decode a single record
+    bool entry(uint32_t index, ManifestRecord& record) const {
+        if (index >= m_header.entryCount) {
+            return false;
+        }
+        
+        uint32_t recordOffset = readU32(m_recordIndex + index * 4);
+        if (recordOffset >= m_recordsSize) {
+            return false;
+        }
+        
+        if (!readManifestRecord(m_records + recordOffset, m_records + m_recordsSize, record)) {
+            return false;
+        }
+        
+        return validString(record.name) && validString(record.path) &&
+               (!(record.flags & MANIFEST_RECORD_SOLID) || record.group < m_groupCount);
+    }
+    
+    // Copy out one solid group descriptor
+    bool group(uint32_t index, ManifestGroup& descriptor) const {
+        if (index >= m_groupCount) {
+            return false;
+        }
+        return WireCodec<ManifestGroup>::decode(m_groups + index * sizeof(ManifestGroup),
+                                                sizeof(ManifestGroup), 1, &descriptor);
+    }
+    
+    // The index-th hole of a sparse record
+    bool hole(const ManifestRecord& record, uint32_t index, ManifestHole& descriptor) const {
+        if (index >= record.holeCount || record.firstHole > m_holeCount ||
+            index >= m_holeCount - record.firstHole) {
+            return false;
+        }
+        size_t offset = (static_cast<size_t>(record.firstHole) + index) * sizeof(ManifestHole);
+        return WireCodec<ManifestHole>::decode(m_holes + offset, sizeof(ManifestHole), 1, &descriptor);
+    }
+    
+    // Bytes stored for a record once decoded: its original size less its
+    // holes, the script size of a delta, nothing for a base reference.
+    // False when the holes are missing, out of order, overlap or run past
+    // the end.
+    bool packedSize(const ManifestRecord& record, uint64_t& size) const {
+        size = record.originalSize;
+        if (record.flags & (MANIFEST_RECORD_BASE | MANIFEST_RECORD_DELTA)) {
+            size = (record.flags & MANIFEST_RECORD_DELTA) ? record.deltaSize : 0;
+            return true;
+        }
+        if (!(record.flags & MANIFEST_RECORD_SPARSE)) {
+            return true;
+        }
+        
+        uint64_t end = 0;
+        for (uint32_t i = 0; i < record.holeCount; i++) {
+            ManifestHole descriptor;
+            if (!hole(record, i, descriptor) || descriptor.offset < end ||
+                descriptor.offset > record.originalSize ||
+                descriptor.length > record.originalSize - descriptor.offset) {
+                return false;
+            }
+            end = descriptor.offset + descriptor.length;
+            size -= descriptor.length;
+        }
+        return true;
+    }
+    
+    // Lay the packed bytes of a sparse record out at their original offsets
+    // in out (originalSize bytes), zero-filling the holes
+    bool expand(const ManifestRecord& record, const uint8_t* packed, size_t size, uint8_t* out) const {
+        uint64_t position = 0;
+        size_t used = 0;
+        for (uint32_t i = 0; i < record.holeCount; i++) {
+            ManifestHole descriptor;
+            if (!hole(record, i, descriptor) || descriptor.offset < position ||
+                descriptor.offset - position > size - used ||
+                descriptor.length > record.originalSize - descriptor.offset) {
+                return false;
+            }
+            size_t extent = static_cast<size_t>(descriptor.offset - position);
+            memcpy(out + position, packed + used, extent);
+            memset(out + descriptor.offset, 0, static_cast<size_t>(descriptor.length));
+            used += extent;
+            position = descriptor.offset + descriptor.length;
+        }
+        
+        if (record.originalSize - position != size - used) {
+            return false;
+        }
+        memcpy(out + position, packed + used, size - used);
+        return true;
+    }
+    
+    // Copy a string out of the string table. Where wchar_t is 32 bits,
+    // surrogate pairs become one code point again (see appendManifestString);
+    // an unpaired surrogate is kept as it is.
+    std::wstring string(const ManifestString& ref) const {
+        std::wstring text;
+        if (!validString(ref)) {
+            return text;
+        }
+        text.reserve(ref.length);
+        const uint8_t* units = m_strings + static_cast<size_t>(ref.offset) * 2;
+        for (uint32_t i = 0; i < ref.length; i++) {
+            uint16_t unit;
+            memcpy(&unit, units + static_cast<size_t>(i) * 2, 2);
+            if constexpr (sizeof(wchar_t) > 2) {
+                uint16_t low = 0;
+                if (unit >= 0xD800 && unit < 0xDC00 && i + 1 < ref.length) {
+                    memcpy(&low, units + static_cast<size_t>(i + 1) * 2, 2);
+                }
+                if (low >= 0xDC00 && low < 0xE000) {
+                    text.push_back(static_cast<wchar_t>(0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00)));
+                    i++;
+                    continue;
+                }
+            }
+            text.push_back(static_cast<wchar_t>(unit));
+        }
+        return text;
+    }
+    
+    // Extension of the entry's name including the dot (".exe"), or empty
+    std::wstring extension(const ManifestRecord& record) const {
+        std::wstring name = string(record.name);
+        size_t dotPos = name.find_last_of(L'.');
+        return dotPos == std::wstring::npos ? std::wstring() : name.substr(dotPos);
+    }
+    
+    // O(1) lookup of an entry by its bundle path (case-insensitive for ASCII)
+    bool find(const std::wstring& path, uint32_t& index) const {
+        if (m_slotCount == 0) {
+            return false;
+        }
+        
+        std::u16string key = toManifestString(path);
+        uint32_t mask = m_slotCount - 1;
+        uint32_t slot = hashManifestName(key.data(), key.size()) & mask;
+        
+        for (uint32_t probe = 0; probe < m_slotCount; probe++, slot = (slot + 1) & mask) {
+            uint32_t value = readU32(m_nameIndex + slot * 4);
+            if (value == 0) {
+                return false;
+            }
+            
+            ManifestRecord record;
+            if (entry(value - 1, record) && equalsIgnoreCase(record.path, key.data(), key.size())) {
+                index = value - 1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    bool validString(const ManifestString& ref) const {
+        return ref.length == 0 ||
+               (ref.offset <= m_stringCount && ref.length <= m_stringCount - ref.offset);
+    }
+    
+    bool equalsIgnoreCase(const ManifestString& ref, const char16_t* units, size_t length) const {
+        if (ref.length != length) {
+            return false;
+        }
+        for (size_t i = 0; i < length; i++) {
+            uint16_t unit;
+            memcpy(&unit, m_strings + (static_cast<size_t>(ref.offset) + i) * 2, 2);
+            if (foldManifestChar(unit) != foldManifestChar(units[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    const uint8_t* m_data;
+    size_t m_size;
+    ManifestHeader m_header;
+    const uint8_t* m_recordIndex;
+    const uint8_t* m_nameIndex;
+    uint32_t m_slotCount;
+    const uint8_t* m_records;
+    size_t m_recordsSize;
+    const uint8_t* m_strings;
+    size_t m_stringCount;
+    const uint8_t* m_groups;
+    uint32_t m_groupCount;
+    const uint8_t* m_holes;
+    uint32_t m_holeCount;
+    const uint8_t* m_base;
+    const uint8_t* m_schedule;
+    const uint8_t* m_dependencies;
+    uint32_t m_dependencyCount;
+};
+
+} // namespace Packer
+
+#endif // MANIFESTFORMAT_H
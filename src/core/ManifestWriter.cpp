@@ -0,0 +1,309 @@
+#include "ManifestWriter.h"
+#include "common.h"
+#include "FileIO.h"
+#include "StepScheduler.h"
+#include <algorithm>
+#include <map>
+
+namespace Packer {
+
+namespace {
+
+// Pad so the next table starts aligned relative to the manifest start
+void alignTable(std::vector<uint8_t>& data, size_t manifestStart) {
+    size_t used = data.size() - manifestStart;
+    data.resize(manifestStart + ((used + 3) & ~static_cast<size_t>(3)), 0);
+}
+
+} // namespace
+
+ManifestWriter::ManifestWriter() : m_base(), m_hasBase(false), m_schedule(), m_hasSchedule(false) {
+}
+
+ManifestWriter::~ManifestWriter() {
+}
+
+void ManifestWriter::reset() {
+    m_records.clear();
+    m_groups.clear();
+    m_holes.clear();
+    m_hasBase = false;
+    m_hasSchedule = false;
+    m_dependencies.clear();
+    m_strings.clear();
+    m_stringRefs.clear();
+    std::fill(m_stringSlots.begin(), m_stringSlots.end(), 0);
+}
+
+void ManifestWriter::addEntry(const ManifestRecord& record,
+                              const std::wstring& name,
+                              const std::wstring& path) {
+    ManifestRecord entry = record;
+    entry.name = intern(name);
+    entry.path = intern(path);
+    m_records.push_back(entry);
+}
+
+void ManifestWriter::addGroup(const ManifestGroup& group) {
+    m_groups.push_back(group);
+}
+
+void ManifestWriter::addHole(const ManifestHole& hole) {
+    m_holes.push_back(hole);
+}
+
+void ManifestWriter::setBase(const ManifestBase& base) {
+    m_base = base;
+    m_hasBase = true;
+}
+
+void ManifestWriter::setSchedule(const ManifestSchedule& schedule) {
+    m_schedule = schedule;
+    m_hasSchedule = true;
+}
+
+void ManifestWriter::addDependency(const ManifestDependency& dependency) {
+    m_dependencies.push_back(dependency);
+}
+
+bool ManifestWriter::setSteps(const std::vector<std::wstring>& names,
+                              const std::vector<StepDependency>& dependencies, uint32_t maxParallel,
+                              std::string& error) {
+    if (dependencies.empty() && maxParallel == 0) {
+        return true;
+    }
+    
+    // A name used twice cannot be depended on
+    const uint32_t ambiguous = UINT32_MAX;
+    std::map<std::wstring, uint32_t> entries;
+    for (size_t i = 0; i < names.size(); i++) {
+        auto inserted = entries.insert(std::make_pair(names[i], static_cast<uint32_t>(i)));
+        if (!inserted.second) {
+            inserted.first->second = ambiguous;
+        }
+    }
+    
+    std::vector<std::pair<uint32_t, uint32_t>> edges;
+    for (const StepDependency& dependency : dependencies) {
+        for (const std::wstring* name : { &dependency.step, &dependency.after }) {
+            auto it = entries.find(*name);
+            if (it == entries.end()) {
+                error = "dependency names no input " + FileIO::toUtf8(*name);
+                return false;
+            }
+            if (it->second == ambiguous) {
+                error = "dependency names " + FileIO::toUtf8(*name) + ", which several inputs are called";
+                return false;
+            }
+        }
+        edges.push_back(std::make_pair(entries[dependency.step], entries[dependency.after]));
+    }
+    
+    StepScheduler scheduler;
+    if (!scheduler.init(static_cast<uint32_t>(names.size()), edges, maxParallel)) {
+        error = "dependencies form a cycle";
+        return false;
+    }
+    
+    ManifestSchedule schedule = {};
+    schedule.maxParallel = maxParallel;
+    setSchedule(schedule);
+    for (const auto& edge : edges) {
+        ManifestDependency dependency = { edge.first, edge.second };
+        addDependency(dependency);
+    }
+    return true;
+}
+
+ManifestString ManifestWriter::intern(const std::wstring& text) {
+    // Append the UTF-16 form, then take it back off if it is already stored
+    size_t start = m_strings.size();
+    appendManifestString(m_strings, text);
+    
+    ManifestString ref;
+    ref.offset = static_cast<uint32_t>(start);
+    ref.length = static_cast<uint32_t>(m_strings.size() - start);
+    
+    if (m_stringSlots.size() < (m_stringRefs.size() + 1) * 2) {
+        growStringSlots();
+    }
+    
+    const char16_t* units = m_strings.data() + start;
+    uint32_t mask = static_cast<uint32_t>(m_stringSlots.size() - 1);
+    uint32_t slot = hashManifestName(units, ref.length) & mask;
+    
+    while (m_stringSlots[slot] != 0) {
+        const ManifestString& other = m_stringRefs[m_stringSlots[slot] - 1];
+        if (other.length == ref.length &&
+            std::char_traits<char16_t>::compare(m_strings.data() + other.offset, units,
+                                                ref.length) == 0) {
+            m_strings.resize(start);
+            return other;
+        }
+        slot = (slot + 1) & mask;
+    }
+    
+    m_stringRefs.push_back(ref);
+    m_stringSlots[slot] = static_cast<uint32_t>(m_stringRefs.size());
+    return ref;
+}
+
+void ManifestWriter::growStringSlots() {
+    size_t slotCount = m_stringSlots.empty() ? 64 : m_stringSlots.size() * 2;
+    m_stringSlots.assign(slotCount, 0);
+    uint32_t mask = static_cast<uint32_t>(slotCount - 1);
+    
+    for (size_t i = 0; i < m_stringRefs.size(); i++) {
+        const ManifestString& ref = m_stringRefs[i];
+        uint32_t slot = hashManifestName(m_strings.data() + ref.offset, ref.length) & mask;
+        while (m_stringSlots[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        m_stringSlots[slot] = static_cast<uint32_t>(i + 1);
+    }
+}
+
+bool ManifestWriter::write(bool waitForPrevious, std::vector<uint8_t>& manifest) {
+    uint32_t entryCount = static_cast<uint32_t>(m_records.size());
+    
+    // Records and their offsets
+    std::vector<uint8_t>& records = m_recordBytes;
+    std::vector<uint32_t>& recordIndex = m_recordIndex;
+    records.clear();
+    records.reserve(entryCount * 16);
+    recordIndex.resize(entryCount);
+    
+    for (uint32_t i = 0; i < entryCount; i++) {
+        recordIndex[i] = static_cast<uint32_t>(records.size());
+        appendManifestRecord(records, m_records[i]);
+    }
+    
+    // Path index: open addressing at load factor <= 0.5, first entry wins
+    // when two entries share a path
+    uint32_t slotCount = 0;
+    if (entryCount != 0) {
+        slotCount = 1;
+        while (slotCount < entryCount * 2) {
+            slotCount <<= 1;
+        }
+    }
+    
+    std::vector<uint32_t>& nameIndex = m_nameIndex;
+    nameIndex.assign(slotCount, 0);
+    uint32_t mask = slotCount - 1;
+    
+    for (uint32_t i = 0; i < entryCount; i++) {
+        const ManifestString& path = m_records[i].path;
+        const char16_t* units = m_strings.data() + path.offset;
+        uint32_t slot = hashManifestName(units, path.length) & mask;
+        
+        while (nameIndex[slot] != 0) {
+            const ManifestString& other = m_records[nameIndex[slot] - 1].path;
+            bool same = other.length == path.length;
+            for (uint32_t c = 0; same && c < path.length; c++) {
+                same = foldManifestChar(m_strings[other.offset + c]) == foldManifestChar(units[c]);
+            }
+            if (same) {
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+        
+        if (nameIndex[slot] == 0) {
+            nameIndex[slot] = i + 1;
+        }
+    }
+    
+    // Lay out the tables after the header and directory. HOLS, BASE, SCHD
+    // and DEPS are left out when unused, so full bundles without sparse
+    // entries stay as they were.
+    const uint32_t maxTables = 9;
+    ManifestTable tables[maxTables] = {
+        { MANIFEST_TABLE_RECORD_INDEX, 0, 0 },
+        { MANIFEST_TABLE_NAME_INDEX,   0, 0 },
+        { MANIFEST_TABLE_RECORDS,      0, 0 },
+        { MANIFEST_TABLE_STRINGS,      0, 0 },
+        { MANIFEST_TABLE_GROUPS,       0, 0 },
+    };
+    uint64_t sizes[maxTables] = {
+        static_cast<uint64_t>(entryCount) * 4,
+        static_cast<uint64_t>(slotCount) * 4,
+        records.size(),
+        m_strings.size() * 2,
+        m_groups.size() * sizeof(ManifestGroup),
+    };
+    
+    uint32_t tableCount = 5;
+    if (!m_holes.empty()) {
+        tables[tableCount].tag = MANIFEST_TABLE_HOLES;
+        sizes[tableCount++] = m_holes.size() * sizeof(ManifestHole);
+    }
+    if (m_hasBase) {
+        tables[tableCount].tag = MANIFEST_TABLE_BASE;
+        sizes[tableCount++] = sizeof(ManifestBase);
+    }
+    if (m_hasSchedule) {
+        std::stable_sort(m_dependencies.begin(), m_dependencies.end(),
+                         [](const ManifestDependency& a, const ManifestDependency& b) {
+                             return a.entry < b.entry;
+                         });
+        tables[tableCount].tag = MANIFEST_TABLE_SCHEDULE;
+        sizes[tableCount++] = sizeof(ManifestSchedule);
+        tables[tableCount].tag = MANIFEST_TABLE_DEPENDENCIES;
+        sizes[tableCount++] = m_dependencies.size() * sizeof(ManifestDependency);
+    }
+    
+    uint64_t totalSize = sizeof(ManifestHeader) + tableCount * sizeof(ManifestTable);
+    for (uint32_t i = 0; i < tableCount; i++) {
+        totalSize = (totalSize + 3) & ~static_cast<uint64_t>(3);
+        tables[i].offset = static_cast<uint32_t>(totalSize);
+        tables[i].size = static_cast<uint32_t>(sizes[i]);
+        totalSize += sizes[i];
+    }
+    
+    if (totalSize > 0xFFFFFFFF) {
+        return false;
+    }
+    
+    ManifestHeader header = {};
+    memcpy(header.magic, MANIFEST_MAGIC, sizeof(header.magic));
+    header.version = MANIFEST_VERSION;
+    header.entryCount = entryCount;
+    header.waitForPrevious = (waitForPrevious || m_hasSchedule) ? 1 : 0;
+    header.manifestSize = static_cast<uint32_t>(totalSize);
+    header.tableCount = tableCount;
+    
+    // Each table is one bulk copy
+    size_t start = manifest.size();
+    manifest.reserve(start + static_cast<size_t>(totalSize));
+    WireCodec<ManifestHeader>::encode(&header, 1, manifest);
+    WireCodec<ManifestTable>::encode(tables, tableCount, manifest);
+    alignTable(manifest, start);
+    WireCodec<uint32_t>::encode(recordIndex.data(), recordIndex.size(), manifest);
+    alignTable(manifest, start);
+    WireCodec<uint32_t>::encode(nameIndex.data(), nameIndex.size(), manifest);
+    alignTable(manifest, start);
+    WireCodec<uint8_t>::encode(records.data(), records.size(), manifest);
+    alignTable(manifest, start);
+    WireCodec<char16_t>::encode(m_strings.data(), m_strings.size(), manifest);
+    alignTable(manifest, start);
+    WireCodec<ManifestGroup>::encode(m_groups.data(), m_groups.size(), manifest);
+    if (!m_holes.empty()) {
+        alignTable(manifest, start);
+        WireCodec<ManifestHole>::encode(m_holes.data(), m_holes.size(), manifest);
+    }
+    if (m_hasBase) {
+        alignTable(manifest, start);
+        WireCodec<ManifestBase>::encode(&m_base, 1, manifest);
+    }
+    if (m_hasSchedule) {
+        alignTable(manifest, start);
+        WireCodec<ManifestSchedule>::encode(&m_schedule, 1, manifest);
+        alignTable(manifest, start);
+        WireCodec<ManifestDependency>::encode(m_dependencies.data(), m_dependencies.size(), manifest);
+    }
+    
+    return true;
+}
+
+} // namespace Packer
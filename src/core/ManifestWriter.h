@@ -0,0 +1,82 @@
+#ifndef MANIFESTWRITER_H
+#define MANIFESTWRITER_H
+
+#include "ManifestFormat.h"
+#include <string>
+
+namespace Packer {
+
+struct StepDependency;
+
+// Builds a version 3 manifest (see ManifestFormat.h). A writer can be
+// reset and reused; it then keeps its tables' capacity, so batch builds
+// that reuse one writer per worker stop allocating for manifests.
+class ManifestWriter {
+public:
+    ManifestWriter();
+    ~ManifestWriter();
+    
+    // Drop all entries, groups, holes, the base and the schedule, keeping capacity
+    void reset();
+    
+    // Add an entry; the record's name and path refs are filled in here
+    void addEntry(const ManifestRecord& record,
+                  const std::wstring& name,
+                  const std::wstring& path);
+    
+    // Add a solid group; member records refer to it by index
+    void addGroup(const ManifestGroup& group);
+    
+    // Add a hole of a sparse entry; records refer to a run of them by index
+    void addHole(const ManifestHole& hole);
+    
+    // Make this a delta manifest against the given bundle
+    void setBase(const ManifestBase& base);
+    
+    // Run entries as a dependency graph instead of by waitForPrevious
+    void setSchedule(const ManifestSchedule& schedule);
+    
+    // Add an edge of the graph; edges are written sorted by entry
+    void addDependency(const ManifestDependency& dependency);
+    
+    // Schedule and edges for a build with these dependencies and cap, the
+    // entries named by names (one per entry, in order); nothing without
+    // either. False, with the reason in error, for a name that no entry or
+    // several entries have, or a cycle.
+    bool setSteps(const std::vector<std::wstring>& names,
+                  const std::vector<StepDependency>& dependencies, uint32_t maxParallel,
+                  std::string& error);
+    
+    // Serialize header, index tables, records and string table
+    bool write(bool waitForPrevious, std::vector<uint8_t>& manifest);
+
+private:
+    // Store a string once in the string table
+    ManifestString intern(const std::wstring& text);
+    
+    // Double the intern table and re-insert every string
+    void growStringSlots();
+    
+    std::vector<ManifestRecord> m_records;
+    std::vector<ManifestGroup> m_groups;
+    std::vector<ManifestHole> m_holes;
+    ManifestBase m_base;
+    bool m_hasBase;
+    ManifestSchedule m_schedule;
+    bool m_hasSchedule;
+    std::vector<ManifestDependency> m_dependencies;
+    std::u16string m_strings;
+    
+    // Interned strings: open addressing over m_stringRefs (index + 1, 0 = empty)
+    std::vector<ManifestString> m_stringRefs;
+    std::vector<uint32_t> m_stringSlots;
+    
+    // write() scratch, kept between manifests
+    std::vector<uint8_t> m_recordBytes;
+    std::vector<uint32_t> m_recordIndex;
+    std::vector<uint32_t> m_nameIndex;
+};
+
+} // namespace Packer
+
+#endif // MANIFESTWRITER_H
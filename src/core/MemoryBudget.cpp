@@ -0,0 +1,36 @@
+#include "MemoryBudget.h"
+#include <algorithm>
+
+namespace Packer {
+
+MemoryBudget::MemoryBudget(uint64_t limit)
+    : m_limit(limit), m_inUse(0), m_peak(0) {
+}
+
+uint64_t MemoryBudget::acquire(uint64_t bytes) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    
+    if (m_limit != 0) {
+        bytes = std::min(bytes, m_limit);
+        m_released.wait(lock, [this, bytes] { return m_inUse + bytes <= m_limit; });
+    }
+    
+    m_inUse += bytes;
+    m_peak = std::max(m_peak, m_inUse);
+    return bytes;
+}
+
+void MemoryBudget::release(uint64_t granted) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_inUse -= granted;
+    }
+    m_released.notify_all();
+}
+
+uint64_t MemoryBudget::peak() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_peak;
+}
+
+} // namespace Packer
@@ -0,0 +1,38 @@
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace Packer {
+
+// Global cap on bytes held by concurrently running jobs. Workers acquire
+// their estimated footprint before starting and block while the budget is
+// exhausted.
+class MemoryBudget {
+public:
+    // limit 0 = unlimited
+    explicit MemoryBudget(uint64_t limit);
+    
+    // Wait until 'bytes' fit; requests larger than the whole budget are
+    // clamped so they run alone instead of never running
+    uint64_t acquire(uint64_t bytes);
+    
+    // Return what acquire() granted
+    void release(uint64_t granted);
+    
+    uint64_t limit() const { return m_limit; }
+    uint64_t peak() const;
+    
+private:
+    uint64_t m_limit;
+    uint64_t m_inUse;
+    uint64_t m_peak;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_released;
+};
+
+} // namespace Packer
+
+#endif // MEMORYBUDGET_H
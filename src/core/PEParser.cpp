@@ -1,5 +1,5 @@
 #include "PEParser.h"
-#include <fstream>
+#include "FileIO.h"
 #include <algorithm>
 
 namespace Packer {
@@ -11,25 +11,30 @@ PEParser::~PEParser() {
 }
 
 bool PEParser::loadFile(const std::wstring& filePath, PEInfo& peInfo) {
-    // Open file
-    std::ifstream file(filePath.c_str(), std::ios::binary | std::ios::ate);
-    if (!file.is_open()) {
+    // Read file data
+    if (!FileIO::readFile(filePath, peInfo.fileData)) {
         return false;
     }
     
-    // Get file size
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
+    peInfo.filePath = filePath;
+    peInfo.fileSize = peInfo.fileData.size();
     
-    // Read file data
-    peInfo.fileData.resize(size);
-    if (!file.read(reinterpret_cast<char*>(peInfo.fileData.data()), size)) {
+    if (!parseHeaders(peInfo)) {
         return false;
     }
     
-    peInfo.filePath = filePath;
-    peInfo.fileSize = size;
+    // Extract filename
+    size_t lastSlash = filePath.find_last_of(L"\\/");
+    if (lastSlash != std::wstring::npos) {
+        peInfo.originalName = filePath.substr(lastSlash + 1);
+    } else {
+        peInfo.originalName = filePath;
+    }
     
+    return true;
+}
+
+bool PEParser::parseHeaders(PEInfo& peInfo) {
     // Validate PE
     if (!isValidPE(peInfo.fileData)) {
         return false;
@@ -45,14 +50,6 @@ bool PEParser::loadFile(const std::wstring& filePath, PEInfo& peInfo) {
         peInfo.imageBase = static_cast<DWORD>(ntHeaders->OptionalHeader.ImageBase);
     }
     
-    // Extract filename
-    size_t lastSlash = filePath.find_last_of(L"\\/");
-    if (lastSlash != std::wstring::npos) {
-        peInfo.originalName = filePath.substr(lastSlash + 1);
-    } else {
-        peInfo.originalName = filePath;
-    }
-    
     return true;
 }
 
@@ -98,14 +95,23 @@ bool PEParser::extractResources(const PEInfo& peInfo, std::vector<uint8_t>& reso
 }
 
 bool PEParser::getSections(const PEInfo& peInfo, std::vector<IMAGE_SECTION_HEADER>& sections) {
-    auto ntHeaders = getNTHeaders(peInfo.fileData);
+    return getSections(peInfo.fileData, sections);
+}
+
+bool PEParser::getSections(const std::vector<uint8_t>& data, std::vector<IMAGE_SECTION_HEADER>& sections) {
+    auto ntHeaders = getNTHeaders(data);
     if (!ntHeaders) {
         return false;
     }
     
     auto sectionHeader = IMAGE_FIRST_SECTION(ntHeaders);
+    size_t tableOffset = reinterpret_cast<const uint8_t*>(sectionHeader) - data.data();
+    size_t count = ntHeaders->FileHeader.NumberOfSections;
+    if (tableOffset > data.size() || count > (data.size() - tableOffset) / sizeof(IMAGE_SECTION_HEADER)) {
+        return false;
+    }
     
-    for (int i = 0; i < ntHeaders->FileHeader.NumberOfSections; i++) {
+    for (size_t i = 0; i < count; i++) {
         sections.push_back(sectionHeader[i]);
     }
     
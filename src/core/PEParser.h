@@ -14,6 +14,9 @@ public:
     // Load and parse PE file
     bool loadFile(const std::wstring& filePath, PEInfo& peInfo);
     
+    // Fill architecture, entry point and image base from peInfo.fileData
+    bool parseHeaders(PEInfo& peInfo);
+    
     // Validate PE file
     bool isValidPE(const std::vector<uint8_t>& data);
     
@@ -26,9 +29,13 @@ public:
     // Get section information
     bool getSections(const PEInfo& peInfo, std::vector<IMAGE_SECTION_HEADER>& sections);
     
+    // Section table of an image in memory; false if it is not a PE or the
+    // table runs past the data
+    bool getSections(const std::vector<uint8_t>& data, std::vector<IMAGE_SECTION_HEADER>& sections);
+    
     // Get import table
     bool getImports(const PEInfo& peInfo, std::vector<std::string>& imports);
-    
+
 private:
     IMAGE_DOS_HEADER* getDOSHeader(const std::vector<uint8_t>& data);
     IMAGE_NT_HEADERS* getNTHeaders(const std::vector<uint8_t>& data);
@@ -0,0 +1,130 @@
+#include "PackEngine.h"
+#include "ArchiveSource.h"
+#include <algorithm>
+#include <chrono>
+
+namespace Packer {
+
+PackEngine::PackEngine(size_t threads, uint64_t retainLimit, IoBackendKind io)
+    : m_encodePool(threads), m_buffers(retainLimit), m_io(IoBackend::create(io, m_buffers)) {
+    if (!m_io) {
+        m_io = IoBackend::create(IoBackendKind::THREADS, m_buffers);
+    }
+}
+
+PackEngine::~PackEngine() {
+}
+
+bool PackEngine::pack(const std::vector<std::wstring>& inputs, const PackerOptions& options,
+                      PackResult& result, bool dryRun, InputSource* source) {
+    return build(inputs, options, std::vector<OutputVariant>(), result, dryRun, source);
+}
+
+bool PackEngine::packMatrix(const std::vector<std::wstring>& inputs, const PackerOptions& options,
+                            const std::vector<OutputVariant>& variants, PackResult& result) {
+    return build(inputs, options, variants, result, false, nullptr);
+}
+
+bool PackEngine::build(const std::vector<std::wstring>& inputs, const PackerOptions& options,
+                       const std::vector<OutputVariant>& variants, PackResult& result,
+                       bool dryRun, InputSource* source) {
+    auto start = std::chrono::steady_clock::now();
+    result = PackResult();
+    
+    // Archive members among the inputs are read from their archives, unless
+    // a source supplies every input
+    ArchiveSource archives;
+    if (!source && !archives.open(inputs, options.expandArchives, result.error)) {
+        return false;
+    }
+    const std::vector<std::wstring>& buildInputs = source ? inputs : archives.inputs();
+    if (!source && !archives.empty()) {
+        source = &archives;
+    }
+    
+    std::unique_ptr<JobArena> arena = takeArena();
+    BuildPipeline pipeline(m_encodePool, m_buffers, *arena, *m_io);
+    bool ok = pipeline.run(buildInputs, options, dryRun, source) &&
+              pipeline.writeVariants(variants, options, result.variantSizes);
+    result.stages = pipeline.stageStats();
+    result.delta = pipeline.deltaStats();
+    if (ok && dryRun) {
+        result.blocks = pipeline.blockReports();
+    }
+    returnArena(std::move(arena));
+    
+    if (!ok) {
+        result.error = pipeline.error();
+        return false;
+    }
+    result.success = true;
+    result.outputSize = pipeline.outputSize();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+bool PackEngine::update(const std::vector<std::wstring>& inputs, const PackerOptions& options,
+                        const std::vector<size_t>& changed, PackResult& result) {
+    auto start = std::chrono::steady_clock::now();
+    result = PackResult();
+    
+    // Every member of a changed archive counts as changed; those whose
+    // content is the same keep their stored data
+    ArchiveSource archives;
+    if (!archives.open(inputs, options.expandArchives, result.error)) {
+        return false;
+    }
+    std::vector<size_t> changedInputs;
+    for (size_t i = 0; i < archives.inputs().size(); i++) {
+        if (std::binary_search(changed.begin(), changed.end(), archives.origin(i))) {
+            changedInputs.push_back(i);
+        }
+    }
+    
+    std::unique_ptr<JobArena> arena = takeArena();
+    bool ok;
+    {
+        BuildPipeline pipeline(m_encodePool, m_buffers, *arena, *m_io);
+        ok = pipeline.update(archives.inputs(), options, changedInputs,
+                             archives.empty() ? nullptr : &archives);
+        result.stages = pipeline.stageStats();
+        result.update = pipeline.updateStats();
+        result.error = pipeline.error();
+        result.outputSize = pipeline.outputSize();
+    }
+    returnArena(std::move(arena));
+    
+    if (!ok && !result.update.rebuildReason.empty()) {
+        // The bundle was left alone; replace it with a full build
+        std::string reason = result.update.rebuildReason;
+        if (!pack(inputs, options, result)) {
+            return false;
+        }
+        result.update.rebuildReason = reason;
+        return true;
+    }
+    if (!ok) {
+        return false;
+    }
+    result.error.clear();
+    result.success = true;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+std::unique_ptr<JobArena> PackEngine::takeArena() {
+    std::lock_guard<std::mutex> lock(m_arenaMutex);
+    if (m_arenas.empty()) {
+        return std::unique_ptr<JobArena>(new JobArena());
+    }
+    std::unique_ptr<JobArena> arena = std::move(m_arenas.back());
+    m_arenas.pop_back();
+    return arena;
+}
+
+void PackEngine::returnArena(std::unique_ptr<JobArena> arena) {
+    std::lock_guard<std::mutex> lock(m_arenaMutex);
+    m_arenas.push_back(std::move(arena));
+}
+
+} // namespace Packer
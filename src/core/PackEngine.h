@@ -0,0 +1,83 @@
+#ifndef PACKENGINE_H
+#define PACKENGINE_H
+
+#include "BuildPipeline.h"
+#include <memory>
+#include <mutex>
+
+namespace Packer {
+
+struct PackResult {
+    bool success;
+    std::string error;
+    uint64_t outputSize;              // Payload size only for a dry run
+    double seconds;
+    std::vector<BlockReport> blocks;  // Dry runs only
+    std::vector<StageStats> stages;   // Pipeline throughput, see BuildPipeline
+    DeltaStats delta;                 // Delta builds only
+    UpdateStats update;               // Updates only
+    std::vector<uint64_t> variantSizes;  // Matrix builds: size of each variant
+    
+    PackResult() : success(false), outputSize(0), seconds(0.0) {}
+};
+
+// Reentrant packer front end. Every pack call runs its own BuildPipeline
+// and keeps all build state on its own stack; calls share only the encode
+// pool, the buffer pool and idle job arenas, which are internally locked.
+// Any number of threads may pack through one engine at once.
+class PackEngine {
+public:
+    // threads 0 = one per hardware thread; retainLimit caps idle buffers.
+    // An io_uring request falls back to threads where io_uring is unavailable.
+    explicit PackEngine(size_t threads = 0,
+                        uint64_t retainLimit = BufferPool::DEFAULT_RETAIN_LIMIT,
+                        IoBackendKind io = IoBackendKind::AUTO);
+    ~PackEngine();
+    
+    PackEngine(const PackEngine&) = delete;
+    PackEngine& operator=(const PackEngine&) = delete;
+    
+    // Build one bundle on the calling thread. A dry run stops after encoding
+    // the payload and reports each block instead. A source supplies the
+    // inputs' contents in place of the file system; without one, member
+    // paths ("setup.zip!/bin/a.exe") are read from their archives, and with
+    // options.expandArchives .zip and .tar inputs stand for their files.
+    bool pack(const std::vector<std::wstring>& inputs, const PackerOptions& options,
+              PackResult& result, bool dryRun = false, InputSource* source = nullptr);
+    
+    // Build the bundle at options.outputPath, then write every variant from
+    // the same encoded file data: inputs are read, hashed and encoded once
+    // however many outputs there are
+    bool packMatrix(const std::vector<std::wstring>& inputs, const PackerOptions& options,
+                    const std::vector<OutputVariant>& variants, PackResult& result);
+    
+    // Bring the bundle at options.outputPath up to date after the inputs at
+    // indices changed (sorted) changed, re-encoding only those. A bundle
+    // that cannot be updated in place is built from scratch instead, and
+    // result.update.rebuildReason says why.
+    bool update(const std::vector<std::wstring>& inputs, const PackerOptions& options,
+                const std::vector<size_t>& changed, PackResult& result);
+    
+    size_t threadCount() const { return m_encodePool.threadCount(); }
+    BufferPoolStats bufferStats() const { return m_buffers.stats(); }
+    const char* ioBackendName() const { return m_io->name(); }
+
+private:
+    bool build(const std::vector<std::wstring>& inputs, const PackerOptions& options,
+               const std::vector<OutputVariant>& variants, PackResult& result, bool dryRun,
+               InputSource* source);
+    
+    // Idle arenas; a build takes one (or a new one) and puts it back
+    std::unique_ptr<JobArena> takeArena();
+    void returnArena(std::unique_ptr<JobArena> arena);
+    
+    ThreadPool m_encodePool;    // Encode stage of every running build
+    BufferPool m_buffers;
+    std::unique_ptr<IoBackend> m_io;
+    std::vector<std::unique_ptr<JobArena>> m_arenas;
+    std::mutex m_arenaMutex;
+};
+
+} // namespace Packer
+
+#endif // PACKENGINE_H
@@ -1,13 +1,15 @@
 #include "ResourceEmbedder.h"
+#include "AllocStats.h"
+#include "Codec.h"
+#include "CodecSearch.h"
+#include "ContentHash.h"
+#include "SparseScan.h"
+#include "Trace.h"
 #include <algorithm>
 
-#ifdef USE_ZLIB
-#include <zlib.h>
-#endif
-
 namespace Packer {
 
-ResourceEmbedder::ResourceEmbedder() {
+ResourceEmbedder::ResourceEmbedder() : m_pendingCount(0) {
 }
 
 ResourceEmbedder::~ResourceEmbedder() {
@@ -15,193 +17,243 @@ ResourceEmbedder::~ResourceEmbedder() {
 
 bool ResourceEmbedder::embedExecutables(const std::vector<PEInfo>& exeFiles, 
                                        std::vector<uint8_t>& outputData,
-                                       bool waitForPrevious) {
-    // Create resource data FIRST (this populates m_entries)
+                                       bool waitForPrevious,
+                                       CompressionMode compression,
+                                       const CodecSearchOptions& codecSearch,
+                                       bool sparse,
+                                       uint32_t startupEntries,
+                                       const std::vector<StepDependency>& dependencies,
+                                       uint32_t maxParallel) {
+    m_error.clear();
+    
+    // Create resource data FIRST (this populates m_entries, m_groups and m_holes)
     std::vector<uint8_t> resourceData;
-    if (!createResourceSection(exeFiles, resourceData)) {
+    if (!createResourceSection(exeFiles, resourceData, compression, codecSearch, sparse,
+                               startupEntries)) {
         return false;
     }
     
     // Generate manifest AFTER (uses m_entries populated above)
     std::vector<uint8_t> manifest;
-    if (!generateManifest(exeFiles, manifest, waitForPrevious)) {
+    if (!generateManifest(exeFiles, manifest, waitForPrevious, dependencies, maxParallel)) {
         return false;
     }
     
-    // Combine manifest and resources
+    // Combine manifest and resources, then the trailer readers start from
+    ALLOC_SCOPE(ALLOC_STAGE_WRITE);
+    BundleTrailer trailer = makeBundleTrailer(manifest.size() + resourceData.size(),
+                                              0, static_cast<uint32_t>(manifest.size()),
+                                              manifest.size(), resourceData.size());
+    
+    outputData.reserve(outputData.size() + trailer.payloadSize);
     outputData.insert(outputData.end(), manifest.begin(), manifest.end());
     outputData.insert(outputData.end(), resourceData.begin(), resourceData.end());
+    WireCodec<BundleTrailer>::encode(&trailer, 1, outputData);
     
     return true;
 }
 
 bool ResourceEmbedder::createResourceSection(const std::vector<PEInfo>& exeFiles,
-                                             std::vector<uint8_t>& resourceData) {
+                                             std::vector<uint8_t>& resourceData,
+                                             CompressionMode compression,
+                                             const CodecSearchOptions& codecSearch,
+                                             bool sparse,
+                                             uint32_t startupEntries) {
+    TRACE_SPAN("createResourceSection");
     m_entries.clear();
+    m_groups.clear();
+    m_holes.clear();
+    m_reports.clear();
+    m_pendingGroup.clear();
+    m_pendingCount = 0;
+    m_search.reset(new CodecSearch(codecSearch));
+    
+    // Data is laid out in execution order; records stay in input order
+    std::vector<size_t> order(exeFiles.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return exeFiles[a].executionOrder < exeFiles[b].executionOrder;
+    });
     
-    DWORD currentOffset = 0;
-    DWORD resourceId = 100; // Start from resource ID 100
+    m_entries.assign(exeFiles.size(), ManifestRecord());
     
-    for (const auto& exeFile : exeFiles) {
-        ResourceEntry entry;
-        entry.id = resourceId++;
-        entry.offset = currentOffset;
-        entry.originalSize = static_cast<DWORD>(exeFile.fileSize);
-        entry.executionOrder = exeFile.executionOrder;
+    for (size_t position = 0; position < order.size(); position++) {
+        const PEInfo& exeFile = exeFiles[order[position]];
+        ManifestRecord& entry = m_entries[order[position]];
+        entry.id = 100 + static_cast<uint32_t>(order[position]);  // Resource IDs start at 100
+        entry.originalSize = exeFile.fileData.size();
+        entry.executionOrder = static_cast<uint32_t>(exeFile.executionOrder);
+        entry.flags = MANIFEST_RECORD_HASH;
+        entry.contentHash = xxh64(exeFile.fileData.data(), exeFile.fileData.size());
         
-        // Store file extension
-        std::wstring ext = L"." + exeFile.extension;
-        wcsncpy_s(entry.extension, 8, ext.c_str(), _TRUNCATE);
+        // The first entries to run are stored as they are, ahead of any group
+        bool startup = position < startupEntries;
         
-        // Don't compress - stub doesn't have decompression code yet
-        std::vector<uint8_t> data = exeFile.fileData;
-        entry.compressed = false;
-        entry.size = entry.originalSize;
+        // Already compressed content is stored on its own
+        if (compression == CompressionMode::SOLID && exeFile.compressible && !startup &&
+            entry.originalSize <= SOLID_ENTRY_LIMIT) {
+            // Small entry: a slice of the pending group's decoded stream
+            entry.flags |= MANIFEST_RECORD_SOLID;
+            entry.group = static_cast<uint32_t>(m_groups.size());
+            entry.dataOffset = m_pendingGroup.size();
+            entry.codec = CODEC_STORE;
+            entry.storedSize = entry.originalSize;
+            m_pendingGroup.insert(m_pendingGroup.end(), exeFile.fileData.begin(), exeFile.fileData.end());
+            m_pendingCount++;
+            
+            if (m_pendingGroup.size() >= SOLID_GROUP_TARGET) {
+                flushGroup(resourceData);
+            }
+            continue;
+        }
         
-        // Add to resource data
-        resourceData.insert(resourceData.end(), data.begin(), data.end());
+        entry.dataOffset = resourceData.size();
         
-        currentOffset += entry.size;
-        m_entries.push_back(entry);
+        // Long zero runs become holes; only the bytes between them are stored
+        const std::vector<uint8_t>* data = &exeFile.fileData;
+        std::vector<uint8_t> packed;
+        size_t firstHole = m_holes.size();
+        if (sparse && entry.originalSize >= SPARSE_MIN_HOLE) {
+            SparseScan::findZeroRuns(exeFile.fileData.data(), exeFile.fileData.size(),
+                                     SPARSE_MIN_HOLE, m_holes);
+        }
+        if (m_holes.size() > firstHole) {
+            entry.flags |= MANIFEST_RECORD_SPARSE;
+            entry.firstHole = static_cast<uint32_t>(firstHole);
+            entry.holeCount = static_cast<uint32_t>(m_holes.size() - firstHole);
+            
+            auto position = exeFile.fileData.begin();
+            for (size_t h = firstHole; h < m_holes.size(); h++) {
+                auto holeStart = exeFile.fileData.begin() + static_cast<ptrdiff_t>(m_holes[h].offset);
+                packed.insert(packed.end(), position, holeStart);
+                position = holeStart + static_cast<ptrdiff_t>(m_holes[h].length);
+            }
+            packed.insert(packed.end(), position, exeFile.fileData.end());
+            data = &packed;
+        }
+        
+        BlockReport report;
+        report.name = exeFile.originalName;
+        report.entryCount = 1;
+        if (compression != CompressionMode::NONE && exeFile.compressible && !startup) {
+            appendBlock(*data, report, resourceData);
+        } else {
+            report.storedSize = data->size();
+            resourceData.insert(resourceData.end(), data->begin(), data->end());
+        }
+        report.originalSize = entry.originalSize;
+        entry.codec = report.codec;
+        entry.storedSize = report.storedSize;
+        
+        m_reports.push_back(report);
     }
     
+    flushGroup(resourceData);
+    m_search.reset();
     return true;
 }
 
+void ResourceEmbedder::appendBlock(const std::vector<uint8_t>& data, BlockReport& report,
+                                   std::vector<uint8_t>& resourceData) {
+    TRACE_SPAN("encode", report.name);
+    ALLOC_SCOPE(ALLOC_STAGE_ENCODE);
+    CodecChoice choice;
+    m_search->choose(data.data(), data.size(), choice);
+    
+    report.originalSize = data.size();
+    report.codec = choice.codec;
+    report.level = choice.level;
+    report.encodeSeconds = choice.encodeSeconds;
+    report.decodeSeconds = choice.decodeSeconds;
+    
+    if (choice.codec == CODEC_STORE) {
+        report.storedSize = data.size();
+        resourceData.insert(resourceData.end(), data.begin(), data.end());
+    } else {
+        report.storedSize = choice.output.size();
+        resourceData.insert(resourceData.end(), choice.output.begin(), choice.output.end());
+    }
+}
+
+void ResourceEmbedder::flushGroup(std::vector<uint8_t>& resourceData) {
+    if (m_pendingGroup.empty()) {
+        return;
+    }
+    
+    ManifestGroup group = {};
+    group.dataOffset = resourceData.size();
+    group.originalSize = m_pendingGroup.size();
+    group.entryCount = m_pendingCount;
+    
+    BlockReport report;
+    report.group = static_cast<uint32_t>(m_groups.size());
+    report.entryCount = m_pendingCount;
+    appendBlock(m_pendingGroup, report, resourceData);
+    group.codec = report.codec;
+    group.storedSize = report.storedSize;
+    
+    m_groups.push_back(group);
+    m_reports.push_back(report);
+    m_pendingGroup.clear();
+    m_pendingCount = 0;
+}
+
 bool ResourceEmbedder::compressData(const std::vector<uint8_t>& input,
                                    std::vector<uint8_t>& output) {
+    TRACE_SPAN("compressData");
+    ALLOC_SCOPE(ALLOC_STAGE_ENCODE);
+    output.clear();
     if (input.empty()) {
         return false;
     }
     
-#ifdef USE_ZLIB
-    // Calculate maximum compressed size
-    uLongf compressedSize = compressBound(static_cast<uLong>(input.size()));
-    output.resize(compressedSize);
-    
-    // Compress with zlib
-    int result = compress2(
-        output.data(),
-        &compressedSize,
-        input.data(),
-        static_cast<uLong>(input.size()),
-        Z_BEST_COMPRESSION  // Maximum compression
-    );
-    
-    if (result != Z_OK) {
-        return false;
-    }
-    
-    // Resize to actual compressed size
-    output.resize(compressedSize);
+    // Default codec of CodecSearch, for callers outside a section build
+    output.reserve(input.size());
+    encodeLz(input.data(), input.size(), output);
     
     // Only use compression if it actually reduces size
     if (output.size() >= input.size()) {
-        output = input;
+        output.clear();
         return false;  // Not compressed
     }
     
     return true;  // Successfully compressed
-#else
-    // Simple RLE compression fallback when zlib is not available
-    output.clear();
-    output.reserve(input.size());
-    
-    size_t i = 0;
-    while (i < input.size()) {
-        uint8_t value = input[i];
-        size_t count = 1;
-        
-        // Count consecutive identical bytes (max 255)
-        while (i + count < input.size() && input[i + count] == value && count < 255) {
-            count++;
-        }
-        
-        if (count > 3) {
-            // Use RLE encoding: 0xFF (marker) + count + value
-            output.push_back(0xFF);
-            output.push_back(static_cast<uint8_t>(count));
-            output.push_back(value);
-        } else {
-            // Just copy the bytes
-            for (size_t j = 0; j < count; j++) {
-                output.push_back(value);
-            }
-        }
-        
-        i += count;
+}
+
+bool ResourceEmbedder::generateManifest(const std::vector<PEInfo>& exeFiles,
+                                       std::vector<uint8_t>& manifest,
+                                       bool waitForPrevious,
+                                       const std::vector<StepDependency>& dependencies,
+                                       uint32_t maxParallel) {
+    TRACE_SPAN("generateManifest");
+    ALLOC_SCOPE(ALLOC_STAGE_MANIFEST);
+    // Manifest layout lives in ManifestFormat.h. Names and extensions come
+    // from the same files createResourceSection just laid out.
+    if (exeFiles.size() != m_entries.size()) {
+        return false;
     }
     
-    // Only use compression if it actually reduces size
-    if (output.size() >= input.size()) {
-        output = input;
-        return false;  // Not compressed
+    ManifestWriter writer;
+    std::vector<std::wstring> names;
+    names.reserve(m_entries.size());
+    for (size_t i = 0; i < m_entries.size(); i++) {
+        const std::wstring& name = exeFiles[i].originalName;
+        writer.addEntry(m_entries[i], name, name);
+        names.push_back(name);
     }
-    
-    return true;  // Successfully compressed
-#endif
-}bool ResourceEmbedder::generateManifest(const std::vector<PEInfo>& exeFiles,
-                                       std::vector<uint8_t>& manifest,
-                                       bool waitForPrevious) {
-    // Manifest structure:
-    // - Magic number (4 bytes): "PACK"
-    // - Version (4 bytes)
-    // - Entry count (4 bytes)
-    // - Wait for previous (1 byte)
-    // - For each entry:
-    //   - Resource ID (4 bytes)
-    //   - Offset (4 bytes)
-    //   - Size (4 bytes)
-    //   - Original size (4 bytes)
-    //   - Compressed flag (1 byte)
-    //   - Execution order (4 bytes)
-    //   - File extension (16 bytes - 8 wchar_t)
-    
-    const char magic[4] = {'P', 'A', 'C', 'K'};
-    DWORD version = 2;  // Incremented for new format with extensions
-    DWORD entryCount = static_cast<DWORD>(m_entries.size());
-    
-    // Write magic
-    manifest.insert(manifest.end(), magic, magic + 4);
-    
-    // Write version
-    const uint8_t* versionBytes = reinterpret_cast<const uint8_t*>(&version);
-    manifest.insert(manifest.end(), versionBytes, versionBytes + sizeof(DWORD));
-    
-    // Write entry count
-    const uint8_t* countBytes = reinterpret_cast<const uint8_t*>(&entryCount);
-    manifest.insert(manifest.end(), countBytes, countBytes + sizeof(DWORD));
-    
-    // Write waitForPrevious flag
-    uint8_t waitFlag = waitForPrevious ? 1 : 0;
-    manifest.push_back(waitFlag);
-    
-    // Write entries
-    for (const auto& entry : m_entries) {
-        const uint8_t* idBytes = reinterpret_cast<const uint8_t*>(&entry.id);
-        manifest.insert(manifest.end(), idBytes, idBytes + sizeof(DWORD));
-        
-        const uint8_t* offsetBytes = reinterpret_cast<const uint8_t*>(&entry.offset);
-        manifest.insert(manifest.end(), offsetBytes, offsetBytes + sizeof(DWORD));
-        
-        const uint8_t* sizeBytes = reinterpret_cast<const uint8_t*>(&entry.size);
-        manifest.insert(manifest.end(), sizeBytes, sizeBytes + sizeof(DWORD));
-        
-        const uint8_t* origSizeBytes = reinterpret_cast<const uint8_t*>(&entry.originalSize);
-        manifest.insert(manifest.end(), origSizeBytes, origSizeBytes + sizeof(DWORD));
-        
-        uint8_t compressedFlag = entry.compressed ? 1 : 0;
-        manifest.push_back(compressedFlag);
-        
-        const uint8_t* orderBytes = reinterpret_cast<const uint8_t*>(&entry.executionOrder);
-        manifest.insert(manifest.end(), orderBytes, orderBytes + sizeof(DWORD));
-        
-        // Write file extension (16 bytes)
-        const uint8_t* extBytes = reinterpret_cast<const uint8_t*>(&entry.extension);
-        manifest.insert(manifest.end(), extBytes, extBytes + 16);
+    if (!writer.setSteps(names, dependencies, maxParallel, m_error)) {
+        return false;
+    }
+    for (const auto& group : m_groups) {
+        writer.addGroup(group);
+    }
+    for (const auto& hole : m_holes) {
+        writer.addHole(hole);
     }
     
-    return true;
+    return writer.write(waitForPrevious, manifest);
 }
 
 } // namespace Packer
@@ -2,9 +2,33 @@
 #define RESOURCEEMBEDDER_H
 
 #include "common.h"
+#include "ManifestWriter.h"
+#include <memory>
 
 namespace Packer {
 
+class CodecSearch;
+
+// How one stored block (a standalone entry or a solid group) was encoded
+struct BlockReport {
+    std::wstring name;       // Entry name, or empty for a solid group
+    uint32_t group;          // Group index when name is empty
+    uint32_t entryCount;
+    uint64_t originalSize;
+    uint64_t storedSize;
+    uint32_t codec;
+    int level;
+    double encodeSeconds;
+    double decodeSeconds;
+    
+    BlockReport() : group(0), entryCount(0), originalSize(0), storedSize(0), codec(0),
+                    level(0), encodeSeconds(0), decodeSeconds(0) {}
+};
+
+// In-memory bundle builder used by the GUI. It keeps the entries of the
+// build in progress between createResourceSection and generateManifest, so
+// each concurrent build needs its own instance; PackEngine is the
+// reentrant way to build.
 class ResourceEmbedder {
 public:
     ResourceEmbedder();
@@ -13,33 +37,58 @@ public:
     // Embed multiple EXEs as resources
     bool embedExecutables(const std::vector<PEInfo>& exeFiles, 
                          std::vector<uint8_t>& outputData,
-                         bool waitForPrevious = true);
+                         bool waitForPrevious = true,
+                         CompressionMode compression = CompressionMode::SOLID,
+                         const CodecSearchOptions& codecSearch = CodecSearchOptions(),
+                         bool sparse = true,
+                         uint32_t startupEntries = 0,
+                         const std::vector<StepDependency>& dependencies = std::vector<StepDependency>(),
+                         uint32_t maxParallel = 0);
     
-    // Create resource section
+    // Lay out the file data in execution order; the first startupEntries
+    // entries are stored uncompressed, ahead of everything else
     bool createResourceSection(const std::vector<PEInfo>& exeFiles,
-                              std::vector<uint8_t>& resourceData);
+                              std::vector<uint8_t>& resourceData,
+                              CompressionMode compression = CompressionMode::SOLID,
+                              const CodecSearchOptions& codecSearch = CodecSearchOptions(),
+                              bool sparse = true,
+                              uint32_t startupEntries = 0);
     
-    // Compress data
+    // Compress data with a codec the stub can decode; false (and output
+    // cleared) when that would not save space
     bool compressData(const std::vector<uint8_t>& input, 
                      std::vector<uint8_t>& output);
     
-    // Generate resource manifest
+    // Generate resource manifest; with dependencies or a cap the entries
+    // run as a dependency graph (see ManifestWriter::setSteps)
     bool generateManifest(const std::vector<PEInfo>& exeFiles,
                          std::vector<uint8_t>& manifest,
-                         bool waitForPrevious);
+                         bool waitForPrevious,
+                         const std::vector<StepDependency>& dependencies = std::vector<StepDependency>(),
+                         uint32_t maxParallel = 0);
     
+    // One report per stored block of the last createResourceSection
+    const std::vector<BlockReport>& blockReports() const { return m_reports; }
+    
+    // Why the last embedExecutables or generateManifest failed, if it said
+    const std::string& error() const { return m_error; }
+
 private:
-    struct ResourceEntry {
-        DWORD id;
-        DWORD offset;
-        DWORD size;
-        DWORD originalSize;
-        bool compressed;
-        int executionOrder;
-        wchar_t extension[8];  // Store file extension (e.g., ".exe", ".txt", ".bat")
-    };
-    
-    std::vector<ResourceEntry> m_entries;
+    // Compress the pending solid group and append it to resourceData
+    void flushGroup(std::vector<uint8_t>& resourceData);
+    
+    // Encode one block with the codec search and append it to resourceData
+    void appendBlock(const std::vector<uint8_t>& data, BlockReport& report,
+                     std::vector<uint8_t>& resourceData);
+    
+    std::unique_ptr<CodecSearch> m_search;
+    std::vector<BlockReport> m_reports;
+    std::vector<ManifestRecord> m_entries;
+    std::vector<ManifestGroup> m_groups;
+    std::vector<ManifestHole> m_holes;
+    std::vector<uint8_t> m_pendingGroup;
+    uint32_t m_pendingCount;
+    std::string m_error;
 };
 
 } // namespace Packer
@@ -0,0 +1,203 @@
+#ifndef SHAREDCONTENT_H
+#define SHAREDCONTENT_H
+
+// Which of a bundle's entries the stub writes once and links for the rest.
+// Used by the stub, so like StepScheduler.h it must not depend on Windows.h;
+// the file operations go through SharedFiles.
+
+#include "ManifestFormat.h"
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Packer {
+
+// File operations for SharedContent. The stub's use the Windows API; a test's
+// can record them and fail on demand.
+class SharedFiles {
+public:
+    virtual ~SharedFiles() {}
+    
+    virtual bool hardLink(const std::wstring& source, const std::wstring& path) = 0;
+    virtual bool copy(const std::wstring& source, const std::wstring& path) = 0;
+    virtual void remove(const std::wstring& path) = 0;
+    
+    // Keep a file from being changed until unhold; best effort
+    virtual void hold(const std::wstring& path) = 0;
+    virtual void unhold(const std::wstring& path) = 0;
+    
+    // XXH64 of a file's content; false if it cannot be read
+    virtual bool hash(const std::wstring& path, uint64_t& hash) = 0;
+};
+
+// Entries with the same content (hash and size) are decoded and written
+// once. Later ones become hard links to that first copy, or copies of it
+// where the volume has no hard links (FAT); CopyFileW clones the blocks
+// itself on ReFS and Dev Drives. Until every sharer exists the first copy
+// is kept, even past its own step, and held so nothing changes it
+// underneath them. Before the first link it is hashed again: a copy that
+// no longer matches the entry's hash is not shared, and every sharer is
+// written out in full instead.
+class SharedContent {
+public:
+    explicit SharedContent(SharedFiles& files) : m_files(files) {}
+    
+    ~SharedContent() {
+        for (Copy& copy : m_copies) {
+            finish(copy);
+        }
+    }
+    
+    SharedContent(const SharedContent&) = delete;
+    SharedContent& operator=(const SharedContent&) = delete;
+    
+    // Group the manifest's entries by content; hashed ones only
+    void init(const ManifestView& manifest) {
+        struct Key {
+            uint64_t hash;
+            uint64_t size;
+            uint32_t index;
+        };
+        std::vector<Key> keys;
+        for (uint32_t i = 0; i < manifest.entryCount(); i++) {
+            ManifestRecord entry;
+            if (manifest.entry(i, entry) && (entry.flags & MANIFEST_RECORD_HASH) &&
+                !(entry.flags & (MANIFEST_RECORD_BASE | MANIFEST_RECORD_DELTA))) {
+                keys.push_back({ entry.contentHash, entry.originalSize, i });
+            }
+        }
+        std::sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) {
+            return a.hash != b.hash ? a.hash < b.hash : a.size < b.size;
+        });
+        
+        m_slot.assign(manifest.entryCount(), 0);
+        size_t first = 0;
+        while (first < keys.size()) {
+            size_t last = first + 1;
+            while (last < keys.size() && keys[last].hash == keys[first].hash &&
+                   keys[last].size == keys[first].size) {
+                last++;
+            }
+            if (last - first > 1) {
+                m_copies.push_back(Copy());
+                m_copies.back().hash = keys[first].hash;
+                m_copies.back().remaining = static_cast<uint32_t>(last - first);
+                for (size_t k = first; k < last; k++) {
+                    m_slot[keys[k].index] = static_cast<uint32_t>(m_copies.size());
+                }
+            }
+            first = last;
+        }
+    }
+    
+    // Whether an entry's content is already on disk to link to
+    bool available(uint32_t index) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return index < m_slot.size() && m_slot[index] != 0 &&
+               !m_copies[m_slot[index] - 1].source.empty();
+    }
+    
+    // Create path from an earlier copy of the entry's content; false if
+    // there is none or it cannot be linked or copied, and the entry must
+    // be written out
+    bool link(uint32_t index, const std::wstring& path) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (index >= m_slot.size() || m_slot[index] == 0) {
+            return false;
+        }
+        Copy& copy = m_copies[m_slot[index] - 1];
+        if (copy.source.empty()) {
+            return false;
+        }
+        
+        // The first copy is held from here on, so checking it once covers
+        // every link to it
+        if (!copy.verified) {
+            uint64_t hash = 0;
+            if (!m_files.hash(copy.source, hash) || hash != copy.hash) {
+                copy.remaining = 0;
+                finish(copy);
+                return false;
+            }
+            copy.verified = true;
+        }
+        
+        // A leftover from an earlier run would block the link
+        m_files.remove(path);
+        if (!m_files.hardLink(copy.source, path) && !m_files.copy(copy.source, path)) {
+            return false;
+        }
+        if (--copy.remaining == 0) {
+            finish(copy);
+        }
+        return true;
+    }
+    
+    // The entry was written to path in full; the first such copy becomes
+    // the one later sharers link to
+    void written(uint32_t index, const std::wstring& path) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (index >= m_slot.size() || m_slot[index] == 0) {
+            return;
+        }
+        Copy& copy = m_copies[m_slot[index] - 1];
+        if (copy.remaining == 0) {
+            return;  // No longer shared
+        }
+        if (--copy.remaining == 0) {
+            finish(copy);
+        } else if (copy.source.empty()) {
+            copy.source = path;
+            m_files.hold(path);
+        }
+    }
+    
+    // Delete an entry's temp file once its step is done; a first copy that
+    // sharers still need is deleted after the last of them is created
+    void release(uint32_t index, const std::wstring& path) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (index < m_slot.size() && m_slot[index] != 0) {
+                Copy& copy = m_copies[m_slot[index] - 1];
+                if (copy.source == path) {
+                    copy.parked.push_back(path);
+                    return;
+                }
+            }
+        }
+        m_files.remove(path);
+    }
+
+private:
+    struct Copy {
+        std::wstring source;                // First copy written; empty once all sharers exist
+        uint64_t hash;                      // Content hash source must still have
+        bool verified;                      // source hashed since it was held
+        uint32_t remaining;                 // Sharers not created yet; 0 = no longer shared
+        std::vector<std::wstring> parked;   // Released while still needed
+        
+        Copy() : hash(0), verified(false), remaining(0) {}
+    };
+    
+    // Every sharer exists (or the stub is done): let the first copy go
+    void finish(Copy& copy) {
+        if (!copy.source.empty()) {
+            m_files.unhold(copy.source);
+        }
+        for (const std::wstring& path : copy.parked) {
+            m_files.remove(path);
+        }
+        copy.parked.clear();
+        copy.source.clear();
+    }
+    
+    SharedFiles& m_files;
+    std::vector<uint32_t> m_slot;   // Per entry: index into m_copies + 1, 0 = content not shared
+    std::vector<Copy> m_copies;
+    std::mutex m_mutex;
+};
+
+} // namespace Packer
+
+#endif // SHAREDCONTENT_H
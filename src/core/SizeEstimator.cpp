@@ -0,0 +1,407 @@
+#include "SizeEstimator.h"
+#include "ArchiveReader.h"
+#include "Codec.h"
+#include "CodecSearch.h"
+#include "FileIO.h"
+#include "ManifestWriter.h"
+#include "SparseScan.h"
+#include "StubRegistry.h"
+#include "../utils/FileTypeDetector.h"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <unordered_map>
+
+namespace Packer {
+
+namespace {
+
+// Inputs up to this size are sampled whole; larger ones as SAMPLE_WINDOWS
+// windows of SAMPLE_WINDOW bytes, first and last at the ends of the file
+const uint64_t SAMPLE_WHOLE_LIMIT = 2 * 1024 * 1024;
+const size_t SAMPLE_WINDOW = 256 * 1024;
+const size_t SAMPLE_WINDOWS = 6;
+
+// Samples this close to random are not worth a trial encode; the codec
+// would not beat storing them
+const double STORED_ENTROPY = 7.9;
+
+// How far back the LZ codec matches (CODEC_LZ's window), which bounds how
+// much a solid group member can gain from the members before it
+const uint64_t LZ_WINDOW = 64 * 1024;
+
+// Sketch: a gear hash over the last 16 bytes, about the length of a match
+// worth taking, kept at about one position in SKETCH_RATE
+const size_t SKETCH_CONTEXT = 16;
+const uint64_t SKETCH_RATE = 8;
+
+struct GearTable {
+    uint64_t values[256];
+    
+    GearTable() {
+        uint64_t state = 0x9E3779B97F4A7C15ull;
+        for (uint64_t& value : values) {
+            // splitmix64
+            uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            value = z ^ (z >> 31);
+        }
+    }
+};
+
+void sketchContent(const uint8_t* data, size_t size, std::vector<uint64_t>& sketch) {
+    static const GearTable gear;
+    uint64_t hash = 0;
+    for (size_t i = 0; i < size; i++) {
+        // Each byte shifts 64 / SKETCH_CONTEXT bits, so older ones fall out
+        hash = (hash << (64 / SKETCH_CONTEXT)) + gear.values[data[i]];
+        // The low bits hold only the newest byte; choose on mixed high ones
+        if (i + 1 >= SKETCH_CONTEXT && ((hash * 0x9E3779B97F4A7C15ull) >> 32) % SKETCH_RATE == 0) {
+            sketch.push_back(hash);
+        }
+    }
+    std::sort(sketch.begin(), sketch.end());
+    sketch.erase(std::unique(sketch.begin(), sketch.end()), sketch.end());
+}
+
+std::wstring entryName(const std::wstring& path) {
+    size_t lastSlash = path.find_last_of(L"\\/");
+    return lastSlash != std::wstring::npos ? path.substr(lastSlash + 1) : path;
+}
+
+// The windows of an input to sample: all of it when small, else spread out
+bool readWindows(const std::wstring& path, uint64_t& size,
+                 std::vector<std::vector<uint8_t>>& windows, std::string& error) {
+    std::wstring archivePath;
+    std::string name;
+    if (ArchiveReader::splitMemberPath(path, archivePath, name)) {
+        // Members may be deflated; sample their front rather than seek
+        ArchiveReader archive;
+        size_t index = 0;
+        if (!archive.open(archivePath)) {
+            error = archive.error();
+            return false;
+        }
+        if (!archive.find(name, index)) {
+            error = "no file " + name + " in the archive";
+            return false;
+        }
+        size = archive.members()[index].size;
+        windows.resize(1);
+        return archive.readPrefix(index, static_cast<size_t>(SAMPLE_WHOLE_LIMIT), windows[0], error);
+    }
+    
+    if (!FileIO::fileSize(path, size)) {
+        error = "cannot read";
+        return false;
+    }
+    if (size <= SAMPLE_WHOLE_LIMIT) {
+        windows.resize(1);
+        if (!FileIO::readFile(path, windows[0])) {
+            error = "cannot read";
+            return false;
+        }
+        size = windows[0].size();
+        return true;
+    }
+    
+    windows.resize(SAMPLE_WINDOWS);
+    uint64_t stride = (size - SAMPLE_WINDOW) / (SAMPLE_WINDOWS - 1);
+    for (size_t i = 0; i < SAMPLE_WINDOWS; i++) {
+        if (!FileIO::readRange(path, stride * i, SAMPLE_WINDOW, windows[i])) {
+            error = "cannot read";
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+SizeEstimator::SizeEstimator(const CodecSearchOptions& codecSearch, size_t threads)
+    : m_codecSearch(codecSearch), m_pool(threads) {
+}
+
+SizeEstimator::~SizeEstimator() {
+    m_pool.wait();
+}
+
+void SizeEstimator::setListener(std::function<void()> listener) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_listener = std::move(listener);
+}
+
+void SizeEstimator::add(const std::vector<std::wstring>& inputs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const std::wstring& path : inputs) {
+        Slot& slot = m_samples[path];
+        if (slot.busy) {
+            continue;
+        }
+        uint64_t size = 0;
+        if (slot.sample && (!FileIO::fileSize(path, size) || size == slot.sample->size)) {
+            continue;  // Unchanged, or an archive member
+        }
+        
+        slot.busy = true;
+        m_pool.submit([this, path] {
+            std::shared_ptr<InputSample> result = std::make_shared<InputSample>();
+            std::string error;
+            bool sampled = SizeEstimator::sample(path, m_codecSearch, *result, error);
+            
+            std::function<void()> listener;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                Slot& done = m_samples[path];
+                done.busy = false;
+                done.sample = sampled ? std::move(result) : nullptr;
+                listener = m_listener;
+            }
+            if (listener) {
+                listener();
+            }
+        });
+    }
+}
+
+void SizeEstimator::wait() {
+    m_pool.wait();
+}
+
+bool SizeEstimator::busy() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& slot : m_samples) {
+        if (slot.second.busy) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SizeEstimator::sample(const std::wstring& path, const CodecSearchOptions& codecSearch,
+                           InputSample& sample, std::string& error) {
+    std::vector<std::vector<uint8_t>> windows;
+    if (!readWindows(path, sample.size, windows, error)) {
+        return false;
+    }
+    sample.compressible = windows[0].empty() ||
+                          FileTypeDetector::isCompressible(windows[0].data(), windows[0].size());
+    
+    // Headers and trailers are unlike the rest of a file, so the end windows
+    // stand only for themselves and the inner ones share the middle
+    std::vector<double> weights(windows.size(), 1.0);
+    if (windows.size() > 2) {
+        double inner = static_cast<double>(sample.size - 2 * windows[0].size()) /
+                       ((windows.size() - 2) * windows[0].size());
+        std::fill(weights.begin() + 1, weights.end() - 1, inner);
+    }
+    double covered = 0;
+    for (size_t w = 0; w < windows.size(); w++) {
+        covered += weights[w] * windows[w].size();
+    }
+    
+    uint64_t counts[256] = {};
+    double holeBytes = 0;
+    double holeCount = 0;
+    for (size_t w = 0; w < windows.size(); w++) {
+        sample.sampledBytes += windows[w].size();
+        for (uint8_t byte : windows[w]) {
+            counts[byte]++;
+        }
+        std::vector<ManifestHole> holes;
+        SparseScan::findZeroRuns(windows[w].data(), windows[w].size(), SPARSE_MIN_HOLE, holes);
+        for (const auto& hole : holes) {
+            holeBytes += weights[w] * hole.length;
+        }
+        holeCount += weights[w] * holes.size();
+    }
+    if (sample.sampledBytes == 0) {
+        return true;
+    }
+    for (uint64_t count : counts) {
+        if (count != 0) {
+            double p = static_cast<double>(count) / sample.sampledBytes;
+            sample.entropy -= p * std::log2(p);
+        }
+    }
+    sample.holeShare = holeBytes / covered;
+    sample.holesPerByte = holeCount / covered;
+    
+    if (sample.size <= SOLID_ENTRY_LIMIT) {
+        sketchContent(windows[0].data(), windows[0].size(), sample.sketch);
+    }
+    if (!sample.compressible || sample.entropy >= STORED_ENTROPY) {
+        return true;
+    }
+    
+    // Trial encode the bytes between holes, as the build would
+    CodecSearch search(codecSearch, false);
+    double bodyBytes = 0;
+    double storedBytes = 0;
+    double encodeSeconds = 0;
+    double decodeSeconds = 0;
+    for (size_t w = 0; w < windows.size(); w++) {
+        std::vector<uint8_t>& window = windows[w];
+        std::vector<ManifestHole> holes;
+        SparseScan::pack(window, SPARSE_MIN_HOLE, holes);
+        CodecChoice choice;
+        search.choose(window.data(), window.size(), choice);
+        bodyBytes += weights[w] * window.size();
+        storedBytes += weights[w] * (choice.codec == CODEC_STORE ? window.size() : choice.output.size());
+        encodeSeconds += weights[w] * (choice.encodeSeconds + choice.decodeSeconds);
+        decodeSeconds += weights[w] * choice.decodeSeconds;
+    }
+    if (bodyBytes > 0) {
+        sample.storedRatio = storedBytes / bodyBytes;
+        sample.encodeSecondsPerByte = encodeSeconds / bodyBytes;
+        sample.decodeSecondsPerByte = decodeSeconds / bodyBytes;
+    }
+    return true;
+}
+
+SizeEstimate SizeEstimator::estimate(const std::vector<std::wstring>& inputs,
+                                     const PackerOptions& options, size_t threads) const {
+    SizeEstimate result;
+    std::vector<std::shared_ptr<const InputSample>> samples(inputs.size());
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < inputs.size(); i++) {
+            auto found = m_samples.find(inputs[i]);
+            if (found != m_samples.end()) {
+                samples[i] = found->second.sample;
+            }
+        }
+    }
+    
+    ManifestWriter manifest;
+    ManifestRecord record = {};
+    ManifestHole hole = {};
+    double encodeSeconds = 0;
+    double longestBlock = 0;  // One block never spreads over several threads
+    double decodeSeconds = 0;
+    uint64_t dataSize = 0;
+    
+    // The solid group being filled, and the sketches of its members still
+    // inside the LZ window, newest last
+    double groupStored = 0;
+    uint64_t groupBytes = 0;
+    double groupSeconds = 0;
+    std::deque<std::pair<const InputSample*, uint64_t>> window;
+    uint64_t windowBytes = 0;
+    std::unordered_map<uint64_t, uint32_t> seen;
+    auto closeGroup = [&] {
+        if (groupBytes > 0) {
+            dataSize += static_cast<uint64_t>(std::min(groupStored, static_cast<double>(groupBytes)));
+            longestBlock = std::max(longestBlock, groupSeconds);
+            manifest.addGroup(ManifestGroup());
+        }
+        groupStored = 0;
+        groupBytes = 0;
+        groupSeconds = 0;
+        window.clear();
+        windowBytes = 0;
+        seen.clear();
+    };
+    
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (!samples[i]) {
+            result.pending++;
+            continue;
+        }
+        const InputSample& sample = *samples[i];
+        result.sampled++;
+        manifest.addEntry(record, entryName(inputs[i]), entryName(inputs[i]));
+        
+        bool startup = i < options.startupEntries;
+        bool compress = options.compression != CompressionMode::NONE && sample.compressible &&
+                        !startup;
+        if (options.compression == CompressionMode::SOLID && compress &&
+            sample.size <= SOLID_ENTRY_LIMIT) {
+            // Hashes already in the window come out as matches
+            size_t matched = 0;
+            for (uint64_t hash : sample.sketch) {
+                matched += seen.count(hash);
+            }
+            double fresh = sample.sketch.empty() ? 1.0 :
+                           1.0 - static_cast<double>(matched) / sample.sketch.size();
+            double seconds = sample.size * sample.encodeSecondsPerByte;
+            groupStored += sample.size * sample.storedRatio * fresh;
+            groupBytes += sample.size;
+            groupSeconds += seconds;
+            encodeSeconds += seconds;
+            decodeSeconds += sample.size * sample.decodeSecondsPerByte;
+            
+            for (uint64_t hash : sample.sketch) {
+                seen[hash]++;
+            }
+            window.emplace_back(&sample, sample.size);
+            windowBytes += sample.size;
+            while (window.size() > 1 && windowBytes - window.front().second >= LZ_WINDOW) {
+                for (uint64_t hash : window.front().first->sketch) {
+                    auto it = seen.find(hash);
+                    if (--it->second == 0) {
+                        seen.erase(it);
+                    }
+                }
+                windowBytes -= window.front().second;
+                window.pop_front();
+            }
+            if (groupBytes >= SOLID_GROUP_TARGET) {
+                closeGroup();
+            }
+            continue;
+        }
+        
+        // Standalone entry: holes out, the rest encoded or stored
+        double body = static_cast<double>(sample.size);
+        if (options.sparse && sample.size >= SPARSE_MIN_HOLE) {
+            body -= sample.size * sample.holeShare;
+            uint64_t holes = static_cast<uint64_t>(sample.size * sample.holesPerByte + 0.5);
+            for (uint64_t h = 0; h < holes; h++) {
+                manifest.addHole(hole);
+            }
+        }
+        if (compress) {
+            double seconds = body * sample.encodeSecondsPerByte;
+            dataSize += static_cast<uint64_t>(body * sample.storedRatio);
+            encodeSeconds += seconds;
+            longestBlock = std::max(longestBlock, seconds);
+            decodeSeconds += body * sample.decodeSecondsPerByte;
+        } else {
+            dataSize += static_cast<uint64_t>(body);
+        }
+    }
+    closeGroup();
+    
+    if (!options.dependencies.empty()) {
+        manifest.setSchedule(ManifestSchedule());
+        for (size_t i = 0; i < options.dependencies.size(); i++) {
+            manifest.addDependency(ManifestDependency());
+        }
+    }
+    std::vector<uint8_t> tail;
+    manifest.write(options.waitForPrevious, tail);
+    uint64_t payloadSize = dataSize + tail.size() + BundleTrailerSchema::size;
+    
+    // Overlay payloads follow the stub; a section starts on the file
+    // alignment and is padded to it
+    uint64_t stubSize = 0;
+    std::string error;
+    std::shared_ptr<const StubTemplate> stub =
+        StubRegistry::instance().get(options.stubPath, options.outputType, error);
+    if (stub && options.payloadLayout == PayloadLayout::SECTION) {
+        stubSize = stub->payloadOffset;
+        payloadSize = (payloadSize + stub->fileAlignment - 1) / stub->fileAlignment * stub->fileAlignment;
+    } else if (stub) {
+        stubSize = stub->data.size();
+    }
+    
+    result.dataSize = dataSize;
+    result.outputSize = stubSize + payloadSize;
+    result.encodeSeconds = std::max(encodeSeconds / std::max<size_t>(threads, 1), longestBlock);
+    result.extractSeconds = decodeSeconds;
+    return result;
+}
+
+} // namespace Packer
@@ -0,0 +1,107 @@
+#ifndef SIZEESTIMATOR_H
+#define SIZEESTIMATOR_H
+
+#include "common.h"
+#include "ThreadPool.h"
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace Packer {
+
+// What sampling learned about one input. Inputs up to SAMPLE_WHOLE_LIMIT
+// are read whole, larger ones as a few windows spread over the file.
+struct InputSample {
+    uint64_t size;
+    uint64_t sampledBytes;
+    bool compressible;            // Per FileTypeDetector, as the build decides
+    double entropy;               // Order-0 bits per byte of the sampled bytes
+    double holeShare;             // Of the input, in zero runs stored as holes
+    double holesPerByte;          // Such runs per input byte
+    double storedRatio;           // Encoded / original, hole bytes left out
+    double encodeSecondsPerByte;  // Encode plus the build's decode-back check
+    double decodeSecondsPerByte;
+    std::vector<uint64_t> sketch; // Sorted content hashes, small inputs only
+    
+    InputSample() : size(0), sampledBytes(0), compressible(true), entropy(0), holeShare(0),
+                    holesPerByte(0), storedRatio(1), encodeSecondsPerByte(0),
+                    decodeSecondsPerByte(0) {}
+};
+
+// Predicted outcome of a build
+struct SizeEstimate {
+    uint64_t outputSize;     // Stub, file data, manifest and trailer
+    uint64_t dataSize;       // File data alone
+    double encodeSeconds;    // Wall clock for the encode stage on the build's threads
+    double extractSeconds;   // The stub decoding every entry, one after another
+    size_t sampled;          // Inputs the estimate covers
+    size_t pending;          // Inputs still being sampled, or unreadable
+    
+    SizeEstimate() : outputSize(0), dataSize(0), encodeSeconds(0), extractSeconds(0),
+                     sampled(0), pending(0) {}
+};
+
+// Predicts a bundle's size and build and extraction times without
+// building it. Inputs are sampled in the background as they are named:
+// an entropy count, which sends near-random data straight to "stored", a
+// trial encode of a few blocks with the build's codec settings, timed both
+// ways, and for solid-group candidates a sketch of content hashes.
+// estimate() then lays the inputs out as the pipeline would (startup
+// entries, solid groups, sparse holes, manifest, stub) from those samples
+// alone, so it is cheap enough to call on every list change.
+//
+// Solid groups compress better than their members one by one because the
+// LZ window reaches back into earlier members. The sketch measures that:
+// the share of an entry's hashes already seen within the window is taken
+// off its trial-encoded size. Every copy of duplicate content is still
+// counted, since the build stores each entry.
+class SizeEstimator {
+public:
+    // threads sample in the background; 0 = one per hardware thread
+    explicit SizeEstimator(const CodecSearchOptions& codecSearch = CodecSearchOptions(),
+                           size_t threads = 0);
+    ~SizeEstimator();
+    
+    SizeEstimator(const SizeEstimator&) = delete;
+    SizeEstimator& operator=(const SizeEstimator&) = delete;
+    
+    // Called from a sampling thread after each input is sampled
+    void setListener(std::function<void()> listener);
+    
+    // Start sampling the inputs not sampled yet, or changed in size since
+    void add(const std::vector<std::wstring>& inputs);
+    
+    // Block until every started sample has finished
+    void wait();
+    
+    // Whether any sample is still running
+    bool busy() const;
+    
+    // Estimate for building inputs in this order; unsampled inputs are left
+    // out and counted as pending. threads is the build's encode threads.
+    SizeEstimate estimate(const std::vector<std::wstring>& inputs, const PackerOptions& options,
+                          size_t threads) const;
+    
+    // Sample one input on the calling thread
+    static bool sample(const std::wstring& path, const CodecSearchOptions& codecSearch,
+                       InputSample& sample, std::string& error);
+
+private:
+    struct Slot {
+        std::shared_ptr<const InputSample> sample;  // Latest sample; nullptr until one succeeds
+        bool busy;
+        
+        Slot() : busy(false) {}
+    };
+    
+    CodecSearchOptions m_codecSearch;
+    std::function<void()> m_listener;
+    std::map<std::wstring, Slot> m_samples;
+    mutable std::mutex m_mutex;
+    ThreadPool m_pool;      // Last, so it stops before the rest goes away
+};
+
+} // namespace Packer
+
+#endif // SIZEESTIMATOR_H
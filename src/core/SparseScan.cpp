@@ -0,0 +1,88 @@
+#include "SparseScan.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PACKER_SPARSE_SSE2
+#endif
+
+namespace Packer {
+
+namespace {
+
+const size_t BLOCK = 16;
+
+inline bool blockIsZero(const uint8_t* p) {
+#ifdef PACKER_SPARSE_SSE2
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_setzero_si128())) == 0xFFFF;
+#else
+    uint64_t low;
+    uint64_t high;
+    memcpy(&low, p, 8);
+    memcpy(&high, p + 8, 8);
+    return (low | high) == 0;
+#endif
+}
+
+} // namespace
+
+void SparseScan::findZeroRuns(const uint8_t* data, size_t size, size_t minRun,
+                              std::vector<ManifestHole>& holes) {
+    if (minRun == 0 || size < minRun) {
+        return;
+    }
+    
+    size_t scanned = 0;     // End of the last run; runs never reach back past it
+    size_t i = 0;
+    while (size - i >= BLOCK) {
+        if (!blockIsZero(data + i)) {
+            i += BLOCK;
+            continue;
+        }
+        
+        // Widen the run bytewise into the blocks on either side
+        size_t start = i;
+        while (start > scanned && data[start - 1] == 0) {
+            start--;
+        }
+        i += BLOCK;
+        while (size - i >= BLOCK && blockIsZero(data + i)) {
+            i += BLOCK;
+        }
+        while (i < size && data[i] == 0) {
+            i++;
+        }
+        
+        if (i - start >= minRun) {
+            ManifestHole hole;
+            hole.offset = start;
+            hole.length = i - start;
+            holes.push_back(hole);
+        }
+        scanned = i;
+    }
+}
+
+bool SparseScan::pack(std::vector<uint8_t>& data, size_t minRun, std::vector<ManifestHole>& holes) {
+    size_t first = holes.size();
+    findZeroRuns(data.data(), data.size(), minRun, holes);
+    if (holes.size() == first) {
+        return false;
+    }
+    
+    size_t packed = 0;
+    size_t position = 0;
+    for (size_t h = first; h < holes.size(); h++) {
+        size_t extent = static_cast<size_t>(holes[h].offset) - position;
+        memmove(data.data() + packed, data.data() + position, extent);
+        packed += extent;
+        position = static_cast<size_t>(holes[h].offset + holes[h].length);
+    }
+    memmove(data.data() + packed, data.data() + position, data.size() - position);
+    packed += data.size() - position;
+    data.resize(packed);
+    return true;
+}
+
+} // namespace Packer
@@ -0,0 +1,26 @@
+#ifndef SPARSESCAN_H
+#define SPARSESCAN_H
+
+#include "ManifestFormat.h"
+#include <vector>
+
+namespace Packer {
+
+// Zero-run detection for sparse entries. The scan tests 16 bytes at a
+// time (SSE2 where available, two 64-bit words otherwise) and only walks
+// bytes at the edges of a run, so it costs about as much as reading the
+// data once.
+class SparseScan {
+public:
+    // Append every run of at least minRun zero bytes to holes, in order
+    static void findZeroRuns(const uint8_t* data, size_t size, size_t minRun,
+                             std::vector<ManifestHole>& holes);
+    
+    // Find the runs and squeeze them out of data in place, leaving only the
+    // bytes between them. False, with data untouched, when there are none.
+    static bool pack(std::vector<uint8_t>& data, size_t minRun, std::vector<ManifestHole>& holes);
+};
+
+} // namespace Packer
+
+#endif // SPARSESCAN_H
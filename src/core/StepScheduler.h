@@ -0,0 +1,143 @@
+#ifndef STEPSCHEDULER_H
+#define STEPSCHEDULER_H
+
+// Dependency-graph scheduling of a bundle's steps (its entries, by index).
+// Shared by the builder, which checks the graph, and the stub, which runs
+// it, so like ManifestFormat.h it must not depend on Windows.h.
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace Packer {
+
+// Starts steps and reports when they finish. The stub's launches processes;
+// anything else (a fake for testing, a dry run) works the same way.
+class StepLauncher {
+public:
+    virtual ~StepLauncher() {}
+    
+    // Start a step. running is false when it has already finished, or has
+    // nothing to wait for; false if it could not be started at all.
+    virtual bool start(uint32_t step, bool& running) = 0;
+    
+    // Block until one running step finishes and return it; false if there
+    // is nothing left to wait for
+    virtual bool waitAny(uint32_t& step) = 0;
+};
+
+// Runs each step as soon as every step it depends on has finished, at most
+// maxParallel at a time. Ready steps start lowest index first, so a chain
+// of edges runs in manifest order and a graph without edges runs like the
+// old "all at once" mode. A step that fails to start counts as finished:
+// its dependents still run, as they did when steps were simply sequential.
+class StepScheduler {
+public:
+    StepScheduler() : m_stepCount(0), m_maxParallel(0) {}
+    
+    // Steps 0..stepCount-1; each edge is (step, step it waits for).
+    // maxParallel 0 means no cap. False for an edge out of range, a step
+    // waiting for itself, or a cycle, none of which could ever finish.
+    bool init(uint32_t stepCount, const std::vector<std::pair<uint32_t, uint32_t>>& edges,
+              uint32_t maxParallel) {
+        m_stepCount = stepCount;
+        m_maxParallel = maxParallel;
+        m_waitingOn.assign(stepCount, 0);
+        m_firstDependent.assign(static_cast<size_t>(stepCount) + 1, 0);
+        m_dependents.assign(edges.size(), 0);
+        
+        // Dependents of each step, compressed: those of step s are
+        // m_dependents[m_firstDependent[s] .. m_firstDependent[s + 1])
+        for (const auto& edge : edges) {
+            if (edge.first >= stepCount || edge.second >= stepCount || edge.first == edge.second) {
+                return false;
+            }
+            m_waitingOn[edge.first]++;
+            m_firstDependent[edge.second + 1]++;
+        }
+        for (uint32_t s = 0; s < stepCount; s++) {
+            m_firstDependent[s + 1] += m_firstDependent[s];
+        }
+        std::vector<uint32_t> fill(m_firstDependent.begin(), m_firstDependent.end() - 1);
+        for (const auto& edge : edges) {
+            m_dependents[fill[edge.second]++] = edge.first;
+        }
+        
+        // Every step is reachable from the roots exactly when there is no cycle
+        std::vector<uint32_t> waiting = m_waitingOn;
+        std::vector<uint32_t> ready;
+        for (uint32_t s = 0; s < stepCount; s++) {
+            if (waiting[s] == 0) {
+                ready.push_back(s);
+            }
+        }
+        uint32_t reached = 0;
+        while (!ready.empty()) {
+            uint32_t step = ready.back();
+            ready.pop_back();
+            reached++;
+            for (uint32_t d = m_firstDependent[step]; d < m_firstDependent[step + 1]; d++) {
+                if (--waiting[m_dependents[d]] == 0) {
+                    ready.push_back(m_dependents[d]);
+                }
+            }
+        }
+        return reached == stepCount;
+    }
+    
+    // Run every step through launcher; returns once all have finished, or
+    // early if the launcher has nothing left to wait for
+    void run(StepLauncher& launcher) {
+        std::vector<uint32_t> waiting = m_waitingOn;
+        std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> ready;
+        for (uint32_t s = 0; s < m_stepCount; s++) {
+            if (waiting[s] == 0) {
+                ready.push(s);
+            }
+        }
+        
+        uint32_t finished = 0;
+        uint32_t running = 0;
+        auto finish = [&](uint32_t step) {
+            finished++;
+            for (uint32_t d = m_firstDependent[step]; d < m_firstDependent[step + 1]; d++) {
+                if (--waiting[m_dependents[d]] == 0) {
+                    ready.push(m_dependents[d]);
+                }
+            }
+        };
+        
+        while (finished < m_stepCount) {
+            while (!ready.empty() && (m_maxParallel == 0 || running < m_maxParallel)) {
+                uint32_t step = ready.top();
+                ready.pop();
+                bool started = false;
+                if (launcher.start(step, started) && started) {
+                    running++;
+                } else {
+                    finish(step);
+                }
+            }
+            
+            uint32_t step;
+            if (running == 0 || !launcher.waitAny(step)) {
+                return;
+            }
+            running--;
+            finish(step);
+        }
+    }
+
+private:
+    uint32_t m_stepCount;
+    uint32_t m_maxParallel;
+    std::vector<uint32_t> m_waitingOn;       // Unfinished dependencies per step
+    std::vector<uint32_t> m_firstDependent;
+    std::vector<uint32_t> m_dependents;
+};
+
+} // namespace Packer
+
+#endif // STEPSCHEDULER_H
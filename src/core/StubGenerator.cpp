@@ -1,10 +1,49 @@
 #include "StubGenerator.h"
+#include "StubRegistry.h"
 #include "ResourceEmbedder.h"
-#include "stub_template.h"
-#include <fstream>
+#include "Trace.h"
+#include <cstring>
+#include <algorithm>
+#include <utility>
 
 namespace Packer {
 
+namespace {
+
+DWORD alignTo(DWORD value, DWORD alignment) {
+    return ((value + alignment - 1) / alignment) * alignment;
+}
+
+// Bounds-checked NT headers. Callers only touch fields that sit at the same
+// offset in PE32 and PE32+ images (alignments, SizeOfImage, SizeOfHeaders,
+// CheckSum), so the native header type is fine for both.
+IMAGE_NT_HEADERS* getNTHeaders(std::vector<uint8_t>& peData) {
+    if (peData.size() < sizeof(IMAGE_DOS_HEADER)) {
+        return nullptr;
+    }
+    
+    auto dosHeader = reinterpret_cast<IMAGE_DOS_HEADER*>(peData.data());
+    if (dosHeader->e_magic != IMAGE_DOS_SIGNATURE || dosHeader->e_lfanew < 0) {
+        return nullptr;
+    }
+    
+    size_t ntOffset = static_cast<size_t>(dosHeader->e_lfanew);
+    size_t minSize = ntOffset + sizeof(DWORD) + sizeof(IMAGE_FILE_HEADER) +
+                     sizeof(IMAGE_OPTIONAL_HEADER32);
+    if (minSize > peData.size()) {
+        return nullptr;
+    }
+    
+    auto ntHeaders = reinterpret_cast<IMAGE_NT_HEADERS*>(peData.data() + ntOffset);
+    if (ntHeaders->Signature != IMAGE_NT_SIGNATURE) {
+        return nullptr;
+    }
+    
+    return ntHeaders;
+}
+
+} // namespace
+
 StubGenerator::StubGenerator() {
 }
 
@@ -13,153 +52,156 @@ StubGenerator::~StubGenerator() {
 
 bool StubGenerator::generatePackedExecutable(const std::vector<PEInfo>& exeFiles,
                                              const PackerOptions& options,
-                                             std::vector<uint8_t>& output) {
+                                             std::vector<uint8_t>& output,
+                                             std::string& error) {
     // Load stub template
-    if (!loadStubTemplate(m_stubTemplate)) {
+    std::shared_ptr<const StubTemplate> stub =
+        StubRegistry::instance().get(options.stubPath, options.outputType, error);
+    if (!stub) {
         return false;
     }
+    std::vector<uint8_t> stubTemplate = stub->data;
     
     // Create resource embedder
     ResourceEmbedder embedder;
     std::vector<uint8_t> resourceData;
     
-    if (!embedder.embedExecutables(exeFiles, resourceData, options.waitForPrevious)) {
+    if (!embedder.embedExecutables(exeFiles, resourceData, options.waitForPrevious,
+                                   options.compression, options.codecSearch, options.sparse,
+                                   options.startupEntries, options.dependencies,
+                                   options.maxParallel)) {
+        error = embedder.error();
         return false;
     }
     
     // Append resources to stub
-    output = m_stubTemplate;
-    if (!appendResources(output, resourceData)) {
-        return false;
-    }
+    TRACE_SPAN("write output");
+    output = std::move(stubTemplate);
     
-    // NOTE: We don't update PE headers because we're just appending data to the end
-    // The stub will find the resources using the marker, and Windows will still
-    // execute the original PE code correctly
+    if (options.payloadLayout == PayloadLayout::SECTION) {
+        // Payload becomes a real section, the stub reads it from its own image
+        return appendResourceSection(output, resourceData);
+    }
     
-    return true;
+    // Overlay: just append to the end. The stub finds the resources from the
+    // trailer at EOF, and Windows still executes the original PE code correctly
+    return appendResources(output, resourceData);
 }
 
-bool StubGenerator::loadStubTemplate(std::vector<uint8_t>& stubData) {
-    // Try to load from file first (if stub was built separately)
-    // Look for stub.exe in the same directory as the executable
-    wchar_t exePath[MAX_PATH];
-    GetModuleFileNameW(NULL, exePath, MAX_PATH);
-    
-    // Get directory of the executable
-    std::wstring exeDir(exePath);
-    size_t lastSlash = exeDir.find_last_of(L"\\/");
-    if (lastSlash != std::wstring::npos) {
-        exeDir = exeDir.substr(0, lastSlash + 1);
-    }
-    
-    std::wstring stubPath = exeDir + L"stub.exe";
-    
-    std::ifstream stubFile(stubPath.c_str(), std::ios::binary | std::ios::ate);
-    if (stubFile.is_open()) {
-        std::streamsize size = stubFile.tellg();
-        stubFile.seekg(0, std::ios::beg);
-        
-        stubData.resize(size);
-        if (stubFile.read(reinterpret_cast<char*>(stubData.data()), size)) {
-            // Validate it's a PE file
-            if (stubData.size() >= 64) {
-                PIMAGE_DOS_HEADER dosHeader = reinterpret_cast<PIMAGE_DOS_HEADER>(stubData.data());
-                if (dosHeader->e_magic == IMAGE_DOS_SIGNATURE) {
-                    return true;
-                }
-            }
-        }
+bool StubGenerator::loadStubTemplate(std::vector<uint8_t>& stubData,
+                                     const std::wstring& stubPath, OutputType type) {
+    std::string error;
+    std::shared_ptr<const StubTemplate> stub = StubRegistry::instance().get(stubPath, type, error);
+    if (!stub) {
+        return false;
     }
-    
-    // Fallback: Use embedded template
-    stubData = getStubTemplate();
-    
-    if (stubData.empty()) {
+    stubData = stub->data;
+    return true;
+}
+
+bool StubGenerator::parseTemplate(StubTemplate& stub) {
+    auto ntHeaders = getNTHeaders(stub.data);
+    if (!ntHeaders) {
         return false;
     }
-    
-    // Basic validation - check DOS signature
-    if (stubData.size() < sizeof(IMAGE_DOS_HEADER)) {
-        // Create a simple message box PE as fallback
-        return createMinimalStub(stubData);
+    stub.machine = ntHeaders->FileHeader.Machine;
+    stub.dll = (ntHeaders->FileHeader.Characteristics & IMAGE_FILE_DLL) != 0;
+    
+    // Everything a .pack section header touches lies before the first
+    // section's raw data; patching a copy of those bytes is enough
+    auto dosHeader = reinterpret_cast<IMAGE_DOS_HEADER*>(stub.data.data());
+    size_t tableOffset = static_cast<size_t>(dosHeader->e_lfanew) + sizeof(DWORD) +
+                         sizeof(IMAGE_FILE_HEADER) + ntHeaders->FileHeader.SizeOfOptionalHeader;
+    size_t sectionCount = ntHeaders->FileHeader.NumberOfSections;
+    if (tableOffset + sectionCount * sizeof(IMAGE_SECTION_HEADER) > stub.data.size()) {
+        return false;
     }
-    
-    PIMAGE_DOS_HEADER dosHeader = reinterpret_cast<PIMAGE_DOS_HEADER>(stubData.data());
-    if (dosHeader->e_magic != IMAGE_DOS_SIGNATURE) {
-        return createMinimalStub(stubData);
+    auto sectionHeader = reinterpret_cast<IMAGE_SECTION_HEADER*>(stub.data.data() + tableOffset);
+    size_t firstRawData = stub.data.size();
+    for (size_t i = 0; i < sectionCount; i++) {
+        if (sectionHeader[i].SizeOfRawData != 0) {
+            firstRawData = std::min<size_t>(firstRawData, sectionHeader[i].PointerToRawData);
+        }
     }
+    stub.headerSize = firstRawData;
     
+    // A trial run on a one-byte payload settles whether builds can add one
+    std::vector<uint8_t> headers;
+    stub.sectionReady = sectionPayloadOffset(stub.data, stub.payloadOffset, stub.fileAlignment) &&
+                        sectionHeaders(stub, 1, headers);
     return true;
 }
 
-bool StubGenerator::createMinimalStub(std::vector<uint8_t>& stubData) {
-    // Create a minimal PE that shows a message box
-    // This is a temporary solution until real stub is compiled
-    
-    // For now, just copy a working Windows executable as template
-    // Try to use a small Windows utility
-    std::wstring systemExe = L"C:\\Windows\\System32\\msg.exe";
-    std::ifstream file(systemExe.c_str(), std::ios::binary | std::ios::ate);
-    
-    if (!file.is_open()) {
-        // Try notepad as fallback
-        systemExe = L"C:\\Windows\\System32\\notepad.exe";
-        file.open(systemExe.c_str(), std::ios::binary | std::ios::ate);
-    }
-    
-    if (file.is_open()) {
-        std::streamsize size = file.tellg();
-        file.seekg(0, std::ios::beg);
-        
-        stubData.resize(size);
-        if (file.read(reinterpret_cast<char*>(stubData.data()), size)) {
-            return true;
-        }
+bool StubGenerator::sectionHeaders(const StubTemplate& stub, uint64_t payloadSize,
+                                   std::vector<uint8_t>& headers) {
+    if (stub.headerSize > stub.data.size() || payloadSize > 0x7FFFFFFF - stub.payloadOffset) {
+        return false;
     }
-    
-    return false;
+    headers.assign(stub.data.begin(), stub.data.begin() + stub.headerSize);
+    return updatePEHeaders(headers, stub.payloadOffset, static_cast<size_t>(payloadSize));
 }
 
 bool StubGenerator::appendResources(std::vector<uint8_t>& stubData,
                                     const std::vector<uint8_t>& resources) {
-    // Write resource marker so stub can find the data
-    const char marker[] = "PACKEDRES_V2";
-    // Don't include null terminator - write only the string characters
-    stubData.insert(stubData.end(), marker, marker + sizeof(marker) - 1);
-    
-    // Append resources (manifest + file data)
+    // Append resources (manifest + file data + trailer); the trailer must
+    // stay the last bytes of the file
     stubData.insert(stubData.end(), resources.begin(), resources.end());
     
     return true;
 }
 
-bool StubGenerator::updatePEHeaders(std::vector<uint8_t>& peData,
-                                    size_t resourceOffset,
-                                    size_t resourceSize) {
-    if (peData.size() < sizeof(IMAGE_DOS_HEADER) + sizeof(IMAGE_NT_HEADERS)) {
+bool StubGenerator::appendResourceSection(std::vector<uint8_t>& stubData,
+                                          const std::vector<uint8_t>& resources) {
+    size_t payloadSize = resources.size();
+    size_t payloadOffset = 0;
+    size_t fileAlignment = 0;
+    if (!sectionPayloadOffset(stubData, payloadOffset, fileAlignment) ||
+        payloadSize > 0x7FFFFFFF - payloadOffset) {
         return false;
     }
     
-    auto dosHeader = reinterpret_cast<IMAGE_DOS_HEADER*>(peData.data());
-    if (dosHeader->e_magic != IMAGE_DOS_SIGNATURE) {
+    if (!updatePEHeaders(stubData, payloadOffset, payloadSize)) {
         return false;
     }
     
-    auto ntHeaders = reinterpret_cast<IMAGE_NT_HEADERS*>(peData.data() + dosHeader->e_lfanew);
-    if (ntHeaders->Signature != IMAGE_NT_SIGNATURE) {
+    // Same bytes as the overlay layout, zero-padded to SizeOfRawData. The
+    // trailer sits at the end of VirtualSize, not of the padding.
+    stubData.resize(payloadOffset, 0);
+    stubData.insert(stubData.end(), resources.begin(), resources.end());
+    stubData.resize(payloadOffset + alignTo(static_cast<DWORD>(payloadSize),
+                                            static_cast<DWORD>(fileAlignment)), 0);
+    
+    return true;
+}
+
+bool StubGenerator::sectionPayloadOffset(std::vector<uint8_t>& stubData, size_t& payloadOffset,
+                                         size_t& fileAlignment) {
+    auto ntHeaders = getNTHeaders(stubData);
+    if (!ntHeaders) {
         return false;
     }
     
-    // Get last section
-    auto sectionHeader = IMAGE_FIRST_SECTION(ntHeaders);
-    int sectionCount = ntHeaders->FileHeader.NumberOfSections;
+    fileAlignment = ntHeaders->OptionalHeader.FileAlignment;
+    if (fileAlignment == 0) fileAlignment = 0x200;
     
-    if (sectionCount == 0) {
+    // Section raw data must start on a file alignment boundary, after any
+    // overlay the stub template already carries
+    payloadOffset = alignTo(static_cast<DWORD>(stubData.size()), static_cast<DWORD>(fileAlignment));
+    return payloadOffset >= stubData.size();
+}
+
+bool StubGenerator::updatePEHeaders(std::vector<uint8_t>& peData,
+                                    size_t resourceOffset,
+                                    size_t resourceSize) {
+    auto ntHeaders = getNTHeaders(peData);
+    if (!ntHeaders) {
         return false;
     }
     
-    auto lastSection = &sectionHeader[sectionCount - 1];
+    int sectionCount = ntHeaders->FileHeader.NumberOfSections;
+    if (sectionCount == 0 || resourceSize == 0) {
+        return false;
+    }
     
     // Calculate alignments
     DWORD fileAlignment = ntHeaders->OptionalHeader.FileAlignment;
@@ -168,20 +210,63 @@ bool StubGenerator::updatePEHeaders(std::vector<uint8_t>& peData,
     if (fileAlignment == 0) fileAlignment = 0x200;
     if (sectionAlignment == 0) sectionAlignment = 0x1000;
     
-    // Helper lambda for alignment
-    auto alignTo = [](DWORD value, DWORD alignment) -> DWORD {
-        return ((value + alignment - 1) / alignment) * alignment;
-    };
+    if (resourceOffset % fileAlignment != 0 ||
+        resourceOffset + resourceSize > 0xFFFFFFFF) {
+        return false;
+    }
+    
+    // The new header goes into the slack after the existing section table.
+    // Inserting bytes instead would shift every section's raw data away from
+    // its PointerToRawData.
+    auto dosHeader = reinterpret_cast<IMAGE_DOS_HEADER*>(peData.data());
+    size_t tableOffset = static_cast<size_t>(dosHeader->e_lfanew) +
+                         sizeof(DWORD) + // Signature
+                         sizeof(IMAGE_FILE_HEADER) +
+                         ntHeaders->FileHeader.SizeOfOptionalHeader;
+    size_t newHeaderOffset = tableOffset + sectionCount * sizeof(IMAGE_SECTION_HEADER);
+    size_t newHeaderEnd = newHeaderOffset + sizeof(IMAGE_SECTION_HEADER);
+    
+    if (newHeaderEnd > peData.size()) {
+        return false;
+    }
+    
+    auto sectionHeader = reinterpret_cast<IMAGE_SECTION_HEADER*>(peData.data() + tableOffset);
+    
+    // Find where existing raw data starts and ends, and the first free RVA
+    DWORD firstRawData = 0xFFFFFFFF;
+    DWORD rawDataEnd = 0;
+    DWORD nextVirtualAddress = 0;
+    
+    for (int i = 0; i < sectionCount; i++) {
+        const IMAGE_SECTION_HEADER& section = sectionHeader[i];
+        
+        if (section.SizeOfRawData != 0) {
+            firstRawData = std::min(firstRawData, section.PointerToRawData);
+            rawDataEnd = std::max(rawDataEnd, section.PointerToRawData + section.SizeOfRawData);
+        }
+        
+        DWORD virtualSize = std::max(section.Misc.VirtualSize, section.SizeOfRawData);
+        nextVirtualAddress = std::max(nextVirtualAddress,
+                                      section.VirtualAddress + alignTo(virtualSize, sectionAlignment));
+    }
+    
+    if (alignTo(static_cast<DWORD>(newHeaderEnd), fileAlignment) > firstRawData ||
+        resourceOffset < rawDataEnd) {
+        return false;
+    }
+    
+    // Slot must be unused - bound import data sometimes lives in this slack
+    for (size_t i = newHeaderOffset; i < newHeaderEnd; i++) {
+        if (peData[i] != 0) {
+            return false;
+        }
+    }
     
     // Create new .pack section
     IMAGE_SECTION_HEADER newSection = {};
-    strcpy_s(reinterpret_cast<char*>(newSection.Name), 8, ".pack");
-    
-    // Calculate virtual address (after last section)
-    newSection.VirtualAddress = lastSection->VirtualAddress + 
-                                alignTo(lastSection->Misc.VirtualSize, sectionAlignment);
+    memcpy(newSection.Name, ".pack", 5);
     
-    // Set sizes
+    newSection.VirtualAddress = nextVirtualAddress;
     newSection.Misc.VirtualSize = static_cast<DWORD>(resourceSize);
     newSection.SizeOfRawData = alignTo(static_cast<DWORD>(resourceSize), fileAlignment);
     newSection.PointerToRawData = static_cast<DWORD>(resourceOffset);
@@ -190,29 +275,25 @@ bool StubGenerator::updatePEHeaders(std::vector<uint8_t>& peData,
     newSection.Characteristics = IMAGE_SCN_CNT_INITIALIZED_DATA | 
                                 IMAGE_SCN_MEM_READ;
     
-    // Add section header (need to resize PE data to add section header)
-    size_t sectionHeaderOffset = dosHeader->e_lfanew + 
-                                 sizeof(DWORD) + // Signature
-                                 sizeof(IMAGE_FILE_HEADER) +
-                                 ntHeaders->FileHeader.SizeOfOptionalHeader +
-                                 (sectionCount * sizeof(IMAGE_SECTION_HEADER));
-    
-    // Insert new section header
-    peData.insert(peData.begin() + sectionHeaderOffset, 
-                  reinterpret_cast<uint8_t*>(&newSection),
-                  reinterpret_cast<uint8_t*>(&newSection) + sizeof(IMAGE_SECTION_HEADER));
-    
-    // Update headers after insertion (pointers may have changed)
-    dosHeader = reinterpret_cast<IMAGE_DOS_HEADER*>(peData.data());
-    ntHeaders = reinterpret_cast<IMAGE_NT_HEADERS*>(peData.data() + dosHeader->e_lfanew);
+    memcpy(peData.data() + newHeaderOffset, &newSection, sizeof(IMAGE_SECTION_HEADER));
     
     // Update number of sections
     ntHeaders->FileHeader.NumberOfSections++;
     
+    if (newHeaderEnd > ntHeaders->OptionalHeader.SizeOfHeaders) {
+        ntHeaders->OptionalHeader.SizeOfHeaders = alignTo(static_cast<DWORD>(newHeaderEnd),
+                                                          fileAlignment);
+    }
+    
+    ntHeaders->OptionalHeader.SizeOfInitializedData += newSection.SizeOfRawData;
+    
     // Update SizeOfImage
     ntHeaders->OptionalHeader.SizeOfImage = newSection.VirtualAddress +
                                            alignTo(newSection.Misc.VirtualSize, sectionAlignment);
     
+    // Stale after the rewrite; the loader only enforces it for drivers
+    ntHeaders->OptionalHeader.CheckSum = 0;
+    
     return true;
 }
 
@@ -5,33 +5,66 @@
 
 namespace Packer {
 
+// A stub template parsed once, with everything a build patches into it
+// worked out up front. Shared read-only between builds; see StubRegistry.
+struct StubTemplate {
+    std::wstring path;          // Empty for the template built into the packer
+    std::vector<uint8_t> data;
+    WORD machine;               // FileHeader.Machine
+    bool dll;                   // IMAGE_FILE_DLL set
+    size_t payloadOffset;       // Where a .pack section's raw data would start
+    size_t fileAlignment;       // What its raw size is padded to
+    size_t headerSize;          // Leading bytes a .pack section header patches
+    bool sectionReady;          // Whether there is room for that header
+    
+    StubTemplate() : machine(0), dll(false), payloadOffset(0), fileAlignment(1),
+                     headerSize(0), sectionReady(false) {}
+};
+
+// Stateless; one instance may serve any number of builds at once
 class StubGenerator {
 public:
     StubGenerator();
     ~StubGenerator();
     
-    // Generate complete packed executable
+    // Generate complete packed executable; on failure error says why when
+    // the stub template or the step graph was the cause
     bool generatePackedExecutable(const std::vector<PEInfo>& exeFiles,
                                   const PackerOptions& options,
-                                  std::vector<uint8_t>& output);
+                                  std::vector<uint8_t>& output,
+                                  std::string& error);
+    
+    // Copy of the registry's stub template (the default one for the output
+    // type unless a path is given)
+    bool loadStubTemplate(std::vector<uint8_t>& stubData,
+                          const std::wstring& stubPath = std::wstring(),
+                          OutputType type = OutputType::EXE);
+    
+    // Validate a template's headers and fill in everything but path and data
+    bool parseTemplate(StubTemplate& stub);
     
-    // Load stub template
-    bool loadStubTemplate(std::vector<uint8_t>& stubData);
+    // The template's first headerSize bytes with a .pack section header for
+    // a payload of payloadSize bytes at payloadOffset
+    bool sectionHeaders(const StubTemplate& stub, uint64_t payloadSize,
+                        std::vector<uint8_t>& headers);
     
     // Append resources to stub
     bool appendResources(std::vector<uint8_t>& stubData,
                         const std::vector<uint8_t>& resources);
     
+    // Store resources in a new .pack section mapped by the loader
+    bool appendResourceSection(std::vector<uint8_t>& stubData,
+                              const std::vector<uint8_t>& resources);
+    
+    // File offset where a .pack section appended to stubData would start,
+    // and the alignment its raw size is padded to
+    bool sectionPayloadOffset(std::vector<uint8_t>& stubData, size_t& payloadOffset,
+                              size_t& fileAlignment);
+    
     // Update PE headers
     bool updatePEHeaders(std::vector<uint8_t>& peData,
                         size_t resourceOffset,
                         size_t resourceSize);
-    
-    // Create minimal stub fallback
-    bool createMinimalStub(std::vector<uint8_t>& stubData);
-    
-private:
-    std::vector<uint8_t> m_stubTemplate;
 };
 
 } // namespace Packer
@@ -0,0 +1,162 @@
+#include "StubRegistry.h"
+#include "stub_template.h"
+#include "FileIO.h"
+#include "Trace.h"
+#include <cstdio>
+#include <filesystem>
+
+namespace Packer {
+
+namespace {
+
+// Directory of the running packer, with a trailing separator; empty (the
+// working directory) where it cannot be found
+std::wstring packerDirectory() {
+    std::wstring dir;
+#ifdef _WIN32
+    wchar_t exePath[MAX_PATH];
+    DWORD length = GetModuleFileNameW(NULL, exePath, MAX_PATH);
+    if (length > 0 && length < MAX_PATH) {
+        dir.assign(exePath, length);
+        size_t lastSlash = dir.find_last_of(L"\\/");
+        dir = lastSlash != std::wstring::npos ? dir.substr(0, lastSlash + 1) : std::wstring();
+    }
+#endif
+    return dir;
+}
+
+bool fileStamp(const std::wstring& path, uint64_t& size, int64_t& modified) {
+    std::error_code error;
+    std::filesystem::path file = FileIO::nativePath(path);
+    size = std::filesystem::file_size(file, error);
+    if (error) {
+        return false;
+    }
+    auto written = std::filesystem::last_write_time(file, error);
+    if (error) {
+        return false;
+    }
+    modified = static_cast<int64_t>(written.time_since_epoch().count());
+    return true;
+}
+
+std::string templateName(const std::wstring& path) {
+    return path.empty() ? std::string("built-in stub") : FileIO::toUtf8(path);
+}
+
+std::shared_ptr<const StubTemplate> parse(const std::wstring& path, std::vector<uint8_t>&& data,
+                                          std::string& error) {
+    std::shared_ptr<StubTemplate> stub = std::make_shared<StubTemplate>();
+    stub->path = path;
+    stub->data = std::move(data);
+    StubGenerator stubGen;
+    if (!stubGen.parseTemplate(*stub)) {
+        error = templateName(path) + ": not a PE image";
+        return nullptr;
+    }
+    return stub;
+}
+
+// Whether a parsed template can produce the output asked for
+bool fits(const StubTemplate& stub, WORD machine, OutputType type, std::string& error) {
+    if (stub.dll != (type == OutputType::DLL)) {
+        error = templateName(stub.path) + (stub.dll ? ": a DLL template for an EXE output" :
+                                                      ": an EXE template for a DLL output");
+        return false;
+    }
+    if (machine != 0 && stub.machine != machine) {
+        char text[64];
+        snprintf(text, sizeof(text), ": built for machine 0x%X, not 0x%X", stub.machine, machine);
+        error = templateName(stub.path) + text;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+std::shared_ptr<const StubTemplate> StubRegistry::get(const std::wstring& stubPath, OutputType type,
+                                                      std::string& error, WORD machine) {
+    // An explicitly configured stub must load; no fallbacks
+    if (!stubPath.empty()) {
+        std::shared_ptr<const StubTemplate> stub = file({stubPath, machine, type}, error);
+        if (!stub && error.empty()) {
+            error = FileIO::toUtf8(stubPath) + ": cannot read";
+        }
+        return stub;
+    }
+    
+    const wchar_t* name = type == OutputType::DLL ? L"stub-dll.dll" : L"stub.exe";
+    std::shared_ptr<const StubTemplate> stub = file({packerDirectory() + name, machine, type}, error);
+    if (stub || !error.empty()) {
+        return stub;
+    }
+    
+    stub = builtIn({std::wstring(), machine, type}, error);
+    if (!stub && error.empty()) {
+        error = FileIO::toUtf8(name) + " not found next to the packer";
+    }
+    return stub;
+}
+
+std::shared_ptr<StubRegistry::Entry> StubRegistry::entry(const Key& key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::shared_ptr<Entry>& slot = m_entries[key];
+    if (!slot) {
+        slot = std::make_shared<Entry>();
+    }
+    return slot;
+}
+
+std::shared_ptr<const StubTemplate> StubRegistry::file(const Key& key, std::string& error) {
+    std::shared_ptr<Entry> cached = entry(key);
+    std::lock_guard<std::mutex> lock(cached->mutex);
+    
+    uint64_t size = 0;
+    int64_t modified = 0;
+    if (!fileStamp(key.path, size, modified)) {
+        cached->stub.reset();
+        return nullptr;
+    }
+    if (cached->stub && cached->size == size && cached->modified == modified) {
+        return cached->stub;
+    }
+    
+    TRACE_SPAN("load stub", key.path);
+    cached->stub.reset();
+    std::vector<uint8_t> data;
+    if (!FileIO::readFile(key.path, data)) {
+        error = FileIO::toUtf8(key.path) + ": cannot read";
+        return nullptr;
+    }
+    std::shared_ptr<const StubTemplate> stub = parse(key.path, std::move(data), error);
+    if (!stub || !fits(*stub, key.machine, key.type, error)) {
+        return nullptr;
+    }
+    
+    cached->stub = stub;
+    cached->size = size;
+    cached->modified = modified;
+    return stub;
+}
+
+std::shared_ptr<const StubTemplate> StubRegistry::builtIn(const Key& key, std::string& error) {
+    std::shared_ptr<Entry> cached = entry(key);
+    std::lock_guard<std::mutex> lock(cached->mutex);
+    if (cached->stub) {
+        return cached->stub;
+    }
+    
+    std::vector<uint8_t> data = getStubTemplate();
+    if (data.empty()) {
+        return nullptr;
+    }
+    std::shared_ptr<const StubTemplate> stub = parse(std::wstring(), std::move(data), error);
+    if (!stub || !fits(*stub, key.machine, key.type, error)) {
+        return nullptr;
+    }
+    cached->stub = stub;
+    return stub;
+}
+
+} // namespace Packer
@@ -0,0 +1,78 @@
+#ifndef STUBREGISTRY_H
+#define STUBREGISTRY_H
+
+#include "StubGenerator.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+namespace Packer {
+
+// Process-wide cache of stub templates. Each template is read, validated
+// and parsed once (see StubTemplate) and then handed to every build that
+// asks for it; builds only read it, patching a copy of the headers when
+// they add a .pack section. A template file that changes on disk (size or
+// modification time) is loaded again on the next request, while builds
+// still holding the old one keep it.
+//
+// Without an explicit path the template depends on the output type: DLLs
+// use stub-dll.dll next to the packer, and everything else stub.exe. A
+// packer built with a template inside it (stub_template.h) falls back to
+// that. Nothing else is ever substituted: a template whose IMAGE_FILE_DLL
+// flag does not match the output type, or built for another machine than
+// the one asked for, fails the build like a missing one.
+//
+// Templates are cached per (path, machine, output type). Each has its own
+// lock, held while it is read and parsed, so builds waiting for different
+// templates do not wait for each other and one template loads only once.
+class StubRegistry {
+public:
+    static StubRegistry& instance() {
+        static StubRegistry registry;
+        return registry;
+    }
+    
+    // The template at stubPath, or the default one for type; nullptr (see
+    // error) if it cannot be read, is not a PE image or does not fit type
+    // and machine (FileHeader.Machine, 0 for any)
+    std::shared_ptr<const StubTemplate> get(const std::wstring& stubPath, OutputType type,
+                                            std::string& error, WORD machine = 0);
+
+private:
+    StubRegistry() {}
+    
+    struct Key {
+        std::wstring path;      // Empty for the built-in template
+        WORD machine;
+        OutputType type;
+        
+        bool operator<(const Key& other) const {
+            return std::tie(path, machine, type) < std::tie(other.path, other.machine, other.type);
+        }
+    };
+    
+    struct Entry {
+        std::mutex mutex;       // Held while the template is (re)loaded
+        std::shared_ptr<const StubTemplate> stub;
+        uint64_t size;
+        int64_t modified;
+        
+        Entry() : size(0), modified(0) {}
+    };
+    
+    std::shared_ptr<Entry> entry(const Key& key);
+    
+    // The cached template for a file, loaded again if the file changed;
+    // nullptr without an error if there is no such file
+    std::shared_ptr<const StubTemplate> file(const Key& key, std::string& error);
+    
+    std::shared_ptr<const StubTemplate> builtIn(const Key& key, std::string& error);
+    
+    std::map<Key, std::shared_ptr<Entry>> m_entries;
+    std::mutex m_mutex;         // Guards m_entries only, never held while loading
+};
+
+} // namespace Packer
+
+#endif // STUBREGISTRY_H
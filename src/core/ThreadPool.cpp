@@ -0,0 +1,120 @@
+#include "ThreadPool.h"
+
+namespace Packer {
+
+namespace {
+
+// Pool and deque index of the calling worker, if it is one
+thread_local const ThreadPool* t_pool = nullptr;
+thread_local size_t t_index = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t threadCount)
+    : m_nextQueue(0), m_queued(0), m_pending(0), m_stopping(false) {
+    if (threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    if (threadCount == 0) {
+        threadCount = 1;
+    }
+    
+    m_queues.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; i++) {
+        m_queues.emplace_back(new WorkerQueue());
+    }
+    
+    m_threads.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; i++) {
+        m_threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_taskAvailable.notify_all();
+    
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    size_t index = t_pool == this ? t_index : m_nextQueue++ % m_queues.size();
+    
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+        m_queues[index]->tasks.push_back(std::move(task));
+    }
+    {
+        // Counted under m_mutex so a worker checking before it sleeps
+        // cannot miss the wakeup
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queued++;
+    }
+    m_taskAvailable.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_allDone.wait(lock, [this] { return m_pending == 0; });
+}
+
+bool ThreadPool::takeTask(size_t index, std::function<void()>& task) {
+    {
+        WorkerQueue& own = *m_queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    
+    for (size_t i = 1; i < m_queues.size(); i++) {
+        WorkerQueue& victim = *m_queues[(index + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    t_pool = this;
+    t_index = index;
+    
+    for (;;) {
+        std::function<void()> task;
+        if (!takeTask(index, task)) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_taskAvailable.wait(lock, [this] { return m_stopping || m_queued > 0; });
+            
+            if (m_queued <= 0) {
+                return;  // Stopping and drained
+            }
+            continue;
+        }
+        
+        m_queued--;
+        task();
+        
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_pending == 0) {
+            m_allDone.notify_all();
+        }
+    }
+}
+
+} // namespace Packer
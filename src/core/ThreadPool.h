@@ -0,0 +1,63 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Packer {
+
+// Fixed set of worker threads with one task deque each. A worker runs its
+// own newest task first and steals the oldest task of another worker when
+// its deque is empty, so bursts submitted by one pipeline or job spread
+// over every thread.
+class ThreadPool {
+public:
+    // threadCount 0 = one per hardware thread
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+    
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    // Queue a task. From a worker it goes onto that worker's own deque,
+    // otherwise the deques take turns.
+    void submit(std::function<void()> task);
+    
+    // Block until every submitted task has finished
+    void wait();
+    
+    size_t threadCount() const { return m_threads.size(); }
+
+private:
+    struct WorkerQueue {
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+    };
+    
+    void workerLoop(size_t index);
+    
+    // Own deque from the back, then other deques from the front
+    bool takeTask(size_t index, std::function<void()>& task);
+    
+    std::vector<std::thread> m_threads;
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    std::atomic<size_t> m_nextQueue;
+    std::atomic<std::ptrdiff_t> m_queued;  // Tasks sitting in deques; may dip
+                                           // below 0 while a submit finishes
+    std::mutex m_mutex;                    // Guards sleeping, m_pending and m_stopping
+    std::condition_variable m_taskAvailable;
+    std::condition_variable m_allDone;
+    size_t m_pending;                      // Submitted and not yet finished
+    bool m_stopping;
+};
+
+} // namespace Packer
+
+#endif // THREADPOOL_H
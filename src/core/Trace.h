@@ -0,0 +1,246 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Lightweight timing spans exported as Chrome trace JSON (chrome://tracing,
+// ui.perfetto.dev), one track per thread. Shared by the builder and the
+// stub, so like ManifestFormat.h it only uses the standard library.
+//
+//   TRACE_THREAD("read stage");          // Name the calling thread's track
+//   TRACE_SPAN("encode");                // Times the rest of the scope
+//   TRACE_SPAN("read", fileName);        // With a detail shown in args
+//
+// Spans cost one relaxed load until Tracer::enable is called. Building
+// with PACKER_NO_TRACE removes them entirely.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Packer {
+
+struct TraceEvent {
+    const char* name;       // Static string
+    std::string detail;     // UTF-8, may be empty
+    double start;           // Microseconds since enable
+    double duration;
+};
+
+class Tracer {
+public:
+    static Tracer& instance() {
+        static Tracer tracer;
+        return tracer;
+    }
+    
+    // Start recording. pid and processName label the process in the trace
+    // so builder and stub traces can be loaded side by side.
+    void enable(int pid, const char* processName) {
+        m_epoch = std::chrono::steady_clock::now();
+        m_pid = pid;
+        m_processName = processName;
+        m_enabled.store(true, std::memory_order_release);
+    }
+    
+    bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+    
+    // Microseconds since enable
+    double now() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() -
+                                                         m_epoch).count();
+    }
+    
+    // Label the calling thread's track; the first name sticks
+    void nameThread(const char* name) {
+        if (enabled()) {
+            Track& track = currentTrack();
+            if (track.name.empty()) {
+                track.name = name;
+            }
+        }
+    }
+    
+    // Append a finished span to the calling thread's track
+    void record(const char* name, std::string detail, double start) {
+        double end = now();
+        currentTrack().events.push_back(TraceEvent{ name, std::move(detail), start, end - start });
+    }
+    
+    // Serialize everything recorded so far. Call once the traced threads
+    // are done; tracks are appended to without locks.
+    void exportJson(std::string& json) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        
+        char buffer[160];
+        std::snprintf(buffer, sizeof(buffer),
+                      "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":",
+                      m_pid);
+        json += buffer;
+        appendString(json, m_processName);
+        json += "}}";
+        
+        for (size_t i = 0; i < m_tracks.size(); i++) {
+            const Track& track = *m_tracks[i];
+            int tid = static_cast<int>(i + 1);
+            
+            if (!track.name.empty()) {
+                std::snprintf(buffer, sizeof(buffer),
+                              ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                              "\"args\":{\"name\":", m_pid, tid);
+                json += buffer;
+                appendString(json, track.name);
+                json += "}}";
+            }
+            
+            for (const auto& event : track.events) {
+                json += ",\n{\"name\":";
+                appendString(json, event.name);
+                std::snprintf(buffer, sizeof(buffer),
+                              ",\"cat\":\"packer\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                              "\"pid\":%d,\"tid\":%d", event.start, event.duration, m_pid, tid);
+                json += buffer;
+                if (!event.detail.empty()) {
+                    json += ",\"args\":{\"detail\":";
+                    appendString(json, event.detail);
+                    json += "}";
+                }
+                json += "}";
+            }
+        }
+        
+        json += "\n]}\n";
+    }
+    
+    // Wide names to UTF-8 for span details (wchar_t is UTF-16 on Windows)
+    static std::string toUtf8(const std::wstring& text) {
+        std::string out;
+        out.reserve(text.size());
+        for (size_t i = 0; i < text.size(); i++) {
+            uint32_t c = static_cast<uint32_t>(text[i]);
+            if (c >= 0xD800 && c < 0xDC00 && i + 1 < text.size()) {
+                uint32_t low = static_cast<uint32_t>(text[i + 1]);
+                if (low >= 0xDC00 && low < 0xE000) {
+                    c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                    i++;
+                }
+            }
+            
+            if (c < 0x80) {
+                out += static_cast<char>(c);
+            } else if (c < 0x800) {
+                out += static_cast<char>(0xC0 | (c >> 6));
+                out += static_cast<char>(0x80 | (c & 0x3F));
+            } else if (c < 0x10000) {
+                out += static_cast<char>(0xE0 | (c >> 12));
+                out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (c & 0x3F));
+            } else {
+                out += static_cast<char>(0xF0 | (c >> 18));
+                out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (c & 0x3F));
+            }
+        }
+        return out;
+    }
+
+private:
+    struct Track {
+        std::string name;
+        std::vector<TraceEvent> events;
+    };
+    
+    Tracer() : m_enabled(false), m_pid(1) {}
+    
+    // Tracks live as long as the tracer, so thread exit loses nothing
+    Track& currentTrack() {
+        thread_local Track* track = nullptr;
+        if (!track) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tracks.emplace_back(new Track());
+            track = m_tracks.back().get();
+        }
+        return *track;
+    }
+    
+    static void appendString(std::string& json, const std::string& text) {
+        json += '"';
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                json += '\\';
+                json += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+                json += escaped;
+            } else {
+                json += c;
+            }
+        }
+        json += '"';
+    }
+    
+    std::atomic<bool> m_enabled;
+    std::chrono::steady_clock::time_point m_epoch;
+    int m_pid;
+    std::string m_processName;
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<Track>> m_tracks;
+};
+
+// Times its scope when tracing is enabled
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name) : m_name(name), m_start(-1) {
+        if (Tracer::instance().enabled()) {
+            m_start = Tracer::instance().now();
+        }
+    }
+    
+    TraceSpan(const char* name, const std::wstring& detail) : m_name(name), m_start(-1) {
+        if (Tracer::instance().enabled()) {
+            m_detail = Tracer::toUtf8(detail);
+            m_start = Tracer::instance().now();
+        }
+    }
+    
+    TraceSpan(const char* name, const std::string& detail) : m_name(name), m_start(-1) {
+        if (Tracer::instance().enabled()) {
+            m_detail = detail;
+            m_start = Tracer::instance().now();
+        }
+    }
+    
+    ~TraceSpan() {
+        if (m_start >= 0) {
+            Tracer::instance().record(m_name, std::move(m_detail), m_start);
+        }
+    }
+    
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* m_name;
+    std::string m_detail;
+    double m_start;
+};
+
+} // namespace Packer
+
+#ifndef PACKER_NO_TRACE
+#define PACKER_TRACE_CONCAT2(a, b) a##b
+#define PACKER_TRACE_CONCAT(a, b) PACKER_TRACE_CONCAT2(a, b)
+#define TRACE_SPAN(...) ::Packer::TraceSpan PACKER_TRACE_CONCAT(traceSpan_, __LINE__)(__VA_ARGS__)
+#define TRACE_THREAD(name) ::Packer::Tracer::instance().nameThread(name)
+#else
+#define TRACE_SPAN(...) ((void)0)
+#define TRACE_THREAD(name) ((void)0)
+#endif
+
+#endif // TRACE_H
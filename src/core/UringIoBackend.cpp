@@ -0,0 +1,570 @@
+#include "IoBackend.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define PACKER_HAVE_URING 1
+#endif
+
+#ifdef PACKER_HAVE_URING
+
+#include "FileIO.h"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace Packer {
+
+namespace {
+
+// Requests a queue keeps in flight, and the largest single request. 1 MB
+// pieces let one big file keep the device busy on several queues at once.
+const unsigned RING_OPS = 64;
+const size_t REQUEST_SIZE = 1024 * 1024;
+
+// Minimal io_uring wrapper over the raw system calls, so builds need no
+// liburing. One thread uses a ring at a time.
+class Ring {
+public:
+    Ring() : m_fd(-1), m_sqRing(MAP_FAILED), m_cqRing(MAP_FAILED), m_sqes(nullptr),
+             m_sqRingSize(0), m_cqRingSize(0), m_sqesSize(0), m_tail(0), m_unsubmitted(0) {}
+    
+    ~Ring() {
+        if (m_sqes) {
+            munmap(m_sqes, m_sqesSize);
+        }
+        if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing) {
+            munmap(m_cqRing, m_cqRingSize);
+        }
+        if (m_sqRing != MAP_FAILED) {
+            munmap(m_sqRing, m_sqRingSize);
+        }
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+    
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+    
+    bool init(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        m_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (m_fd < 0) {
+            return false;
+        }
+        
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) {
+            m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+        }
+        
+        m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        m_fd, IORING_OFF_SQ_RING);
+        if (m_sqRing == MAP_FAILED) {
+            return false;
+        }
+        m_cqRing = single ? m_sqRing
+                          : mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        if (m_cqRing == MAP_FAILED) {
+            return false;
+        }
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          m_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+        m_sqes = static_cast<io_uring_sqe*>(sqes);
+        
+        char* sq = static_cast<char*>(m_sqRing);
+        m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        char* cq = static_cast<char*>(m_cqRing);
+        m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        m_tail = *m_sqTail;
+        return true;
+    }
+    
+    // Queue a read or write; callers never have more than entries in flight
+    void prepare(uint8_t opcode, int fd, uint8_t* data, uint32_t length, uint64_t offset,
+                 uint64_t userData) {
+        unsigned index = m_tail & m_sqMask;
+        io_uring_sqe& sqe = m_sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = opcode;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(data);
+        sqe.len = length;
+        sqe.off = offset;
+        sqe.user_data = userData;
+        m_sqArray[index] = index;
+        m_tail++;
+        m_unsubmitted++;
+    }
+    
+    // Hand queued requests to the kernel and wait for waitFor completions
+    bool enter(unsigned waitFor) {
+        __atomic_store_n(m_sqTail, m_tail, __ATOMIC_RELEASE);
+        unsigned flags = waitFor ? IORING_ENTER_GETEVENTS : 0;
+        for (;;) {
+            long submitted = syscall(__NR_io_uring_enter, m_fd, m_unsubmitted, waitFor, flags,
+                                     nullptr, 0);
+            if (submitted >= 0) {
+                m_unsubmitted -= static_cast<unsigned>(submitted);
+                return true;
+            }
+            if (errno != EINTR) {
+                return false;
+            }
+        }
+    }
+    
+    // Take one completion; false when there is none yet
+    bool completion(io_uring_cqe& cqe) {
+        unsigned head = *m_cqHead;
+        if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        cqe = m_cqes[head & m_cqMask];
+        __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+private:
+    int m_fd;
+    void* m_sqRing;
+    void* m_cqRing;
+    io_uring_sqe* m_sqes;
+    size_t m_sqRingSize;
+    size_t m_cqRingSize;
+    size_t m_sqesSize;
+    unsigned* m_sqTail;
+    unsigned m_sqMask;
+    unsigned* m_sqArray;
+    unsigned* m_cqHead;
+    unsigned* m_cqTail;
+    unsigned m_cqMask;
+    io_uring_cqe* m_cqes;
+    unsigned m_tail;            // Local tail, published by enter
+    unsigned m_unsubmitted;
+};
+
+// One request in flight. user_data is its index in the queue's table.
+struct Request {
+    int fd;
+    uint8_t* data;
+    uint32_t length;
+    uint64_t offset;
+    void* owner;                // The read or written buffer it belongs to
+};
+
+// Free-list of request slots shared by reader and writer
+class RequestTable {
+public:
+    explicit RequestTable(unsigned count) : m_requests(count) {
+        for (unsigned i = count; i > 0; i--) {
+            m_free.push_back(i - 1);
+        }
+    }
+    
+    bool full() const { return m_free.empty(); }
+    bool idle() const { return m_free.size() == m_requests.size(); }
+    
+    uint32_t take() {
+        uint32_t index = m_free.back();
+        m_free.pop_back();
+        return index;
+    }
+    
+    void put(uint32_t index) { m_free.push_back(index); }
+    Request& operator[](uint32_t index) { return m_requests[index]; }
+
+private:
+    std::vector<Request> m_requests;
+    std::vector<uint32_t> m_free;
+};
+
+// Outcome of one completion: finished, failed, or to be queued again for
+// the rest of a short or interrupted transfer
+enum class Completion { DONE, FAILED, RETRY };
+
+Completion complete(Request& request, int result) {
+    if (result == -EINTR || result == -EAGAIN) {
+        return Completion::RETRY;
+    }
+    if (result <= 0) {
+        return Completion::FAILED;
+    }
+    uint32_t done = static_cast<uint32_t>(result);
+    if (done < request.length) {
+        request.data += done;
+        request.length -= done;
+        request.offset += done;
+        return Completion::RETRY;
+    }
+    return Completion::DONE;
+}
+
+std::string nativePath(const std::wstring& path) {
+    return FileIO::nativePath(path).string();
+}
+
+class UringReadQueue : public FileReadQueue {
+public:
+    UringReadQueue(BufferPool& buffers) : m_buffers(buffers), m_requests(RING_OPS), m_ok(false) {}
+    
+    ~UringReadQueue() override {
+        // Requests still reference buffers and descriptors
+        while (!m_requests.idle() && m_ok && reap(1)) {
+        }
+        for (auto& read : m_reads) {
+            if (read->fd >= 0) {
+                close(read->fd);
+            }
+            m_buffers.release(std::move(read->data));
+        }
+    }
+    
+    bool init() {
+        m_ok = m_ring.init(RING_OPS);
+        return m_ok;
+    }
+    
+    void submit(const std::wstring& path) override {
+        std::unique_ptr<Read> read(new Read());
+        read->fd = open(nativePath(path).c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info;
+        if (read->fd < 0 || fstat(read->fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+            read->failed = true;
+        } else {
+            read->data = m_buffers.acquire(static_cast<size_t>(info.st_size));
+            read->data.resize(static_cast<size_t>(info.st_size));
+        }
+        m_reads.push_back(std::move(read));
+        queueRequests();
+    }
+    
+    bool next(std::vector<uint8_t>& data) override {
+        Read& read = *m_reads.front();
+        while (!read.failed && (read.queued < read.data.size() || read.inFlight > 0)) {
+            queueRequests();
+            if (!reap(1)) {
+                read.failed = true;
+                m_ok = false;
+            }
+        }
+        while (read.inFlight > 0 && m_ok && reap(1)) {
+        }
+        
+        if (read.fd >= 0) {
+            close(read.fd);
+        }
+        m_buffers.release(std::move(data));
+        data = std::move(read.data);
+        bool ok = !read.failed;
+        m_reads.pop_front();
+        return ok;
+    }
+
+private:
+    struct Read {
+        int fd;
+        std::vector<uint8_t> data;
+        uint64_t queued;        // Bytes handed to requests so far
+        unsigned inFlight;
+        bool failed;
+        
+        Read() : fd(-1), queued(0), inFlight(0), failed(false) {}
+    };
+    
+    // Fill free request slots, oldest file first
+    void queueRequests() {
+        for (auto& entry : m_reads) {
+            Read& read = *entry;
+            while (!read.failed && read.queued < read.data.size() && !m_requests.full()) {
+                uint32_t index = m_requests.take();
+                Request& request = m_requests[index];
+                request.fd = read.fd;
+                request.data = read.data.data() + read.queued;
+                request.length = static_cast<uint32_t>(std::min<uint64_t>(REQUEST_SIZE,
+                                                                          read.data.size() - read.queued));
+                request.offset = read.queued;
+                request.owner = &read;
+                m_ring.prepare(IORING_OP_READ, request.fd, request.data, request.length,
+                               request.offset, index);
+                read.queued += request.length;
+                read.inFlight++;
+            }
+            if (m_requests.full()) {
+                break;
+            }
+        }
+    }
+    
+    // Submit and handle at least waitFor completions; false on a ring error
+    bool reap(unsigned waitFor) {
+        if (!m_ring.enter(m_requests.idle() ? 0 : waitFor)) {
+            return false;
+        }
+        io_uring_cqe cqe;
+        while (m_ring.completion(cqe)) {
+            uint32_t index = static_cast<uint32_t>(cqe.user_data);
+            Request& request = m_requests[index];
+            Read& read = *static_cast<Read*>(request.owner);
+            Completion outcome = complete(request, cqe.res);
+            if (outcome == Completion::RETRY) {
+                m_ring.prepare(IORING_OP_READ, request.fd, request.data, request.length,
+                               request.offset, index);
+                continue;
+            }
+            if (outcome == Completion::FAILED) {
+                read.failed = true;     // Also a file that shrank while read
+            }
+            read.inFlight--;
+            m_requests.put(index);
+        }
+        return true;
+    }
+    
+    BufferPool& m_buffers;
+    Ring m_ring;
+    RequestTable m_requests;
+    std::deque<std::unique_ptr<Read>> m_reads;
+    bool m_ok;
+};
+
+class UringWriteQueue : public FileWriteQueue {
+public:
+    UringWriteQueue(BufferPool& buffers)
+        : m_buffers(buffers), m_requests(RING_OPS), m_fd(-1), m_size(0), m_failed(false) {}
+    
+    ~UringWriteQueue() override {
+        drain();
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+    }
+    
+    bool init() { return m_ring.init(RING_OPS); }
+    
+    bool open(const std::wstring& path) override {
+        m_fd = ::open(nativePath(path).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        m_size = 0;
+        return m_fd >= 0;
+    }
+    
+    bool openAppend(const std::wstring& path) override {
+        m_fd = ::open(nativePath(path).c_str(), O_WRONLY | O_CLOEXEC);
+        struct stat info;
+        if (m_fd < 0 || fstat(m_fd, &info) != 0) {
+            return false;
+        }
+        m_size = static_cast<uint64_t>(info.st_size);
+        return true;
+    }
+    
+    bool append(std::vector<uint8_t>&& buffer) override {
+        if (m_fd < 0 || m_failed) {
+            m_buffers.release(std::move(buffer));
+            return false;
+        }
+        if (buffer.empty()) {
+            m_buffers.release(std::move(buffer));
+            return true;
+        }
+        
+        // One extra count holds the buffer while its requests are queued,
+        // since queueing may reap completions of its first pieces
+        std::unique_ptr<Pending> pending(new Pending());
+        pending->buffer = std::move(buffer);
+        pending->inFlight = 1;
+        Pending* owner = pending.get();
+        m_pending.push_back(std::move(pending));
+        
+        size_t size = owner->buffer.size();
+        for (size_t position = 0; position < size; position += REQUEST_SIZE) {
+            while (m_requests.full()) {
+                if (!reap(1)) {
+                    return false;
+                }
+            }
+            uint32_t index = m_requests.take();
+            Request& request = m_requests[index];
+            request.fd = m_fd;
+            request.data = owner->buffer.data() + position;
+            request.length = static_cast<uint32_t>(std::min(REQUEST_SIZE, size - position));
+            request.offset = m_size + position;
+            request.owner = owner;
+            m_ring.prepare(IORING_OP_WRITE, m_fd, request.data, request.length, request.offset, index);
+            owner->inFlight++;
+        }
+        owner->inFlight--;
+        m_size += size;
+        
+        // Submit now so the writes run while the caller prepares the next block
+        return reap(0) && !m_failed;
+    }
+    
+    bool write(const uint8_t* data, size_t size) override {
+        std::vector<uint8_t> buffer = m_buffers.acquire(size);
+        buffer.assign(data, data + size);
+        return append(std::move(buffer));
+    }
+    
+    bool writeAt(uint64_t offset, const uint8_t* data, size_t size) override {
+        if (offset > m_size || size > m_size - offset || !drain()) {
+            return false;
+        }
+        while (size > 0) {
+            ssize_t written = pwrite(m_fd, data, size, static_cast<off_t>(offset));
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                m_failed = true;
+                return false;
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+            offset += static_cast<uint64_t>(written);
+        }
+        return true;
+    }
+    
+    bool close() override {
+        bool drained = drain();
+        bool closed = m_fd >= 0 && ::close(m_fd) == 0;
+        m_fd = -1;
+        return drained && closed && !m_failed;
+    }
+    
+    uint64_t size() const override { return m_size; }
+
+private:
+    struct Pending {
+        std::vector<uint8_t> buffer;
+        unsigned inFlight;
+        
+        Pending() : inFlight(0) {}
+    };
+    
+    // Wait for every write in flight
+    bool drain() {
+        while (!m_requests.idle()) {
+            if (!reap(1)) {
+                return false;
+            }
+        }
+        return !m_failed;
+    }
+    
+    bool reap(unsigned waitFor) {
+        if (!m_ring.enter(m_requests.idle() ? 0 : waitFor)) {
+            m_failed = true;
+            return false;
+        }
+        io_uring_cqe cqe;
+        while (m_ring.completion(cqe)) {
+            uint32_t index = static_cast<uint32_t>(cqe.user_data);
+            Request& request = m_requests[index];
+            Completion outcome = complete(request, cqe.res);
+            if (outcome == Completion::RETRY) {
+                m_ring.prepare(IORING_OP_WRITE, request.fd, request.data, request.length,
+                               request.offset, index);
+                continue;
+            }
+            if (outcome == Completion::FAILED) {
+                m_failed = true;
+            }
+            static_cast<Pending*>(request.owner)->inFlight--;
+            m_requests.put(index);
+        }
+        
+        // Buffers whose writes all landed go back to the pool
+        for (auto it = m_pending.begin(); it != m_pending.end();) {
+            if ((*it)->inFlight == 0) {
+                m_buffers.release(std::move((*it)->buffer));
+                it = m_pending.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        return true;
+    }
+    
+    BufferPool& m_buffers;
+    Ring m_ring;
+    RequestTable m_requests;
+    std::deque<std::unique_ptr<Pending>> m_pending;
+    int m_fd;
+    uint64_t m_size;
+    bool m_failed;
+};
+
+} // namespace
+
+bool IoBackend::uringAvailable() {
+    // Disabled kernels and seccomp filters fail the setup call
+    Ring ring;
+    return ring.init(4);
+}
+
+UringIoBackend::UringIoBackend(BufferPool& buffers, bool fallback)
+    : m_buffers(buffers), m_fallback(fallback) {
+}
+
+std::unique_ptr<FileReadQueue> UringIoBackend::openReader(size_t depth) {
+    std::unique_ptr<UringReadQueue> reader(new UringReadQueue(m_buffers));
+    if (!reader->init()) {
+        return m_fallback ? threads().openReader(depth) : nullptr;
+    }
+    return std::unique_ptr<FileReadQueue>(reader.release());
+}
+
+std::unique_ptr<FileWriteQueue> UringIoBackend::openWriter() {
+    std::unique_ptr<UringWriteQueue> writer(new UringWriteQueue(m_buffers));
+    if (!writer->init()) {
+        return m_fallback ? threads().openWriter() : nullptr;
+    }
+    return std::unique_ptr<FileWriteQueue>(writer.release());
+}
+
+} // namespace Packer
+
+#else // !PACKER_HAVE_URING
+
+namespace Packer {
+
+bool IoBackend::uringAvailable() {
+    return false;
+}
+
+UringIoBackend::UringIoBackend(BufferPool& buffers, bool fallback)
+    : m_buffers(buffers), m_fallback(fallback) {
+}
+
+std::unique_ptr<FileReadQueue> UringIoBackend::openReader(size_t depth) {
+    return m_fallback ? threads().openReader(depth) : nullptr;
+}
+
+std::unique_ptr<FileWriteQueue> UringIoBackend::openWriter() {
+    return m_fallback ? threads().openWriter() : nullptr;
+}
+
+} // namespace Packer
+
+#endif // PACKER_HAVE_URING
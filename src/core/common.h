@@ -4,7 +4,7 @@
 #include <string>
 #include <vector>
 #include <memory>
-#include <Windows.h>
+#include "platform.h"
 
 namespace Packer {
 
@@ -28,6 +28,7 @@ struct FileInfo {
     std::wstring extension;
     int executionOrder;
     bool obfuscate;  // Only applicable for executables
+    bool compressible;  // False for already compressed content (see FileTypeDetector)
     
     // PE-specific fields (only valid if fileType == EXECUTABLE)
     bool is64Bit;
@@ -35,7 +36,7 @@ struct FileInfo {
     DWORD imageBase;
     
     FileInfo() : fileSize(0), fileType(FileType::OTHER), executionOrder(0), 
-                 obfuscate(false), is64Bit(false), entryPoint(0), imageBase(0) {}
+                 obfuscate(false), compressible(true), is64Bit(false), entryPoint(0), imageBase(0) {}
 };
 
 // Legacy typedef for backward compatibility
@@ -60,15 +61,87 @@ enum class OutputType {
     DLL
 };
 
+// Where the packed payload lives in the output image
+enum class PayloadLayout {
+    OVERLAY,  // Appended after the last section, read back from disk by the stub
+    SECTION   // Stored in a .pack section that the loader maps for the stub
+};
+
+// How entry data is compressed
+enum class CompressionMode {
+    NONE,   // Store everything as is
+    ENTRY,  // Compress each entry on its own
+    SOLID   // Like ENTRY, but small entries share compressed groups
+};
+
+// Entries up to this size go into solid groups. Groups close once their
+// decoded size reaches the target, which bounds what the stub decodes to
+// reach any one small entry.
+const uint64_t SOLID_ENTRY_LIMIT = 64 * 1024;
+const uint64_t SOLID_GROUP_TARGET = 1024 * 1024;
+
+// Zero runs at least this long are left out of an entry's stored data and
+// recreated by the stub as sparse regions. Matches the NTFS sparse unit.
+const uint64_t SPARSE_MIN_HOLE = 64 * 1024;
+
+// Per-block codec selection (see CodecSearch)
+struct CodecSearchOptions {
+    bool enabled;           // Try every codec and level, keep the smallest
+    double timeBudget;      // Seconds for the whole build, 0 = unlimited
+    double minDecodeSpeed;  // MB/s a candidate must decode at, 0 = no floor
+    
+    CodecSearchOptions() : enabled(false), timeBudget(0), minDecodeSpeed(0) {}
+};
+
+// One edge of a scheduled bundle: the entry named step starts only once
+// the entry named after has finished. Entries are named as in the
+// manifest, by file name.
+struct StepDependency {
+    std::wstring step;
+    std::wstring after;
+};
+
 struct PackerOptions {
     OutputType outputType;
+    PayloadLayout payloadLayout;
+    CompressionMode compression;
+    CodecSearchOptions codecSearch;
+    bool sparse;           // Store long zero runs as holes (SPARSE_MIN_HOLE)
+    bool expandArchives;   // Pack the files inside .zip and .tar inputs, not the archives
+    uint32_t startupEntries;  // First entries to run, stored uncompressed at the front
     std::wstring outputPath;
+    std::wstring stubPath;  // Stub template to use; empty = the default, see StubRegistry
+    std::wstring basePath;  // Previous bundle to build a delta against (command line only)
     bool obfuscateFinal;
     bool waitForPrevious;  // Wait for each file to finish before running next
+    std::vector<StepDependency> dependencies;  // Run as a dependency graph instead
+    uint32_t maxParallel;  // Graph steps running at once, 0 = no cap; nonzero also
+                           // schedules a bundle without dependencies
     ObfuscationOptions obfuscationOpts;
     
-    PackerOptions() : outputType(OutputType::EXE), obfuscateFinal(false), 
-                     waitForPrevious(true) {}
+    PackerOptions() : outputType(OutputType::EXE), payloadLayout(PayloadLayout::OVERLAY),
+                     compression(CompressionMode::SOLID), sparse(true), expandArchives(false),
+                     startupEntries(0), obfuscateFinal(false), waitForPrevious(true),
+                     maxParallel(0) {}
+};
+
+// One more output of a matrix build. Only what lives outside the encoded
+// file data may vary, so every variant reuses the same encoded payload.
+struct OutputVariant {
+    std::wstring outputPath;
+    std::wstring stubPath;
+    OutputType outputType;
+    PayloadLayout payloadLayout;
+    bool waitForPrevious;
+    
+    OutputVariant() : outputType(OutputType::EXE), payloadLayout(PayloadLayout::OVERLAY),
+                      waitForPrevious(true) {}
+    
+    // The output options already carry
+    explicit OutputVariant(const PackerOptions& options)
+        : outputPath(options.outputPath), stubPath(options.stubPath),
+          outputType(options.outputType), payloadLayout(options.payloadLayout),
+          waitForPrevious(options.waitForPrevious) {}
 };
 
 } // namespace Packer
@@ -0,0 +1,185 @@
+#include "FileListModel.h"
+#include "../utils/FileTypeDetector.h"
+#include <algorithm>
+#include <numeric>
+
+namespace Packer {
+
+namespace {
+
+// Contiguous runs [first, last] in a sorted row list
+std::vector<std::pair<int, int>> runsOf(const std::vector<int>& rows) {
+    std::vector<std::pair<int, int>> runs;
+    for (int row : rows) {
+        if (!runs.empty() && runs.back().second + 1 == row) {
+            runs.back().second = row;
+        } else {
+            runs.push_back(std::make_pair(row, row));
+        }
+    }
+    return runs;
+}
+
+} // namespace
+
+FileListModel::FileListModel(QObject* parent)
+    : QAbstractListModel(parent) {
+}
+
+int FileListModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : static_cast<int>(m_entries.size());
+}
+
+QVariant FileListModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= static_cast<int>(m_entries.size())) {
+        return QVariant();
+    }
+    
+    const FileListEntry& entry = m_entries[index.row()];
+    switch (role) {
+        case Qt::DisplayRole:
+            return QString("[%1] %2").arg(index.row() + 1).arg(entry.label);
+        case Qt::ToolTipRole:
+            return QString::fromStdWString(entry.path);
+        default:
+            return QVariant();
+    }
+}
+
+FileListEntry FileListModel::makeEntry(const FileInfo& fileInfo) {
+    FileListEntry entry;
+    entry.path = fileInfo.filePath;
+    entry.name = QString::fromStdWString(fileInfo.originalName);
+    entry.size = fileInfo.fileSize;
+    entry.type = fileInfo.fileType;
+    
+    QString type = QString::fromStdWString(FileTypeDetector::getFileTypeString(fileInfo.fileType));
+    if (fileInfo.fileType == FileType::EXECUTABLE) {
+        type += fileInfo.is64Bit ? ", 64-bit" : ", 32-bit";
+    }
+    entry.label = QString("%1 (%2, %3 KB)")
+        .arg(entry.name)
+        .arg(type)
+        .arg(fileInfo.fileSize / 1024);
+    return entry;
+}
+
+void FileListModel::append(std::vector<FileListEntry>&& entries) {
+    if (entries.empty()) {
+        return;
+    }
+    
+    int first = static_cast<int>(m_entries.size());
+    beginInsertRows(QModelIndex(), first, first + static_cast<int>(entries.size()) - 1);
+    m_entries.insert(m_entries.end(),
+                     std::make_move_iterator(entries.begin()),
+                     std::make_move_iterator(entries.end()));
+    endInsertRows();
+}
+
+void FileListModel::remove(const std::vector<int>& rows) {
+    if (rows.empty()) {
+        return;
+    }
+    
+    // Last run first, so earlier row numbers stay valid
+    std::vector<std::pair<int, int>> runs = runsOf(rows);
+    for (size_t i = runs.size(); i-- > 0;) {
+        beginRemoveRows(QModelIndex(), runs[i].first, runs[i].second);
+        m_entries.erase(m_entries.begin() + runs[i].first,
+                        m_entries.begin() + runs[i].second + 1);
+        endRemoveRows();
+    }
+    
+    // Rows after the first removal show new order numbers
+    int first = runs.front().first;
+    if (first < static_cast<int>(m_entries.size())) {
+        emit dataChanged(index(first), index(static_cast<int>(m_entries.size()) - 1),
+                         {Qt::DisplayRole});
+    }
+}
+
+bool FileListModel::moveUp(const std::vector<int>& rows) {
+    bool moved = false;
+    int floor = 0;          // First row a run may move into
+    for (const std::pair<int, int>& run : runsOf(rows)) {
+        if (run.first == floor) {
+            floor = run.second + 1;
+            continue;
+        }
+        
+        // The row above the run drops below it
+        moveRun(run.first - 1, run.first - 1, run.second + 1);
+        emit dataChanged(index(run.first - 1), index(run.second), {Qt::DisplayRole});
+        moved = true;
+    }
+    return moved;
+}
+
+bool FileListModel::moveDown(const std::vector<int>& rows) {
+    bool moved = false;
+    int ceiling = static_cast<int>(m_entries.size()) - 1;
+    std::vector<std::pair<int, int>> runs = runsOf(rows);
+    for (size_t i = runs.size(); i-- > 0;) {
+        if (runs[i].second == ceiling) {
+            ceiling = runs[i].first - 1;
+            continue;
+        }
+        
+        // The row below the run rises above it
+        moveRun(runs[i].second + 1, runs[i].second + 1, runs[i].first);
+        emit dataChanged(index(runs[i].first), index(runs[i].second + 1), {Qt::DisplayRole});
+        moved = true;
+    }
+    return moved;
+}
+
+void FileListModel::moveRun(int first, int last, int destination) {
+    beginMoveRows(QModelIndex(), first, last, QModelIndex(), destination);
+    std::vector<FileListEntry>::iterator begin = m_entries.begin();
+    if (destination < first) {
+        std::rotate(begin + destination, begin + first, begin + last + 1);
+    } else {
+        std::rotate(begin + first, begin + last + 1, begin + destination);
+    }
+    endMoveRows();
+}
+
+void FileListModel::sortBy(SortKey key, Qt::SortOrder order) {
+    std::vector<int> sorted(m_entries.size());
+    std::iota(sorted.begin(), sorted.end(), 0);
+    
+    auto compare = [&](int a, int b) {
+        const FileListEntry& left = m_entries[order == Qt::AscendingOrder ? a : b];
+        const FileListEntry& right = m_entries[order == Qt::AscendingOrder ? b : a];
+        if (key == SORT_SIZE && left.size != right.size) {
+            return left.size < right.size;
+        }
+        if (key == SORT_TYPE && left.type != right.type) {
+            return left.type < right.type;
+        }
+        return left.name.compare(right.name, Qt::CaseInsensitive) < 0;
+    };
+    std::stable_sort(sorted.begin(), sorted.end(), compare);
+    
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+    
+    std::vector<FileListEntry> entries;
+    entries.reserve(m_entries.size());
+    std::vector<int> newRow(m_entries.size());
+    for (size_t i = 0; i < sorted.size(); i++) {
+        entries.push_back(std::move(m_entries[sorted[i]]));
+        newRow[sorted[i]] = static_cast<int>(i);
+    }
+    m_entries.swap(entries);
+    
+    // Selections and the current row are persistent indexes
+    const QModelIndexList persistent = persistentIndexList();
+    for (const QModelIndex& old : persistent) {
+        changePersistentIndex(old, index(newRow[old.row()]));
+    }
+    
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
+
+} // namespace Packer
@@ -0,0 +1,69 @@
+#ifndef FILELISTMODEL_H
+#define FILELISTMODEL_H
+
+#include <QAbstractListModel>
+#include <QString>
+#include "../core/common.h"
+
+namespace Packer {
+
+// What the list keeps per input: metadata only, the data is read at build
+// time. Small enough that moving rows around never touches file contents.
+struct FileListEntry {
+    std::wstring path;
+    QString name;
+    QString label;          // "name (type, size)", without the order prefix
+    uint64_t size;
+    FileType type;
+    
+    FileListEntry() : size(0), type(FileType::OTHER) {}
+};
+
+// Inputs in execution order, for a QListView. The order number shown in
+// front of each name is the row itself, so edits renumber nothing; every
+// operation signals only the rows it changes and views repaint just those
+// on screen. Row lists passed in must be sorted and free of duplicates.
+class FileListModel : public QAbstractListModel {
+    Q_OBJECT
+
+public:
+    enum SortKey {
+        SORT_NAME,
+        SORT_SIZE,
+        SORT_TYPE
+    };
+    
+    explicit FileListModel(QObject* parent = nullptr);
+    
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    
+    // Entry for a probed file
+    static FileListEntry makeEntry(const FileInfo& fileInfo);
+    
+    // Append a batch in one insertion
+    void append(std::vector<FileListEntry>&& entries);
+    
+    // Remove rows, one removal per contiguous run
+    void remove(const std::vector<int>& rows);
+    
+    // Move each selected run one row up or down. Runs already at the top or
+    // bottom, and runs blocked by them, stay put. False if nothing moved.
+    bool moveUp(const std::vector<int>& rows);
+    bool moveDown(const std::vector<int>& rows);
+    
+    // Stable sort; selections follow their rows
+    void sortBy(SortKey key, Qt::SortOrder order = Qt::AscendingOrder);
+    
+    const std::vector<FileListEntry>& entries() const { return m_entries; }
+
+private:
+    // Move rows [first, last] so they end up before row destination
+    void moveRun(int first, int last, int destination);
+    
+    std::vector<FileListEntry> m_entries;
+};
+
+} // namespace Packer
+
+#endif // FILELISTMODEL_H
@@ -3,6 +3,9 @@
 #include "../core/ResourceEmbedder.h"
 #include "../core/Obfuscator.h"
 #include "../core/StubGenerator.h"
+#include "../core/ArchiveReader.h"
+#include "../core/InputLoader.h"
+#include "../core/FileIO.h"
 #include "../utils/FileTypeDetector.h"
 
 #include <QVBoxLayout>
@@ -13,17 +16,30 @@
 #include <QMessageBox>
 #include <QApplication>
 #include <QStatusBar>
-#include <fstream>
+#include <QMenu>
+#include <algorithm>
+#include <map>
+#include <memory>
 
 namespace Packer {
 
 MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent) {
+    : QMainWindow(parent), m_estimator(new SizeEstimator()), m_estimateQueued(false) {
     setupUI();
     updateButtonStates();
+    
+    // Samples finish on the estimator's threads; a burst of them becomes
+    // one refresh on the UI thread
+    m_estimator->setListener([this] {
+        if (!m_estimateQueued.exchange(true)) {
+            QMetaObject::invokeMethod(this, [this] { updateEstimate(); }, Qt::QueuedConnection);
+        }
+    });
 }
 
 MainWindow::~MainWindow() {
+    // Stop sampling before the window it reports to goes away
+    m_estimator.reset();
 }
 
 void MainWindow::setupUI() {
@@ -41,11 +57,25 @@ void MainWindow::setupUI() {
     QGroupBox* fileGroup = new QGroupBox("Files (Top = First to Execute)", this);
     QVBoxLayout* fileLayout = new QVBoxLayout(fileGroup);
     
-    m_fileList = new QListWidget(this);
-    m_fileList->setSelectionMode(QAbstractItemView::SingleSelection);
-    m_fileList->setDragDropMode(QAbstractItemView::InternalMove);
-    connect(m_fileList, &QListWidget::itemSelectionChanged, 
+    // The view asks the model only for rows on screen, and uniform row
+    // heights spare it measuring the rest
+    m_fileModel = new FileListModel(this);
+    m_fileList = new QListView(this);
+    m_fileList->setModel(m_fileModel);
+    m_fileList->setUniformItemSizes(true);
+    m_fileList->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    connect(m_fileList->selectionModel(), &QItemSelectionModel::selectionChanged,
             this, &MainWindow::onItemSelectionChanged);
+    connect(m_fileModel, &QAbstractItemModel::rowsInserted,
+            this, &MainWindow::updateButtonStates);
+    connect(m_fileModel, &QAbstractItemModel::rowsRemoved,
+            this, &MainWindow::updateButtonStates);
+    
+    // Order matters to the estimate too: startup entries and solid groups
+    connect(m_fileModel, &QAbstractItemModel::rowsInserted, this, &MainWindow::updateEstimate);
+    connect(m_fileModel, &QAbstractItemModel::rowsRemoved, this, &MainWindow::updateEstimate);
+    connect(m_fileModel, &QAbstractItemModel::rowsMoved, this, &MainWindow::updateEstimate);
+    connect(m_fileModel, &QAbstractItemModel::layoutChanged, this, &MainWindow::updateEstimate);
     
     fileLayout->addWidget(m_fileList);
     
@@ -55,6 +85,16 @@ void MainWindow::setupUI() {
     m_removeButton = new QPushButton("Remove", this);
     m_moveUpButton = new QPushButton("Move Up ↑", this);
     m_moveDownButton = new QPushButton("Move Down ↓", this);
+    m_sortButton = new QPushButton("Sort", this);
+    
+    QMenu* sortMenu = new QMenu(this);
+    connect(sortMenu->addAction("By Name"), &QAction::triggered,
+            this, [this] { onSort(FileListModel::SORT_NAME); });
+    connect(sortMenu->addAction("By Type"), &QAction::triggered,
+            this, [this] { onSort(FileListModel::SORT_TYPE); });
+    connect(sortMenu->addAction("By Size"), &QAction::triggered,
+            this, [this] { onSort(FileListModel::SORT_SIZE); });
+    m_sortButton->setMenu(sortMenu);
     
     connect(m_addButton, &QPushButton::clicked, this, &MainWindow::onAddFiles);
     connect(m_removeButton, &QPushButton::clicked, this, &MainWindow::onRemoveFile);
@@ -65,6 +105,7 @@ void MainWindow::setupUI() {
     fileButtonLayout->addWidget(m_removeButton);
     fileButtonLayout->addWidget(m_moveUpButton);
     fileButtonLayout->addWidget(m_moveDownButton);
+    fileButtonLayout->addWidget(m_sortButton);
     fileButtonLayout->addStretch();
     
     fileLayout->addLayout(fileButtonLayout);
@@ -80,6 +121,32 @@ void MainWindow::setupUI() {
     
     optionsLayout->addWidget(m_waitForPreviousCheckbox);
     
+    // A nonzero cap runs the programs as a step graph instead, that many
+    // at a time in list order; the wait option no longer applies
+    QHBoxLayout* maxParallelLayout = new QHBoxLayout();
+    maxParallelLayout->addWidget(new QLabel("Programs running at once (0 = as above):", this));
+    m_maxParallelSpin = new QSpinBox(this);
+    m_maxParallelSpin->setRange(0, 64);
+    m_maxParallelSpin->setValue(0);
+    connect(m_maxParallelSpin, &QSpinBox::valueChanged, this, [this](int value) {
+        m_waitForPreviousCheckbox->setEnabled(value == 0);
+    });
+    maxParallelLayout->addWidget(m_maxParallelSpin);
+    maxParallelLayout->addStretch();
+    optionsLayout->addLayout(maxParallelLayout);
+    
+    // Payload layout
+    m_sectionLayoutCheckbox = new QCheckBox("Store files in a PE section (mapped at launch, no file read)", this);
+    m_sectionLayoutCheckbox->setChecked(false);
+    
+    optionsLayout->addWidget(m_sectionLayoutCheckbox);
+    
+    // Archives added to the list
+    m_expandArchivesCheckbox = new QCheckBox("Add the files inside ZIP and TAR archives instead of the archives", this);
+    m_expandArchivesCheckbox->setChecked(true);
+    
+    optionsLayout->addWidget(m_expandArchivesCheckbox);
+    
     // Output type
     QHBoxLayout* outputTypeLayout = new QHBoxLayout();
     outputTypeLayout->addWidget(new QLabel("Output Type:", this));
@@ -104,6 +171,15 @@ void MainWindow::setupUI() {
     
     mainLayout->addWidget(optionsGroup);
     
+    // Options that change the layout change the estimate
+    connect(m_waitForPreviousCheckbox, &QCheckBox::toggled, this, &MainWindow::updateEstimate);
+    connect(m_sectionLayoutCheckbox, &QCheckBox::toggled, this, &MainWindow::updateEstimate);
+    connect(m_outputTypeCombo, &QComboBox::currentIndexChanged, this, &MainWindow::updateEstimate);
+    
+    // Estimate, kept up to date as files are added and sampled
+    m_estimateLabel = new QLabel("Add files to see the estimated size", this);
+    mainLayout->addWidget(m_estimateLabel);
+    
     // Progress bar
     m_progressBar = new QProgressBar(this);
     m_progressBar->setValue(0);
@@ -132,115 +208,86 @@ void MainWindow::onAddFiles() {
         return;
     }
     
+    // Only the first bytes of each file are read here; the data is loaded
+    // when building. All files go into the list as one insertion.
+    std::vector<FileListEntry> entries;
+    entries.reserve(fileNames.size());
+    QStringList failed;
+    int order = m_fileModel->rowCount();
+    
     for (const QString& fileName : fileNames) {
-        FileInfo fileInfo;
-        std::wstring filePath = fileName.toStdWString();
+        std::wstring path = fileName.toStdWString();
         
-        // Load file data
-        std::ifstream file(filePath.c_str(), std::ios::binary | std::ios::ate);
-        if (!file.is_open()) {
-            QMessageBox::warning(this, "Error", 
-                QString("Failed to open file: %1").arg(fileName));
+        // Archive contents are listed as member paths and read from the
+        // archive at build time; nothing is extracted
+        if (m_expandArchivesCheckbox->isChecked() && ArchiveReader::isArchive(path)) {
+            ArchiveReader archive;
+            if (!archive.open(path)) {
+                failed.append(fileName + ": " + QString::fromStdString(archive.error()));
+                continue;
+            }
+            for (size_t i = 0; i < archive.members().size(); i++) {
+                FileInfo fileInfo;
+                std::string error;
+                if (!InputLoader::probeMember(archive, i, order, fileInfo, error)) {
+                    failed.append(fileName + ": " + QString::fromStdString(error));
+                    continue;
+                }
+                entries.push_back(FileListModel::makeEntry(fileInfo));
+                order++;
+            }
             continue;
         }
         
-        std::streamsize size = file.tellg();
-        file.seekg(0, std::ios::beg);
-        
-        fileInfo.fileData.resize(size);
-        if (!file.read(reinterpret_cast<char*>(fileInfo.fileData.data()), size)) {
-            QMessageBox::warning(this, "Error", 
-                QString("Failed to read file: %1").arg(fileName));
+        FileInfo fileInfo;
+        if (!InputLoader::probeFile(path, order, fileInfo)) {
+            failed.append(fileName);
             continue;
         }
         
-        fileInfo.filePath = filePath;
-        fileInfo.fileSize = size;
-        fileInfo.executionOrder = static_cast<int>(m_exeFiles.size());
-        
-        // Extract filename
-        size_t lastSlash = filePath.find_last_of(L"\\/");
-        fileInfo.originalName = (lastSlash != std::wstring::npos) ? 
-            filePath.substr(lastSlash + 1) : filePath;
-        
-        // Detect file type
-        fileInfo.fileType = FileTypeDetector::detectFileType(filePath);
-        fileInfo.extension = FileTypeDetector::getExtension(filePath);
-        
-        // If it's an executable, try to parse PE info
-        if (fileInfo.fileType == FileType::EXECUTABLE) {
-            PEParser parser;
-            PEInfo peInfo;
-            if (parser.loadFile(filePath, peInfo)) {
-                fileInfo.is64Bit = peInfo.is64Bit;
-                fileInfo.entryPoint = peInfo.entryPoint;
-                fileInfo.imageBase = peInfo.imageBase;
-            }
-            fileInfo.obfuscate = false;  // Obfuscation disabled
-        }
-        
-        m_exeFiles.push_back(fileInfo);
-        
-        QString displayName = QString("[%1] %2 (%3, %4 KB)")
-            .arg(fileInfo.executionOrder + 1)
-            .arg(QString::fromStdWString(fileInfo.originalName))
-            .arg(QString::fromStdWString(FileTypeDetector::getFileTypeString(fileInfo.fileType)))
-            .arg(fileInfo.fileSize / 1024);
-        
-        m_fileList->addItem(displayName);
-        
-        statusBar()->showMessage(QString("Added: %1")
-            .arg(QString::fromStdWString(fileInfo.originalName)), 3000);
+        entries.push_back(FileListModel::makeEntry(fileInfo));
+        order++;
     }
     
-    updateButtonStates();
-}
-
-void MainWindow::onRemoveFile() {
-    int currentRow = m_fileList->currentRow();
-    if (currentRow < 0) {
-        return;
+    // Sample the new inputs in the background for the estimate
+    std::vector<std::wstring> paths;
+    paths.reserve(entries.size());
+    for (const FileListEntry& entry : entries) {
+        paths.push_back(entry.path);
     }
+    m_estimator->add(paths);
     
-    m_exeFiles.erase(m_exeFiles.begin() + currentRow);
-    delete m_fileList->takeItem(currentRow);
+    int added = static_cast<int>(entries.size());
+    m_fileModel->append(std::move(entries));
+    statusBar()->showMessage(QString("Added %1 file(s)").arg(added), 3000);
     
-    updateExecutionOrder();
+    if (!failed.isEmpty()) {
+        QMessageBox::warning(this, "Error",
+            QString("Failed to read %1 file(s):\n%2")
+                .arg(failed.size())
+                .arg(failed.mid(0, 10).join("\n")));
+    }
+}
+
+void MainWindow::onRemoveFile() {
+    m_fileModel->remove(selectedRows());
     updateButtonStates();
 }
 
 void MainWindow::onMoveUp() {
-    int currentRow = m_fileList->currentRow();
-    if (currentRow <= 0) {
-        return;
-    }
-    
-    // Swap in vector
-    std::swap(m_exeFiles[currentRow], m_exeFiles[currentRow - 1]);
-    
-    // Swap in list
-    QListWidgetItem* item = m_fileList->takeItem(currentRow);
-    m_fileList->insertItem(currentRow - 1, item);
-    m_fileList->setCurrentRow(currentRow - 1);
-    
-    updateExecutionOrder();
+    // Selected rows are persistent indexes, so the selection moves along
+    m_fileModel->moveUp(selectedRows());
+    updateButtonStates();
 }
 
 void MainWindow::onMoveDown() {
-    int currentRow = m_fileList->currentRow();
-    if (currentRow < 0 || currentRow >= m_fileList->count() - 1) {
-        return;
-    }
-    
-    // Swap in vector
-    std::swap(m_exeFiles[currentRow], m_exeFiles[currentRow + 1]);
-    
-    // Swap in list
-    QListWidgetItem* item = m_fileList->takeItem(currentRow);
-    m_fileList->insertItem(currentRow + 1, item);
-    m_fileList->setCurrentRow(currentRow + 1);
-    
-    updateExecutionOrder();
+    m_fileModel->moveDown(selectedRows());
+    updateButtonStates();
+}
+
+void MainWindow::onSort(int key) {
+    m_fileModel->sortBy(static_cast<FileListModel::SortKey>(key));
+    updateButtonStates();
 }
 
 void MainWindow::onBuild() {
@@ -257,16 +304,47 @@ void MainWindow::onBuild() {
         // Step 1: Generate packed executable
         statusBar()->showMessage("Generating packed executable...");
         StubGenerator stubGen;
-        PackerOptions opts;
-        opts.outputType = m_outputTypeCombo->currentText() == "EXE" ? 
-                         OutputType::EXE : OutputType::DLL;
-        opts.outputPath = m_outputPathEdit->text().toStdWString();
-        opts.obfuscateFinal = false;
-        opts.waitForPrevious = m_waitForPreviousCheckbox->isChecked();
+        PackerOptions opts = buildOptions();
+        
+        // Load the data of every input in list order, opening each archive
+        // that inputs come from once
+        const std::vector<FileListEntry>& entries = m_fileModel->entries();
+        std::vector<FileInfo> files(entries.size());
+        std::map<std::wstring, std::unique_ptr<ArchiveReader>> archives;
+        for (size_t i = 0; i < entries.size(); i++) {
+            std::wstring archivePath;
+            std::string name;
+            if (!ArchiveReader::splitMemberPath(entries[i].path, archivePath, name)) {
+                if (!InputLoader::loadFile(entries[i].path, static_cast<int>(i), files[i])) {
+                    throw std::runtime_error("Failed to read " + FileIO::toUtf8(entries[i].path));
+                }
+                continue;
+            }
+            
+            std::unique_ptr<ArchiveReader>& archive = archives[archivePath];
+            if (!archive) {
+                archive.reset(new ArchiveReader());
+                if (!archive->open(archivePath)) {
+                    throw std::runtime_error("Failed to open " + FileIO::toUtf8(archivePath) + ": " +
+                                             archive->error());
+                }
+            }
+            size_t index = 0;
+            std::string error = "no such file in the archive";
+            if (!archive->find(name, index) ||
+                !InputLoader::loadMember(*archive, index, static_cast<int>(i), files[i], error)) {
+                throw std::runtime_error("Failed to read " + FileIO::toUtf8(entries[i].path) + ": " + error);
+            }
+        }
+        
+        m_progressBar->setValue(40);
+        QApplication::processEvents();
         
         std::vector<uint8_t> finalOutput;
-        if (!stubGen.generatePackedExecutable(m_exeFiles, opts, finalOutput)) {
-            throw std::runtime_error("Failed to generate packed executable");
+        std::string error;
+        if (!stubGen.generatePackedExecutable(files, opts, finalOutput, error)) {
+            throw std::runtime_error(error.empty() ? std::string("Failed to generate packed executable") :
+                                     "Failed to generate packed executable: " + error);
         }
         
         m_progressBar->setValue(80);
@@ -274,18 +352,7 @@ void MainWindow::onBuild() {
         
         // Step 2: Write output file
         statusBar()->showMessage("Writing output file...");
-        std::string outputPath = m_outputPathEdit->text().toStdString();
-        std::ofstream outFile(outputPath, std::ios::binary);
-        
-        if (!outFile.is_open()) {
-            throw std::runtime_error("Failed to open output file for writing");
-        }
-        
-        outFile.write(reinterpret_cast<const char*>(finalOutput.data()), 
-                     finalOutput.size());
-        outFile.close();
-        
-        if (!outFile.good()) {
+        if (!FileIO::writeFile(opts.outputPath, finalOutput)) {
             throw std::runtime_error("Failed to write output file");
         }
         
@@ -294,7 +361,7 @@ void MainWindow::onBuild() {
         
         QMessageBox::information(this, "Success", 
             "Packed executable created successfully!");
-        
+    
     } catch (const std::exception& e) {
         QMessageBox::critical(this, "Error", 
             QString("Build failed: %1").arg(e.what()));
@@ -328,17 +395,59 @@ void MainWindow::onItemSelectionChanged() {
 }
 
 void MainWindow::updateButtonStates() {
-    int currentRow = m_fileList->currentRow();
-    int count = m_fileList->count();
-    
-    m_removeButton->setEnabled(currentRow >= 0);
-    m_moveUpButton->setEnabled(currentRow > 0);
-    m_moveDownButton->setEnabled(currentRow >= 0 && currentRow < count - 1);
+    std::vector<int> rows = selectedRows();
+    int selected = static_cast<int>(rows.size());
+    int count = m_fileModel->rowCount();
+    
+    // Nothing can move once the selection is packed against that end
+    m_removeButton->setEnabled(selected > 0);
+    m_moveUpButton->setEnabled(selected > 0 && rows.back() != selected - 1);
+    m_moveDownButton->setEnabled(selected > 0 && rows.front() != count - selected);
+    m_sortButton->setEnabled(count > 1);
     m_buildButton->setEnabled(count > 0 && !m_outputPathEdit->text().isEmpty());
 }
 
+PackerOptions MainWindow::buildOptions() const {
+    PackerOptions opts;
+    opts.outputType = m_outputTypeCombo->currentText() == "EXE" ? 
+                     OutputType::EXE : OutputType::DLL;
+    opts.outputPath = m_outputPathEdit->text().toStdWString();
+    opts.obfuscateFinal = false;
+    opts.waitForPrevious = m_waitForPreviousCheckbox->isChecked();
+    opts.maxParallel = static_cast<uint32_t>(m_maxParallelSpin->value());
+    opts.payloadLayout = m_sectionLayoutCheckbox->isChecked() ?
+                        PayloadLayout::SECTION : PayloadLayout::OVERLAY;
+    return opts;
+}
+
+void MainWindow::updateEstimate() {
+    m_estimateQueued = false;
+    const std::vector<FileListEntry>& entries = m_fileModel->entries();
+    if (entries.empty()) {
+        m_estimateLabel->setText("Add files to see the estimated size");
+        return;
+    }
+    
+    std::vector<std::wstring> paths;
+    paths.reserve(entries.size());
+    for (const FileListEntry& entry : entries) {
+        paths.push_back(entry.path);
+    }
+    
+    // The window builds on one thread
+    SizeEstimate estimate = m_estimator->estimate(paths, buildOptions(), 1);
+    QString text = QString("Estimated size: ~%1 KB, compression ~%2 s, extraction ~%3 s")
+        .arg(estimate.outputSize / 1024.0, 0, 'f', 1)
+        .arg(estimate.encodeSeconds, 0, 'f', 2)
+        .arg(estimate.extractSeconds, 0, 'f', 2);
+    if (estimate.pending > 0) {
+        text += QString(" (%1 of %2 files sampled)").arg(estimate.sampled).arg(entries.size());
+    }
+    m_estimateLabel->setText(text);
+}
+
 bool MainWindow::validateInputs() {
-    if (m_exeFiles.empty()) {
+    if (m_fileModel->rowCount() == 0) {
         QMessageBox::warning(this, "Validation Error", 
             "Please add at least one executable file.");
         return false;
@@ -353,18 +462,15 @@ bool MainWindow::validateInputs() {
     return true;
 }
 
-void MainWindow::updateExecutionOrder() {
-    for (size_t i = 0; i < m_exeFiles.size(); i++) {
-        m_exeFiles[i].executionOrder = static_cast<int>(i);
-        
-        QString displayName = QString("[%1] %2 (%3-bit, %4 KB)")
-            .arg(i + 1)
-            .arg(QString::fromStdWString(m_exeFiles[i].originalName))
-            .arg(m_exeFiles[i].is64Bit ? 64 : 32)
-            .arg(m_exeFiles[i].fileSize / 1024);
-        
-        m_fileList->item(static_cast<int>(i))->setText(displayName);
+std::vector<int> MainWindow::selectedRows() const {
+    const QModelIndexList selected = m_fileList->selectionModel()->selectedRows();
+    std::vector<int> rows;
+    rows.reserve(selected.size());
+    for (const QModelIndex& index : selected) {
+        rows.push_back(index.row());
     }
+    std::sort(rows.begin(), rows.end());
+    return rows;
 }
 
 } // namespace Packer
@@ -2,13 +2,18 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
-#include <QListWidget>
+#include <QListView>
 #include <QPushButton>
 #include <QCheckBox>
 #include <QComboBox>
+#include <QSpinBox>
 #include <QLineEdit>
+#include <QLabel>
 #include <QProgressBar>
-#include "../core/common.h"
+#include "FileListModel.h"
+#include "../core/SizeEstimator.h"
+#include <atomic>
+#include <memory>
 
 namespace Packer {
 
@@ -27,29 +32,45 @@ private slots:
     void onBuild();
     void onOutputBrowse();
     void onItemSelectionChanged();
+    void onSort(int key);
     
 private:
     void setupUI();
     void updateButtonStates();
     bool validateInputs();
-    void updateExecutionOrder();
+    
+    // Options as set in the window; the output path as typed
+    PackerOptions buildOptions() const;
+    
+    // Refresh the predicted size and times from the samples taken so far
+    void updateEstimate();
+    
+    // Selected rows in ascending order
+    std::vector<int> selectedRows() const;
     
     // UI Components
-    QListWidget* m_fileList;
+    QListView* m_fileList;
     QPushButton* m_addButton;
     QPushButton* m_removeButton;
     QPushButton* m_moveUpButton;
     QPushButton* m_moveDownButton;
+    QPushButton* m_sortButton;
     QPushButton* m_buildButton;
     QPushButton* m_outputBrowseButton;
     
     QCheckBox* m_waitForPreviousCheckbox;
+    QSpinBox* m_maxParallelSpin;
+    QCheckBox* m_sectionLayoutCheckbox;
+    QCheckBox* m_expandArchivesCheckbox;
     QComboBox* m_outputTypeCombo;
     QLineEdit* m_outputPathEdit;
+    QLabel* m_estimateLabel;
     QProgressBar* m_progressBar;
     
     // Data
-    std::vector<PEInfo> m_exeFiles;
+    FileListModel* m_fileModel;
+    std::unique_ptr<SizeEstimator> m_estimator;
+    std::atomic<bool> m_estimateQueued;     // An updateEstimate() call is already posted
 };
 
 } // namespace Packer
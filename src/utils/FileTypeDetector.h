@@ -2,59 +2,199 @@
 #define FILETYPEDETECTOR_H
 
 #include "../core/common.h"
-#include <algorithm>
-#include <cctype>
+#include <cstddef>
+#include <cstdint>
 
 namespace Packer {
 
+// Magic bytes at the start of a file
+struct ContentSignature {
+    const char* bytes;
+    uint8_t length;
+    FileType type;
+    uint8_t flags;          // SIGNATURE_*
+    const char* name;
+};
+
+const uint8_t SIGNATURE_COMPRESSED = 0x1;  // Already compressed, storing beats re-encoding
+const uint8_t SIGNATURE_WEAK = 0x2;        // Only a hint; a known extension wins
+const uint8_t SIGNATURE_CASELESS = 0x4;    // ASCII letters match either case
+
+inline constexpr ContentSignature CONTENT_SIGNATURES[] = {
+    { "MZ",                           2, FileType::EXECUTABLE, SIGNATURE_WEAK, "MZ" },
+    { "PK\x03\x04",                   4, FileType::ARCHIVE, SIGNATURE_COMPRESSED, "ZIP" },
+    { "PK\x05\x06",                   4, FileType::ARCHIVE, SIGNATURE_COMPRESSED, "ZIP (empty)" },
+    { "7z\xBC\xAF\x27\x1C",           6, FileType::ARCHIVE, SIGNATURE_COMPRESSED, "7z" },
+    { "Rar!\x1A\x07",                 6, FileType::ARCHIVE, SIGNATURE_COMPRESSED, "RAR" },
+    { "\x1F\x8B",                     2, FileType::ARCHIVE, SIGNATURE_COMPRESSED, "gzip" },
+    { "BZh",                          3, FileType::ARCHIVE, SIGNATURE_COMPRESSED, "bzip2" },
+    { "\xFD" "7zXZ\x00",              6, FileType::ARCHIVE, SIGNATURE_COMPRESSED, "xz" },
+    { "\x28\xB5\x2F\xFD",             4, FileType::ARCHIVE, SIGNATURE_COMPRESSED, "zstd" },
+    { "MSCF",                         4, FileType::ARCHIVE, SIGNATURE_COMPRESSED, "CAB" },
+    { "\x89PNG\r\n\x1A\n",            8, FileType::IMAGE, SIGNATURE_COMPRESSED, "PNG" },
+    { "\xFF\xD8\xFF",                 3, FileType::IMAGE, SIGNATURE_COMPRESSED, "JPEG" },
+    { "GIF8",                         4, FileType::IMAGE, SIGNATURE_COMPRESSED, "GIF" },
+    { "BM",                           2, FileType::IMAGE, SIGNATURE_WEAK, "BMP" },
+    { "%PDF-",                        5, FileType::DOCUMENT, 0, "PDF" },
+    { "{\\rtf",                       5, FileType::DOCUMENT, 0, "RTF" },
+    { "#!",                           2, FileType::SCRIPT, 0, "shebang script" },
+    { "@echo",                        5, FileType::SCRIPT, SIGNATURE_CASELESS, "batch script" },
+    { "\xFF\xFE",                     2, FileType::DOCUMENT, SIGNATURE_WEAK, "UTF-16LE text" },
+    { "\xFE\xFF",                     2, FileType::DOCUMENT, SIGNATURE_WEAK, "UTF-16BE text" },
+    { "\xEF\xBB\xBF",                 3, FileType::DOCUMENT, SIGNATURE_WEAK, "UTF-8 text" },
+};
+
+const size_t CONTENT_SIGNATURE_COUNT = sizeof(CONTENT_SIGNATURES) / sizeof(CONTENT_SIGNATURES[0]);
+
+// Trie over all signatures, built by the compiler: next[state][byte] is the
+// following state (0 = no signature continues with that byte) and
+// accept[state] the signature ending there (-1 = none). Matching the first
+// bytes of a file is one table lookup per byte, whatever the signature count.
+struct SniffAutomaton {
+    static const size_t MAX_STATES = 96;
+    
+    uint8_t next[MAX_STATES][256];
+    int8_t accept[MAX_STATES];
+    size_t stateCount;
+    size_t depth;               // Longest signature
+};
+
+constexpr uint8_t toLowerAscii(uint8_t c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<uint8_t>(c + ('a' - 'A')) : c;
+}
+
+constexpr uint8_t toUpperAscii(uint8_t c) {
+    return (c >= 'a' && c <= 'z') ? static_cast<uint8_t>(c - ('a' - 'A')) : c;
+}
+
+constexpr SniffAutomaton buildSniffAutomaton() {
+    SniffAutomaton automaton = {};
+    for (size_t state = 0; state < SniffAutomaton::MAX_STATES; state++) {
+        automaton.accept[state] = -1;
+    }
+    automaton.stateCount = 1;  // State 0 is the root
+    
+    for (size_t index = 0; index < CONTENT_SIGNATURE_COUNT; index++) {
+        const ContentSignature& signature = CONTENT_SIGNATURES[index];
+        bool caseless = (signature.flags & SIGNATURE_CASELESS) != 0;
+        size_t state = 0;
+        
+        for (size_t i = 0; i < signature.length; i++) {
+            uint8_t byte = static_cast<uint8_t>(signature.bytes[i]);
+            uint8_t lower = caseless ? toLowerAscii(byte) : byte;
+            uint8_t upper = caseless ? toUpperAscii(byte) : byte;
+            
+            size_t next = automaton.next[state][lower];
+            if (next == 0) {
+                next = automaton.stateCount++;
+                automaton.next[state][lower] = static_cast<uint8_t>(next);
+            }
+            automaton.next[state][upper] = static_cast<uint8_t>(next);
+            state = next;
+        }
+        
+        if (automaton.accept[state] < 0) {
+            automaton.accept[state] = static_cast<int8_t>(index);
+        }
+        if (signature.length > automaton.depth) {
+            automaton.depth = signature.length;
+        }
+    }
+    
+    return automaton;
+}
+
+inline constexpr SniffAutomaton SNIFF_AUTOMATON = buildSniffAutomaton();
+
+static_assert(SNIFF_AUTOMATON.stateCount <= SniffAutomaton::MAX_STATES,
+              "raise SniffAutomaton::MAX_STATES");
+static_assert(CONTENT_SIGNATURE_COUNT < 128, "signature index must fit accept[]");
+
 class FileTypeDetector {
 public:
+    // Type from the extension alone
     static FileType detectFileType(const std::wstring& filePath) {
-        std::wstring extension = getExtension(filePath);
+        size_t length = 0;
+        const wchar_t* extension = extensionOf(filePath, length);
         
-        // Convert to lowercase for comparison
-        std::transform(extension.begin(), extension.end(), extension.begin(),
-                      [](wchar_t c) { return std::tolower(c); });
+        for (const auto& known : KNOWN_EXTENSIONS) {
+            if (equalsIgnoreCase(extension, length, known.extension)) {
+                return known.type;
+            }
+        }
+        return FileType::OTHER;
+    }
+    
+    // Type from the first bytes, with the extension deciding where content
+    // is ambiguous. A PE image is an executable whatever it is called; files
+    // named like executables that are not get their content's type; other
+    // strong signatures only type files whose extension is unknown. "MZ"
+    // alone is weak: text and data files can start with it too.
+    static FileType detectFileType(const std::wstring& filePath, const uint8_t* data, size_t size) {
+        const ContentSignature* signature = matchSignature(data, size);
+        FileType byExtension = detectFileType(filePath);
         
-        // Executables
-        if (extension == L"exe" || extension == L"com") {
+        if (signature && signature->type == FileType::EXECUTABLE && isPeImage(data, size)) {
             return FileType::EXECUTABLE;
         }
-        
-        // Scripts
-        if (extension == L"bat" || extension == L"cmd" || 
-            extension == L"ps1" || extension == L"vbs" || 
-            extension == L"js" || extension == L"py") {
-            return FileType::SCRIPT;
+        if (signature && byExtension == FileType::EXECUTABLE &&
+            !(signature->flags & SIGNATURE_WEAK)) {
+            return signature->type;
         }
-        
-        // Documents
-        if (extension == L"txt" || extension == L"pdf" || extension == L"doc" || 
-            extension == L"docx" || extension == L"rtf" || extension == L"odt") {
-            return FileType::DOCUMENT;
+        if (byExtension != FileType::OTHER) {
+            return byExtension;
         }
+        return signature ? signature->type : FileType::OTHER;
+    }
+    
+    // Longest signature matching the start of data, or nullptr
+    static const ContentSignature* matchSignature(const uint8_t* data, size_t size) {
+        size_t state = 0;
+        int match = -1;
+        size_t limit = size < SNIFF_AUTOMATON.depth ? size : SNIFF_AUTOMATON.depth;
         
-        // Archives
-        if (extension == L"zip" || extension == L"rar" || extension == L"7z" || 
-            extension == L"tar" || extension == L"gz") {
-            return FileType::ARCHIVE;
+        for (size_t i = 0; i < limit; i++) {
+            state = SNIFF_AUTOMATON.next[state][data[i]];
+            if (state == 0) {
+                break;
+            }
+            if (SNIFF_AUTOMATON.accept[state] >= 0) {
+                match = SNIFF_AUTOMATON.accept[state];
+            }
         }
         
-        // Images
-        if (extension == L"jpg" || extension == L"jpeg" || extension == L"png" || 
-            extension == L"bmp" || extension == L"gif" || extension == L"ico") {
-            return FileType::IMAGE;
+        return match < 0 ? nullptr : &CONTENT_SIGNATURES[match];
+    }
+    
+    // Whether data starts with an MZ header whose e_lfanew points, within
+    // data, at a "PE\0\0" signature
+    static bool isPeImage(const uint8_t* data, size_t size) {
+        const size_t lfanewOffset = 0x3C;
+        if (size < lfanewOffset + 4 || data[0] != 'M' || data[1] != 'Z') {
+            return false;
         }
-        
-        return FileType::OTHER;
+        uint32_t lfanew = static_cast<uint32_t>(data[lfanewOffset]) |
+                          static_cast<uint32_t>(data[lfanewOffset + 1]) << 8 |
+                          static_cast<uint32_t>(data[lfanewOffset + 2]) << 16 |
+                          static_cast<uint32_t>(data[lfanewOffset + 3]) << 24;
+        if (lfanew > size - 4) {
+            return false;
+        }
+        return data[lfanew] == 'P' && data[lfanew + 1] == 'E' && data[lfanew + 2] == 0 &&
+               data[lfanew + 3] == 0;
+    }
+    
+    // False for content that is already compressed (archives, PNG, JPEG...),
+    // which the packer stores instead of encoding again
+    static bool isCompressible(const uint8_t* data, size_t size) {
+        const ContentSignature* signature = matchSignature(data, size);
+        return !signature || !(signature->flags & SIGNATURE_COMPRESSED);
     }
     
     static std::wstring getExtension(const std::wstring& filePath) {
-        size_t dotPos = filePath.find_last_of(L'.');
-        if (dotPos == std::wstring::npos) {
-            return L"";
-        }
-        return filePath.substr(dotPos + 1);
+        size_t length = 0;
+        const wchar_t* extension = extensionOf(filePath, length);
+        return std::wstring(extension, length);
     }
     
     static std::wstring getFileTypeString(FileType type) {
@@ -68,6 +208,49 @@ public:
             default:                   return L"Unknown";
         }
     }
+
+private:
+    struct KnownExtension {
+        const wchar_t* extension;
+        FileType type;
+    };
+    
+    static constexpr KnownExtension KNOWN_EXTENSIONS[] = {
+        { L"exe", FileType::EXECUTABLE }, { L"com", FileType::EXECUTABLE },
+        { L"bat", FileType::SCRIPT }, { L"cmd", FileType::SCRIPT }, { L"ps1", FileType::SCRIPT },
+        { L"vbs", FileType::SCRIPT }, { L"js", FileType::SCRIPT }, { L"py", FileType::SCRIPT },
+        { L"txt", FileType::DOCUMENT }, { L"pdf", FileType::DOCUMENT }, { L"doc", FileType::DOCUMENT },
+        { L"docx", FileType::DOCUMENT }, { L"rtf", FileType::DOCUMENT }, { L"odt", FileType::DOCUMENT },
+        { L"zip", FileType::ARCHIVE }, { L"rar", FileType::ARCHIVE }, { L"7z", FileType::ARCHIVE },
+        { L"tar", FileType::ARCHIVE }, { L"gz", FileType::ARCHIVE },
+        { L"jpg", FileType::IMAGE }, { L"jpeg", FileType::IMAGE }, { L"png", FileType::IMAGE },
+        { L"bmp", FileType::IMAGE }, { L"gif", FileType::IMAGE }, { L"ico", FileType::IMAGE },
+    };
+    
+    // Extension without the dot, pointing into filePath; empty when the
+    // last path component has no dot
+    static const wchar_t* extensionOf(const std::wstring& filePath, size_t& length) {
+        size_t dotPos = filePath.find_last_of(L"./\\");
+        if (dotPos == std::wstring::npos || filePath[dotPos] != L'.') {
+            length = 0;
+            return filePath.c_str() + filePath.size();
+        }
+        length = filePath.size() - dotPos - 1;
+        return filePath.c_str() + dotPos + 1;
+    }
+    
+    static bool equalsIgnoreCase(const wchar_t* text, size_t length, const wchar_t* lowerCase) {
+        for (size_t i = 0; i < length; i++) {
+            wchar_t c = text[i];
+            if (c >= L'A' && c <= L'Z') {
+                c = static_cast<wchar_t>(c + (L'a' - L'A'));
+            }
+            if (lowerCase[i] == L'\0' || c != lowerCase[i]) {
+                return false;
+            }
+        }
+        return lowerCase[length] == L'\0';
+    }
 };
 
 } // namespace Packer
@@ -6,9 +6,15 @@ echo ====================================
 set MINGW_PATH=C:\Qt\Tools\mingw1310_64
 set PATH=%MINGW_PATH%\bin;%PATH%
 
+REM "build_stub.bat trace" keeps the tracing spans (see SUURSTOF_TRACE in
+REM the README); release stubs compile them out
+set TRACE_FLAGS=-DPACKER_NO_TRACE
+if /i "%1"=="trace" set TRACE_FLAGS=
+
 echo.
 echo Compiling stub.cpp...
 g++ -o stub.exe stub.cpp ^
+    %TRACE_FLAGS% ^
     -static ^
     -std=c++17 ^
     -O2 ^
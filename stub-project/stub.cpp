@@ -1,11 +1,24 @@
 #include <windows.h>
+#include <algorithm>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <string>
 #include <shellapi.h>
 #include <shlwapi.h>
 #include <tlhelp32.h>
 
+#include "../src/core/ManifestFormat.h"
+#include "../src/core/Codec.h"
+#include "../src/core/ContentHash.h"
+#include "../src/core/SharedContent.h"
+#include "../src/core/StepScheduler.h"
+#include "../src/core/Trace.h"
+
 #pragma comment(lib, "shell32.lib")
 #pragma comment(lib, "shlwapi.lib")
 
@@ -46,82 +59,46 @@ bool LaunchProcessDirect(const std::wstring& filePath, bool waitForCompletion) {
     return false;
 }
 
-// Manifest structure (must match ResourceEmbedder)
-#pragma pack(push, 1)
-struct ResourceEntry {
-    uint32_t id;
-    uint32_t offset;
-    uint32_t size;
-    uint32_t originalSize;
-    uint8_t compressed;
-    uint32_t executionOrder;
-    wchar_t extension[8];  // 16 bytes
-};
-
-struct ManifestHeader {
-    char magic[4];      // "PACK"
-    uint32_t version;
-    uint32_t entryCount;
-    uint8_t waitForPrevious;  // 1 = wait for each to finish, 0 = run all at once
-};
-#pragma pack(pop)
-
-// Marker to find resources section
-const char RESOURCE_MARKER[] = "PACKEDRES_V2";
+// Manifest wire format, shared with the builder
+using Packer::BundleTrailer;
+using Packer::ManifestRecord;
+using Packer::ManifestView;
+using Packer::ManifestSchedule;
 
-bool findResourceSection(std::vector<uint8_t>& exeData, size_t& outOffset) {
-    size_t markerSize = sizeof(RESOURCE_MARKER) - 1; // Exclude null terminator
-    
-    if (exeData.size() < markerSize + sizeof(ManifestHeader)) {
+// The payload ends with a fixed trailer, so it is found from the end of
+// the file (overlay) or of the .pack section without scanning
+bool findPayload(const uint8_t* data, size_t dataSize,
+                 const uint8_t*& payload, BundleTrailer& trailer) {
+    if (!Packer::readBundleTrailer(data, dataSize, trailer)) {
         return false;
     }
-    
-    // Search from END of file backwards to find the LAST occurrence
-    // This avoids finding markers that might be embedded in the stub itself
-    for (size_t i = exeData.size() - markerSize; i > 0; i--) {
-        if (memcmp(&exeData[i], RESOURCE_MARKER, markerSize) == 0) {
-            outOffset = i + markerSize;
-            return true;
-        }
-    }
-    return false;
+    payload = data + dataSize - trailer.payloadSize;
+    return true;
 }
 
-bool loadManifest(const std::vector<uint8_t>& exeData, size_t offset,
-                  std::vector<ResourceEntry>& entries, bool& waitForPrevious) {
-    if (offset + sizeof(ManifestHeader) > exeData.size()) {
+// Section layout: the payload is a .pack section the loader already mapped
+// into this image
+bool findPackSection(const uint8_t*& data, size_t& dataSize) {
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(GetModuleHandleW(NULL));
+    if (!base) {
         return false;
     }
     
-    const ManifestHeader* header = reinterpret_cast<const ManifestHeader*>(&exeData[offset]);
-    
-    // Check magic
-    if (memcmp(header->magic, "PACK", 4) != 0) {
-        return false;
-    }
+    auto dosHeader = reinterpret_cast<const IMAGE_DOS_HEADER*>(base);
+    auto ntHeaders = reinterpret_cast<const IMAGE_NT_HEADERS*>(base + dosHeader->e_lfanew);
+    auto sectionHeader = IMAGE_FIRST_SECTION(ntHeaders);
     
-    // Check version
-    if (header->version != 2) {
-        return false;
-    }
-    
-    // Read waitForPrevious flag
-    waitForPrevious = (header->waitForPrevious != 0);
-    
-    offset += sizeof(ManifestHeader);
-    
-    for (uint32_t i = 0; i < header->entryCount; i++) {
-        if (offset + sizeof(ResourceEntry) > exeData.size()) {
-            return false;
+    for (WORD i = 0; i < ntHeaders->FileHeader.NumberOfSections; i++) {
+        if (memcmp(sectionHeader[i].Name, ".pack\0\0", IMAGE_SIZEOF_SHORT_NAME) != 0) {
+            continue;
         }
         
-        ResourceEntry entry;
-        memcpy(&entry, &exeData[offset], sizeof(ResourceEntry));
-        entries.push_back(entry);
-        offset += sizeof(ResourceEntry);
+        data = base + sectionHeader[i].VirtualAddress;
+        dataSize = sectionHeader[i].Misc.VirtualSize;
+        return true;
     }
     
-    return true;
+    return false;
 }
 
 std::wstring getTempFilePath(int index, const wchar_t* extension) {
@@ -140,27 +117,279 @@ std::wstring getTempFilePath(int index, const wchar_t* extension) {
     return std::wstring(fileName);
 }
 
-bool extractFile(const std::vector<uint8_t>& exeData, const ResourceEntry& entry, 
-                 const std::wstring& outputPath, size_t resourceStart) {
-    size_t fileOffset = resourceStart + entry.offset;
+// Decoded solid group kept between entries; members of a group are
+// usually extracted one after another
+struct GroupCache {
+    uint32_t index;
+    std::vector<uint8_t> data;
+    
+    GroupCache() : index(UINT32_MAX) {}
+};
+
+// Resolve an entry to its stored bytes: stored entries are used in place,
+// compressed ones are decoded into 'buffer', solid ones come from 'cache'.
+// Sparse entries come back without their holes; extractFile puts them back.
+bool loadEntry(const uint8_t* data, uint64_t dataSize, const ManifestView& manifest,
+               const ManifestRecord& entry, GroupCache& cache, std::vector<uint8_t>& buffer,
+               const uint8_t*& bytes) {
+    // Delta bundles refer to another bundle's entries; they are rebuilt
+    // with suurstof-pack apply, never run
+    if (entry.flags & (Packer::MANIFEST_RECORD_BASE | Packer::MANIFEST_RECORD_DELTA)) {
+        return false;
+    }
+    
+    if (entry.flags & Packer::MANIFEST_RECORD_SOLID) {
+        if (cache.index != entry.group) {
+            Packer::ManifestGroup group;
+            cache.index = UINT32_MAX;
+            if (!manifest.group(entry.group, group) || group.dataOffset > dataSize ||
+                group.storedSize > dataSize - group.dataOffset) {
+                return false;
+            }
+            cache.data.resize(static_cast<size_t>(group.originalSize));
+            if (!Packer::decodeBlock(group.codec, data + group.dataOffset,
+                                     static_cast<size_t>(group.storedSize),
+                                     cache.data.data(), cache.data.size())) {
+                return false;
+            }
+            cache.index = entry.group;
+        }
+        if (entry.dataOffset > cache.data.size() ||
+            entry.originalSize > cache.data.size() - entry.dataOffset) {
+            return false;
+        }
+        bytes = cache.data.data() + entry.dataOffset;
+        return true;
+    }
     
-    if (fileOffset + entry.size > exeData.size()) {
+    if (entry.dataOffset > dataSize || entry.storedSize > dataSize - entry.dataOffset) {
         return false;
     }
     
+    uint64_t packedSize;
+    if (!manifest.packedSize(entry, packedSize)) {
+        return false;
+    }
+    
+    const uint8_t* stored = data + entry.dataOffset;
+    if (entry.codec == Packer::CODEC_STORE) {
+        bytes = stored;
+        return entry.storedSize == packedSize;
+    }
+    
+    buffer.resize(static_cast<size_t>(packedSize));
+    if (!Packer::decodeBlock(entry.codec, stored, static_cast<size_t>(entry.storedSize),
+                             buffer.data(), buffer.size())) {
+        return false;
+    }
+    bytes = buffer.data();
+    return true;
+}
+
+// PrefetchVirtualMemory's range entry (WIN32_MEMORY_RANGE_ENTRY), declared
+// here since the function is looked up at run time
+struct PrefetchRange {
+    PVOID address;
+    SIZE_T size;
+};
+
+typedef BOOL (WINAPI* PrefetchVirtualMemoryFn)(HANDLE, ULONG_PTR, PrefetchRange*, ULONG);
+
+// Ask for a range of the mapped payload to be read in one large request
+// before it is touched, rather than a page at a time as it faults in. Only
+// Windows 8 and later have PrefetchVirtualMemory; elsewhere this does nothing
+// and the range faults in as before.
+void prefetch(const uint8_t* data, uint64_t size) {
+    static PrefetchVirtualMemoryFn prefetchVirtualMemory = reinterpret_cast<PrefetchVirtualMemoryFn>(
+        GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "PrefetchVirtualMemory"));
+    if (!prefetchVirtualMemory || size == 0) {
+        return;
+    }
+    
+    PrefetchRange range = { const_cast<uint8_t*>(data), static_cast<SIZE_T>(size) };
+    prefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+// Prefetch the stored bytes loadEntry is about to read for an entry: its
+// own, or its group's when that is not already decoded in cache
+void prefetchEntry(const uint8_t* data, uint64_t dataSize, const ManifestView& manifest,
+                   uint32_t index, const GroupCache& cache) {
+    ManifestRecord entry;
+    if (index >= manifest.entryCount() || !manifest.entry(index, entry) ||
+        (entry.flags & (Packer::MANIFEST_RECORD_BASE | Packer::MANIFEST_RECORD_DELTA))) {
+        return;
+    }
+    
+    uint64_t offset = entry.dataOffset;
+    uint64_t size = entry.storedSize;
+    if (entry.flags & Packer::MANIFEST_RECORD_SOLID) {
+        Packer::ManifestGroup group;
+        if (entry.group == cache.index || !manifest.group(entry.group, group)) {
+            return;
+        }
+        offset = group.dataOffset;
+        size = group.storedSize;
+    }
+    
+    if (offset <= dataSize && size <= dataSize - offset) {
+        prefetch(data + offset, size);
+    }
+}
+
+// WriteFile takes a DWORD count, so large writes go out in chunks
+bool writeAll(HANDLE hFile, const uint8_t* data, uint64_t size) {
+    while (size > 0) {
+        DWORD chunk = static_cast<DWORD>(size < 0x40000000 ? size : 0x40000000);
+        DWORD written = 0;
+        if (!WriteFile(hFile, data, chunk, &written, NULL) || written != chunk) {
+            return false;
+        }
+        data += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+// Hash a sparse entry as if its holes were filled in
+uint64_t sparseHash(const uint8_t* fileData, const ManifestView& manifest, const ManifestRecord& entry) {
+    Packer::Xxh64Stream hash;
+    uint64_t position = 0;
+    for (uint32_t i = 0; i < entry.holeCount; i++) {
+        Packer::ManifestHole hole;
+        manifest.hole(entry, i, hole);
+        hash.update(fileData, static_cast<size_t>(hole.offset - position));
+        fileData += hole.offset - position;
+        hash.zeros(hole.length);
+        position = hole.offset + hole.length;
+    }
+    hash.update(fileData, static_cast<size_t>(entry.originalSize - position));
+    return hash.digest();
+}
+
+// Write the bytes between the holes at their offsets and leave the holes
+// unallocated. Volumes without sparse support (FAT) still read the skipped
+// ranges back as zeros, only without the disk space savings.
+bool writeSparse(HANDLE hFile, const uint8_t* fileData, const ManifestView& manifest,
+                 const ManifestRecord& entry) {
+    DWORD returned = 0;
+    DeviceIoControl(hFile, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &returned, NULL);
+    
+    uint64_t position = 0;
+    for (uint32_t i = 0; i <= entry.holeCount; i++) {
+        Packer::ManifestHole hole = { entry.originalSize, 0 };
+        if (i < entry.holeCount) {
+            manifest.hole(entry, i, hole);
+        }
+        
+        LARGE_INTEGER offset;
+        offset.QuadPart = static_cast<LONGLONG>(position);
+        if (!SetFilePointerEx(hFile, offset, NULL, FILE_BEGIN) ||
+            !writeAll(hFile, fileData, hole.offset - position)) {
+            return false;
+        }
+        fileData += hole.offset - position;
+        position = hole.offset + hole.length;
+    }
+    
+    LARGE_INTEGER end;
+    end.QuadPart = static_cast<LONGLONG>(entry.originalSize);
+    return SetFilePointerEx(hFile, end, NULL, FILE_BEGIN) && SetEndOfFile(hFile);
+}
+
+// fileData is what loadEntry returned; the manifest has already checked
+// that a sparse entry's holes fit its size
+bool extractFile(const uint8_t* fileData, const ManifestView& manifest, const ManifestRecord& entry,
+                 const std::wstring& outputPath) {
+    bool sparse = (entry.flags & Packer::MANIFEST_RECORD_SPARSE) != 0;
+    
+    // Never run a damaged file
+    if (entry.flags & Packer::MANIFEST_RECORD_HASH) {
+        uint64_t hash = sparse ? sparseHash(fileData, manifest, entry)
+                               : Packer::xxh64(fileData, static_cast<size_t>(entry.originalSize));
+        if (hash != entry.contentHash) {
+            return false;
+        }
+    }
+    
     HANDLE hFile = CreateFileW(outputPath.c_str(), GENERIC_WRITE, 0, NULL, 
                                CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
     if (hFile == INVALID_HANDLE_VALUE) {
         return false;
     }
     
-    DWORD written;
-    WriteFile(hFile, &exeData[fileOffset], entry.size, &written, NULL);
+    bool ok = sparse ? writeSparse(hFile, fileData, manifest, entry)
+                     : writeAll(hFile, fileData, entry.originalSize);
     CloseHandle(hFile);
     
-    return written == entry.size;
+    return ok;
 }
 
+// SharedContent's file operations on the temp directory. Held files stay
+// open without write sharing; hashing reads through a handle of its own.
+class TempFiles : public Packer::SharedFiles {
+public:
+    TempFiles() {}
+    
+    ~TempFiles() {
+        for (auto& held : m_held) {
+            CloseHandle(held.second);
+        }
+    }
+    
+    TempFiles(const TempFiles&) = delete;
+    TempFiles& operator=(const TempFiles&) = delete;
+    
+    bool hardLink(const std::wstring& source, const std::wstring& path) override {
+        return CreateHardLinkW(path.c_str(), source.c_str(), NULL) != FALSE;
+    }
+    
+    bool copy(const std::wstring& source, const std::wstring& path) override {
+        return CopyFileW(source.c_str(), path.c_str(), FALSE) != FALSE;
+    }
+    
+    void remove(const std::wstring& path) override {
+        DeleteFileW(path.c_str());
+    }
+    
+    void hold(const std::wstring& path) override {
+        HANDLE guard = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                                   NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (guard != INVALID_HANDLE_VALUE) {
+            m_held[path] = guard;
+        }
+    }
+    
+    void unhold(const std::wstring& path) override {
+        auto held = m_held.find(path);
+        if (held != m_held.end()) {
+            CloseHandle(held->second);
+            m_held.erase(held);
+        }
+    }
+    
+    bool hash(const std::wstring& path, uint64_t& hash) override {
+        HANDLE hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                                   NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        Packer::Xxh64Stream stream;
+        std::vector<uint8_t> chunk(1 << 20);
+        DWORD read = 0;
+        bool ok;
+        while ((ok = ReadFile(hFile, chunk.data(), static_cast<DWORD>(chunk.size()), &read, NULL) != FALSE) &&
+               read != 0) {
+            stream.update(chunk.data(), read);
+        }
+        CloseHandle(hFile);
+        hash = stream.digest();
+        return ok;
+    }
+
+private:
+    std::map<std::wstring, HANDLE> m_held;  // Callers hold SharedContent's lock
+};
+
 bool executeFile(const std::wstring& filePath, const wchar_t* extension, bool waitForCompletion) {
     // Check if it's an executable or script
     bool isExecutable = false;
@@ -319,74 +548,279 @@ bool executeFile(const std::wstring& filePath, const wchar_t* extension, bool wa
     return false;
 }
 
-int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, 
-                   PWSTR pCmdLine, int nCmdShow) {
-    // Load this executable
-    wchar_t exePath[MAX_PATH];
-    GetModuleFileNameW(NULL, exePath, MAX_PATH);
+// Decode one entry and write it to its temp file, or link it to an
+// earlier copy of the same content
+bool extractStep(const uint8_t* fileData, uint64_t dataSize, const ManifestView& manifest,
+                 uint32_t index, GroupCache& cache, std::vector<uint8_t>& buffer,
+                 Packer::SharedContent& shared, std::wstring& tempFile, std::wstring& extension) {
+    ManifestRecord entry;
+    if (!manifest.entry(index, entry)) {
+        return false;
+    }
     
-    HANDLE hFile = CreateFileW(exePath, GENERIC_READ, FILE_SHARE_READ, NULL,
-                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (hFile == INVALID_HANDLE_VALUE) {
-        return 1;
+    extension = manifest.extension(entry);
+    tempFile = getTempFilePath(static_cast<int>(index), extension.c_str());
+    
+    {
+        TRACE_SPAN("link", tempFile);
+        if (shared.link(index, tempFile)) {
+            return true;
+        }
     }
     
-    DWORD fileSize = GetFileSize(hFile, NULL);
-    std::vector<uint8_t> exeData(fileSize);
+    const uint8_t* bytes = nullptr;
+    bool extracted;
+    {
+        TRACE_SPAN("decode", manifest.string(entry.name));
+        extracted = loadEntry(fileData, dataSize, manifest, entry, cache, buffer, bytes);
+    }
+    if (extracted) {
+        TRACE_SPAN("write", tempFile);
+        extracted = extractFile(bytes, manifest, entry, tempFile);
+    }
+    if (extracted) {
+        shared.written(index, tempFile);
+    }
+    return extracted;
+}
+
+// Launcher of a scheduled bundle. Steps are extracted one at a time on the
+// scheduler's thread, which owns the group cache; each then runs and is
+// waited for on a thread of its own, so any number can run at once.
+class StubLauncher : public Packer::StepLauncher {
+public:
+    StubLauncher(const uint8_t* fileData, uint64_t dataSize, const ManifestView& manifest,
+                 Packer::SharedContent& shared)
+        : m_fileData(fileData), m_dataSize(dataSize), m_manifest(manifest), m_shared(shared) {}
+    
+    ~StubLauncher() {
+        for (std::thread& thread : m_threads) {
+            thread.join();
+        }
+    }
     
-    DWORD bytesRead;
-    ReadFile(hFile, exeData.data(), fileSize, &bytesRead, NULL);
-    CloseHandle(hFile);
+    bool start(uint32_t step, bool& running) override {
+        std::wstring tempFile;
+        std::wstring extension;
+        if (!m_shared.available(step)) {
+            prefetchEntry(m_fileData, m_dataSize, m_manifest, step, m_cache);
+        }
+        if (!extractStep(m_fileData, m_dataSize, m_manifest, step, m_cache, m_buffer, m_shared,
+                         tempFile, extension)) {
+            return false;
+        }
+        
+        m_threads.emplace_back([this, step, tempFile, extension] {
+            TRACE_THREAD("step");
+            bool executed;
+            {
+                TRACE_SPAN("execute", tempFile);
+                executed = executeFile(tempFile, extension.c_str(), true);
+            }
+            if (!executed) {
+                wchar_t msg[256];
+                swprintf_s(msg, 256, L"Failed to execute file %u: %s", step + 1, tempFile.c_str());
+                MessageBoxW(NULL, msg, L"Error", MB_ICONERROR);
+            }
+            m_shared.release(step, tempFile);
+            
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_finished.push_back(step);
+            m_changed.notify_one();
+        });
+        running = true;
+        return true;
+    }
     
-    if (bytesRead != fileSize) {
-        MessageBoxW(NULL, L"Failed to read executable", L"Error", MB_ICONERROR);
-        return 1;
+    bool waitAny(uint32_t& step) override {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [this] { return !m_finished.empty(); });
+        step = m_finished.front();
+        m_finished.pop_front();
+        return true;
+    }
+
+private:
+    const uint8_t* m_fileData;
+    uint64_t m_dataSize;
+    const ManifestView& m_manifest;
+    Packer::SharedContent& m_shared;
+    GroupCache m_cache;
+    std::vector<uint8_t> m_buffer;
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::deque<uint32_t> m_finished;
+};
+
+#ifndef PACKER_NO_TRACE
+// Trace builds record a run when SUURSTOF_TRACE names an output file; the
+// trace is written however wWinMain returns
+struct TraceSession {
+    wchar_t path[MAX_PATH];
+    bool active;
+    
+    TraceSession() : active(false) {
+        DWORD length = GetEnvironmentVariableW(L"SUURSTOF_TRACE", path, MAX_PATH);
+        if (length > 0 && length < MAX_PATH) {
+            active = true;
+            Packer::Tracer::instance().enable(2, "stub");
+            TRACE_THREAD("stub main");
+        }
     }
     
-    // Find resources
-    size_t resourceOffset;
-    if (!findResourceSection(exeData, resourceOffset)) {
+    ~TraceSession() {
+        if (!active) {
+            return;
+        }
+        std::string json;
+        Packer::Tracer::instance().exportJson(json);
+        HANDLE hFile = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                                   FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile != INVALID_HANDLE_VALUE) {
+            DWORD written = 0;
+            WriteFile(hFile, json.data(), static_cast<DWORD>(json.size()), &written, NULL);
+            CloseHandle(hFile);
+        }
+    }
+};
+#endif
+
+int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, 
+                   PWSTR pCmdLine, int nCmdShow) {
+#ifndef PACKER_NO_TRACE
+    TraceSession traceSession;
+#endif
+    
+    // Locate the payload from its trailer
+    const uint8_t* payload = nullptr;
+    BundleTrailer trailer;
+    bool found;
+    {
+        TRACE_SPAN("find payload");
+        const uint8_t* image = nullptr;
+        size_t imageSize = 0;
+        
+        // Section layout needs no file I/O: read straight from the mapped image
+        if (!findPackSection(image, imageSize)) {
+            // Overlay layout: map this executable and read it in place
+            wchar_t exePath[MAX_PATH];
+            GetModuleFileNameW(NULL, exePath, MAX_PATH);
+            
+            HANDLE hFile = CreateFileW(exePath, GENERIC_READ, FILE_SHARE_READ, NULL,
+                                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (hFile == INVALID_HANDLE_VALUE) {
+                return 1;
+            }
+            
+            LARGE_INTEGER fileSize;
+            HANDLE hMapping = NULL;
+            if (GetFileSizeEx(hFile, &fileSize)) {
+                hMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+            }
+            CloseHandle(hFile);
+            
+            // The view stays valid after the mapping handle is closed
+            const void* view = hMapping ? MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+            if (hMapping) {
+                CloseHandle(hMapping);
+            }
+            
+            if (!view) {
+                MessageBoxW(NULL, L"Failed to read executable", L"Error", MB_ICONERROR);
+                return 1;
+            }
+            
+            image = static_cast<const uint8_t*>(view);
+            imageSize = static_cast<size_t>(fileSize.QuadPart);
+        }
+        
+        found = findPayload(image, imageSize, payload, trailer);
+    }
+    if (!found) {
         return 0;
     }
     
-    // Load manifest
-    std::vector<ResourceEntry> entries;
-    bool waitForPrevious = true;  // Default to true
-    if (!loadManifest(exeData, resourceOffset, entries, waitForPrevious)) {
+    // Open manifest in place - records are decoded one at a time below
+    ManifestView manifest;
+    bool manifestOpened;
+    {
+        TRACE_SPAN("parse manifest");
+        prefetch(payload + trailer.manifestOffset, trailer.manifestSize);
+        manifestOpened = manifest.open(payload + trailer.manifestOffset, trailer.manifestSize);
+    }
+    if (!manifestOpened) {
         return 1;
     }
     
-    if (entries.empty()) {
+    if (manifest.entryCount() == 0) {
         return 0;
     }
     
-    // Calculate where file data starts (after manifest)
-    size_t manifestSize = sizeof(ManifestHeader) + (entries.size() * sizeof(ResourceEntry));
-    size_t fileDataStart = resourceOffset + manifestSize;
-    
-    // Validate file data range
-    if (fileDataStart >= exeData.size()) {
-        return 1;
+    const uint8_t* fileData = payload + trailer.dataOffset;
+    
+    // Outlives the launcher below, whose step threads release into it
+    TempFiles tempFiles;
+    Packer::SharedContent shared(tempFiles);
+    shared.init(manifest);
+    
+    // A dependency graph starts each step once those it waits for are done
+    ManifestSchedule schedule;
+    if (manifest.schedule(schedule)) {
+        std::vector<std::pair<uint32_t, uint32_t>> edges;
+        for (uint32_t d = 0; d < manifest.dependencyCount(); d++) {
+            Packer::ManifestDependency edge;
+            if (!manifest.dependency(d, edge)) {
+                return 1;
+            }
+            edges.push_back(std::make_pair(edge.entry, edge.dependsOn));
+        }
+        
+        Packer::StepScheduler scheduler;
+        if (!scheduler.init(manifest.entryCount(), edges, schedule.maxParallel)) {
+            return 1;
+        }
+        StubLauncher launcher(fileData, trailer.dataSize, manifest, shared);
+        scheduler.run(launcher);
+        return 0;
     }
     
+    bool waitForPrevious = manifest.waitForPrevious();
+    GroupCache groupCache;
+    std::vector<uint8_t> entryBuffer;
+    
+    // Only the data of the entry about to run is read ahead; the next one is
+    // read while it runs
+    prefetchEntry(fileData, trailer.dataSize, manifest, 0, groupCache);
+    
     // Extract and execute each file in order
-    for (size_t i = 0; i < entries.size(); i++) {
-        std::wstring tempFile = getTempFilePath(static_cast<int>(i), entries[i].extension);
-        
-        if (!extractFile(exeData, entries[i], tempFile, fileDataStart)) {
+    for (uint32_t i = 0; i < manifest.entryCount(); i++) {
+        std::wstring tempFile;
+        std::wstring extension;
+        bool extracted = extractStep(fileData, trailer.dataSize, manifest, i, groupCache,
+                                     entryBuffer, shared, tempFile, extension);
+        if (!shared.available(i + 1)) {
+            prefetchEntry(fileData, trailer.dataSize, manifest, i + 1, groupCache);
+        }
+        if (!extracted) {
             continue;
         }
         
         // Use waitForPrevious flag from manifest
-        if (!executeFile(tempFile, entries[i].extension, waitForPrevious)) {
+        bool executed;
+        {
+            TRACE_SPAN("execute", tempFile);
+            executed = executeFile(tempFile, extension.c_str(), waitForPrevious);
+        }
+        if (!executed) {
             wchar_t msg[256];
-            swprintf_s(msg, 256, L"Failed to execute file %zu: %s", i + 1, tempFile.c_str());
+            swprintf_s(msg, 256, L"Failed to execute file %u: %s", i + 1, tempFile.c_str());
             MessageBoxW(NULL, msg, L"Error", MB_ICONERROR);
         }
         
         // Delete temp file after execution completes (or immediately if not waiting)
         if (waitForPrevious) {
-            DeleteFileW(tempFile.c_str());
+            shared.release(i, tempFile);
         }
         // Note: If not waiting, temp files will remain until system cleanup
     }
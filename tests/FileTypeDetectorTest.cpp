@@ -0,0 +1,64 @@
+// FileTypeDetector on files starting with "MZ": a PE image is an executable
+// whatever it is called, anything else that happens to start with those
+// bytes keeps the type of its extension.
+
+#include "TestCheck.h"
+#include "FileTypeDetector.h"
+#include <vector>
+
+using namespace Packer;
+
+namespace {
+
+// MZ header with e_lfanew at 0x80 and, if pe, "PE\0\0" there
+std::vector<uint8_t> mzFile(bool pe, uint32_t lfanew = 0x80, size_t size = 0x200) {
+    std::vector<uint8_t> data(size, 0);
+    data[0] = 'M';
+    data[1] = 'Z';
+    for (int i = 0; i < 4; i++) {
+        data[0x3C + i] = static_cast<uint8_t>(lfanew >> (8 * i));
+    }
+    if (pe && static_cast<size_t>(lfanew) + 4 <= size) {
+        data[lfanew] = 'P';
+        data[lfanew + 1] = 'E';
+    }
+    return data;
+}
+
+FileType typeOf(const wchar_t* name, const std::vector<uint8_t>& data) {
+    return FileTypeDetector::detectFileType(name, data.data(), data.size());
+}
+
+} // namespace
+
+int main() {
+    // A real PE image overrides the extension
+    std::vector<uint8_t> image = mzFile(true);
+    CHECK(FileTypeDetector::isPeImage(image.data(), image.size()));
+    CHECK(typeOf(L"setup.exe", image) == FileType::EXECUTABLE);
+    CHECK(typeOf(L"payload.dat", image) == FileType::EXECUTABLE);
+    CHECK(typeOf(L"renamed.txt", image) == FileType::EXECUTABLE);
+    
+    // "MZ" without a PE header is only a hint
+    std::vector<uint8_t> text = { 'M', 'Z', ' ', 'i', 's', ' ', 'a', ' ', 'p', 'o', 's', 't', 'c', 'o', 'd', 'e' };
+    CHECK(!FileTypeDetector::isPeImage(text.data(), text.size()));
+    CHECK(typeOf(L"notes.txt", text) == FileType::DOCUMENT);
+    CHECK(typeOf(L"run.bat", text) == FileType::SCRIPT);
+    CHECK(typeOf(L"tool.exe", text) == FileType::EXECUTABLE);
+    
+    std::vector<uint8_t> noSignature = mzFile(false);
+    CHECK(typeOf(L"readme.txt", noSignature) == FileType::DOCUMENT);
+    
+    // e_lfanew past the sniffed bytes, or reaching past their end
+    std::vector<uint8_t> far = mzFile(true, 0x1000);
+    CHECK(!FileTypeDetector::isPeImage(far.data(), far.size()));
+    CHECK(typeOf(L"data.txt", far) == FileType::DOCUMENT);
+    std::vector<uint8_t> edge = mzFile(true, 0x1FE);
+    CHECK(!FileTypeDetector::isPeImage(edge.data(), edge.size()));
+    std::vector<uint8_t> last = mzFile(true, 0x1FC);
+    CHECK(FileTypeDetector::isPeImage(last.data(), last.size()));
+    std::vector<uint8_t> huge = mzFile(true, 0xFFFFFFFE);
+    CHECK(!FileTypeDetector::isPeImage(huge.data(), huge.size()));
+    
+    return Packer::Test::testResult("FileTypeDetectorTest");
+}
@@ -0,0 +1,110 @@
+// Wire schemas: the bulk copy for records laid out as the wire, the copy
+// per field for records the compiler padded, and both agreeing on bytes;
+// names outside the BMP through the manifest and through UTF-8.
+
+#include "TestCheck.h"
+#include "ManifestFormat.h"
+#include "ManifestWriter.h"
+#include "FileIO.h"
+
+using namespace Packer;
+
+namespace {
+
+// Same wire record as ManifestGroup, but with natural alignment: codec and
+// entryCount swapped in memory and padding after them
+struct PaddedGroup {
+    uint64_t dataOffset;
+    uint32_t entryCount;
+    uint64_t storedSize;
+    uint64_t originalSize;
+    uint32_t codec;
+};
+
+typedef WireSchema<PaddedGroup,
+    WIRE_FIELD(PaddedGroup, dataOffset,    0),
+    WIRE_FIELD(PaddedGroup, storedSize,    8),
+    WIRE_FIELD(PaddedGroup, originalSize, 16),
+    WIRE_FIELD(PaddedGroup, codec,        24),
+    WIRE_FIELD(PaddedGroup, entryCount,   28)
+> PaddedGroupSchema;
+
+static_assert(ManifestGroupSchema::inPlace(), "packed records are copied whole");
+static_assert(!PaddedGroupSchema::inPlace(), "padded records are copied per field");
+static_assert(PaddedGroupSchema::size == ManifestGroupSchema::size, "same wire size");
+
+} // namespace
+
+int main() {
+    ManifestGroup groups[2] = {
+        { 0x1122334455667788ull, 100, 200, 3, 7 },
+        { 1, 2, 3, 4, 5 },
+    };
+    PaddedGroup padded[2] = {
+        { 0x1122334455667788ull, 7, 100, 200, 3 },
+        { 1, 5, 2, 3, 4 },
+    };
+    
+    std::vector<uint8_t> packedBytes;
+    std::vector<uint8_t> paddedBytes;
+    WireCodec<ManifestGroup>::encode(groups, 2, packedBytes);
+    PaddedGroupSchema::encode(padded, 2, paddedBytes);
+    CHECK_EQ(packedBytes.size(), 2 * ManifestGroupSchema::size);
+    CHECK(packedBytes == paddedBytes);
+    CHECK_EQ(packedBytes[24], 3);   // codec, low byte
+    CHECK_EQ(packedBytes[28], 7);   // entryCount, low byte
+    
+    PaddedGroup decoded[2] = {};
+    CHECK(PaddedGroupSchema::decode(packedBytes.data(), packedBytes.size(), 2, decoded));
+    CHECK_EQ(decoded[0].dataOffset, 0x1122334455667788ull);
+    CHECK_EQ(decoded[0].entryCount, 7u);
+    CHECK_EQ(decoded[1].storedSize, 2u);
+    CHECK_EQ(decoded[1].codec, 4u);
+    CHECK(!PaddedGroupSchema::decode(packedBytes.data(), packedBytes.size() - 1, 2, decoded));
+    
+    // A trailer written through its schema reads back through it
+    BundleTrailer trailer = makeBundleTrailer(1000, 10, 20, 40, 900);
+    std::vector<uint8_t> payload(1000, 0);
+    WireCodec<BundleTrailer>::encode(&trailer, 1, payload);
+    BundleTrailer read;
+    CHECK(readBundleTrailer(payload.data(), payload.size(), read));
+    CHECK_EQ(read.payloadSize, payload.size());
+    CHECK_EQ(read.manifestSize, 20u);
+    CHECK_EQ(read.dataSize, 900u);
+    
+    // Names outside the BMP are stored as surrogate pairs and read back
+    // whole, whatever the size of wchar_t
+    std::wstring name = std::wstring(L"setup-") + static_cast<wchar_t>(0x1F4E6) + L".exe";
+    std::wstring path = std::wstring(L"tools/") + name;
+    ManifestWriter writer;
+    ManifestRecord record = {};
+    record.originalSize = 1;
+    writer.addEntry(record, name, path);
+    std::vector<uint8_t> manifest;
+    CHECK(writer.write(true, manifest));
+    ManifestView view;
+    ManifestRecord entry;
+    uint32_t index = 1;
+    CHECK(view.open(manifest.data(), manifest.size()));
+    CHECK(view.entry(0, entry));
+    CHECK(view.string(entry.name) == name);
+    CHECK(view.string(entry.path) == path);
+    CHECK(view.extension(entry) == L".exe");
+    CHECK(view.find(path, index) && index == 0);
+    
+    // The same name through UTF-8 and back, whatever the locale
+    std::string utf8 = FileIO::toUtf8(name);
+    CHECK(utf8 == "setup-\xF0\x9F\x93\xA6.exe");
+    CHECK(FileIO::fromUtf8(utf8) == name);
+    CHECK(FileIO::fromNative(FileIO::nativePath(path)) == path);
+    CHECK(FileIO::fromUtf8("h\xC3\xA9llo") == L"h\u00E9llo");
+    
+    // Malformed input is replaced, not thrown on: a stray continuation
+    // byte, an overlong form, a truncated sequence and a surrogate
+    CHECK(FileIO::fromUtf8("a\x80" "b") == L"a\uFFFDb");
+    CHECK(FileIO::fromUtf8("\xC0\xAF") == L"\uFFFD\uFFFD");
+    CHECK(FileIO::fromUtf8("\xE2\x82") == L"\uFFFD");
+    CHECK(FileIO::fromUtf8("\xED\xA0\x80") == L"\uFFFD");
+    
+    return Packer::Test::testResult("ManifestFormatTest");
+}
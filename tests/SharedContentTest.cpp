@@ -0,0 +1,251 @@
+// SharedContent against in-memory files: which entries share a first copy,
+// hard links and the copy fallback, the first copy kept until the last
+// sharer exists, and a first copy that no longer matches its hash.
+
+#include "TestCheck.h"
+#include "SharedContent.h"
+#include "ContentHash.h"
+#include "ManifestWriter.h"
+#include <map>
+#include <set>
+
+using namespace Packer;
+
+namespace {
+
+class FakeFiles : public SharedFiles {
+public:
+    FakeFiles() : linkFails(false), copyFails(false), hashes(0) {}
+    
+    std::map<std::wstring, std::string> files;
+    std::set<std::wstring> held;
+    std::vector<std::string> calls;     // "link t1", "copy t1", "remove t1", ...
+    bool linkFails;
+    bool copyFails;
+    int hashes;
+    
+    bool hardLink(const std::wstring& source, const std::wstring& path) override {
+        calls.push_back("link " + name(path));
+        if (linkFails || files.count(path) || !files.count(source)) {
+            return false;
+        }
+        files[path] = files[source];
+        return true;
+    }
+    
+    bool copy(const std::wstring& source, const std::wstring& path) override {
+        calls.push_back("copy " + name(path));
+        if (copyFails || !files.count(source)) {
+            return false;
+        }
+        files[path] = files[source];
+        return true;
+    }
+    
+    void remove(const std::wstring& path) override {
+        calls.push_back("remove " + name(path));
+        CHECK(!held.count(path));   // Windows would refuse while it is held open
+        files.erase(path);
+    }
+    
+    void hold(const std::wstring& path) override {
+        held.insert(path);
+    }
+    
+    void unhold(const std::wstring& path) override {
+        CHECK(held.erase(path) == 1);
+    }
+    
+    bool hash(const std::wstring& path, uint64_t& hash) override {
+        hashes++;
+        auto file = files.find(path);
+        if (file == files.end()) {
+            return false;
+        }
+        hash = xxh64(file->second.data(), file->second.size());
+        return true;
+    }
+    
+    // The step wrote an entry out in full
+    void write(const std::wstring& path, const std::string& content) {
+        files[path] = content;
+    }
+    
+    bool called(const std::string& call) const {
+        for (const std::string& made : calls) {
+            if (made == call) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    static std::string name(const std::wstring& path) {
+        return std::string(path.begin(), path.end());
+    }
+};
+
+const std::string CONTENT = "shared runtime";
+
+// Entries 0-2 share CONTENT. 3 is different, 4 has CONTENT's hash but
+// another size, and 5 has CONTENT without a hash, so none of those share.
+void makeManifest(std::vector<uint8_t>& data, ManifestView& manifest) {
+    uint64_t hash = xxh64(CONTENT.data(), CONTENT.size());
+    struct { uint64_t hash; uint64_t size; bool hashed; } entries[] = {
+        { hash, CONTENT.size(), true },
+        { hash, CONTENT.size(), true },
+        { hash, CONTENT.size(), true },
+        { hash + 1, CONTENT.size(), true },
+        { hash, CONTENT.size() + 1, true },
+        { hash, CONTENT.size(), false },
+    };
+    ManifestWriter writer;
+    for (size_t i = 0; i < sizeof(entries) / sizeof(entries[0]); i++) {
+        ManifestRecord record = {};
+        record.originalSize = entries[i].size;
+        record.contentHash = entries[i].hash;
+        record.flags = entries[i].hashed ? MANIFEST_RECORD_HASH : 0;
+        std::wstring name = L"e" + std::to_wstring(i) + L".exe";
+        writer.addEntry(record, name, name);
+    }
+    CHECK(writer.write(true, data));
+    CHECK(manifest.open(data.data(), data.size()));
+}
+
+void checkLinks(bool hardLinks) {
+    std::vector<uint8_t> data;
+    ManifestView manifest;
+    makeManifest(data, manifest);
+    FakeFiles files;
+    files.linkFails = !hardLinks;
+    
+    {
+        SharedContent shared(files);
+        shared.init(manifest);
+        CHECK(!shared.available(1));
+        CHECK(!shared.link(0, L"t0"));
+        
+        // The first copy written is the one the others link to
+        files.write(L"t0", CONTENT);
+        shared.written(0, L"t0");
+        CHECK(files.held.count(L"t0") == 1);
+        CHECK(shared.available(1));
+        CHECK(shared.available(2));
+        CHECK(!shared.available(3));
+        CHECK(!shared.available(4));
+        CHECK(!shared.available(5));
+        
+        // Its step finishes first; it stays until every sharer exists
+        shared.release(0, L"t0");
+        CHECK(files.files.count(L"t0") == 1);
+        
+        files.write(L"t1", "leftover");
+        CHECK(shared.link(1, L"t1"));
+        CHECK(files.files[L"t1"] == CONTENT);
+        CHECK(files.called("remove t1"));
+        CHECK(files.called(hardLinks ? "link t1" : "copy t1"));
+        CHECK(files.files.count(L"t0") == 1);
+        
+        CHECK(shared.link(2, L"t2"));
+        CHECK(files.files[L"t2"] == CONTENT);
+        CHECK_EQ(files.hashes, 1);      // Checked once, before the first link
+        CHECK(files.held.empty());
+        CHECK(files.files.count(L"t0") == 0);
+        CHECK(!shared.available(2));
+        
+        shared.release(1, L"t1");
+        shared.release(2, L"t2");
+        CHECK(files.files.empty());
+    }
+    CHECK(files.held.empty());
+}
+
+void checkNoLinkOrCopy() {
+    std::vector<uint8_t> data;
+    ManifestView manifest;
+    makeManifest(data, manifest);
+    FakeFiles files;
+    SharedContent shared(files);
+    shared.init(manifest);
+    
+    files.write(L"t0", CONTENT);
+    shared.written(0, L"t0");
+    
+    // Neither works: the entry is written out and counts as created
+    files.linkFails = true;
+    files.copyFails = true;
+    CHECK(!shared.link(1, L"t1"));
+    files.write(L"t1", CONTENT);
+    shared.written(1, L"t1");
+    CHECK(files.held.count(L"t0") == 1);
+    CHECK(files.held.count(L"t1") == 0);
+    
+    files.linkFails = false;
+    CHECK(shared.link(2, L"t2"));
+    CHECK(files.held.empty());
+    shared.release(0, L"t0");
+    shared.release(1, L"t1");
+    shared.release(2, L"t2");
+    CHECK(files.files.empty());
+}
+
+void checkChangedFirstCopy() {
+    std::vector<uint8_t> data;
+    ManifestView manifest;
+    makeManifest(data, manifest);
+    FakeFiles files;
+    SharedContent shared(files);
+    shared.init(manifest);
+    
+    files.write(L"t0", CONTENT);
+    shared.written(0, L"t0");
+    shared.release(0, L"t0");
+    files.files[L"t0"] = "shared runtimX";
+    
+    // Not linked to; the content is no longer shared and every other
+    // sharer is written out
+    CHECK(!shared.link(1, L"t1"));
+    CHECK(!files.called("link t1") && !files.called("copy t1"));
+    CHECK(files.held.empty());
+    CHECK(files.files.count(L"t0") == 0);
+    CHECK(!shared.available(2));
+    CHECK(!shared.link(2, L"t2"));
+    for (uint32_t i = 1; i <= 2; i++) {
+        std::wstring path = L"t" + std::to_wstring(i);
+        files.write(path, CONTENT);
+        shared.written(i, path);
+        shared.release(i, path);
+    }
+    CHECK(files.held.empty());
+    CHECK(files.files.empty());
+}
+
+void checkUnfinished() {
+    std::vector<uint8_t> data;
+    ManifestView manifest;
+    makeManifest(data, manifest);
+    FakeFiles files;
+    {
+        // The other sharers never ran: the first copy goes with the stub
+        SharedContent shared(files);
+        shared.init(manifest);
+        files.write(L"t0", CONTENT);
+        shared.written(0, L"t0");
+        shared.release(0, L"t0");
+        CHECK(files.files.count(L"t0") == 1);
+    }
+    CHECK(files.held.empty());
+    CHECK(files.files.empty());
+}
+
+} // namespace
+
+int main() {
+    checkLinks(true);
+    checkLinks(false);
+    checkNoLinkOrCopy();
+    checkChangedFirstCopy();
+    checkUnfinished();
+    return Packer::Test::testResult("SharedContentTest");
+}
@@ -0,0 +1,177 @@
+// StepScheduler against a fake launcher on a simulated clock: each step
+// takes a fixed time, and waitAny returns the running step that ends first.
+
+#include "TestCheck.h"
+#include "StepScheduler.h"
+#include <algorithm>
+#include <set>
+
+using namespace Packer;
+
+namespace {
+
+typedef std::vector<std::pair<uint32_t, uint32_t>> Edges;
+
+const uint32_t NOT_YET = 0xFFFFFFFF;    // Not started, or not ended
+
+class FakeLauncher : public StepLauncher {
+public:
+    explicit FakeLauncher(const std::vector<uint32_t>& durations)
+        : m_durations(durations), m_now(0), m_maxRunning(0),
+          m_started(durations.size(), NOT_YET), m_ended(durations.size(), NOT_YET) {}
+    
+    // Steps that fail to start, and steps that finish as soon as they start
+    std::set<uint32_t> failing;
+    std::set<uint32_t> instant;
+    std::vector<uint32_t> order;    // Steps in the order they were started
+    
+    bool start(uint32_t step, bool& running) override {
+        order.push_back(step);
+        if (failing.count(step)) {
+            return false;
+        }
+        m_started[step] = m_now;
+        if (instant.count(step)) {
+            m_ended[step] = m_now;
+            running = false;
+            return true;
+        }
+        m_running.insert(step);
+        m_maxRunning = std::max<size_t>(m_maxRunning, m_running.size());
+        running = true;
+        return true;
+    }
+    
+    bool waitAny(uint32_t& step) override {
+        if (m_running.empty()) {
+            return false;
+        }
+        // Earliest end, lowest index on a tie
+        auto next = m_running.begin();
+        for (auto it = m_running.begin(); it != m_running.end(); ++it) {
+            if (end(*it) < end(*next)) {
+                next = it;
+            }
+        }
+        step = *next;
+        m_now = end(step);
+        m_ended[step] = m_now;
+        m_running.erase(next);
+        return true;
+    }
+    
+    uint32_t now() const { return m_now; }
+    size_t maxRunning() const { return m_maxRunning; }
+    uint32_t started(uint32_t step) const { return m_started[step]; }
+    uint32_t ended(uint32_t step) const { return m_ended[step]; }
+
+private:
+    uint32_t end(uint32_t step) const { return m_started[step] + m_durations[step]; }
+    
+    std::vector<uint32_t> m_durations;
+    uint32_t m_now;
+    size_t m_maxRunning;
+    std::set<uint32_t> m_running;
+    std::vector<uint32_t> m_started;
+    std::vector<uint32_t> m_ended;
+};
+
+// 0 -> {1, 2} -> 3, with 0 -> 1 -> 3 the long path
+const std::vector<uint32_t> DIAMOND_TIMES = { 1, 5, 2, 1 };
+const Edges DIAMOND = { {1, 0}, {2, 0}, {3, 1}, {3, 2} };
+
+void checkDiamond() {
+    StepScheduler scheduler;
+    CHECK(scheduler.init(4, DIAMOND, 0));
+    FakeLauncher launcher(DIAMOND_TIMES);
+    scheduler.run(launcher);
+    
+    // Both branches start as 0 ends; 3 waits for the longer one only
+    CHECK_EQ(launcher.started(1), 1u);
+    CHECK_EQ(launcher.started(2), 1u);
+    CHECK_EQ(launcher.ended(2), 3u);
+    CHECK_EQ(launcher.started(3), 6u);
+    CHECK_EQ(launcher.now(), 7u);    // Critical path, not the sum (9)
+    CHECK_EQ(launcher.maxRunning(), 2u);
+}
+
+void checkSequential() {
+    StepScheduler scheduler;
+    CHECK(scheduler.init(4, DIAMOND, 1));
+    FakeLauncher launcher(DIAMOND_TIMES);
+    scheduler.run(launcher);
+    
+    CHECK_EQ(launcher.maxRunning(), 1u);
+    CHECK(launcher.order == std::vector<uint32_t>({0, 1, 2, 3}));
+    CHECK_EQ(launcher.now(), 9u);
+    for (uint32_t s = 1; s < 4; s++) {
+        CHECK(launcher.started(s) >= launcher.ended(s - 1));
+    }
+}
+
+void checkCapped() {
+    // Twelve steps of mixed length, 11 waiting for 0 and 5
+    std::vector<uint32_t> times = { 3, 1, 4, 1, 5, 9, 2, 6, 5, 3, 5, 8 };
+    Edges edges = { {11, 0}, {11, 5} };
+    for (uint32_t cap : {2u, 3u, 5u}) {
+        StepScheduler scheduler;
+        CHECK(scheduler.init(static_cast<uint32_t>(times.size()), edges, cap));
+        FakeLauncher launcher(times);
+        scheduler.run(launcher);
+        
+        CHECK_EQ(launcher.maxRunning(), static_cast<size_t>(cap));
+        CHECK_EQ(launcher.order.size(), times.size());
+        CHECK(launcher.started(11) >= launcher.ended(0));
+        CHECK(launcher.started(11) >= launcher.ended(5));
+        for (uint32_t s = 0; s < times.size(); s++) {
+            CHECK(launcher.ended(s) != NOT_YET);
+        }
+    }
+}
+
+void checkFailedStart() {
+    // 1 cannot start: 3 still runs once 2 has finished
+    StepScheduler scheduler;
+    CHECK(scheduler.init(4, DIAMOND, 0));
+    FakeLauncher launcher(DIAMOND_TIMES);
+    launcher.failing.insert(1);
+    scheduler.run(launcher);
+    
+    CHECK(launcher.order == std::vector<uint32_t>({0, 1, 2, 3}));
+    CHECK_EQ(launcher.started(1), NOT_YET);
+    CHECK_EQ(launcher.started(3), 3u);
+    CHECK_EQ(launcher.now(), 4u);
+    
+    // Nor does a failed step hold a slot under a cap, and a step that
+    // finishes as it starts releases its dependents at once
+    StepScheduler chain;
+    CHECK(chain.init(3, { {1, 0}, {2, 1} }, 1));
+    FakeLauncher chained({ 2, 2, 2 });
+    chained.failing.insert(0);
+    chained.instant.insert(1);
+    chain.run(chained);
+    CHECK(chained.order == std::vector<uint32_t>({0, 1, 2}));
+    CHECK_EQ(chained.started(2), 0u);
+    CHECK_EQ(chained.ended(2), 2u);
+}
+
+void checkRejected() {
+    StepScheduler scheduler;
+    CHECK(!scheduler.init(3, { {1, 0}, {2, 1}, {0, 2} }, 0));   // Cycle
+    CHECK(!scheduler.init(3, { {1, 0}, {2, 2} }, 0));           // Self edge
+    CHECK(!scheduler.init(3, { {3, 0} }, 0));                   // Out of range
+    CHECK(!scheduler.init(3, { {0, 3} }, 0));
+    CHECK(scheduler.init(3, {}, 0));
+    CHECK(scheduler.init(0, {}, 0));
+}
+
+} // namespace
+
+int main() {
+    checkDiamond();
+    checkSequential();
+    checkCapped();
+    checkFailedStart();
+    checkRejected();
+    return Packer::Test::testResult("StepSchedulerTest");
+}
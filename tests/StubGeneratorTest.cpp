@@ -0,0 +1,184 @@
+// StubGenerator::updatePEHeaders against PE32 and PE32+ images built in
+// memory: the .pack section header it adds and the optional header fields
+// it rewrites, and the templates it must refuse.
+
+#include "TestCheck.h"
+#include "StubGenerator.h"
+#include <cstring>
+
+using namespace Packer;
+
+namespace {
+
+const DWORD FILE_ALIGNMENT = 0x200;
+const DWORD SECTION_ALIGNMENT = 0x1000;
+
+// Layout of a fixture image. Two sections: .text (0x180 bytes at RVA
+// 0x1000) and .data, whose VirtualSize (0x1800) exceeds its raw size, so
+// the first free RVA is 0x4000.
+struct Fixture {
+    bool pe64;
+    LONG lfanew;            // NT headers offset
+    DWORD firstRawData;     // .text raw data; .data follows 0x200 later
+    DWORD sizeOfHeaders;
+    
+    Fixture(bool pe64) : pe64(pe64), lfanew(0x80), firstRawData(0x400), sizeOfHeaders(0x400) {}
+    
+    size_t tableOffset() const {
+        return lfanew + sizeof(DWORD) + sizeof(IMAGE_FILE_HEADER) +
+               (pe64 ? sizeof(IMAGE_OPTIONAL_HEADER64) : sizeof(IMAGE_OPTIONAL_HEADER32));
+    }
+};
+
+IMAGE_SECTION_HEADER section(const char* name, DWORD virtualAddress, DWORD virtualSize,
+                             DWORD rawData, DWORD rawSize) {
+    IMAGE_SECTION_HEADER header = {};
+    memcpy(header.Name, name, strlen(name));
+    header.VirtualAddress = virtualAddress;
+    header.Misc.VirtualSize = virtualSize;
+    header.PointerToRawData = rawData;
+    header.SizeOfRawData = rawSize;
+    header.Characteristics = IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ;
+    return header;
+}
+
+// Optional header fields the rewrite touches, at their offsets in either format
+template <typename OptionalHeader>
+void fillOptionalHeader(OptionalHeader& optional, WORD magic, const Fixture& fixture) {
+    optional.Magic = magic;
+    optional.SizeOfInitializedData = 0x400;
+    optional.SectionAlignment = SECTION_ALIGNMENT;
+    optional.FileAlignment = FILE_ALIGNMENT;
+    optional.SizeOfImage = 0x4000;
+    optional.SizeOfHeaders = fixture.sizeOfHeaders;
+    optional.CheckSum = 0x1234ABCD;
+    optional.NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+}
+
+std::vector<uint8_t> makeImage(const Fixture& fixture) {
+    std::vector<uint8_t> image(fixture.firstRawData + 2 * FILE_ALIGNMENT, 0);
+    
+    IMAGE_DOS_HEADER dos = {};
+    dos.e_magic = IMAGE_DOS_SIGNATURE;
+    dos.e_lfanew = fixture.lfanew;
+    memcpy(image.data(), &dos, sizeof(dos));
+    
+    IMAGE_FILE_HEADER file = {};
+    file.NumberOfSections = 2;
+    uint8_t* nt = image.data() + fixture.lfanew;
+    DWORD signature = IMAGE_NT_SIGNATURE;
+    memcpy(nt, &signature, sizeof(signature));
+    if (fixture.pe64) {
+        IMAGE_OPTIONAL_HEADER64 optional = {};
+        fillOptionalHeader(optional, IMAGE_NT_OPTIONAL_HDR64_MAGIC, fixture);
+        file.Machine = 0x8664;
+        file.SizeOfOptionalHeader = sizeof(optional);
+        memcpy(nt + sizeof(DWORD) + sizeof(file), &optional, sizeof(optional));
+    } else {
+        IMAGE_OPTIONAL_HEADER32 optional = {};
+        fillOptionalHeader(optional, IMAGE_NT_OPTIONAL_HDR32_MAGIC, fixture);
+        file.Machine = 0x14C;
+        file.SizeOfOptionalHeader = sizeof(optional);
+        memcpy(nt + sizeof(DWORD) + sizeof(file), &optional, sizeof(optional));
+    }
+    memcpy(nt + sizeof(DWORD), &file, sizeof(file));
+    
+    IMAGE_SECTION_HEADER sections[2] = {
+        section(".text", 0x1000, 0x180, fixture.firstRawData, FILE_ALIGNMENT),
+        section(".data", 0x2000, 0x1800, fixture.firstRawData + FILE_ALIGNMENT, FILE_ALIGNMENT),
+    };
+    memcpy(image.data() + fixture.tableOffset(), sections, sizeof(sections));
+    
+    // Section contents, so a stray write into them would show
+    memset(image.data() + fixture.firstRawData, 0xCC, 2 * FILE_ALIGNMENT);
+    return image;
+}
+
+template <typename NtHeaders>
+void checkRewrite(const Fixture& fixture) {
+    std::vector<uint8_t> image = makeImage(fixture);
+    std::vector<uint8_t> original = image;
+    size_t payloadOffset = image.size();
+    StubGenerator stubGen;
+    CHECK(stubGen.updatePEHeaders(image, payloadOffset, 0x300));
+    CHECK_EQ(image.size(), original.size());
+    
+    NtHeaders nt;
+    memcpy(&nt, image.data() + fixture.lfanew, sizeof(nt));
+    CHECK_EQ(nt.FileHeader.NumberOfSections, 3);
+    CHECK_EQ(nt.OptionalHeader.SizeOfImage, 0x5000u);  // .pack at 0x4000, 0x1000 aligned
+    CHECK_EQ(nt.OptionalHeader.SizeOfInitializedData, 0x800u);
+    CHECK_EQ(nt.OptionalHeader.CheckSum, 0u);
+    
+    size_t headerEnd = fixture.tableOffset() + 3 * sizeof(IMAGE_SECTION_HEADER);
+    DWORD expectedHeaders = headerEnd > fixture.sizeOfHeaders ?
+                            ((static_cast<DWORD>(headerEnd) + FILE_ALIGNMENT - 1) & ~(FILE_ALIGNMENT - 1)) :
+                            fixture.sizeOfHeaders;
+    CHECK_EQ(nt.OptionalHeader.SizeOfHeaders, expectedHeaders);
+    
+    IMAGE_SECTION_HEADER pack;
+    memcpy(&pack, image.data() + fixture.tableOffset() + 2 * sizeof(IMAGE_SECTION_HEADER),
+           sizeof(pack));
+    CHECK(memcmp(pack.Name, ".pack\0\0", IMAGE_SIZEOF_SHORT_NAME) == 0);
+    CHECK_EQ(pack.VirtualAddress, 0x4000u);
+    CHECK_EQ(pack.Misc.VirtualSize, 0x300u);
+    CHECK_EQ(pack.PointerToRawData, static_cast<DWORD>(payloadOffset));
+    CHECK_EQ(pack.SizeOfRawData, 0x400u);
+    CHECK_EQ(pack.Characteristics,
+             static_cast<DWORD>(IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ));
+    
+    // Section data is left alone
+    CHECK(memcmp(image.data() + fixture.firstRawData, original.data() + fixture.firstRawData,
+                 image.size() - fixture.firstRawData) == 0);
+}
+
+void checkRefused(std::vector<uint8_t> image) {
+    std::vector<uint8_t> original = image;
+    StubGenerator stubGen;
+    CHECK(!stubGen.updatePEHeaders(image, image.size(), 0x300));
+    CHECK(image == original);
+}
+
+} // namespace
+
+int main() {
+    for (bool pe64 : {false, true}) {
+        Fixture fixture(pe64);
+        if (pe64) {
+            checkRewrite<IMAGE_NT_HEADERS64>(fixture);
+        } else {
+            checkRewrite<IMAGE_NT_HEADERS32>(fixture);
+        }
+        
+        // SizeOfHeaders grows when the new header ends past it
+        Fixture grown(pe64);
+        grown.lfanew = 0x100;
+        grown.sizeOfHeaders = 0x200;
+        if (pe64) {
+            checkRewrite<IMAGE_NT_HEADERS64>(grown);
+        } else {
+            checkRewrite<IMAGE_NT_HEADERS32>(grown);
+        }
+        
+        // No room: section data starts right after the table
+        Fixture full(pe64);
+        full.firstRawData = 0x200;
+        full.lfanew = static_cast<LONG>(full.lfanew + full.firstRawData -
+                                        (full.tableOffset() + 2 * sizeof(IMAGE_SECTION_HEADER)));
+        full.sizeOfHeaders = 0x200;
+        checkRefused(makeImage(full));
+        
+        // Room, but not zero-filled (bound imports live there)
+        std::vector<uint8_t> used = makeImage(fixture);
+        used[fixture.tableOffset() + 2 * sizeof(IMAGE_SECTION_HEADER) + 12] = 0x01;
+        checkRefused(used);
+        
+        // Payload not on the file alignment, or overlapping section data
+        std::vector<uint8_t> image = makeImage(fixture);
+        StubGenerator stubGen;
+        CHECK(!stubGen.updatePEHeaders(image, image.size() + 1, 0x300));
+        CHECK(!stubGen.updatePEHeaders(image, image.size() - FILE_ALIGNMENT, 0x300));
+        CHECK(image == makeImage(fixture));
+    }
+    return Packer::Test::testResult("StubGeneratorTest");
+}
@@ -0,0 +1,49 @@
+#ifndef TESTCHECK_H
+#define TESTCHECK_H
+
+// Minimal checks for the Linux unit tests (build_tests.sh). A failed check
+// is reported and counted; main() returns testResult().
+
+#include <cstdio>
+
+namespace Packer {
+namespace Test {
+
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+inline void fail(const char* file, int line, const char* expression) {
+    std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+    failures()++;
+}
+
+// 0 if every check passed
+inline int testResult(const char* name) {
+    if (failures() != 0) {
+        std::fprintf(stderr, "%s: %d check(s) failed\n", name, failures());
+        return 1;
+    }
+    std::printf("%s: ok\n", name);
+    return 0;
+}
+
+} // namespace Test
+} // namespace Packer
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            Packer::Test::fail(__FILE__, __LINE__, #condition); \
+        } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    do { \
+        if (!((actual) == (expected))) { \
+            Packer::Test::fail(__FILE__, __LINE__, #actual " == " #expected); \
+        } \
+    } while (0)
+
+#endif // TESTCHECK_H